@@ -126,6 +126,20 @@ infinoted_config_reload(InfinotedRun* run,
     return FALSE;
   }
 
+  if(g_strcmp0(startup->options->local_socket,
+               run->startup->options->local_socket) != 0)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("INFINOTED_CONFIG_RELOAD_ERROR"),
+      0,
+      _("Changing the local socket at runtime is not supported")
+    );
+
+    infinoted_startup_free(startup);
+    return FALSE;
+  }
+
   /* Find out the port we are currently running on */
   tcp4 = tcp6 = NULL;
   if(run->xmpp6)
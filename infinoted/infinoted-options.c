@@ -101,6 +101,19 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
     0,
     N_("The IP address to listen on."),
     N_("ADDRESS"),
+  }, {
+    "local-socket",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, local_socket),
+    infinoted_parameter_convert_filename,
+    0,
+    N_("Path of a Unix domain socket to accept connections from local "
+       "processes on, in addition to the TCP port. Local connections are "
+       "neither encrypted nor authenticated, so the socket should be placed "
+       "in a directory that only trusted users can access. Not supported "
+       "on Windows. [Default=none]"),
+    N_("PATH")
   }, {
     "security-policy",
     INFINOTED_PARAMETER_STRING,
@@ -128,6 +141,19 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "documents on the server, and where they are read from after a "
        "server restart. [Default=~/.infinote]"),
     N_("DIRECTORY")
+  }, {
+    "prefetch",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedOptions, prefetch),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to read the whole directory tree from the root directory "
+       "before accepting connections, instead of reading each folder only "
+       "when a client opens it for the first time. This makes startup "
+       "slower but avoids delays when browsing the tree afterwards. "
+       "[Default=false]"),
+    N_("true|false")
   }, {
     "plugins",
     INFINOTED_PARAMETER_STRING_LIST,
@@ -972,9 +998,11 @@ infinoted_options_new(const gchar* const* config_files,
   options->create_certificate = FALSE;
   options->port = inf_protocol_get_default_port();
   options->listen_address = NULL;
+  options->local_socket = NULL;
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
+  options->prefetch = FALSE;
   options->plugins = g_malloc(2 * sizeof(gchar*));
   options->plugins[0] = g_strdup("note-text");
   options->plugins[1] = NULL;
@@ -1015,6 +1043,7 @@ infinoted_options_free(InfinotedOptions* options)
   g_free(options->root_directory);
   if(options->listen_address != NULL)
     inf_ip_address_free(options->listen_address);
+  g_free(options->local_socket);
   g_strfreev(options->plugins);
   g_free(options->password);
 #ifdef LIBINFINITY_HAVE_PAM
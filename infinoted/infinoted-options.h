@@ -40,8 +40,10 @@ struct _InfinotedOptions {
   gboolean create_certificate;
   guint port;
   InfIpAddress *listen_address;
+  gchar* local_socket;
   InfXmppConnectionSecurityPolicy security_policy;
   gchar* root_directory;
+  gboolean prefetch;
 
   gchar** plugins;
 
@@ -29,6 +29,7 @@
 #include <libinfinity/common/inf-xmpp-manager.h>
 
 #include <libinfinity/inf-i18n.h>
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-config.h>
 
 #ifdef LIBINFINITY_HAVE_LIBSYSTEMD
@@ -38,6 +39,126 @@
 static const guint8 INFINOTED_RUN_IPV6_ANY_ADDR[16] =
   { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
+typedef struct _InfinotedRunPrefetch InfinotedRunPrefetch;
+struct _InfinotedRunPrefetch {
+  InfinotedRun* run;
+  GTimer* timer;
+  gdouble last_report;
+  gboolean done;
+  gboolean interrupted;
+};
+
+static void
+infinoted_run_prefetch_notify_storage_cb(GObject* object,
+                                         GParamSpec* pspec,
+                                         gpointer user_data)
+{
+  InfinotedRunPrefetch* prefetch;
+  prefetch = (InfinotedRunPrefetch*)user_data;
+
+  /* Changing the storage, for example by a configuration reload, cancels
+   * prefetching. The new tree is then read on demand. */
+  infinoted_log_warning(
+    prefetch->run->startup->log,
+    _("Storage changed while loading the directory tree; remaining folders "
+      "will be read when they are opened")
+  );
+
+  prefetch->interrupted = TRUE;
+  inf_standalone_io_loop_quit(prefetch->run->io);
+}
+
+static void
+infinoted_run_prefetch_func(InfdDirectory* directory,
+                            guint explored,
+                            guint remaining,
+                            const GError* error,
+                            gpointer user_data)
+{
+  InfinotedRunPrefetch* prefetch;
+  gdouble elapsed;
+
+  prefetch = (InfinotedRunPrefetch*)user_data;
+  elapsed = g_timer_elapsed(prefetch->timer, NULL);
+
+  if(error != NULL)
+  {
+    infinoted_log_warning(
+      prefetch->run->startup->log,
+      _("Failed to read folder from storage: %s"),
+      error->message
+    );
+  }
+
+  if(remaining == 0)
+  {
+    infinoted_log_info(
+      prefetch->run->startup->log,
+      _("Directory tree loaded: %u folders in %.2f seconds"),
+      explored,
+      elapsed
+    );
+
+    prefetch->done = TRUE;
+    inf_standalone_io_loop_quit(prefetch->run->io);
+  }
+  else if(elapsed - prefetch->last_report >= 1.0)
+  {
+    infinoted_log_info(
+      prefetch->run->startup->log,
+      _("Loading directory tree: %u folders read, %u to go"),
+      explored,
+      remaining
+    );
+
+    prefetch->last_report = elapsed;
+  }
+}
+
+/* Reads the whole directory tree from storage before the server starts
+ * accepting connections. Returns FALSE if the server was stopped while the
+ * tree was being read, in which case the directory is expected to be
+ * disposed before the main loop runs again. */
+static gboolean
+infinoted_run_prefetch(InfinotedRun* run)
+{
+  InfinotedRunPrefetch prefetch;
+
+  infinoted_log_info(run->startup->log, _("Loading directory tree..."));
+
+  prefetch.run = run;
+  prefetch.timer = g_timer_new();
+  prefetch.last_report = 0.0;
+  prefetch.done = FALSE;
+  prefetch.interrupted = FALSE;
+
+  g_signal_connect(
+    G_OBJECT(run->directory),
+    "notify::storage",
+    G_CALLBACK(infinoted_run_prefetch_notify_storage_cb),
+    &prefetch
+  );
+
+  infd_directory_prefetch(
+    run->directory,
+    infinoted_run_prefetch_func,
+    &prefetch
+  );
+
+  /* infinoted_run_stop() quits the loop as well */
+  if(!prefetch.done)
+    inf_standalone_io_loop(run->io);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(run->directory),
+    G_CALLBACK(infinoted_run_prefetch_notify_storage_cb),
+    &prefetch
+  );
+
+  g_timer_destroy(prefetch.timer);
+  return prefetch.done || prefetch.interrupted;
+}
+
 static gboolean
 infinoted_run_load_directory(InfinotedRun* run,
                              InfinotedStartup* startup,
@@ -304,6 +425,21 @@ infinoted_run_new(InfinotedStartup* startup,
 
   inf_ip_address_free(address);
 
+  /* Local clients are served in addition to remote ones */
+  if(run != NULL)
+  {
+    run->local = NULL;
+    if(startup->options->local_socket != NULL)
+    {
+      run->local = infd_unix_server_new(
+        INF_IO(run->io),
+        startup->options->local_socket
+      );
+
+      infd_server_pool_add_server(run->pool, INFD_XML_SERVER(run->local));
+    }
+  }
+
   return run;
 }
 
@@ -339,6 +475,15 @@ infinoted_run_free(InfinotedRun* run)
     g_object_unref(run->xmpp4);
   }
 
+  if(run->local != NULL)
+  {
+    g_object_get(G_OBJECT(run->local), "status", &status, NULL);
+    infd_server_pool_remove_server(run->pool, INFD_XML_SERVER(run->local));
+    if(status != INFD_XML_SERVER_CLOSED)
+      infd_xml_server_close(INFD_XML_SERVER(run->local));
+    g_object_unref(run->local);
+  }
+
 #ifdef LIBINFINITY_HAVE_AVAHI
   g_object_unref(run->avahi);
 #endif
@@ -404,6 +549,20 @@ infinoted_run_start(InfinotedRun* run)
     }
   }
 
+  /* Read the directory tree before clients can ask for it */
+  if(run->startup->options->prefetch)
+  {
+    if(!infinoted_run_prefetch(run))
+    {
+      infinoted_log_info(
+        run->startup->log,
+        _("Infinoted shutting down...")
+      );
+
+      return;
+    }
+  }
+
   /* Open server sockets, accepting incoming connections... TODO: Prevent
    * code duplication here. */
   if(run->xmpp6 != NULL)
@@ -467,6 +626,35 @@ infinoted_run_start(InfinotedRun* run)
   if(error4 != NULL) g_error_free(error4);
   if(error6 != NULL) g_error_free(error6);
 
+  /* The local socket is optional, so the server keeps running without it */
+  if(run->local != NULL && (run->xmpp4 != NULL || run->xmpp6 != NULL))
+  {
+    error = NULL;
+    if(infd_unix_server_open(run->local, &error) == TRUE)
+    {
+      infinoted_log_info(
+        run->startup->log,
+        _("Local server running on %s"),
+        infd_unix_server_get_path(run->local)
+      );
+    }
+    else
+    {
+      infinoted_log_error(
+        run->startup->log,
+        _("Failed to open local socket \"%s\": %s"),
+        infd_unix_server_get_path(run->local),
+        error->message
+      );
+
+      g_error_free(error);
+
+      infd_server_pool_remove_server(run->pool, INFD_XML_SERVER(run->local));
+      g_object_unref(run->local);
+      run->local = NULL;
+    }
+  }
+
   /* Make sure messages are shown. This explicit flush is for example
    * required when running in an MSYS shell on Windows. */
   fflush(stderr);
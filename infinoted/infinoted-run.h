@@ -27,6 +27,7 @@
 
 #include <libinfinity/server/infd-server-pool.h>
 #include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-unix-server.h>
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-discovery-avahi.h>
 
@@ -46,6 +47,7 @@ struct _InfinotedRun {
 
   InfdXmppServer* xmpp4;
   InfdXmppServer* xmpp6;
+  InfdUnixServer* local;
   gnutls_dh_params_t dh_params;
 
 #ifdef LIBINFINITY_HAVE_AVAHI
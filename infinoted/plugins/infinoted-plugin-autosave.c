@@ -43,6 +43,7 @@ struct _InfinotedPluginAutosaveSessionInfo {
   InfBrowserIter iter;
   InfSessionProxy* proxy;
   InfIoTimeout* timeout;
+  InfAsyncOperation* operation;
 };
 
 static void
@@ -112,26 +113,11 @@ infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
 }
 
 static void
-infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+infinoted_plugin_autosave_set_modified(InfinotedPluginAutosaveSessionInfo* info,
+                                       gboolean modified)
 {
-  InfdDirectory* directory;
-  InfBrowserIter* iter;
-  GError* error;
-  gchar* path;
   InfSession* session;
   InfBuffer* buffer;
-  gchar* root_directory;
-  gchar* argv[4];
-
-  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
-  iter = &info->iter;
-  error = NULL;
-
-  if(info->timeout != NULL)
-  {
-    inf_io_remove_timeout(infd_directory_get_io(directory), info->timeout);
-    info->timeout = NULL;
-  }
 
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
@@ -142,72 +128,144 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
     info
   );
 
-  if(infd_directory_iter_save_session(directory, iter, &error) == FALSE)
-  {
-    path = inf_browser_get_path(INF_BROWSER(directory), iter);
+  inf_buffer_set_modified(buffer, modified);
+
+  inf_signal_handlers_unblock_by_func(
+    G_OBJECT(buffer),
+    G_CALLBACK(infinoted_plugin_autosave_buffer_notify_modified_cb),
+    info
+  );
 
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_autosave_run_hook(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfdDirectory* directory;
+  GError* error;
+  gchar* path;
+  gchar* root_directory;
+  gchar* argv[4];
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  error = NULL;
+
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  g_object_get(
+    G_OBJECT(infd_directory_get_storage(directory)),
+    "root-directory",
+    &root_directory,
+    NULL
+  );
+
+  argv[0] = info->plugin->hook;
+  argv[1] = root_directory;
+  argv[2] = path;
+  argv[3] = NULL;
+
+  if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                    NULL, NULL, NULL, &error))
+  {
     infinoted_log_warning(
       infinoted_plugin_manager_get_log(info->plugin->manager),
-      _("Failed to auto-save session \"%s\": %s\n\n"
-        "Will retry in %u seconds."),
-      path,
-      error->message,
-      info->plugin->interval
+      _("Could not execute autosave hook: \"%s\""),
+      error->message
     );
 
-    g_free(path);
     g_error_free(error);
-    error = NULL;
+  }
+
+  g_free(path);
+  g_free(root_directory);
+}
 
+static void
+infinoted_plugin_autosave_failed(InfinotedPluginAutosaveSessionInfo* info,
+                                 const GError* error)
+{
+  InfdDirectory* directory;
+  gchar* path;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(info->plugin->manager),
+    _("Failed to auto-save session \"%s\": %s\n\n"
+      "Will retry in %u seconds."),
+    path,
+    error->message,
+    info->plugin->interval
+  );
+
+  g_free(path);
+
+  /* The buffer was marked as unmodified when the save was started */
+  infinoted_plugin_autosave_set_modified(info, TRUE);
+  if(info->timeout == NULL)
     infinoted_plugin_autosave_start(info);
+}
+
+static void
+infinoted_plugin_autosave_save_done_cb(InfdStorage* storage,
+                                       const GError* error,
+                                       gpointer user_data)
+{
+  InfinotedPluginAutosaveSessionInfo* info;
+  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
+
+  /* The operation frees itself after this callback has run */
+  info->operation = NULL;
+
+  if(error != NULL)
+    infinoted_plugin_autosave_failed(info, error);
+  else if(info->plugin->hook != NULL)
+    infinoted_plugin_autosave_run_hook(info);
+}
+
+static void
+infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfdDirectory* directory;
+  GError* error;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  error = NULL;
+
+  if(info->timeout != NULL)
+  {
+    inf_io_remove_timeout(infd_directory_get_io(directory), info->timeout);
+    info->timeout = NULL;
   }
-  else
+
+  /* A save that is still running is superseded by this one */
+  if(info->operation != NULL)
   {
-    /* TODO: Remove this as soon as directory itself unsets modified flag
-     * on session_write */
-    inf_buffer_set_modified(INF_BUFFER(buffer), FALSE);
-
-    if(info->plugin->hook != NULL)
-    {
-      path = inf_browser_get_path(INF_BROWSER(directory), iter);
-
-      g_object_get(
-        G_OBJECT(infd_directory_get_storage(directory)),
-        "root-directory",
-        &root_directory,
-        NULL
-      );
-
-      argv[0] = info->plugin->hook;
-      argv[1] = root_directory;
-      argv[2] = path;
-      argv[3] = NULL;
-
-      if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
-                        NULL, NULL, NULL, &error))
-      {
-        infinoted_log_warning(
-          infinoted_plugin_manager_get_log(info->plugin->manager),
-          _("Could not execute autosave hook: \"%s\""),
-          error->message
-        );
-
-        g_error_free(error);
-        error = NULL;
-      }
-
-      g_free(path);
-      g_free(root_directory);
-    }
+    inf_async_operation_free(info->operation);
+    info->operation = NULL;
   }
-  
-  inf_signal_handlers_unblock_by_func(
-    G_OBJECT(buffer),
-    G_CALLBACK(infinoted_plugin_autosave_buffer_notify_modified_cb),
-    info
+
+  /* The session is written in the background from a snapshot taken now, so
+   * any change made from this point on marks the buffer modified again. */
+  /* TODO: Remove this as soon as directory itself unsets modified flag
+   * on session_write */
+  infinoted_plugin_autosave_set_modified(info, FALSE);
+
+  info->operation = infd_directory_iter_save_session_async(
+    directory,
+    &info->iter,
+    infinoted_plugin_autosave_save_done_cb,
+    info,
+    &error
   );
 
-  g_object_unref(session);
+  if(info->operation == NULL)
+  {
+    infinoted_plugin_autosave_failed(info, error);
+    g_error_free(error);
+  }
 }
 
 static void
@@ -269,6 +327,7 @@ infinoted_plugin_autosave_session_added(const InfBrowserIter* iter,
   info->iter = *iter;
   info->proxy = proxy;
   info->timeout = NULL;
+  info->operation = NULL;
   g_object_ref(proxy);
 
   g_object_get(G_OBJECT(proxy), "session", &session, NULL);
@@ -304,6 +363,12 @@ infinoted_plugin_autosave_session_removed(const InfBrowserIter* iter,
   if(info->timeout != NULL)
     infinoted_plugin_autosave_stop(info);
 
+  if(info->operation != NULL)
+  {
+    inf_async_operation_free(info->operation);
+    info->operation = NULL;
+  }
+
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
 
@@ -76,53 +76,24 @@ infinoted_plugin_linekeeper_deinitialize(gpointer plugin_info)
 static guint
 infinoted_plugin_linekeeper_count_lines(InfTextBuffer* buffer)
 {
-  /* Count the number of lines at the end of the document. This assumes the
-   * buffer content is in UTF-8, which is currently hardcoded in infinoted. */
-  InfTextBufferIter* iter;
+  /* Count the number of lines at the end of the document, i.e. the number
+   * of empty lines in front of the end. Each of them starts directly behind
+   * the newline character that ends the line after it. */
   guint n_lines;
-  gboolean has_iter;
-
-  guint length;
-  gsize bytes;
-  gchar* text;
-  gchar* pos;
-  gchar* new_pos;
-  gunichar c;
-
-  g_assert(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0);
+  guint line;
+  guint end;
 
   n_lines = 0;
+  end = inf_text_buffer_get_length(buffer);
+  line = inf_text_buffer_offset_to_line(buffer, end);
 
-  iter = inf_text_buffer_create_end_iter(buffer);
-  if(iter == NULL) return 0;
-
-  do
+  while(line > 0 && inf_text_buffer_line_to_offset(buffer, line) == end)
   {
-    length = inf_text_buffer_iter_get_length(buffer, iter);
-    bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
-    text = inf_text_buffer_iter_get_text(buffer, iter);
-    pos = text + bytes;
-
-    while(length > 0)
-    {
-      new_pos = g_utf8_prev_char(pos);
-      g_assert(bytes >= (pos - new_pos));
-
-      c = g_utf8_get_char(new_pos);
-      if(c == '\n' || g_unichar_type(c) == G_UNICODE_LINE_SEPARATOR)
-        ++n_lines;
-      else
-        break;
-
-      --length;
-      bytes -= (pos - new_pos);
-      pos = new_pos;
-    }
-
-    g_free(text);
-  } while(length == 0 && inf_text_buffer_iter_prev(buffer, iter));
+    ++n_lines;
+    --line;
+    --end;
+  }
 
-  inf_text_buffer_destroy_iter(buffer, iter);
   return n_lines;
 }
 
@@ -120,13 +120,35 @@ infinoted_plugin_note_chat_session_write(InfdStorage* storage,
   );
 }
 
+static InfAsyncOperation*
+infinoted_plugin_note_chat_session_write_async(InfdStorage* storage,
+                                               InfIo* io,
+                                               InfSession* session,
+                                               const gchar* path,
+                                               gpointer user_data,
+                                               InfdStorageWriteFunc func,
+                                               gpointer func_data,
+                                               GError** error)
+{
+  return infd_chat_filesystem_format_write_async(
+    INFD_FILESYSTEM_STORAGE(storage),
+    io,
+    path,
+    INF_CHAT_BUFFER(inf_session_get_buffer(session)),
+    func,
+    func_data,
+    error
+  );
+}
+
 const InfdNotePlugin INFINOTED_PLUGIN_NOTE_CHAT_PLUGIN = {
   NULL,
   "InfdFilesystemStorage",
   "InfChat",
   infinoted_plugin_note_chat_session_new,
   infinoted_plugin_note_chat_session_read,
-  infinoted_plugin_note_chat_session_write
+  infinoted_plugin_note_chat_session_write,
+  infinoted_plugin_note_chat_session_write_async
 };
 
 /* Infinoted plugin glue */
@@ -32,6 +32,53 @@ struct _InfinotedPluginNoteText {
   const InfdNotePlugin* plugin;
 };
 
+/* Sessions are stored as a snapshot plus a journal of the changes made
+ * since then, so that saving a session only needs to write the changes
+ * made since the last save. The journal is attached to the session. */
+#define INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY \
+  "infinoted-plugin-note-text-journal"
+
+static void
+infinoted_plugin_note_text_set_journal(InfSession* session,
+                                       InfTextFilesystemJournal* journal)
+{
+  g_object_set_data_full(
+    G_OBJECT(session),
+    INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY,
+    journal,
+    (GDestroyNotify)inf_text_filesystem_journal_free
+  );
+}
+
+static InfTextFilesystemJournal*
+infinoted_plugin_note_text_get_journal(InfdStorage* storage,
+                                       InfSession* session,
+                                       const gchar* path)
+{
+  InfTextFilesystemJournal* journal;
+
+  journal = g_object_get_data(
+    G_OBJECT(session),
+    INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY
+  );
+
+  /* Sessions which have not been read from the storage do not have a
+   * journal yet. The first write then writes a complete snapshot. */
+  if(journal == NULL)
+  {
+    journal = inf_text_filesystem_journal_new(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session))
+    );
+
+    infinoted_plugin_note_text_set_journal(session, journal);
+  }
+
+  return journal;
+}
+
 /* Note plugin implementation */
 static InfSession*
 infinoted_plugin_note_text_session_new(InfIo* io,
@@ -71,7 +118,7 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
 {
   InfUserTable* user_table;
   InfTextBuffer* buffer;
-  gboolean result;
+  InfTextFilesystemJournal* journal;
   InfTextSession* session;
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
@@ -79,7 +126,7 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
   user_table = inf_user_table_new();
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
 
-  result = inf_text_filesystem_format_read(
+  journal = inf_text_filesystem_journal_open(
     INFD_FILESYSTEM_STORAGE(storage),
     path,
     user_table,
@@ -87,7 +134,7 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
     error
   );
 
-  if(result == FALSE)
+  if(journal == NULL)
   {
     g_object_unref(user_table);
     g_object_unref(buffer);
@@ -104,6 +151,8 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
     NULL
   );
 
+  infinoted_plugin_note_text_set_journal(INF_SESSION(session), journal);
+
   g_object_unref(user_table);
   g_object_unref(buffer);
 
@@ -117,11 +166,27 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
                                          gpointer user_data,
                                          GError** error)
 {
-  return inf_text_filesystem_format_write(
-    INFD_FILESYSTEM_STORAGE(storage),
-    path,
-    inf_session_get_user_table(session),
-    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+  return inf_text_filesystem_journal_write(
+    infinoted_plugin_note_text_get_journal(storage, session, path),
+    error
+  );
+}
+
+static InfAsyncOperation*
+infinoted_plugin_note_text_session_write_async(InfdStorage* storage,
+                                               InfIo* io,
+                                               InfSession* session,
+                                               const gchar* path,
+                                               gpointer user_data,
+                                               InfdStorageWriteFunc func,
+                                               gpointer func_data,
+                                               GError** error)
+{
+  return inf_text_filesystem_journal_write_async(
+    infinoted_plugin_note_text_get_journal(storage, session, path),
+    io,
+    func,
+    func_data,
     error
   );
 }
@@ -132,7 +197,8 @@ const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
   "InfText",
   infinoted_plugin_note_text_session_new,
   infinoted_plugin_note_text_session_read,
-  infinoted_plugin_note_text_session_write
+  infinoted_plugin_note_text_session_write,
+  infinoted_plugin_note_text_session_write_async
 };
 
 /* Infinoted plugin glue */
@@ -129,78 +129,6 @@ static guint algorithm_signals[LAST_SIGNAL];
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedAlgorithm, inf_adopted_algorithm, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedAlgorithm))
 
-/* Returns a new state vector v so that both first and second are causally
- * before v and so that there is no other state vector with the same property
- * that is causally before v. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_successor(InfAdoptedAlgorithm* algorithm,
-                                             InfAdoptedStateVector* first,
-                                             InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MAX(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  g_assert(inf_adopted_state_vector_causally_before(first, result));
-  g_assert(inf_adopted_state_vector_causally_before(second, result));
-  return result;
-}
-
-/* Returns a new state vector v so that v is both causally before first and
- * second and so that there is no other state vector with the same property
- * so that v is causally before that vector. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-/* TODO: A version modifying first instead of returning a new result,
- * use in inf_adopted_algorithm_cleanup(). */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_predecessor(InfAdoptedAlgorithm* algorithm,
-                                               InfAdoptedStateVector* first,
-                                               InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MIN(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  return result;
-}
-
 /* Checks whether the given request can be undone (or redone if it is an
  * undo request). In general, a user can perform an undo when
  * there is a request to undo in the request log. However, if there are too
@@ -230,10 +158,10 @@ inf_adopted_algorithm_can_undo_redo(InfAdoptedAlgorithm* algorithm,
        * can be undone or redone, then we need to include these in the
        * vdiff. */
 
-      diff = inf_adopted_state_vector_vdiff(
-        inf_adopted_request_get_vector(request),
-        inf_adopted_user_get_vector(user)
-      );
+      /* The request is in the user's log, so it is causally before the
+       * user's vector. */
+      diff = inf_adopted_state_vector_sum(inf_adopted_user_get_vector(user)) -
+        inf_adopted_request_get_vector_sum(request);
 
       if(diff >= priv->max_total_log_size)
         return FALSE;
@@ -484,11 +412,7 @@ inf_adopted_algorithm_buffer_states_equivalent(InfAdoptedAlgorithm* algorithm,
       else
       {
         request = inf_adopted_request_log_prev_associated(log, request);
-
-        second_n = inf_adopted_state_vector_get(
-          inf_adopted_request_get_vector(request),
-          user_id
-        );
+        second_n = inf_adopted_request_get_index(request);
       }
     }
 
@@ -640,9 +564,12 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
   concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
   if(inf_adopted_request_need_concurrency_id(request_at, against_at) == TRUE)
   {
-    lcs = inf_adopted_algorithm_least_common_successor(
-      algorithm,
-      inf_adopted_request_get_vector(request),
+    lcs = inf_adopted_state_vector_copy(
+      inf_adopted_request_get_vector(request)
+    );
+
+    inf_adopted_state_vector_max(
+      lcs,
       inf_adopted_request_get_vector(against)
     );
 
@@ -718,6 +645,7 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
   InfAdoptedStateVector* associated_vector;
   guint from_n;
   guint to_n;
+  guint to_sum;
   guint associated_index;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
@@ -726,7 +654,10 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
   vector = inf_adopted_request_get_vector(cur_req);
   g_object_ref(cur_req);
 
-  while(inf_adopted_state_vector_compare(vector, to) != 0)
+  /* Since vector is always causally before to, they are equal exactly when
+   * their sums are, which avoids a full vector comparison per step. */
+  to_sum = inf_adopted_state_vector_sum(to);
+  while(inf_adopted_request_get_vector_sum(cur_req) != to_sum)
   {
     next_req = NULL;
 
@@ -2061,13 +1992,12 @@ void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
 {
   InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedStateVector* temp;
   InfAdoptedStateVector* lcp;
   InfAdoptedUser** user;
   InfAdoptedRequestLog* log;
   InfAdoptedRequest* req;
   InfAdoptedStateVector* req_vec;
-  InfAdoptedStateVector* low_vec;
+  guint lcp_sum;
   gboolean req_before_lcp;
   guint n;
   guint id;
@@ -2107,17 +2037,12 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
   {
     if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
     {
-      temp = inf_adopted_algorithm_least_common_predecessor(
-        algorithm,
-        lcp,
-        inf_adopted_user_get_vector(*user)
-      );
-
-      inf_adopted_state_vector_free(lcp);
-      lcp = temp;
+      inf_adopted_state_vector_min(lcp, inf_adopted_user_get_vector(*user));
     }
   }
 
+  lcp_sum = inf_adopted_state_vector_sum(lcp);
+
   for(user = priv->users_begin; user != priv->users_end; ++ user)
   {
     id = inf_user_get_id(INF_USER(*user));
@@ -2149,12 +2074,13 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
        * here. If it doesn't work out, then we will need to use the upper
        * related. Note that changing this requires changing the cleanup
        * tests, too. */
-      low_vec = inf_adopted_request_get_vector(
+      /* The lower related request is causally before the upper related
+       * one, and therefore also before lcp, so the vdiff is simply the
+       * difference of the sums. */
+      vdiff = lcp_sum - inf_adopted_request_get_vector_sum(
         inf_adopted_request_log_get_request(log, n)
       );
 
-      vdiff = inf_adopted_state_vector_vdiff(low_vec, lcp);
-
       /* TODO: Again, I experimentally changed <= to < here. If the vdiff is
        * equal to the log size, then nobody can do anything with the request
        * set anymore: Everybody already processed every request in the set
@@ -2166,7 +2092,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
         break;
 
       /* Check next set of related requests */
-      n = inf_adopted_state_vector_get(req_vec, id) + 1;
+      n = inf_adopted_request_get_index(req) + 1;
     }
 
     inf_adopted_request_log_remove_requests(log, n);
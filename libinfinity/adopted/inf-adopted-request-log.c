@@ -40,12 +40,19 @@
 
 #include <string.h> /* For (g_)memmove */
 
-typedef struct _InfAdoptedRequestLogCleanupCacheData
-  InfAdoptedRequestLogCleanupCacheData;
-struct _InfAdoptedRequestLogCleanupCacheData {
-  guint user_id;
-  guint up_to;
-  GSList* requests_to_remove;
+typedef struct _InfAdoptedRequestLogCacheEntry
+  InfAdoptedRequestLogCacheEntry;
+struct _InfAdoptedRequestLogCacheEntry {
+  InfAdoptedRequest* request;
+  /* The user's component of the request's vector */
+  guint index;
+
+  /* Link in the LRU list, most recently used entry first */
+  GList lru_link;
+
+  /* Other cached translations with the same index */
+  InfAdoptedRequestLogCacheEntry* prev_index;
+  InfAdoptedRequestLogCacheEntry* next_index;
 };
 
 typedef struct _InfAdoptedRequestLogEntry InfAdoptedRequestLogEntry;
@@ -64,7 +71,14 @@ typedef struct _InfAdoptedRequestLogPrivate InfAdoptedRequestLogPrivate;
 struct _InfAdoptedRequestLogPrivate {
   guint user_id;
   InfAdoptedRequestLogEntry* entries;
-  GTree* cache;
+
+  GHashTable* cache; /* InfAdoptedStateVector* -> CacheEntry */
+  GHashTable* cache_index; /* index -> first CacheEntry with that index */
+  GQueue cache_lru;
+  guint cache_size;
+  guint64 cache_hits;
+  guint64 cache_misses;
+  guint64 cache_evictions;
 
   InfAdoptedRequestLogEntry* next_undo;
   InfAdoptedRequestLogEntry* next_redo;
@@ -85,7 +99,10 @@ enum {
   PROP_END,
 
   PROP_NEXT_UNDO,
-  PROP_NEXT_REDO
+  PROP_NEXT_REDO,
+
+  /* read/write */
+  PROP_CACHE_SIZE
 };
 
 enum {
@@ -98,6 +115,7 @@ enum {
 #define INF_ADOPTED_REQUEST_LOG_PRIVATE(obj)     ((InfAdoptedRequestLogPrivate*)(obj)->priv)
 
 static const guint INF_ADOPTED_REQUEST_LOG_INC = 0x80;
+static const guint INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_SIZE = 8192;
 static guint request_log_signals[LAST_SIGNAL];
 
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedRequestLog, inf_adopted_request_log, G_TYPE_OBJECT,
@@ -159,63 +177,84 @@ inf_adopted_request_log_verify_related(InfAdoptedRequestLog* log)
  * Transformation cache
  */
 
-static int
-inf_adopted_request_log_cache_key_cmp(gconstpointer a,
-                                      gconstpointer b,
-                                      gpointer user_data)
+static guint
+inf_adopted_request_log_cache_hash(gconstpointer key)
 {
-  InfAdoptedRequestLog* log;
-  InfAdoptedRequestLogPrivate* priv;
-  const InfAdoptedStateVector* key_a;
-  const InfAdoptedStateVector* key_b;
-  guint n_a, n_b;
-
-  key_a = (const InfAdoptedStateVector*)a;
-  key_b = (const InfAdoptedStateVector*)b;
-
-  log = (InfAdoptedRequestLog*)user_data;
-  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+  return inf_adopted_state_vector_hash((const InfAdoptedStateVector*)key);
+}
 
-  /* Primary, order by component of user ID -- this makes cleanup very
-   * efficient. */
-  n_a = inf_adopted_state_vector_get(key_a, priv->user_id);
-  n_b = inf_adopted_state_vector_get(key_b, priv->user_id);
+static gboolean
+inf_adopted_request_log_cache_equal(gconstpointer a,
+                                    gconstpointer b)
+{
+  return inf_adopted_state_vector_compare(
+    (const InfAdoptedStateVector*)a,
+    (const InfAdoptedStateVector*)b
+  ) == 0;
+}
 
-  if(n_a < n_b)
-    return -1;
-  if(n_a > n_b)
-    return 1;
+static void
+inf_adopted_request_log_cache_entry_free(gpointer data)
+{
+  InfAdoptedRequestLogCacheEntry* entry;
+  entry = (InfAdoptedRequestLogCacheEntry*)data;
 
-  /* If user ID component is equal, go by other components. */
-  return inf_adopted_state_vector_compare(key_a, key_b);
+  g_object_unref(entry->request);
+  g_slice_free(InfAdoptedRequestLogCacheEntry, entry);
 }
 
-static gboolean
-inf_adopted_request_log_remove_requests_cache_foreach_func(gpointer key,
-                                                           gpointer value,
-                                                           gpointer user_data)
+static void
+inf_adopted_request_log_cache_remove(InfAdoptedRequestLog* log,
+                                     InfAdoptedRequestLogCacheEntry* entry)
 {
-  InfAdoptedStateVector* vector;
-  InfAdoptedRequestLogCleanupCacheData* data;
+  InfAdoptedRequestLogPrivate* priv;
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  vector = (InfAdoptedStateVector*)key;
-  data = (InfAdoptedRequestLogCleanupCacheData*)user_data;
+  g_queue_unlink(&priv->cache_lru, &entry->lru_link);
 
-  /* Remove all requests which are a cached translation of one of the requests
-   * that have been removed, i.e. have a user component smaller than up_to. */
-  if(inf_adopted_state_vector_get(vector, data->user_id) < data->up_to)
+  if(entry->next_index != NULL)
+    entry->next_index->prev_index = entry->prev_index;
+
+  if(entry->prev_index != NULL)
+  {
+    entry->prev_index->next_index = entry->next_index;
+  }
+  else if(entry->next_index != NULL)
   {
-    data->requests_to_remove =
-      g_slist_prepend(data->requests_to_remove, vector);
-    return FALSE;
+    g_hash_table_insert(
+      priv->cache_index,
+      GUINT_TO_POINTER(entry->index),
+      entry->next_index
+    );
   }
   else
   {
-    /* Stop traversal. The tree is traversed in sorted order, and the primary
-     * sort criteria of the tree is the vector component of the user. So if
-     * we have reached this point, all other elements in the tree will have
-     * a higher user component and are not scheduled for removal. */
-    return TRUE;
+    g_hash_table_remove(priv->cache_index, GUINT_TO_POINTER(entry->index));
+  }
+
+  /* This frees entry */
+  g_hash_table_remove(
+    priv->cache,
+    inf_adopted_request_get_vector(entry->request)
+  );
+}
+
+/* Removes least recently used entries until there are at most size left */
+static void
+inf_adopted_request_log_cache_shrink(InfAdoptedRequestLog* log,
+                                     guint size)
+{
+  InfAdoptedRequestLogPrivate* priv;
+  GList* link;
+
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+  if(priv->cache == NULL) return;
+
+  while(g_hash_table_size(priv->cache) > size)
+  {
+    link = g_queue_peek_tail_link(&priv->cache_lru);
+    inf_adopted_request_log_cache_remove(log, link->data);
+    ++priv->cache_evictions;
   }
 }
 
@@ -296,7 +335,14 @@ inf_adopted_request_log_init(InfAdoptedRequestLog* log)
 
   priv->alloc = INF_ADOPTED_REQUEST_LOG_INC;
   priv->entries = g_malloc(priv->alloc * sizeof(InfAdoptedRequestLogEntry));
+
   priv->cache = NULL;
+  priv->cache_index = NULL;
+  g_queue_init(&priv->cache_lru);
+  priv->cache_size = INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_SIZE;
+  priv->cache_hits = 0;
+  priv->cache_misses = 0;
+  priv->cache_evictions = 0;
   priv->begin = 0;
   priv->end = 0;
   priv->offset = 0;
@@ -317,7 +363,10 @@ inf_adopted_request_log_dispose(GObject* object)
 
   if(priv->cache != NULL)
   {
-    g_tree_destroy(priv->cache);
+    g_hash_table_destroy(priv->cache_index);
+    g_hash_table_destroy(priv->cache);
+    g_queue_init(&priv->cache_lru);
+    priv->cache_index = NULL;
     priv->cache = NULL;
   }
 
@@ -369,6 +418,9 @@ inf_adopted_request_log_set_property(GObject* object,
     priv->begin = g_value_get_uint(value);
     priv->end = priv->begin;
     break;
+  case PROP_CACHE_SIZE:
+    inf_adopted_request_log_set_cache_size(log, g_value_get_uint(value));
+    break;
   case PROP_END:
   case PROP_NEXT_UNDO:
   case PROP_NEXT_REDO:
@@ -415,6 +467,9 @@ inf_adopted_request_log_get_property(GObject* object,
     else
       g_value_set_object(value, NULL);
 
+    break;
+  case PROP_CACHE_SIZE:
+    g_value_set_uint(value, priv->cache_size);
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -438,10 +493,7 @@ inf_adopted_request_log_add_request_handler(InfAdoptedRequestLog* log,
 
   g_assert(
     priv->begin == priv->end ||
-    inf_adopted_state_vector_get(
-      inf_adopted_request_get_vector(request),
-      priv->user_id
-    ) == priv->end
+    inf_adopted_request_get_index(request) == priv->end
   );
 
   if(priv->offset + (priv->end - priv->begin) == priv->alloc)
@@ -523,10 +575,7 @@ inf_adopted_request_log_add_request_handler(InfAdoptedRequestLog* log,
 
   if(priv->begin == priv->end)
   {
-    priv->begin = inf_adopted_state_vector_get(
-      inf_adopted_request_get_vector(request),
-      priv->user_id
-    );
+    priv->begin = inf_adopted_request_get_index(request);
 
     priv->end = priv->begin;
   }
@@ -706,6 +755,21 @@ inf_adopted_request_log_class_init(
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_CACHE_SIZE,
+    g_param_spec_uint(
+      "cache-size",
+      "Cache size",
+      "The maximum number of translated requests in the cache, or 0 for "
+      "no limit",
+      0,
+      G_MAXUINT,
+      INF_ADOPTED_REQUEST_LOG_DEFAULT_CACHE_SIZE,
+      G_PARAM_READWRITE
+    )
+  );
+
   /**
    * InfAdoptedRequestLog::add-request:
    * @log: The #InfAdoptedRequestLog to which a new request is added.
@@ -919,10 +983,7 @@ inf_adopted_request_log_add_request(InfAdoptedRequestLog* log,
 
   g_return_if_fail(
     priv->begin == priv->end ||
-    inf_adopted_state_vector_get(
-      inf_adopted_request_get_vector(request),
-      priv->user_id
-    ) == priv->end
+    inf_adopted_request_get_index(request) == priv->end
   );
 
   g_signal_emit(G_OBJECT(log), request_log_signals[ADD_REQUEST], 0, request);
@@ -943,9 +1004,9 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
                                         guint up_to)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedRequestLogCleanupCacheData data;
+  InfAdoptedRequestLogCacheEntry* entry;
+  guint old_begin;
   guint i;
-  GSList* item;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
 
@@ -985,25 +1046,26 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
     }
   }
 
+  old_begin = priv->begin;
   priv->offset += (up_to - priv->begin);
   priv->begin = up_to;
   g_object_notify(G_OBJECT(log), "begin");
 
+  /* Remove all requests which are a cached translation of one of the requests
+   * that have been removed, i.e. have a user component smaller than up_to.
+   * Translation never decreases the user component, so there are none
+   * below old_begin. */
   if(priv->cache != NULL)
   {
-    data.user_id = priv->user_id;
-    data.up_to = up_to;
-    data.requests_to_remove = NULL;
-
-    g_tree_foreach(
-      priv->cache,
-      inf_adopted_request_log_remove_requests_cache_foreach_func,
-      &data
-    );
-    
-    for(item = data.requests_to_remove; item != NULL; item = item->next)
-      g_tree_remove(priv->cache, (InfAdoptedStateVector*)item->data);
-    g_slist_free(data.requests_to_remove);
+    for(i = old_begin; i < up_to; ++i)
+    {
+      entry = g_hash_table_lookup(priv->cache_index, GUINT_TO_POINTER(i));
+      while(entry != NULL)
+      {
+        inf_adopted_request_log_cache_remove(log, entry);
+        entry = g_hash_table_lookup(priv->cache_index, GUINT_TO_POINTER(i));
+      }
+    }
   }
 
   inf_adopted_request_log_verify_related(log);
@@ -1028,7 +1090,6 @@ inf_adopted_request_log_next_associated(InfAdoptedRequestLog* log,
                                         InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
   InfAdoptedRequestLogEntry* entry;
@@ -1037,9 +1098,8 @@ inf_adopted_request_log_next_associated(InfAdoptedRequestLog* log,
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
 
   g_return_val_if_fail(priv->user_id == user_id, NULL);
   g_return_val_if_fail(n >= priv->begin && n < priv->end, NULL);
@@ -1071,7 +1131,6 @@ inf_adopted_request_log_prev_associated(InfAdoptedRequestLog* log,
                                         InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
   InfAdoptedRequestLogEntry* entry;
@@ -1080,9 +1139,8 @@ inf_adopted_request_log_prev_associated(InfAdoptedRequestLog* log,
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
 
   g_return_val_if_fail(priv->user_id == user_id, NULL);
   g_return_val_if_fail(n >= priv->begin && n <= priv->end, NULL);
@@ -1140,7 +1198,6 @@ inf_adopted_request_log_original_request(InfAdoptedRequestLog* log,
                                          InfAdoptedRequest* request)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedStateVector* vector;
   guint user_id;
   guint n;
   InfAdoptedRequestLogEntry* entry;
@@ -1149,9 +1206,8 @@ inf_adopted_request_log_original_request(InfAdoptedRequestLog* log,
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  vector = inf_adopted_request_get_vector(request);
   user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
 
   g_return_val_if_fail(priv->user_id == user_id, NULL);
   g_return_val_if_fail(n >= priv->begin && n <= priv->end, NULL);
@@ -1322,9 +1378,12 @@ inf_adopted_request_log_lower_related(InfAdoptedRequestLog* log,
  * requests are removed from the log the cache is automatically updated
  * accordingly.
  *
- * The data structure of the cache is optimized for quick lookup of entries
- * by the state vector and cleaning up entries in an efficient manner also
- * when the cache has grown very big.
+ * The cache is a hash table keyed by the state vector, so that lookups
+ * take constant time, and entries are additionally indexed by the
+ * component of the log's user so that removing requests from the log only
+ * touches the cache entries that are translations of them. The number of
+ * entries is limited by the #InfAdoptedRequestLog:cache-size property.
+ * When the cache is full, the least recently used entry is dropped.
  *
  * The request cache is mainly used by #InfAdoptedAlgorithm to efficiently
  * handle big transformations.
@@ -1338,6 +1397,7 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
 {
   InfAdoptedRequestLogPrivate* priv;
   InfAdoptedStateVector* vector;
+  InfAdoptedRequestLogCacheEntry* entry;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
   g_return_if_fail(INF_ADOPTED_IS_REQUEST(request));
@@ -1349,22 +1409,45 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
 
   if(priv->cache == NULL)
   {
-    priv->cache = g_tree_new_full(
-      inf_adopted_request_log_cache_key_cmp,
-      log,
+    priv->cache = g_hash_table_new_full(
+      inf_adopted_request_log_cache_hash,
+      inf_adopted_request_log_cache_equal,
       NULL,
-      g_object_unref
+      inf_adopted_request_log_cache_entry_free
     );
+
+    priv->cache_index = g_hash_table_new(NULL, NULL);
   }
 
-  g_return_if_fail(g_tree_lookup(priv->cache, vector) == NULL);
+  g_return_if_fail(g_hash_table_lookup(priv->cache, vector) == NULL);
+
+  if(priv->cache_size > 0)
+    inf_adopted_request_log_cache_shrink(log, priv->cache_size - 1);
+
+  entry = g_slice_new(InfAdoptedRequestLogCacheEntry);
+  entry->request = request;
+  entry->index = inf_adopted_request_get_index(request);
+  entry->lru_link.data = entry;
+  entry->lru_link.prev = NULL;
+  entry->lru_link.next = NULL;
+  entry->prev_index = NULL;
+  entry->next_index = g_hash_table_lookup(
+    priv->cache_index,
+    GUINT_TO_POINTER(entry->index)
+  );
+
+  if(entry->next_index != NULL)
+    entry->next_index->prev_index = entry;
 
-  g_tree_insert(priv->cache, vector, request);
   g_object_ref(request);
+  g_hash_table_insert(priv->cache, vector, entry);
+  g_hash_table_insert(
+    priv->cache_index,
+    GUINT_TO_POINTER(entry->index),
+    entry
+  );
 
-  /* Implement lookup_cached_request */
-  /* Use this implementation in InfAdoptedAlgorithm */
-  /* Make the performance tests */
+  g_queue_push_head_link(&priv->cache_lru, &entry->lru_link);
 }
 
 /**
@@ -1386,14 +1469,106 @@ inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
                                               InfAdoptedStateVector* vec)
 {
   InfAdoptedRequestLogPrivate* priv;
+  InfAdoptedRequestLogCacheEntry* entry;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), NULL);
   g_return_val_if_fail(vec != NULL, NULL);
 
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
-  if(priv->cache == NULL) return NULL;
 
-  return INF_ADOPTED_REQUEST(g_tree_lookup(priv->cache, vec));
+  if(priv->cache != NULL)
+    entry = g_hash_table_lookup(priv->cache, vec);
+  else
+    entry = NULL;
+
+  if(entry == NULL)
+  {
+    ++priv->cache_misses;
+    return NULL;
+  }
+
+  ++priv->cache_hits;
+
+  /* Mark as most recently used */
+  g_queue_unlink(&priv->cache_lru, &entry->lru_link);
+  g_queue_push_head_link(&priv->cache_lru, &entry->lru_link);
+
+  return entry->request;
+}
+
+/**
+ * inf_adopted_request_log_set_cache_size:
+ * @log: A #InfAdoptedRequestLog.
+ * @size: The maximum number of entries in the request cache, or 0.
+ *
+ * Sets the maximum number of translated requests that are kept in the
+ * request cache of @log. If the cache contains more entries than that, the
+ * least recently used ones are removed. If @size is 0, the number of
+ * entries is not limited.
+ */
+void
+inf_adopted_request_log_set_cache_size(InfAdoptedRequestLog* log,
+                                       guint size)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  if(priv->cache_size != size)
+  {
+    priv->cache_size = size;
+    if(size > 0)
+      inf_adopted_request_log_cache_shrink(log, size);
+
+    g_object_notify(G_OBJECT(log), "cache-size");
+  }
+}
+
+/**
+ * inf_adopted_request_log_get_cache_size:
+ * @log: A #InfAdoptedRequestLog.
+ *
+ * Returns the maximum number of translated requests that are kept in the
+ * request cache of @log, or 0 if the number is not limited.
+ *
+ * Returns: The maximum size of the request cache.
+ */
+guint
+inf_adopted_request_log_get_cache_size(InfAdoptedRequestLog* log)
+{
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), 0);
+  return INF_ADOPTED_REQUEST_LOG_PRIVATE(log)->cache_size;
+}
+
+/**
+ * inf_adopted_request_log_get_cache_statistics:
+ * @log: A #InfAdoptedRequestLog.
+ * @hits: (out) (allow-none): Location to store the number of cache hits,
+ * or %NULL.
+ * @misses: (out) (allow-none): Location to store the number of cache
+ * misses, or %NULL.
+ * @evictions: (out) (allow-none): Location to store the number of entries
+ * dropped because the cache was full, or %NULL.
+ *
+ * Returns statistics about the request cache of @log, counted since @log
+ * was created. This can be used to choose a suitable value for the
+ * #InfAdoptedRequestLog:cache-size property.
+ */
+void
+inf_adopted_request_log_get_cache_statistics(InfAdoptedRequestLog* log,
+                                             guint64* hits,
+                                             guint64* misses,
+                                             guint64* evictions)
+{
+  InfAdoptedRequestLogPrivate* priv;
+
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
+
+  if(hits != NULL) *hits = priv->cache_hits;
+  if(misses != NULL) *misses = priv->cache_misses;
+  if(evictions != NULL) *evictions = priv->cache_evictions;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -133,6 +133,19 @@ InfAdoptedRequest*
 inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
                                               InfAdoptedStateVector* vec);
 
+void
+inf_adopted_request_log_set_cache_size(InfAdoptedRequestLog* log,
+                                       guint size);
+
+guint
+inf_adopted_request_log_get_cache_size(InfAdoptedRequestLog* log);
+
+void
+inf_adopted_request_log_get_cache_statistics(InfAdoptedRequestLog* log,
+                                             guint64* hits,
+                                             guint64* misses,
+                                             guint64* evictions);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_REQUEST_LOG_H__ */
@@ -66,6 +66,10 @@ struct _InfAdoptedRequestPrivate {
   InfAdoptedOperation* operation;
   gint64 received;
   gint64 executed;
+
+  /* Derived from vector, which does not change after construction */
+  guint index;
+  guint sum;
 };
 
 enum {
@@ -82,7 +86,7 @@ enum {
   PROP_EXECUTED
 };
 
-#define INF_ADOPTED_REQUEST_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_ADOPTED_TYPE_REQUEST, InfAdoptedRequestPrivate))
+#define INF_ADOPTED_REQUEST_GET_PRIVATE(obj) (inf_adopted_request_get_instance_private(obj))
 #define INF_ADOPTED_REQUEST_PRIVATE(obj)     ((InfAdoptedRequestPrivate*)(obj)->priv)
 
 INF_DEFINE_ENUM_TYPE(InfAdoptedRequestType, inf_adopted_request_type, inf_adopted_request_type_values)
@@ -103,6 +107,58 @@ inf_adopted_request_init(InfAdoptedRequest* request)
 
   priv->received = 0;
   priv->executed = 0;
+
+  priv->index = 0;
+  priv->sum = 0;
+}
+
+static void
+inf_adopted_request_update_vector_cache(InfAdoptedRequestPrivate* priv)
+{
+  priv->index = inf_adopted_state_vector_get(priv->vector, priv->user_id);
+  priv->sum = inf_adopted_state_vector_sum(priv->vector);
+}
+
+/* Creates a new request without going through the GObject property
+ * machinery, which is relatively costly compared to the work done when
+ * transforming a request. Takes ownership of vector and operation. */
+static InfAdoptedRequest*
+inf_adopted_request_new_internal(InfAdoptedRequestType type,
+                                 InfAdoptedStateVector* vector,
+                                 guint user_id,
+                                 InfAdoptedOperation* operation,
+                                 gint64 received,
+                                 gint64 executed)
+{
+  InfAdoptedRequest* request;
+  InfAdoptedRequestPrivate* priv;
+
+  request = INF_ADOPTED_REQUEST(g_object_new(INF_ADOPTED_TYPE_REQUEST, NULL));
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  priv->type = type;
+  priv->vector = vector;
+  priv->user_id = user_id;
+  priv->operation = operation;
+  priv->received = received;
+  priv->executed = executed;
+
+  inf_adopted_request_update_vector_cache(priv);
+  return request;
+}
+
+static void
+inf_adopted_request_constructed(GObject* object)
+{
+  InfAdoptedRequestPrivate* priv;
+
+  G_OBJECT_CLASS(inf_adopted_request_parent_class)->constructed(object);
+
+  /* Requests created by inf_adopted_request_new_internal() have no vector
+   * yet at this point; the cache is updated there. */
+  priv = INF_ADOPTED_REQUEST_PRIVATE(INF_ADOPTED_REQUEST(object));
+  if(priv->vector != NULL)
+    inf_adopted_request_update_vector_cache(priv);
 }
 
 static void
@@ -225,6 +281,7 @@ inf_adopted_request_class_init(InfAdoptedRequestClass* request_class)
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(request_class);
 
+  object_class->constructed = inf_adopted_request_constructed;
   object_class->dispose = inf_adopted_request_dispose;
   object_class->finalize = inf_adopted_request_finalize;
   object_class->set_property = inf_adopted_request_set_property;
@@ -327,23 +384,20 @@ inf_adopted_request_new_do(InfAdoptedStateVector* vector,
                            InfAdoptedOperation* operation,
                            gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_DO,
-    "vector", vector,
-    "user-id", user_id,
-    "operation", operation,
-    "received", received,
-    NULL
-  );
+  g_object_ref(operation);
 
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    operation,
+    received,
+    0
+  );
 }
 
 /**
@@ -364,21 +418,17 @@ inf_adopted_request_new_undo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_UNDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_UNDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -399,21 +449,17 @@ inf_adopted_request_new_redo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-  
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
-  
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_REDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_REDO,
+    inf_adopted_state_vector_copy(vector),
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -428,39 +474,21 @@ InfAdoptedRequest*
 inf_adopted_request_copy(InfAdoptedRequest* request)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
-  GObject* object;
-  
+
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   priv = INF_ADOPTED_REQUEST_PRIVATE(request);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "operation", priv->operation,
-      "received", priv->received,
-      NULL
-    );
-  }
-  else
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "received", priv->received,
-      NULL
-    );
-  }
+  if(priv->operation != NULL)
+    g_object_ref(priv->operation);
 
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(INF_ADOPTED_REQUEST(object));
-  new_priv->executed = priv->executed;
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_internal(
+    priv->type,
+    inf_adopted_state_vector_copy(priv->vector),
+    priv->user_id,
+    priv->operation,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
@@ -553,7 +581,28 @@ inf_adopted_request_get_index(InfAdoptedRequest* request)
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), 0);
 
   priv = INF_ADOPTED_REQUEST_PRIVATE(request);
-  return inf_adopted_state_vector_get(priv->vector, priv->user_id);
+  return priv->index;
+}
+
+/**
+ * inf_adopted_request_get_vector_sum:
+ * @request: A #InfAdoptedRequest.
+ *
+ * Returns the sum of all components of the request's vector time, that is
+ * the total number of requests that had been executed at the state in which
+ * @request can be applied. If the vector time of another request is causally
+ * before the one of @request, then the difference of the sums equals
+ * inf_adopted_state_vector_vdiff() of the two, and the two vectors are
+ * equal exactly if the sums are equal. This value is computed when the
+ * request is created, so it is cheap to query.
+ *
+ * Returns: The sum of the components of the request's vector time.
+ */
+guint
+inf_adopted_request_get_vector_sum(InfAdoptedRequest* request)
+{
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), 0);
+  return INF_ADOPTED_REQUEST_PRIVATE(request)->sum;
 }
 
 /**
@@ -700,10 +749,8 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   InfAdoptedRequestPrivate* against_priv;
   InfAdoptedRequestPrivate* request_lcs_priv;
   InfAdoptedRequestPrivate* against_lcs_priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(against), NULL);
@@ -794,19 +841,14 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(request_priv->vector);
   inf_adopted_state_vector_add(new_vector, against_priv->user_id, 1);
 
-  new_request = inf_adopted_request_new_do(
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     request_priv->user_id,
     new_operation,
-    request_priv->received
+    request_priv->received,
+    request_priv->executed
   );
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = request_priv->executed;
-
-  g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
 }
 
 /**
@@ -832,10 +874,8 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
                            guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(by % 2 == 1, NULL);
@@ -851,19 +891,14 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, priv->user_id, by);
 
-  new_request = inf_adopted_request_new_do(
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     priv->user_id,
     new_operation,
-    priv->received
+    priv->received,
+    priv->executed
   );
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
-
-  g_object_unref(new_operation);
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
 }
 
 /**
@@ -889,9 +924,7 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
                          guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedStateVector* new_vector;
-  InfAdoptedRequest* new_request;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   g_return_val_if_fail(into != 0, NULL);
@@ -903,39 +936,17 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, into, by);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "operation", priv->operation,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-  else
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
+  if(priv->operation != NULL)
+    g_object_ref(priv->operation);
 
-  inf_adopted_state_vector_free(new_vector);
-  return new_request;
+  return inf_adopted_request_new_internal(
+    priv->type,
+    new_vector,
+    priv->user_id,
+    priv->operation,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
@@ -117,6 +117,9 @@ inf_adopted_request_get_operation(InfAdoptedRequest* request);
 guint
 inf_adopted_request_get_index(InfAdoptedRequest* request);
 
+guint
+inf_adopted_request_get_vector_sum(InfAdoptedRequest* request);
+
 gint64
 inf_adopted_request_get_receive_time(InfAdoptedRequest* request);
 
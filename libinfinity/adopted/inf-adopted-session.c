@@ -47,11 +47,12 @@
 #include <string.h>
 #include <time.h>
 
-typedef struct _InfAdoptedSessionToXmlSyncForeachData
-  InfAdoptedSessionToXmlSyncForeachData;
-struct _InfAdoptedSessionToXmlSyncForeachData {
-  InfAdoptedSession* session;
-  xmlNodePtr parent_xml;
+/* The requests of all users at the time a synchronization started, which
+ * are serialized one at a time while being sent. */
+typedef struct _InfAdoptedSessionSyncRequests InfAdoptedSessionSyncRequests;
+struct _InfAdoptedSessionSyncRequests {
+  GPtrArray* requests;
+  guint index;
 };
 
 typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
@@ -135,16 +136,12 @@ inf_adopted_session_validate_request(InfAdoptedRequestLog* log,
                                      InfAdoptedRequest* request,
                                      GError** error)
 {
-  InfAdoptedStateVector* vector;
-  guint user_id;
   guint n;
 
   guint begin;
   guint end;
 
-  vector = inf_adopted_request_get_vector(request);
-  user_id = inf_adopted_request_get_user_id(request);
-  n = inf_adopted_state_vector_get(vector, user_id);
+  n = inf_adopted_request_get_index(request);
   
   begin = inf_adopted_request_log_get_begin(log);
   end = inf_adopted_request_log_get_end(log);
@@ -721,6 +718,9 @@ inf_adopted_session_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   session = INF_ADOPTED_SESSION(user_data);
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
+  /* The request log and the buffer have changed */
+  inf_session_invalidate_sync_snapshot(INF_SESSION(session));
+
   if(translated != NULL)
   {
     if(inf_adopted_request_affects_buffer(translated))
@@ -1008,64 +1008,103 @@ inf_adopted_session_get_property(GObject* object,
  */
 
 static void
-inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
-                                                  gpointer user_data)
+inf_adopted_session_to_xml_sync_stream_foreach_user_func(InfUser* user,
+                                                         gpointer user_data)
 {
   InfAdoptedRequestLog* log;
-  InfAdoptedSessionToXmlSyncForeachData* data;
-  InfAdoptedSessionClass* session_class;
+  InfAdoptedSessionSyncRequests* data;
   guint i;
   guint end;
-  xmlNodePtr xml;
-  InfAdoptedRequest* request;
 
   g_assert(INF_ADOPTED_IS_USER(user));
 
-  data = (InfAdoptedSessionToXmlSyncForeachData*)user_data;
+  data = (InfAdoptedSessionSyncRequests*)user_data;
   log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
   end = inf_adopted_request_log_get_end(log);
-  session_class = INF_ADOPTED_SESSION_GET_CLASS(data->session);
-  g_assert(session_class->request_to_xml != NULL);
 
+  /* The requests stay alive even if they are removed from the log before
+   * they have been sent. */
   for(i = inf_adopted_request_log_get_begin(log); i < end; ++ i)
   {
-    request = inf_adopted_request_log_get_request(log, i);
-
-    xml = xmlNewChild(
-      data->parent_xml,
-      NULL,
-      (const xmlChar*)"sync-request",
-      NULL
+    g_ptr_array_add(
+      data->requests,
+      g_object_ref(inf_adopted_request_log_get_request(log, i))
     );
-
-    /* TODO: Diff to previous request? */
-    session_class->request_to_xml(data->session, xml, request, NULL, TRUE);
-    xmlAddChild(data->parent_xml, xml);
   }
 }
 
+static xmlNodePtr
+inf_adopted_session_to_xml_sync_stream_request_func(InfSession* session,
+                                                    gpointer user_data)
+{
+  InfAdoptedSessionSyncRequests* data;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  xmlNodePtr xml;
+
+  data = (InfAdoptedSessionSyncRequests*)user_data;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->request_to_xml != NULL);
+
+  g_assert(data->index < data->requests->len);
+  request = g_ptr_array_index(data->requests, data->index);
+  ++ data->index;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"sync-request");
+
+  /* TODO: Diff to previous request? */
+  session_class->request_to_xml(
+    INF_ADOPTED_SESSION(session),
+    xml,
+    request,
+    NULL,
+    TRUE
+  );
+
+  return xml;
+}
+
 static void
-inf_adopted_session_to_xml_sync(InfSession* session,
-                                xmlNodePtr parent)
+inf_adopted_session_to_xml_sync_stream_free_func(gpointer user_data)
+{
+  InfAdoptedSessionSyncRequests* data;
+  data = (InfAdoptedSessionSyncRequests*)user_data;
+
+  g_ptr_array_free(data->requests, TRUE);
+  g_slice_free(InfAdoptedSessionSyncRequests, data);
+}
+
+static void
+inf_adopted_session_to_xml_sync_stream(InfSession* session,
+                                       InfSessionSyncStream* stream)
 {
   InfAdoptedSessionPrivate* priv;
-  InfAdoptedSessionToXmlSyncForeachData foreach_data;
+  InfAdoptedSessionSyncRequests* data;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
   g_assert(priv->algorithm != NULL);
 
-  INF_SESSION_CLASS(inf_adopted_session_parent_class)->to_xml_sync(
+  INF_SESSION_CLASS(inf_adopted_session_parent_class)->to_xml_sync_stream(
     session,
-    parent
+    stream
   );
 
-  foreach_data.session = INF_ADOPTED_SESSION(session);
-  foreach_data.parent_xml = parent;
+  data = g_slice_new(InfAdoptedSessionSyncRequests);
+  data->requests = g_ptr_array_new_with_free_func(g_object_unref);
+  data->index = 0;
 
   inf_user_table_foreach_user(
     inf_session_get_user_table(session),
-    inf_adopted_session_to_xml_sync_foreach_user_func,
-    &foreach_data
+    inf_adopted_session_to_xml_sync_stream_foreach_user_func,
+    data
+  );
+
+  inf_session_sync_stream_add(
+    stream,
+    data->requests->len,
+    inf_adopted_session_to_xml_sync_stream_request_func,
+    data,
+    inf_adopted_session_to_xml_sync_stream_free_func
   );
 }
 
@@ -1134,6 +1173,7 @@ inf_adopted_session_process_xml_run(InfSession* session,
 
   InfAdoptedStateVector* user_vector;
   InfAdoptedStateVector* request_vector;
+  InfAdoptedStateVector* copy_vector;
 
   gboolean has_num;
   gboolean process_request;
@@ -1250,15 +1290,44 @@ inf_adopted_session_process_xml_run(InfSession* session,
       }
       else
       {
-        copy_req = inf_adopted_request_copy(request);
-
-        /* TODO: This is a bit of a hack since requests are normally
-         * immutable. It avoids an additional vector copy here though. */
-        inf_adopted_state_vector_add(
-          inf_adopted_request_get_vector(copy_req),
-          inf_user_get_id(INF_USER(user)),
-          i
-        );
+        /* Requests are immutable, and they cache information derived from
+         * their vector, so create a new one at the later state. */
+        copy_vector = inf_adopted_state_vector_copy(request_vector);
+        inf_adopted_state_vector_add(copy_vector, user_id, i);
+
+        switch(inf_adopted_request_get_request_type(request))
+        {
+        case INF_ADOPTED_REQUEST_DO:
+          copy_req = inf_adopted_request_new_do(
+            copy_vector,
+            user_id,
+            inf_adopted_request_get_operation(request),
+            inf_adopted_request_get_receive_time(request)
+          );
+
+          break;
+        case INF_ADOPTED_REQUEST_UNDO:
+          copy_req = inf_adopted_request_new_undo(
+            copy_vector,
+            user_id,
+            inf_adopted_request_get_receive_time(request)
+          );
+
+          break;
+        case INF_ADOPTED_REQUEST_REDO:
+          copy_req = inf_adopted_request_new_redo(
+            copy_vector,
+            user_id,
+            inf_adopted_request_get_receive_time(request)
+          );
+
+          break;
+        default:
+          g_assert_not_reached();
+          break;
+        }
+
+        inf_adopted_state_vector_free(copy_vector);
       }
 
       process_request = inf_adopted_session_process_request(
@@ -1547,7 +1616,7 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
   object_class->set_property = inf_adopted_session_set_property;
   object_class->get_property = inf_adopted_session_get_property;
 
-  session_class->to_xml_sync = inf_adopted_session_to_xml_sync;
+  session_class->to_xml_sync_stream = inf_adopted_session_to_xml_sync_stream;
   session_class->process_xml_sync = inf_adopted_session_process_xml_sync;
   session_class->process_xml_run = inf_adopted_session_process_xml_run;
   session_class->get_xml_user_props = inf_adopted_session_get_xml_user_props;
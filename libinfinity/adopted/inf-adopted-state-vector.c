@@ -28,6 +28,14 @@
  * The #InfAdoptedStateVector represents a state in the current state space.
  * It basically maps user IDs to operation counts and states how many
  * operations of the corresponding user have already been performed.
+ *
+ * The components are stored in a flat array sorted by user ID. Within a
+ * session, most vectors contain a component for every user that ever
+ * joined, so the arrays of two vectors usually have exactly the same
+ * layout. The functions operating on two vectors, such as
+ * inf_adopted_state_vector_causally_before() or
+ * inf_adopted_state_vector_max(), have a fast path for this case which
+ * only compares the entries at the same index.
  **/
 
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
@@ -431,6 +439,39 @@ inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
   }
 }
 
+/**
+ * inf_adopted_state_vector_hash:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Computes a hash value for @vec, so that state vectors can be used as keys
+ * in a #GHashTable. Vectors for which inf_adopted_state_vector_compare()
+ * returns 0 have the same hash value.
+ *
+ * Returns: A hash value for @vec.
+ **/
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec)
+{
+  gsize pos;
+  guint hash;
+
+  g_return_val_if_fail(vec != NULL, 0);
+
+  /* Components with value zero are equivalent to missing components, so
+   * they must not contribute to the hash. */
+  hash = 5381;
+  for(pos = 0; pos < vec->size; ++pos)
+  {
+    if(vec->data[pos].n > 0)
+    {
+      hash = (hash * 33) ^ vec->data[pos].id;
+      hash = (hash * 33) ^ vec->data[pos].n;
+    }
+  }
+
+  return hash;
+}
+
 /**
  * inf_adopted_state_vector_causally_before:
  * @first: A #InfAdoptedStateVector.
@@ -455,8 +496,18 @@ inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
   g_return_val_if_fail(first != NULL, FALSE);
   g_return_val_if_fail(second != NULL, FALSE);
 
-  first_pos = 0;
-  second_pos = 0;
+  /* Fast path for the common case of both vectors having the same
+   * components. */
+  for(first_pos = 0;
+      first_pos < first->size && first_pos < second->size &&
+      first->data[first_pos].id == second->data[first_pos].id;
+      ++first_pos)
+  {
+    if(first->data[first_pos].n > second->data[first_pos].n)
+      return FALSE;
+  }
+
+  second_pos = first_pos;
 
   while(first_pos < first->size)
   {
@@ -619,6 +670,192 @@ inf_adopted_state_vector_causally_before_inc(
   return TRUE;
 }
 
+/**
+ * inf_adopted_state_vector_max:
+ * @vec: A #InfAdoptedStateVector.
+ * @other: Another #InfAdoptedStateVector.
+ *
+ * Sets each component of @vec to the maximum of itself and the
+ * corresponding component of @other. Afterwards, @vec is the least common
+ * successor of its previous value and @other, that is both are causally
+ * before @vec, and there is no other vector with this property which is
+ * causally before @vec.
+ *
+ * This runs in linear time in the number of components, and it does not
+ * allocate memory unless @other contains components that @vec does not.
+ **/
+void
+inf_adopted_state_vector_max(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other)
+{
+  InfAdoptedStateVectorComponent* vec_comp;
+  const InfAdoptedStateVectorComponent* other_comp;
+  InfAdoptedStateVectorComponent comp;
+  gsize common;
+  gsize vec_pos;
+  gsize other_pos;
+  gsize write_pos;
+  gsize extra;
+
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(other != NULL);
+
+  /* Fast path for the common case of both vectors having the same
+   * components. */
+  for(common = 0;
+      common < vec->size && common < other->size &&
+      vec->data[common].id == other->data[common].id;
+      ++common)
+  {
+    vec_comp = vec->data + common;
+    vec_comp->n = MAX(vec_comp->n, other->data[common].n);
+  }
+
+  if(common == other->size)
+    return;
+
+  /* Count the components of other that vec does not have, so that we can
+   * merge them in from the back without moving any entry twice. */
+  extra = 0;
+  vec_pos = common;
+  other_pos = common;
+  while(other_pos < other->size)
+  {
+    other_comp = other->data + other_pos;
+    if(vec_pos == vec->size || other_comp->id < vec->data[vec_pos].id)
+    {
+      if(other_comp->n > 0) ++extra;
+      ++other_pos;
+    }
+    else if(other_comp->id == vec->data[vec_pos].id)
+    {
+      ++vec_pos;
+      ++other_pos;
+    }
+    else
+    {
+      ++vec_pos;
+    }
+  }
+
+  if(vec->max_size < vec->size + extra)
+  {
+    vec->max_size = vec->size + extra;
+    vec->data = g_realloc(vec->data,
+                vec->max_size * sizeof(InfAdoptedStateVectorComponent));
+  }
+
+  vec_pos = vec->size;
+  other_pos = other->size;
+  write_pos = vec->size + extra;
+
+  while(other_pos > common)
+  {
+    other_comp = other->data + other_pos - 1;
+    if(vec_pos > common && vec->data[vec_pos - 1].id > other_comp->id)
+    {
+      vec->data[--write_pos] = vec->data[--vec_pos];
+    }
+    else if(vec_pos > common && vec->data[vec_pos - 1].id == other_comp->id)
+    {
+      comp.id = other_comp->id;
+      comp.n = MAX(vec->data[vec_pos - 1].n, other_comp->n);
+      vec->data[--write_pos] = comp;
+      --vec_pos;
+      --other_pos;
+    }
+    else
+    {
+      if(other_comp->n > 0)
+        vec->data[--write_pos] = *other_comp;
+      --other_pos;
+    }
+  }
+
+  /* The remaining components of vec are already in place */
+  g_assert(write_pos == vec_pos);
+  vec->size += extra;
+}
+
+/**
+ * inf_adopted_state_vector_min:
+ * @vec: A #InfAdoptedStateVector.
+ * @other: Another #InfAdoptedStateVector.
+ *
+ * Sets each component of @vec to the minimum of itself and the
+ * corresponding component of @other. Afterwards, @vec is the least common
+ * predecessor of its previous value and @other, that is @vec is causally
+ * before both, and there is no other vector with this property to which
+ * @vec is causally before.
+ *
+ * This runs in linear time in the number of components and never allocates
+ * memory.
+ **/
+void
+inf_adopted_state_vector_min(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other)
+{
+  InfAdoptedStateVectorComponent* vec_comp;
+  gsize vec_pos;
+  gsize other_pos;
+
+  g_return_if_fail(vec != NULL);
+  g_return_if_fail(other != NULL);
+
+  /* Fast path for the common case of both vectors having the same
+   * components. */
+  for(vec_pos = 0;
+      vec_pos < vec->size && vec_pos < other->size &&
+      vec->data[vec_pos].id == other->data[vec_pos].id;
+      ++vec_pos)
+  {
+    vec_comp = vec->data + vec_pos;
+    vec_comp->n = MIN(vec_comp->n, other->data[vec_pos].n);
+  }
+
+  /* Components that other does not have are implicitly zero there, so they
+   * become zero in vec as well. Components that vec does not have stay
+   * zero. */
+  other_pos = vec_pos;
+  for(; vec_pos < vec->size; ++vec_pos)
+  {
+    vec_comp = vec->data + vec_pos;
+    while(other_pos < other->size && other->data[other_pos].id < vec_comp->id)
+      ++other_pos;
+
+    if(other_pos < other->size && other->data[other_pos].id == vec_comp->id)
+      vec_comp->n = MIN(vec_comp->n, other->data[other_pos].n);
+    else
+      vec_comp->n = 0;
+  }
+}
+
+/**
+ * inf_adopted_state_vector_sum:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Returns the sum of all components of @vec, that is the total number of
+ * operations performed at the state @vec represents. For two vectors for
+ * which inf_adopted_state_vector_causally_before() holds, the difference of
+ * their sums is their inf_adopted_state_vector_vdiff().
+ *
+ * Returns: The sum of all components of @vec.
+ */
+guint
+inf_adopted_state_vector_sum(const InfAdoptedStateVector* vec)
+{
+  gsize n;
+  guint sum;
+
+  g_return_val_if_fail(vec != NULL, 0);
+
+  sum = 0;
+  for(n = 0; n < vec->size; ++ n)
+    sum += vec->data[n].n;
+
+  return sum;
+}
+
 /**
  * inf_adopted_state_vector_vdiff:
  * @first: A #InfAdoptedStateVector.
@@ -635,7 +872,6 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second)
 {
-  gsize n;
   guint first_sum;
   guint second_sum;
 
@@ -644,13 +880,8 @@ inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
     0
   );
 
-  first_sum = 0;
-  second_sum = 0;
-
-  for(n = 0; n < first->size; ++ n)
-    first_sum += first->data[n].n;
-  for(n = 0; n < second->size; ++ n)
-    second_sum += second->data[n].n;
+  first_sum = inf_adopted_state_vector_sum(first);
+  second_sum = inf_adopted_state_vector_sum(second);
 
   g_assert(second_sum >= first_sum);
   return second_sum - first_sum;
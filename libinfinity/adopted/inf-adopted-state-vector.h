@@ -101,6 +101,9 @@ int
 inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
                                  const InfAdoptedStateVector* second);
 
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec);
+
 gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second);
@@ -111,6 +114,17 @@ inf_adopted_state_vector_causally_before_inc(
   const InfAdoptedStateVector* second,
   guint inc_component);
 
+void
+inf_adopted_state_vector_max(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other);
+
+void
+inf_adopted_state_vector_min(InfAdoptedStateVector* vec,
+                             const InfAdoptedStateVector* other);
+
+guint
+inf_adopted_state_vector_sum(const InfAdoptedStateVector* vec);
+
 guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second);
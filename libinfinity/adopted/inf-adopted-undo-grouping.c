@@ -239,6 +239,7 @@ inf_adopted_undo_grouping_cleanup(InfAdoptedUndoGrouping* grouping)
   InfAdoptedUndoGroupingPrivate* priv;
   InfAdoptedUndoGroupingItem* item;
   guint max_total_log_size;
+  guint current_sum;
   guint vdiff;
   guint i;
 
@@ -253,14 +254,15 @@ inf_adopted_undo_grouping_cleanup(InfAdoptedUndoGrouping* grouping)
 
   if(max_total_log_size != G_MAXUINT)
   {
+    current_sum =
+      inf_adopted_state_vector_sum(inf_adopted_user_get_vector(priv->user));
+
     while(priv->n_items > 0)
     {
       item = &priv->items[priv->first_item];
 
-      vdiff = inf_adopted_state_vector_vdiff(
-        inf_adopted_request_get_vector(item->request),
-        inf_adopted_user_get_vector(priv->user)
-      );
+      /* The user's requests are all causally before the user's vector */
+      vdiff = current_sum - inf_adopted_request_get_vector_sum(item->request);
 
       if(vdiff + priv->item_pos > max_total_log_size)
       {
@@ -808,11 +810,10 @@ inf_adopted_undo_grouping_get_undo_size(InfAdoptedUndoGrouping* grouping)
   InfAdoptedUndoGroupingPrivate* priv;
   guint max_total_log_size;
   InfAdoptedRequestLog* log;
-  InfAdoptedStateVector* current;
+  guint current_sum;
   guint pos;
   guint index;
   InfAdoptedRequest* lower_related;
-  InfAdoptedStateVector* vector;
   guint vdiff;
 
   g_return_val_if_fail(INF_ADOPTED_IS_UNDO_GROUPING(grouping), 0);
@@ -828,7 +829,8 @@ inf_adopted_undo_grouping_get_undo_size(InfAdoptedUndoGrouping* grouping)
   );
 
   log = inf_adopted_user_get_request_log(priv->user);
-  current = inf_adopted_user_get_vector(priv->user);
+  current_sum =
+    inf_adopted_state_vector_sum(inf_adopted_user_get_vector(priv->user));
 
   pos = priv->item_pos;
   do
@@ -837,8 +839,7 @@ inf_adopted_undo_grouping_get_undo_size(InfAdoptedUndoGrouping* grouping)
 
     index = inf_adopted_request_get_index(priv->items[pos-1].request);
     lower_related = inf_adopted_request_log_lower_related(log, index);
-    vector = inf_adopted_request_get_vector(lower_related);
-    vdiff = inf_adopted_state_vector_vdiff(vector, current);
+    vdiff = current_sum - inf_adopted_request_get_vector_sum(lower_related);
 
     if(vdiff + priv->item_pos - pos >= max_total_log_size)
       return priv->item_pos - pos;
@@ -865,11 +866,10 @@ inf_adopted_undo_grouping_get_redo_size(InfAdoptedUndoGrouping* grouping)
   InfAdoptedUndoGroupingPrivate* priv;
   guint max_total_log_size;
   InfAdoptedRequestLog* log;
-  InfAdoptedStateVector* current;
+  guint current_sum;
   guint pos;
   guint index;
   InfAdoptedRequest* lower_related;
-  InfAdoptedStateVector* vector;
   guint vdiff;
 
   g_return_val_if_fail(INF_ADOPTED_IS_UNDO_GROUPING(grouping), 0);
@@ -885,7 +885,8 @@ inf_adopted_undo_grouping_get_redo_size(InfAdoptedUndoGrouping* grouping)
   );
 
   log = inf_adopted_user_get_request_log(priv->user);
-  current = inf_adopted_user_get_vector(priv->user);
+  current_sum =
+    inf_adopted_state_vector_sum(inf_adopted_user_get_vector(priv->user));
 
   pos = priv->item_pos;
   do
@@ -894,8 +895,7 @@ inf_adopted_undo_grouping_get_redo_size(InfAdoptedUndoGrouping* grouping)
 
     index = inf_adopted_request_get_index(priv->items[pos].request);
     lower_related = inf_adopted_request_log_lower_related(log, index);
-    vector = inf_adopted_request_get_vector(lower_related);
-    vdiff = inf_adopted_state_vector_vdiff(vector, current);
+    vdiff = current_sum - inf_adopted_request_get_vector_sum(lower_related);
 
     if(vdiff + pos - priv->item_pos >= max_total_log_size)
       return pos - priv->item_pos;
@@ -107,6 +107,11 @@ struct _InfcBrowserNode {
   InfAclSheetSet* acl;
   gboolean acl_queried;
 
+  /* Collation key of the case-folded name, and position in the parent's
+   * sorted child sequence. Both are NULL for the root node. */
+  gchar* name_key;
+  GSequenceIter* sorted_iter;
+
   /*InfcBrowserNodeStatus status;*/
 
   union {
@@ -122,6 +127,11 @@ struct _InfcBrowserNode {
     struct {
       /* First child node */
       InfcBrowserNode* child;
+      /* Children by name key, and children sorted by name. Both are created
+       * when the first child is linked, and the child list above follows
+       * the order of the sequence. */
+      GHashTable* names;
+      GSequence* sorted;
       /* Whether we requested the node already from the server.
        * This is required because the child field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
@@ -220,6 +230,8 @@ struct _InfcBrowserPrivate {
   GSList* subscription_requests;
 
   InfcSessionProxy* chat_session;
+
+  guint explore_page_size;
 };
 
 #define INFC_BROWSER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFC_TYPE_BROWSER, InfcBrowserPrivate))
@@ -230,6 +242,7 @@ enum {
   PROP_IO,
   PROP_COMMUNICATION_MANAGER,
   PROP_CONNECTION,
+  PROP_EXPLORE_PAGE_SIZE,
 
   /* read only */
   PROP_STATUS,
@@ -459,33 +472,119 @@ infc_browser_node_get_path(InfcBrowserNode* node,
  * Tree handling
  */
 
+/* Names are compared the same way as the server does when checking
+ * whether a name is available: two names are equal if their keys are. */
+static gchar*
+infc_browser_node_make_name_key(const gchar* name)
+{
+  gchar* folded;
+  gchar* key;
+
+  folded = g_utf8_casefold(name, -1);
+  key = g_utf8_collate_key(folded, -1);
+  g_free(folded);
+
+  return key;
+}
+
+static gint
+infc_browser_node_compare(gconstpointer first,
+                          gconstpointer second,
+                          gpointer user_data)
+{
+  const InfcBrowserNode* node1;
+  const InfcBrowserNode* node2;
+  int result;
+
+  node1 = (const InfcBrowserNode*)first;
+  node2 = (const InfcBrowserNode*)second;
+
+  result = strcmp(node1->name_key, node2->name_key);
+  if(result != 0) return result;
+
+  /* The server might have read names which differ only in case from its
+   * storage. Still keep a deterministic order. */
+  result = strcmp(node1->name, node2->name);
+  if(result != 0) return result;
+
+  if(node1->id < node2->id) return -1;
+  if(node1->id > node2->id) return 1;
+  return 0;
+}
+
 static void
 infc_browser_node_link(InfcBrowserNode* node,
                        InfcBrowserNode* parent)
 {
+  GSequenceIter* iter;
+
   g_assert(parent != NULL);
   g_assert(parent->type == INFC_BROWSER_NODE_SUBDIRECTORY);
 
-  node->prev = NULL;
-  if(parent->shared.subdir.child != NULL)
+  if(parent->shared.subdir.names == NULL)
   {
-    parent->shared.subdir.child->prev = node;
-    node->next = parent->shared.subdir.child;
+    g_assert(parent->shared.subdir.sorted == NULL);
+
+    parent->shared.subdir.names = g_hash_table_new(g_str_hash, g_str_equal);
+    parent->shared.subdir.sorted = g_sequence_new(NULL);
   }
+
+  if(g_hash_table_lookup(parent->shared.subdir.names, node->name_key) == NULL)
+    g_hash_table_insert(parent->shared.subdir.names, node->name_key, node);
+
+  node->sorted_iter = g_sequence_insert_sorted(
+    parent->shared.subdir.sorted,
+    node,
+    infc_browser_node_compare,
+    NULL
+  );
+
+  iter = g_sequence_iter_prev(node->sorted_iter);
+  if(iter != node->sorted_iter)
+    node->prev = (InfcBrowserNode*)g_sequence_get(iter);
+  else
+    node->prev = NULL;
+
+  iter = g_sequence_iter_next(node->sorted_iter);
+  if(!g_sequence_iter_is_end(iter))
+    node->next = (InfcBrowserNode*)g_sequence_get(iter);
   else
-  {
     node->next = NULL;
-  }
 
-  parent->shared.subdir.child = node;
+  if(node->prev != NULL)
+    node->prev->next = node;
+  else
+    parent->shared.subdir.child = node;
+
+  if(node->next != NULL)
+    node->next->prev = node;
 }
 
 static void
 infc_browser_node_unlink(InfcBrowserNode* node)
 {
+  GHashTable* names;
+
   g_assert(node->parent != NULL);
   g_assert(node->parent->type == INFC_BROWSER_NODE_SUBDIRECTORY);
 
+  names = node->parent->shared.subdir.names;
+  if(g_hash_table_lookup(names, node->name_key) == node)
+  {
+    g_hash_table_remove(names, node->name_key);
+
+    /* Nodes with equal names are adjacent in the sorted order, so index
+     * one of them instead, if any. */
+    if(node->prev != NULL && strcmp(node->prev->name_key, node->name_key) == 0)
+      g_hash_table_insert(names, node->prev->name_key, node->prev);
+    else if(node->next != NULL &&
+            strcmp(node->next->name_key, node->name_key) == 0)
+      g_hash_table_insert(names, node->next->name_key, node->next);
+  }
+
+  g_sequence_remove(node->sorted_iter);
+  node->sorted_iter = NULL;
+
   if(node->prev != NULL)
     node->prev->next = node->next;
   else
@@ -514,6 +613,11 @@ infc_browser_node_new_common(InfcBrowser* browser,
   node->id = id;
   node->name = g_strdup(name);
   node->type = type;
+  node->sorted_iter = NULL;
+  if(parent != NULL)
+    node->name_key = infc_browser_node_make_name_key(name);
+  else
+    node->name_key = NULL;
   if(sheet_set != NULL)
     node->acl = inf_acl_sheet_set_copy(sheet_set);
   else
@@ -559,6 +663,8 @@ infc_browser_node_new_subdirectory(InfcBrowser* browser,
 
   node->shared.subdir.explored = FALSE;
   node->shared.subdir.child = NULL;
+  node->shared.subdir.names = NULL;
+  node->shared.subdir.sorted = NULL;
 
   return node;
 }
@@ -735,6 +841,12 @@ infc_browser_node_free(InfcBrowser* browser,
     while(node->shared.subdir.child != NULL)
       infc_browser_node_free(browser, node->shared.subdir.child);
 
+    if(node->shared.subdir.names != NULL)
+    {
+      g_hash_table_destroy(node->shared.subdir.names);
+      g_sequence_free(node->shared.subdir.sorted);
+    }
+
     break;
   case INFC_BROWSER_NODE_NOTE_KNOWN:
     /* Is first unlinked with remove_child_sessions */
@@ -868,6 +980,7 @@ infc_browser_node_free(InfcBrowser* browser,
   removed = g_hash_table_remove(priv->nodes, GUINT_TO_POINTER(node->id));
   g_assert(removed == TRUE);
 
+  g_free(node->name_key);
   g_free(node->name);
   g_slice_free(InfcBrowserNode, node);
 }
@@ -1672,6 +1785,8 @@ infc_browser_init(InfcBrowser* browser)
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
   priv->chat_session = NULL;
+
+  priv->explore_page_size = 0;
 }
 
 static void
@@ -1866,6 +1981,9 @@ infc_browser_set_property(GObject* object,
       }
     }
 
+    break;
+  case PROP_EXPLORE_PAGE_SIZE:
+    priv->explore_page_size = g_value_get_uint(value);
     break;
   case PROP_STATUS:
   case PROP_CHAT_SESSION:
@@ -1899,6 +2017,9 @@ infc_browser_get_property(GObject* object,
   case PROP_CONNECTION:
     g_value_set_object(value, G_OBJECT(priv->connection));
     break;
+  case PROP_EXPLORE_PAGE_SIZE:
+    g_value_set_uint(value, priv->explore_page_size);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, priv->status);
     break;
@@ -3047,6 +3168,9 @@ infc_browser_handle_explore_end(InfcBrowser* browser,
   InfcRequest* request;
   guint current;
   guint total;
+  guint skipped;
+  gboolean has_skipped;
+  GError* local_error;
   InfBrowserIter iter;
 
   priv = INFC_BROWSER_PRIVATE(browser);
@@ -3062,8 +3186,27 @@ infc_browser_handle_explore_end(InfcBrowser* browser,
   if(request == NULL) return FALSE;
   g_assert(INFC_IS_PROGRESS_REQUEST(request));
 
+  /* When exploring page by page, children which are removed before their
+   * page is sent are left out. */
+  local_error = NULL;
+  has_skipped = inf_xml_util_get_attribute_uint(
+    xml,
+    "skipped",
+    &skipped,
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  if(!has_skipped)
+    skipped = 0;
+
   g_object_get(G_OBJECT(request), "current", &current, "total", &total, NULL);
-  if(current < total)
+  if(skipped > total || current < total - skipped)
   {
     g_set_error_literal(
       error,
@@ -5766,6 +5909,15 @@ infc_browser_browser_explore(InfBrowser* browser,
   xml = infc_browser_request_to_xml(request);
   inf_xml_util_set_attribute_uint(xml, "id", node->id);
 
+  if(priv->explore_page_size > 0)
+  {
+    inf_xml_util_set_attribute_uint(
+      xml,
+      "page-size",
+      priv->explore_page_size
+    );
+  }
+
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
     priv->connection,
@@ -6860,6 +7012,21 @@ infc_browser_class_init(InfcBrowserClass* browser_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_EXPLORE_PAGE_SIZE,
+    g_param_spec_uint(
+      "explore-page-size",
+      "Explore page size",
+      "The number of children the server sends at a time when exploring a "
+      "node, or 0 to receive all children at once",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CHAT_SESSION,
@@ -7240,6 +7407,147 @@ infc_browser_iter_is_valid(InfcBrowser* browser,
   return node != NULL && node == iter->node;
 }
 
+/**
+ * infc_browser_iter_get_child_by_name:
+ * @browser: A #InfcBrowser.
+ * @iter: (inout): A #InfBrowserIter pointing to a subdirectory node in
+ * @browser.
+ * @name: The name of the child node to look up.
+ *
+ * Sets @iter to point to the child of the subdirectory node it currently
+ * points to whose name is @name. Names are compared case-insensitively,
+ * like the server does when checking whether a new node's name is
+ * available. If no such child has been received from the server, @iter is
+ * left untouched and the function returns %FALSE.
+ *
+ * Returns: %TRUE if @iter was moved or %FALSE otherwise.
+ */
+gboolean
+infc_browser_iter_get_child_by_name(InfcBrowser* browser,
+                                    InfBrowserIter* iter,
+                                    const gchar* name)
+{
+  InfcBrowserNode* node;
+  InfcBrowserNode* child;
+  gchar* key;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), FALSE);
+  infc_browser_return_val_if_iter_fail(browser, iter, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+
+  node = (InfcBrowserNode*)iter->node;
+  infc_browser_return_val_if_subdir_fail(node, FALSE);
+
+  if(node->shared.subdir.names == NULL)
+    return FALSE;
+
+  key = infc_browser_node_make_name_key(name);
+  child = g_hash_table_lookup(node->shared.subdir.names, key);
+  g_free(key);
+
+  if(child == NULL) return FALSE;
+
+  iter->node_id = child->id;
+  iter->node = child;
+  return TRUE;
+}
+
+/**
+ * infc_browser_iter_get_partially_explored:
+ * @browser: A #InfcBrowser.
+ * @iter: A #InfBrowserIter pointing to a subdirectory node in @browser.
+ *
+ * Returns whether the node @iter points to is being explored and some, but
+ * possibly not all, of its children have been received. The children
+ * received so far can already be accessed with inf_browser_get_child().
+ * If #InfcBrowser:explore-page-size is set, the server only sends that many
+ * children at a time, and infc_browser_iter_explore_continue() asks for
+ * more.
+ *
+ * Returns: Whether the node @iter points to is partially explored.
+ */
+gboolean
+infc_browser_iter_get_partially_explored(InfcBrowser* browser,
+                                         const InfBrowserIter* iter)
+{
+  InfcBrowserNode* node;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), FALSE);
+  infc_browser_return_val_if_iter_fail(browser, iter, FALSE);
+
+  node = (InfcBrowserNode*)iter->node;
+  infc_browser_return_val_if_subdir_fail(node, FALSE);
+
+  if(node->shared.subdir.explored == FALSE)
+    return FALSE;
+
+  return inf_browser_get_pending_request(
+    INF_BROWSER(browser),
+    iter,
+    "explore-node"
+  ) != NULL;
+}
+
+/**
+ * infc_browser_iter_explore_continue:
+ * @browser: A #InfcBrowser.
+ * @iter: A #InfBrowserIter pointing to a partially explored subdirectory
+ * node in @browser.
+ *
+ * Asks the server for the next page of children of the node @iter points
+ * to, see infc_browser_iter_get_partially_explored(). Each call asks for
+ * one more page of #InfcBrowser:explore-page-size children, so this can be
+ * called again before the previous page has arrived.
+ *
+ * No new request is made. Instead, the request that started the
+ * exploration is returned, which makes progress as children arrive and
+ * finishes when the last page has been received.
+ *
+ * Returns: (transfer none): The pending explore request for the node.
+ */
+InfRequest*
+infc_browser_iter_explore_continue(InfcBrowser* browser,
+                                   const InfBrowserIter* iter)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  InfRequest* request;
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
+  infc_browser_return_val_if_iter_fail(browser, iter, NULL);
+
+  node = (InfcBrowserNode*)iter->node;
+  infc_browser_return_val_if_subdir_fail(node, NULL);
+  g_return_val_if_fail(node->shared.subdir.explored == TRUE, NULL);
+
+  request = inf_browser_get_pending_request(
+    INF_BROWSER(browser),
+    iter,
+    "explore-node"
+  );
+
+  g_return_val_if_fail(request != NULL, NULL);
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  g_return_val_if_fail(priv->connection != NULL, NULL);
+  g_return_val_if_fail(priv->status == INF_BROWSER_OPEN, NULL);
+
+  /* Same seq as the explore request, so that the server's answer, or an
+   * error, is attributed to it. */
+  xml = infc_browser_request_to_xml(INFC_REQUEST(request));
+  xmlNodeSetName(xml, (const xmlChar*)"explore-continue");
+  inf_xml_util_set_attribute_uint(xml, "id", node->id);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    priv->connection,
+    xml
+  );
+
+  return request;
+}
+
 /**
  * infc_browser_subscribe_chat:
  * @browser: A #InfcBrowser.
@@ -103,6 +103,19 @@ gboolean
 infc_browser_iter_is_valid(InfcBrowser* browser,
                            const InfBrowserIter* iter);
 
+gboolean
+infc_browser_iter_get_child_by_name(InfcBrowser* browser,
+                                    InfBrowserIter* iter,
+                                    const gchar* name);
+
+gboolean
+infc_browser_iter_get_partially_explored(InfcBrowser* browser,
+                                         const InfBrowserIter* iter);
+
+InfRequest*
+infc_browser_iter_explore_continue(InfcBrowser* browser,
+                                   const InfBrowserIter* iter);
+
 InfRequest*
 infc_browser_subscribe_chat(InfcBrowser* browser,
                             InfRequestFunc func,
@@ -27,25 +27,58 @@
  * #InfAsyncOperation is a simple mechanism to run some code in a separate
  * worker thread and then, once the result is computed, notify the main thread
  * about the result.
+ *
+ * All asynchronous operations share a single pool of worker threads. The
+ * number of threads in the pool, and the number of operations that can be
+ * waiting for a free worker thread, are limited, and can be configured with
+ * inf_async_operation_set_max_threads() and
+ * inf_async_operation_set_max_queued().
  **/
 
 #include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/inf-i18n.h>
 
+#define INF_ASYNC_OPERATION_DEFAULT_MAX_THREADS 8
+#define INF_ASYNC_OPERATION_DEFAULT_MAX_QUEUED 1024
+
 struct _InfAsyncOperation {
   InfIo* io;
   InfIoDispatch* dispatch;
-  GThread* thread;
+  gboolean started;
   GMutex mutex;
 
   InfAsyncOperationRunFunc run_func;
   InfAsyncOperationDoneFunc done_func;
   gpointer user_data;
+  GDestroyNotify notify;
 
   gpointer run_data;
   GDestroyNotify run_notify;
 };
 
+/* The pool is created on first use, and all of these are protected by
+ * inf_async_operation_pool_mutex. Operations waiting for a worker thread
+ * are kept in inf_async_operation_queue, and the pool is only given a
+ * token for each of them. Each token makes a worker thread run the first
+ * operation in the queue. This allows an operation to be taken out of the
+ * queue again if the pool fails to start a worker thread for it. */
+static GMutex inf_async_operation_pool_mutex;
+static GThreadPool* inf_async_operation_pool;
+static GQueue inf_async_operation_queue = G_QUEUE_INIT;
+static guint inf_async_operation_max_threads =
+  INF_ASYNC_OPERATION_DEFAULT_MAX_THREADS;
+static guint inf_async_operation_max_queued =
+  INF_ASYNC_OPERATION_DEFAULT_MAX_QUEUED;
+
+static void
+inf_async_operation_destroy(InfAsyncOperation* op)
+{
+  if(op->notify != NULL)
+    op->notify(op->user_data);
+
+  g_slice_free(InfAsyncOperation, op);
+}
+
 static void
 inf_async_operation_dispatch(gpointer data)
 {
@@ -64,17 +97,40 @@ inf_async_operation_dispatch(gpointer data)
 
   op->run_data = NULL;
   op->run_notify = NULL;
-  op->thread = NULL;
+  op->started = FALSE;
   g_mutex_clear(&op->mutex);
 
   inf_async_operation_free(op);
 }
 
-static gpointer
-inf_async_operation_thread_start(gpointer data)
+static void
+inf_async_operation_thread_func(gpointer data,
+                                gpointer user_data)
 {
   InfAsyncOperation* op;
-  op = (InfAsyncOperation*)data;
+
+  g_mutex_lock(&inf_async_operation_pool_mutex);
+  op = g_queue_pop_head(&inf_async_operation_queue);
+  g_mutex_unlock(&inf_async_operation_pool_mutex);
+
+  /* The operation of this token has been taken out of the queue again
+   * because no worker thread could be created for it, and another worker
+   * thread has run the remaining operations already. */
+  if(op == NULL)
+    return;
+
+  /* If the operation was cancelled while it was still waiting for a worker
+   * thread, then do not run it at all. */
+  g_mutex_lock(&op->mutex);
+  if(op->io == NULL)
+  {
+    g_mutex_unlock(&op->mutex);
+    g_mutex_clear(&op->mutex);
+    inf_async_operation_destroy(op);
+    return;
+  }
+
+  g_mutex_unlock(&op->mutex);
 
   op->run_func(&op->run_data, &op->run_notify, op->user_data);
 
@@ -99,11 +155,26 @@ inf_async_operation_thread_start(gpointer data)
 
     g_mutex_unlock(&op->mutex);
     g_mutex_clear(&op->mutex);
-    g_thread_unref(op->thread);
-    g_slice_free(InfAsyncOperation, op);
+    inf_async_operation_destroy(op);
   }
+}
 
-  return NULL;
+static GThreadPool*
+inf_async_operation_get_pool(GError** error)
+{
+  if(inf_async_operation_pool == NULL)
+  {
+    inf_async_operation_pool = g_thread_pool_new(
+      inf_async_operation_thread_func,
+      NULL,
+      inf_async_operation_max_threads > 0 ?
+        (gint)inf_async_operation_max_threads : -1,
+      FALSE,
+      error
+    );
+  }
+
+  return inf_async_operation_pool;
 }
 
 static void
@@ -158,22 +229,59 @@ inf_async_operation_new(InfIo* io,
                         InfAsyncOperationRunFunc run_func,
                         InfAsyncOperationDoneFunc done_func,
                         gpointer user_data)
+{
+  return inf_async_operation_new_full(
+    io,
+    run_func,
+    done_func,
+    user_data,
+    NULL
+  );
+}
+
+/**
+ * inf_async_operation_new_full:
+ * @io: The #InfIo object used to pass back the result of the operation.
+ * @run_func: (scope notified) (allow-none): A function to run asynchronously
+ * in a worker thread, computing the result of the operation, or %NULL if the
+ * operation is going to be completed with inf_async_operation_complete().
+ * @done_func: (scope notified): A function to be called in the thread of @io
+ * once the result is available.
+ * @user_data: Additional user data to pass to both functions.
+ * @notify: Function called to free @user_data, or %NULL.
+ *
+ * Creates a new #InfAsyncOperation like inf_async_operation_new(), but
+ * additionally calls @notify on @user_data when the operation is freed. This
+ * happens after @done_func has been called, or when the operation is
+ * cancelled. Note that in the latter case @notify may be called from the
+ * worker thread, if the operation is cancelled while @run_func is still
+ * running, or before it has started running.
+ *
+ * Returns: (transfer full): A new #InfAsyncOperation. Free with
+ * inf_async_operation_free() to cancel the operation.
+ */
+InfAsyncOperation*
+inf_async_operation_new_full(InfIo* io,
+                             InfAsyncOperationRunFunc run_func,
+                             InfAsyncOperationDoneFunc done_func,
+                             gpointer user_data,
+                             GDestroyNotify notify)
 {
   InfAsyncOperation* op;
 
   g_return_val_if_fail(INF_IS_IO(io), NULL);
-  g_return_val_if_fail(run_func != NULL, NULL);
   g_return_val_if_fail(done_func != NULL, NULL);
 
   op = g_slice_new(InfAsyncOperation);
 
   op->io = io;
   op->dispatch = NULL;
-  op->thread = NULL;
+  op->started = FALSE;
 
   op->run_func = run_func;
   op->done_func = done_func;
   op->user_data = user_data;
+  op->notify = notify;
 
   op->run_data = NULL;
   op->run_notify = NULL;
@@ -197,37 +305,123 @@ inf_async_operation_new(InfIo* io,
  * @error is set and %FALSE is returned. In that case, the operation must not
  * be used anymore since it will be automatically freed.
  *
+ * The operation is queued in the shared worker thread pool, and is run as
+ * soon as a worker thread becomes available. If the maximum number of
+ * operations waiting for a worker thread has been reached already, the
+ * function fails with %G_THREAD_ERROR_AGAIN.
+ *
  * Returns: %TRUE on success or %FALSE if the operation could not be started.
  */
 gboolean
 inf_async_operation_start(InfAsyncOperation* op,
                           GError** error)
 {
+  GThreadPool* pool;
+  gboolean result;
+
   g_return_val_if_fail(op != NULL, FALSE);
-  g_return_val_if_fail(op->thread == NULL, FALSE);
+  g_return_val_if_fail(op->run_func != NULL, FALSE);
+  g_return_val_if_fail(op->started == FALSE, FALSE);
+
+  g_mutex_lock(&inf_async_operation_pool_mutex);
+
+  pool = inf_async_operation_get_pool(error);
+  if(pool == NULL)
+  {
+    g_mutex_unlock(&inf_async_operation_pool_mutex);
+    inf_async_operation_free(op);
+    return FALSE;
+  }
+
+  if(inf_async_operation_max_queued > 0 &&
+     g_queue_get_length(&inf_async_operation_queue) >=
+       inf_async_operation_max_queued)
+  {
+    g_mutex_unlock(&inf_async_operation_pool_mutex);
+
+    g_set_error_literal(
+      error,
+      G_THREAD_ERROR,
+      G_THREAD_ERROR_AGAIN,
+      _("Too many asynchronous operations are waiting to be run")
+    );
+
+    inf_async_operation_free(op);
+    return FALSE;
+  }
 
   g_mutex_init(&op->mutex);
   g_mutex_lock(&op->mutex);
+  op->started = TRUE;
 
-  op->thread = g_thread_try_new(
-    "InfAsyncOperation",
-    inf_async_operation_thread_start,
-    op,
-    error
-  );
+  /* Any non-NULL pointer serves as a token */
+  g_queue_push_tail(&inf_async_operation_queue, op);
+  result = g_thread_pool_push(pool, &inf_async_operation_queue, error);
 
-  if(op->thread == NULL)
+  if(result == FALSE)
   {
+    /* The token has been queued nevertheless, but no new worker thread
+     * could be created for it. Since the pool mutex has been held all the
+     * time, no worker thread can have taken the operation yet, so take it
+     * out of the queue and free it here. If a worker thread picks up the
+     * token later, it runs the next queued operation, if any. */
+    g_queue_remove(&inf_async_operation_queue, op);
+    g_mutex_unlock(&inf_async_operation_pool_mutex);
+
+    op->started = FALSE;
     g_mutex_unlock(&op->mutex);
     g_mutex_clear(&op->mutex);
+
     inf_async_operation_free(op);
     return FALSE;
   }
 
+  g_mutex_unlock(&inf_async_operation_pool_mutex);
   g_mutex_unlock(&op->mutex);
   return TRUE;
 }
 
+/**
+ * inf_async_operation_complete:
+ * @op: (transfer full): A #InfAsyncOperation which has not been started.
+ * @run_data: The result of the operation.
+ * @run_notify: Function to be used to free @run_data, or %NULL.
+ *
+ * Completes @op without running its run function in a worker thread, as if
+ * the run function had produced @run_data. The done function of @op is
+ * called from the thread of the operation's #InfIo, as usual, and not from
+ * within this function. This is useful when the result is computed without
+ * a worker thread, or by a different asynchronous operation, but it still
+ * needs to be reported through an #InfAsyncOperation.
+ *
+ * This function can be called from any thread. After it has been called,
+ * the operation can still be cancelled with inf_async_operation_free() until
+ * its done function has run, and it is freed automatically afterwards.
+ */
+void
+inf_async_operation_complete(InfAsyncOperation* op,
+                             gpointer run_data,
+                             GDestroyNotify run_notify)
+{
+  g_return_if_fail(op != NULL);
+  g_return_if_fail(op->started == FALSE);
+
+  g_mutex_init(&op->mutex);
+  g_mutex_lock(&op->mutex);
+  op->started = TRUE;
+  op->run_data = run_data;
+  op->run_notify = run_notify;
+
+  op->dispatch = inf_io_add_dispatch(
+    op->io,
+    inf_async_operation_dispatch,
+    op,
+    NULL
+  );
+
+  g_mutex_unlock(&op->mutex);
+}
+
 /**
  * inf_async_operation_free:
  * @op: A #InfAsyncOperation.
@@ -242,7 +436,7 @@ inf_async_operation_free(InfAsyncOperation* op)
 {
   g_return_if_fail(op != NULL);
 
-  if(op->thread == NULL)
+  if(op->started == FALSE)
   {
     /* The async operation has not started yet,
      * or it has finished (dispatched) already. */
@@ -254,7 +448,7 @@ inf_async_operation_free(InfAsyncOperation* op)
       op
     );
 
-    g_slice_free(InfAsyncOperation, op);
+    inf_async_operation_destroy(op);
   }
   else
   {
@@ -263,11 +457,12 @@ inf_async_operation_free(InfAsyncOperation* op)
 
     if(op->dispatch == NULL)
     {
-      /* We have not dispatched yet, i.e. the worker thread is still running.
-       * We keep the object alive, but remove the IO object, so that the
-       * worker thread does not attempt to dispatch. This also allows to
-       * unreference the IO object from this point onwards. The operation
-       * object is deleted when the thread finishes. */
+      /* We have not dispatched yet, i.e. the operation is still waiting for
+       * a worker thread, or the worker thread is still running. We keep the
+       * object alive, but remove the IO object, so that the worker thread
+       * does not attempt to run the operation or to dispatch. This also
+       * allows to unreference the IO object from this point onwards. The
+       * operation object is deleted when the thread is done with it. */
       g_object_weak_unref(
         G_OBJECT(op->io),
         inf_async_operation_io_unref_func,
@@ -283,14 +478,104 @@ inf_async_operation_free(InfAsyncOperation* op)
        * the main thread has not yet executed the dispatch function. We
        * cancel the dispatch and delete the operation object. */
       inf_io_remove_dispatch(op->io, op->dispatch);
+
+      g_object_weak_unref(
+        G_OBJECT(op->io),
+        inf_async_operation_io_unref_func,
+        op
+      );
+
       if(op->run_notify != NULL) op->run_notify(op->run_data);
 
       g_mutex_unlock(&op->mutex);
       g_mutex_clear(&op->mutex);
-      g_thread_unref(op->thread);
-      g_slice_free(InfAsyncOperation, op);
+      inf_async_operation_destroy(op);
     }
   }
 }
 
+/**
+ * inf_async_operation_set_max_threads:
+ * @max_threads: The maximum number of worker threads, or 0 for no limit.
+ *
+ * Sets the maximum number of worker threads that run asynchronous operations
+ * at the same time. Operations that are started while all worker threads are
+ * busy wait until one of them becomes available. The default is 8.
+ */
+void
+inf_async_operation_set_max_threads(guint max_threads)
+{
+  g_mutex_lock(&inf_async_operation_pool_mutex);
+
+  inf_async_operation_max_threads = max_threads;
+  if(inf_async_operation_pool != NULL)
+  {
+    g_thread_pool_set_max_threads(
+      inf_async_operation_pool,
+      max_threads > 0 ? (gint)max_threads : -1,
+      NULL
+    );
+  }
+
+  g_mutex_unlock(&inf_async_operation_pool_mutex);
+}
+
+/**
+ * inf_async_operation_get_max_threads:
+ *
+ * Returns the maximum number of worker threads that run asynchronous
+ * operations, as set with inf_async_operation_set_max_threads().
+ *
+ * Returns: The maximum number of worker threads, or 0 if there is no limit.
+ */
+guint
+inf_async_operation_get_max_threads(void)
+{
+  guint max_threads;
+
+  g_mutex_lock(&inf_async_operation_pool_mutex);
+  max_threads = inf_async_operation_max_threads;
+  g_mutex_unlock(&inf_async_operation_pool_mutex);
+
+  return max_threads;
+}
+
+/**
+ * inf_async_operation_set_max_queued:
+ * @max_queued: The maximum number of waiting operations, or 0 for no limit.
+ *
+ * Sets the maximum number of asynchronous operations that can be waiting for
+ * a free worker thread. If this number is reached, inf_async_operation_start()
+ * fails until some of the waiting operations have been run. The default
+ * is 1024.
+ */
+void
+inf_async_operation_set_max_queued(guint max_queued)
+{
+  g_mutex_lock(&inf_async_operation_pool_mutex);
+  inf_async_operation_max_queued = max_queued;
+  g_mutex_unlock(&inf_async_operation_pool_mutex);
+}
+
+/**
+ * inf_async_operation_get_max_queued:
+ *
+ * Returns the maximum number of asynchronous operations that can be waiting
+ * for a free worker thread, as set with inf_async_operation_set_max_queued().
+ *
+ * Returns: The maximum number of waiting operations, or 0 if there is no
+ * limit.
+ */
+guint
+inf_async_operation_get_max_queued(void)
+{
+  guint max_queued;
+
+  g_mutex_lock(&inf_async_operation_pool_mutex);
+  max_queued = inf_async_operation_max_queued;
+  g_mutex_unlock(&inf_async_operation_pool_mutex);
+
+  return max_queued;
+}
+
 /* vim:set et sw=2 ts=2: */
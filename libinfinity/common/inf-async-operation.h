@@ -66,13 +66,37 @@ inf_async_operation_new(InfIo* io,
                         InfAsyncOperationDoneFunc done_func,
                         gpointer user_data);
 
+InfAsyncOperation*
+inf_async_operation_new_full(InfIo* io,
+                             InfAsyncOperationRunFunc run_func,
+                             InfAsyncOperationDoneFunc done_func,
+                             gpointer user_data,
+                             GDestroyNotify notify);
+
 gboolean
 inf_async_operation_start(InfAsyncOperation* op,
                           GError** error);
 
+void
+inf_async_operation_complete(InfAsyncOperation* op,
+                             gpointer run_data,
+                             GDestroyNotify run_notify);
+
 void
 inf_async_operation_free(InfAsyncOperation* op);
 
+void
+inf_async_operation_set_max_threads(guint max_threads);
+
+guint
+inf_async_operation_get_max_threads(void);
+
+void
+inf_async_operation_set_max_queued(guint max_queued);
+
+guint
+inf_async_operation_get_max_queued(void);
+
 G_END_DECLS
 
 #endif /* __INF_ASYNC_OPERATION_H__ */
@@ -580,6 +580,9 @@ inf_chat_session_add_message_cb(InfChatBuffer* buffer,
                                 const InfChatBufferMessage* message,
                                 gpointer user_data)
 {
+  /* The message is part of the synchronization from now on */
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+
   /* Ignore these messages, we cannot send them */
   if(message->type != INF_CHAT_BUFFER_MESSAGE_USERJOIN &&
      message->type != INF_CHAT_BUFFER_MESSAGE_USERPART)
@@ -784,20 +787,25 @@ inf_chat_session_get_property(GObject* object,
  */
 
 static void
-inf_chat_session_to_xml_sync(InfSession* session,
-                             xmlNodePtr parent)
+inf_chat_session_to_xml_sync_stream(InfSession* session,
+                                    InfSessionSyncStream* stream)
 {
   InfChatBuffer* buffer;
   InfSessionClass* parent_class;
   const InfChatBufferMessage* message;
+  xmlNodePtr container;
   xmlNodePtr child;
   guint i;
 
   buffer = INF_CHAT_BUFFER(inf_session_get_buffer(session));
   parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
 
-  g_assert(parent_class->to_xml_sync != NULL);
-  parent_class->to_xml_sync(session, parent);
+  g_assert(parent_class->to_xml_sync_stream != NULL);
+  parent_class->to_xml_sync_stream(session, stream);
+
+  /* The chat buffer has a limited size, so we serialize the messages right
+   * away. */
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
 
   for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
   {
@@ -809,8 +817,10 @@ inf_chat_session_to_xml_sync(InfSession* session,
       TRUE
     );
 
-    xmlAddChild(parent, child);
+    xmlAddChild(container, child);
   }
+
+  inf_session_sync_stream_add_xml(stream, container);
 }
 
 static gboolean
@@ -1030,7 +1040,7 @@ inf_chat_session_class_init(InfChatSessionClass* chat_session_class)
   object_class->set_property = inf_chat_session_set_property;
   object_class->get_property = inf_chat_session_get_property;
 
-  session_class->to_xml_sync = inf_chat_session_to_xml_sync;
+  session_class->to_xml_sync_stream = inf_chat_session_to_xml_sync_stream;
   session_class->process_xml_sync = inf_chat_session_process_xml_sync;
   session_class->process_xml_run = inf_chat_session_process_xml_run;
   session_class->synchronization_complete =
@@ -105,6 +105,47 @@ struct _InfSessionSync {
   InfSessionSyncStatus status;
 };
 
+/* The messages of a synchronization, consisting of parts whose messages
+ * are produced one at a time while they are sent. */
+struct _InfSessionSyncStream {
+  InfSession* session;
+  GQueue parts;
+  guint n_messages;
+
+  /* Whether <sync-end/> has been produced */
+  gboolean finished;
+};
+
+typedef struct _InfSessionSyncStreamPart InfSessionSyncStreamPart;
+struct _InfSessionSyncStreamPart {
+  guint n_messages; /* not yet produced */
+  InfSessionSyncStreamFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+/* The messages of a synchronization, shared by all synchronizations that
+ * begin before the session changes next. Each message is produced and
+ * serialized once, when the first of these synchronizations sends it. */
+typedef struct _InfSessionSyncSnapshot InfSessionSyncSnapshot;
+struct _InfSessionSyncSnapshot {
+  guint ref_count;
+  InfSession* session;
+
+  /* NULL once all messages have been produced */
+  InfSessionSyncStream* stream;
+  guint n_messages;
+
+  GPtrArray* messages; /* xmlNodePtr */
+  GPtrArray* serialized; /* GBytes */
+};
+
+typedef struct _InfSessionSyncSnapshotReader InfSessionSyncSnapshotReader;
+struct _InfSessionSyncSnapshotReader {
+  InfSessionSyncSnapshot* snapshot;
+  guint index; /* n_messages + 1 after <sync-end/> */
+};
+
 typedef struct _InfSessionPrivate InfSessionPrivate;
 struct _InfSessionPrivate {
   InfCommunicationManager* manager;
@@ -115,6 +156,10 @@ struct _InfSessionPrivate {
   /* Group of subscribed connections */
   InfCommunicationGroup* subscription_group;
 
+  /* Snapshot for synchronizations beginning now, or NULL. Owned by the
+   * synchronizations using it. */
+  InfSessionSyncSnapshot* sync_snapshot;
+
   union {
     /* INF_SESSION_PRESYNC */
     struct {
@@ -278,6 +323,217 @@ inf_session_find_sync_by_connection(InfSession* session,
   return (InfSessionSync*)item->data;
 }
 
+static InfSessionSyncStream*
+inf_session_sync_stream_new(InfSession* session)
+{
+  InfSessionSyncStream* stream;
+
+  stream = g_slice_new(InfSessionSyncStream);
+  stream->session = session;
+  g_queue_init(&stream->parts);
+  stream->n_messages = 0;
+  stream->finished = FALSE;
+
+  g_object_ref(session);
+  return stream;
+}
+
+static void
+inf_session_sync_stream_part_free(InfSessionSyncStreamPart* part)
+{
+  if(part->notify != NULL)
+    part->notify(part->user_data);
+
+  g_slice_free(InfSessionSyncStreamPart, part);
+}
+
+static void
+inf_session_sync_stream_free(gpointer data)
+{
+  InfSessionSyncStream* stream;
+  InfSessionSyncStreamPart* part;
+
+  stream = (InfSessionSyncStream*)data;
+
+  while((part = g_queue_pop_head(&stream->parts)) != NULL)
+    inf_session_sync_stream_part_free(part);
+
+  g_object_unref(stream->session);
+  g_slice_free(InfSessionSyncStream, stream);
+}
+
+/* Returns the next message of the stream, or NULL if all messages have been
+ * produced. */
+static xmlNodePtr
+inf_session_sync_stream_pull(InfSessionSyncStream* stream)
+{
+  InfSessionSyncStreamPart* part;
+  xmlNodePtr xml;
+
+  part = g_queue_peek_head(&stream->parts);
+  if(part == NULL)
+    return NULL;
+
+  xml = part->func(stream->session, part->user_data);
+  g_assert(xml != NULL);
+
+  if(--part->n_messages == 0)
+  {
+    g_queue_pop_head(&stream->parts);
+    inf_session_sync_stream_part_free(part);
+  }
+
+  return xml;
+}
+
+/* InfCommunicationMessageFunc sending the stream followed by <sync-end/> */
+static xmlNodePtr
+inf_session_sync_stream_next_message(GBytes** serialized,
+                                     gpointer user_data)
+{
+  InfSessionSyncStream* stream;
+  xmlNodePtr xml;
+
+  stream = (InfSessionSyncStream*)user_data;
+  xml = inf_session_sync_stream_pull(stream);
+
+  if(xml == NULL && stream->finished == FALSE)
+  {
+    stream->finished = TRUE;
+    xml = xmlNewNode(NULL, (const xmlChar*)"sync-end");
+  }
+
+  return xml;
+}
+
+static xmlNodePtr
+inf_session_sync_stream_xml_func(InfSession* session,
+                                 gpointer user_data)
+{
+  xmlNodePtr container;
+  xmlNodePtr xml;
+
+  container = (xmlNodePtr)user_data;
+  xml = container->children;
+  g_assert(xml != NULL);
+
+  xmlUnlinkNode(xml);
+  return xml;
+}
+
+static InfSessionSyncSnapshot*
+inf_session_sync_snapshot_new(InfSession* session,
+                              InfSessionSyncStream* stream)
+{
+  InfSessionSyncSnapshot* snapshot;
+
+  snapshot = g_slice_new(InfSessionSyncSnapshot);
+  snapshot->ref_count = 1;
+  snapshot->session = session;
+  snapshot->stream = stream;
+  snapshot->n_messages = stream->n_messages;
+  snapshot->messages = g_ptr_array_sized_new(stream->n_messages);
+  snapshot->serialized = g_ptr_array_sized_new(stream->n_messages);
+
+  if(snapshot->n_messages == 0)
+  {
+    inf_session_sync_stream_free(stream);
+    snapshot->stream = NULL;
+  }
+
+  g_object_ref(session);
+  return snapshot;
+}
+
+static void
+inf_session_sync_snapshot_unref(InfSessionSyncSnapshot* snapshot)
+{
+  InfSessionPrivate* priv;
+  guint i;
+
+  if(--snapshot->ref_count > 0)
+    return;
+
+  priv = INF_SESSION_PRIVATE(snapshot->session);
+  if(priv->sync_snapshot == snapshot)
+    priv->sync_snapshot = NULL;
+
+  if(snapshot->stream != NULL)
+    inf_session_sync_stream_free(snapshot->stream);
+
+  for(i = 0; i < snapshot->messages->len; ++i)
+  {
+    xmlFreeNode(g_ptr_array_index(snapshot->messages, i));
+    g_bytes_unref(g_ptr_array_index(snapshot->serialized, i));
+  }
+
+  g_ptr_array_free(snapshot->messages, TRUE);
+  g_ptr_array_free(snapshot->serialized, TRUE);
+
+  g_object_unref(snapshot->session);
+  g_slice_free(InfSessionSyncSnapshot, snapshot);
+}
+
+static void
+inf_session_sync_snapshot_reader_free(gpointer data)
+{
+  InfSessionSyncSnapshotReader* reader;
+  reader = (InfSessionSyncSnapshotReader*)data;
+
+  inf_session_sync_snapshot_unref(reader->snapshot);
+  g_slice_free(InfSessionSyncSnapshotReader, reader);
+}
+
+/* InfCommunicationMessageFunc sending a copy of the snapshot's messages
+ * followed by <sync-end/>. The serialized form is shared. */
+static xmlNodePtr
+inf_session_sync_snapshot_next_message(GBytes** serialized,
+                                       gpointer user_data)
+{
+  InfSessionSyncSnapshotReader* reader;
+  InfSessionSyncSnapshot* snapshot;
+  xmlNodePtr xml;
+
+  reader = (InfSessionSyncSnapshotReader*)user_data;
+  snapshot = reader->snapshot;
+
+  /* We are the first to send this message, so produce it */
+  if(reader->index == snapshot->messages->len && snapshot->stream != NULL)
+  {
+    xml = inf_session_sync_stream_pull(snapshot->stream);
+    g_assert(xml != NULL);
+
+    g_ptr_array_add(snapshot->messages, xml);
+    g_ptr_array_add(snapshot->serialized, inf_xml_util_serialize(xml));
+
+    if(snapshot->messages->len == snapshot->n_messages)
+    {
+      inf_session_sync_stream_free(snapshot->stream);
+      snapshot->stream = NULL;
+    }
+  }
+
+  if(reader->index < snapshot->messages->len)
+  {
+    *serialized = g_bytes_ref(
+      g_ptr_array_index(snapshot->serialized, reader->index)
+    );
+
+    xml = g_ptr_array_index(snapshot->messages, reader->index);
+    ++reader->index;
+
+    return xmlCopyNode(xml, 1);
+  }
+
+  if(reader->index == snapshot->n_messages)
+  {
+    ++reader->index;
+    return xmlNewNode(NULL, (const xmlChar*)"sync-end");
+  }
+
+  return NULL;
+}
+
 /* Required by inf_session_release_connection() */
 static void
 inf_session_connection_notify_status_cb(InfXmlConnection* connection,
@@ -443,6 +699,43 @@ inf_session_connection_notify_status_cb(InfXmlConnection* connection,
   }
 }
 
+static void
+inf_session_user_notify_cb(GObject* object,
+                           GParamSpec* pspec,
+                           gpointer user_data)
+{
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+}
+
+static void
+inf_session_add_user_cb(InfUserTable* user_table,
+                        InfUser* user,
+                        gpointer user_data)
+{
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify",
+    G_CALLBACK(inf_session_user_notify_cb),
+    user_data
+  );
+
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+}
+
+static void
+inf_session_remove_user_cb(InfUserTable* user_table,
+                           InfUser* user,
+                           gpointer user_data)
+{
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(user),
+    G_CALLBACK(inf_session_user_notify_cb),
+    user_data
+  );
+
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+}
+
 /*
  * GObject overrides.
  */
@@ -457,10 +750,23 @@ inf_session_init(InfSession* session)
   priv->buffer = NULL;
   priv->user_table = NULL;
   priv->status = INF_SESSION_RUNNING;
+  priv->sync_snapshot = NULL;
 
   priv->shared.run.syncs = NULL;
 }
 
+static void
+inf_session_constructed_foreach_user_func(InfUser* user,
+                                          gpointer user_data)
+{
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify",
+    G_CALLBACK(inf_session_user_notify_cb),
+    user_data
+  );
+}
+
 static void
 inf_session_constructed(GObject* object)
 {
@@ -475,6 +781,28 @@ inf_session_constructed(GObject* object)
   if(priv->user_table == NULL)
     priv->user_table = inf_user_table_new();
 
+  /* Users are part of the synchronization, so a snapshot of the session
+   * is outdated when they change */
+  g_signal_connect(
+    G_OBJECT(priv->user_table),
+    "add-user",
+    G_CALLBACK(inf_session_add_user_cb),
+    object
+  );
+
+  g_signal_connect(
+    G_OBJECT(priv->user_table),
+    "remove-user",
+    G_CALLBACK(inf_session_remove_user_cb),
+    object
+  );
+
+  inf_user_table_foreach_user(
+    priv->user_table,
+    inf_session_constructed_foreach_user_func,
+    object
+  );
+
   switch(priv->status)
   {
   case INF_SESSION_PRESYNC:
@@ -507,6 +835,17 @@ inf_session_constructed(GObject* object)
   }
 }
 
+static void
+inf_session_dispose_foreach_user_func(InfUser* user,
+                                      gpointer user_data)
+{
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(user),
+    G_CALLBACK(inf_session_user_notify_cb),
+    user_data
+  );
+}
+
 static void
 inf_session_dispose(GObject* object)
 {
@@ -523,6 +862,24 @@ inf_session_dispose(GObject* object)
     inf_session_close(session);
   }
 
+  inf_user_table_foreach_user(
+    priv->user_table,
+    inf_session_dispose_foreach_user_func,
+    session
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(priv->user_table),
+    G_CALLBACK(inf_session_add_user_cb),
+    session
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(priv->user_table),
+    G_CALLBACK(inf_session_remove_user_cb),
+    session
+  );
+
   g_object_unref(G_OBJECT(priv->user_table));
   priv->user_table = NULL;
 
@@ -819,19 +1176,43 @@ inf_session_to_xml_sync_impl_foreach_func(InfUser* user,
 static void
 inf_session_to_xml_sync_impl(InfSession* session,
                              xmlNodePtr parent)
+{
+  InfSessionClass* session_class;
+  InfSessionSyncStream* stream;
+  xmlNodePtr xml;
+
+  session_class = INF_SESSION_GET_CLASS(session);
+  g_assert(session_class->to_xml_sync_stream != NULL);
+
+  stream = inf_session_sync_stream_new(session);
+  session_class->to_xml_sync_stream(session, stream);
+
+  while((xml = inf_session_sync_stream_pull(stream)) != NULL)
+    xmlAddChild(parent, xml);
+
+  inf_session_sync_stream_free(stream);
+}
+
+static void
+inf_session_to_xml_sync_stream_impl(InfSession* session,
+                                    InfSessionSyncStream* stream)
 {
   InfSessionPrivate* priv;
   InfSessionXmlData data;
 
   priv = INF_SESSION_PRIVATE(session);
+
+  /* There are not many users, so we serialize them right away */
   data.session = session;
-  data.xml = parent;
+  data.xml = xmlNewNode(NULL, (const xmlChar*)"sync-container");
 
   inf_user_table_foreach_user(
     priv->user_table,
     inf_session_to_xml_sync_impl_foreach_func,
     &data
   );
+
+  inf_session_sync_stream_add_xml(stream, data.xml);
 }
 
 static gboolean
@@ -1708,8 +2089,12 @@ inf_session_synchronization_begin_handler(InfSession* session,
   InfSessionPrivate* priv;
   InfSessionClass* session_class;
   InfSessionSync* sync;
+  InfSessionSyncStream* stream;
+  InfSessionSyncSnapshotReader* reader;
+  InfCommunicationMessageFunc func;
+  gpointer func_data;
+  GDestroyNotify func_notify;
   xmlNodePtr messages;
-  xmlNodePtr next;
   xmlNodePtr xml;
   gchar num_messages_buf[16];
 
@@ -1743,14 +2128,50 @@ inf_session_synchronization_begin_handler(InfSession* session,
   /* The group needs to contain that connection, of course. */
   g_assert(inf_communication_group_is_member(sync->group, connection));
 
-  /* Name is irrelevant because the node is only used to collect the child
-   * nodes via the to_xml_sync vfunc. */
-  messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
-  session_class->to_xml_sync(session, messages);
+  if(session_class->to_xml_sync != inf_session_to_xml_sync_impl)
+  {
+    /* A subclass overrides to_xml_sync itself, so we cannot produce the
+     * messages while sending, and we cannot tell when they change. Name is
+     * irrelevant because the node is only used to collect the child nodes
+     * via the to_xml_sync vfunc. */
+    stream = inf_session_sync_stream_new(session);
+    messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+    session_class->to_xml_sync(session, messages);
+    inf_session_sync_stream_add_xml(stream, messages);
+
+    sync->messages_total += stream->n_messages;
+    func = inf_session_sync_stream_next_message;
+    func_data = stream;
+    func_notify = inf_session_sync_stream_free;
+  }
+  else
+  {
+    /* If the session did not change since the previous synchronization
+     * began, then send the same messages, so that many connections
+     * subscribing at the same time share the work of producing and
+     * serializing them. */
+    if(priv->sync_snapshot == NULL)
+    {
+      g_assert(session_class->to_xml_sync_stream != NULL);
+
+      stream = inf_session_sync_stream_new(session);
+      session_class->to_xml_sync_stream(session, stream);
+      priv->sync_snapshot = inf_session_sync_snapshot_new(session, stream);
+    }
+    else
+    {
+      ++priv->sync_snapshot->ref_count;
+    }
 
-  for(xml = messages->children; xml != NULL; xml = xml->next)
-    ++ sync->messages_total;
+    reader = g_slice_new(InfSessionSyncSnapshotReader);
+    reader->snapshot = priv->sync_snapshot;
+    reader->index = 0;
 
+    sync->messages_total += reader->snapshot->n_messages;
+    func = inf_session_sync_snapshot_next_message;
+    func_data = reader;
+    func_notify = inf_session_sync_snapshot_reader_free;
+  }
   sprintf(num_messages_buf, "%u", sync->messages_total - 2);
 
   xml = xmlNewNode(NULL, (const xmlChar*)"sync-begin");
@@ -1763,18 +2184,17 @@ inf_session_synchronization_begin_handler(InfSession* session,
 
   inf_communication_group_send_message(sync->group, connection, xml);
 
-  /* TODO: Add a function that can send multiple messages */
-  for(xml = messages->children; xml != NULL; xml = next)
-  {
-    next = xml->next;
-    xmlUnlinkNode(xml);
-
-    inf_communication_group_send_message(sync->group, connection, xml);
-  }
-
-  xmlFreeNode(messages);
-  xml = xmlNewNode(NULL, (const xmlChar*)"sync-end");
-  inf_communication_group_send_message(sync->group, connection, xml);
+  /* The remaining messages, including <sync-end/>, are produced only when
+   * the connection is ready to send them, so that we never keep the whole
+   * session in XML form in memory. Messages sent to the group in the
+   * meanwhile are still sent after the synchronization. */
+  inf_communication_group_send_lazy(
+    sync->group,
+    connection,
+    func,
+    func_data,
+    func_notify
+  );
 }
 
 static void
@@ -1898,6 +2318,7 @@ inf_session_class_init(InfSessionClass* session_class)
     inf_session_synchronization_complete_handler;
   session_class->synchronization_failed =
     inf_session_synchronization_failed_handler;
+  session_class->to_xml_sync_stream = inf_session_to_xml_sync_stream_impl;
 
   inf_session_sync_error_quark = g_quark_from_static_string(
     "INF_SESSION_SYNC_ERROR"
@@ -2272,6 +2693,115 @@ inf_session_user_to_xml(InfSession* session,
   g_free(pspecs);
 }
 
+/**
+ * inf_session_sync_stream_add:
+ * @stream: A #InfSessionSyncStream.
+ * @n_messages: The number of messages in the new part.
+ * @func: (scope notified): Function producing the messages.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data when it is no
+ * longer needed, or %NULL.
+ *
+ * Appends a part consisting of @n_messages messages to @stream. The
+ * messages are produced by calling @func, once for each message, after the
+ * messages of all parts added before. This usually happens only when the
+ * connection to which the session is synchronized is ready to send more
+ * data, so @user_data should refer to a snapshot of the session content
+ * that is not affected by changes to the session.
+ *
+ * @notify is called when all messages have been produced, or when the
+ * synchronization is cancelled before that.
+ *
+ * This function is meant to be called from implementations of the
+ * to_xml_sync_stream virtual function of #InfSessionClass.
+ */
+void
+inf_session_sync_stream_add(InfSessionSyncStream* stream,
+                            guint n_messages,
+                            InfSessionSyncStreamFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify)
+{
+  InfSessionSyncStreamPart* part;
+
+  g_return_if_fail(stream != NULL);
+  g_return_if_fail(func != NULL);
+
+  if(n_messages == 0)
+  {
+    if(notify != NULL)
+      notify(user_data);
+    return;
+  }
+
+  part = g_slice_new(InfSessionSyncStreamPart);
+  part->n_messages = n_messages;
+  part->func = func;
+  part->user_data = user_data;
+  part->notify = notify;
+
+  g_queue_push_tail(&stream->parts, part);
+  stream->n_messages += n_messages;
+}
+
+/**
+ * inf_session_sync_stream_add_xml:
+ * @stream: A #InfSessionSyncStream.
+ * @container: (transfer full): An XML node whose children are
+ * synchronization messages.
+ *
+ * Appends the children of @container to @stream as messages. This is
+ * useful for content that is small enough to be serialized right away.
+ * This function takes ownership of @container.
+ */
+void
+inf_session_sync_stream_add_xml(InfSessionSyncStream* stream,
+                                xmlNodePtr container)
+{
+  xmlNodePtr xml;
+  guint n_messages;
+
+  g_return_if_fail(stream != NULL);
+  g_return_if_fail(container != NULL);
+
+  n_messages = 0;
+  for(xml = container->children; xml != NULL; xml = xml->next)
+    ++ n_messages;
+
+  inf_session_sync_stream_add(
+    stream,
+    n_messages,
+    inf_session_sync_stream_xml_func,
+    container,
+    (GDestroyNotify)xmlFreeNode
+  );
+}
+
+/**
+ * inf_session_invalidate_sync_snapshot:
+ * @session: A #InfSession.
+ *
+ * Synchronizations that begin while the session does not change share the
+ * synchronization messages. This function tells @session that it has
+ * changed, so that the next synchronization produces new messages.
+ * Synchronizations already in progress are not affected.
+ *
+ * #InfSession calls this function itself when its users change. Subclasses
+ * need to call it when other state changes that they synchronize in their
+ * to_xml_sync_stream implementation.
+ */
+void
+inf_session_invalidate_sync_snapshot(InfSession* session)
+{
+  InfSessionPrivate* priv;
+
+  g_return_if_fail(INF_IS_SESSION(session));
+  priv = INF_SESSION_PRIVATE(session);
+
+  /* The snapshot is owned by the synchronizations using it */
+  priv->sync_snapshot = NULL;
+}
+
 /**
  * inf_session_close:
  * @session: A #InfSession.
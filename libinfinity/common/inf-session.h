@@ -147,6 +147,29 @@ typedef enum _InfSessionSyncError {
   INF_SESSION_SYNC_ERROR_FAILED
 } InfSessionSyncError;
 
+/**
+ * InfSessionSyncStream:
+ *
+ * #InfSessionSyncStream is an opaque data type. It describes the messages
+ * that make up the synchronization of a session, see
+ * inf_session_sync_stream_add().
+ */
+typedef struct _InfSessionSyncStream InfSessionSyncStream;
+
+/**
+ * InfSessionSyncStreamFunc:
+ * @session: The #InfSession being synchronized.
+ * @user_data: User data passed to inf_session_sync_stream_add().
+ *
+ * This function produces the next message of a part of a synchronization.
+ * It is called exactly as many times as the number of messages given to
+ * inf_session_sync_stream_add().
+ *
+ * Returns: (transfer full): The next synchronization message.
+ */
+typedef xmlNodePtr(*InfSessionSyncStreamFunc)(InfSession* session,
+                                              gpointer user_data);
+
 /**
  * InfSessionClass:
  * @to_xml_sync: Virtual function that saves the session within a XML
@@ -154,7 +177,10 @@ typedef enum _InfSessionSyncError {
  * much nodes as possible within that root node and not in sub-nodes because
  * these are sent to a client and it is not allowed that other traffic is put
  * in between those nodes. This way, communication through the same connection
- * does not hang just because a large session is synchronized.
+ * does not hang just because a large session is synchronized. The default
+ * implementation adds the messages described by @to_xml_sync_stream.
+ * Subclasses should override @to_xml_sync_stream instead. If they override
+ * this function, synchronizations use it, and build all messages at once.
  * @process_xml_sync: Virtual function that is called for every node in the
  * XML document created by @to_xml_sync. It is supposed to reconstruct the
  * session content from the XML data.
@@ -188,6 +214,14 @@ typedef enum _InfSessionSyncError {
  * #InfSession::synchronization-failed signal. If the session itself got
  * synchronized (and did not synchronize another session), then the default
  * handler changes status to %INF_SESSION_CLOSED.
+ * @to_xml_sync_stream: Virtual function that adds the messages which
+ * synchronize the session to @stream, using inf_session_sync_stream_add().
+ * Messages are only produced when the connection is ready to send them, so
+ * they need to be produced from a snapshot of the session that is not
+ * affected by later changes. The messages are shared by all
+ * synchronizations that begin before the session changes next, so
+ * subclasses need to call inf_session_invalidate_sync_snapshot() whenever
+ * state they synchronize changes. Implementations should chain up first.
  *
  * This structure contains the virtual functions and default signal handlers
  * of #InfSession.
@@ -254,6 +288,10 @@ struct _InfSessionClass {
   void(*synchronization_failed)(InfSession* session,
                                 InfXmlConnection* connection,
                                 const GError* error);
+
+  /* Virtual table, continued */
+  void(*to_xml_sync_stream)(InfSession* session,
+                            InfSessionSyncStream* stream);
 };
 
 /**
@@ -289,6 +327,20 @@ inf_session_user_to_xml(InfSession* session,
                         InfUser* user,
                         xmlNodePtr xml);
 
+void
+inf_session_sync_stream_add(InfSessionSyncStream* stream,
+                            guint n_messages,
+                            InfSessionSyncStreamFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify);
+
+void
+inf_session_sync_stream_add_xml(InfSessionSyncStream* stream,
+                                xmlNodePtr container);
+
+void
+inf_session_invalidate_sync_snapshot(InfSession* session);
+
 void
 inf_session_close(InfSession* session);
 
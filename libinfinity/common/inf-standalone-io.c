@@ -37,12 +37,19 @@
  * instead which implements the #InfIo interface. For the GTK+ toolkit, there
  * is #InfGtkIo in the libinfgtk library, to integrate with the Glib main
  * loop.
+ *
+ * On Linux, #InfStandaloneIo uses epoll to wait for events on its sockets,
+ * so that the cost of a wakeup does not depend on the number of idle
+ * sockets. On other platforms, or if epoll is not available at runtime,
+ * it falls back to poll(), or WSAWaitForMultipleEvents() on Windows. The
+ * poll() backend can also be selected explicitly by setting the
+ * LIBINFINITY_STANDALONE_IO_BACKEND environment variable to "poll".
  */
 
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
 
-/* TODO: Modularize the FD handling, then add epoll support */
+#include "config.h"
 
 #ifdef G_OS_WIN32
 # include <winsock2.h>
@@ -50,6 +57,9 @@
 # include <poll.h>
 # include <errno.h>
 # include <unistd.h>
+# ifdef HAVE_EPOLL
+#  include <sys/epoll.h>
+# endif
 #endif /* !G_OS_WIN32 */
 
 #include <string.h>
@@ -57,31 +67,72 @@
 #ifdef G_OS_WIN32
 typedef WSAEVENT InfStandaloneIoNativeEvent;
 typedef DWORD InfStandaloneIoPollTimeout;
-typedef DWORD InfStandaloneIoPollResult;
-static const InfStandaloneIoPollResult INF_STANDALONE_IO_POLL_TIMEOUT =
-  WSA_WAIT_TIMEOUT;
 static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE =
   WSA_INFINITE;
-#define inf_standalone_io_poll(events, num_events, timeout) \
-  ((num_events) == 0 ? \
-    (Sleep(timeout), WSA_WAIT_TIMEOUT) : \
-    (WSAWaitForMultipleEvents(num_events, events, FALSE, timeout, TRUE)))
+#define INF_STANDALONE_IO_SOCKET_KEY(socket) (GSIZE_TO_POINTER(socket))
 #else
 typedef struct pollfd InfStandaloneIoNativeEvent;
 typedef int InfStandaloneIoPollTimeout;
-typedef int InfStandaloneIoPollResult;
-static const InfStandaloneIoPollResult INF_STANDALONE_IO_POLL_TIMEOUT = 0;
 static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE = -1;
-#define inf_standalone_io_poll(events, num_events, timeout) \
-  (poll(events, (nfds_t)num_events, timeout))
+#define INF_STANDALONE_IO_SOCKET_KEY(socket) (GINT_TO_POINTER(socket))
 #endif
 
-struct _InfIoWatch {
-  /* TODO: Do we actually need this? We can access the event by
-   * priv->events[watchindex+1]. */
-  InfStandaloneIoNativeEvent* event;
+#ifdef HAVE_EPOLL
+/* Maximum number of events to fetch with a single epoll_wait() call */
+#define INF_STANDALONE_IO_EPOLL_MAX_EVENTS 64
+#endif
 
+typedef enum _InfStandaloneIoPollStatus {
+  /* Waiting failed or was interrupted */
+  INF_STANDALONE_IO_POLL_FAILED,
+  /* No event occurred within the timeout */
+  INF_STANDALONE_IO_POLL_TIMEOUT,
+  /* Events are available via the backend's next_event function */
+  INF_STANDALONE_IO_POLL_EVENTS
+} InfStandaloneIoPollStatus;
+
+/* The backend waits for events on the sockets of all watches, plus the
+ * wakeup pipe or event. add_watch, update_watch, remove_watch and
+ * next_event are called with the mutex locked. When remove_watch is called,
+ * the watch is still at its index, and the backend needs to move its data
+ * for the last watch into that index, in the same way as it is done for
+ * the watches array. poll is called without the mutex being locked.
+ * drop_events discards the events that next_event has not returned yet.
+ * It is called whenever a watch is added or removed, since a socket that
+ * has been closed in a callback can be reused for a new watch, and events
+ * that were reported for the old socket must not reach the new watch.
+ * Both backends are level-triggered, so the dropped events of other
+ * sockets are reported again by the next poll. */
+typedef struct _InfStandaloneIoBackend InfStandaloneIoBackend;
+struct _InfStandaloneIoBackend {
+  const gchar* name;
+
+  gboolean(*init)(InfStandaloneIo* io);
+  void(*finalize)(InfStandaloneIo* io);
+
+  gboolean(*add_watch)(InfStandaloneIo* io,
+                       InfIoWatch* watch);
+  void(*update_watch)(InfStandaloneIo* io,
+                      InfIoWatch* watch);
+  void(*remove_watch)(InfStandaloneIo* io,
+                      InfIoWatch* watch);
+
+  InfStandaloneIoPollStatus(*poll)(InfStandaloneIo* io,
+                                   InfStandaloneIoPollTimeout timeout);
+  gboolean(*next_event)(InfStandaloneIo* io,
+                        InfIoWatch** watch,
+                        InfIoEvent* events);
+  void(*drop_events)(InfStandaloneIo* io);
+};
+
+struct _InfIoWatch {
   InfNativeSocket* socket;
+  /* The value of *socket when the watch was added */
+  InfNativeSocket native;
+  InfIoEvent events;
+  /* Position in the watches array */
+  guint index;
+
   InfIoWatchFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -93,8 +144,11 @@ struct _InfIoWatch {
 };
 
 struct _InfIoTimeout {
-  GTimeVal begin;
-  guint msecs;
+  /* Monotonic time in microseconds at which the timeout elapses */
+  gint64 deadline;
+  /* Position in the timeout heap */
+  guint index;
+
   InfIoTimeoutFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -108,16 +162,37 @@ struct _InfIoDispatch {
 
 typedef struct _InfStandaloneIoPrivate InfStandaloneIoPrivate;
 struct _InfStandaloneIoPrivate {
-  InfStandaloneIoNativeEvent* events;
+  const InfStandaloneIoBackend* backend;
   GMutex mutex;
 
-  guint fd_size;
-  guint fd_alloc;
-
-  /* this array has fd_size-1 entries and fd_alloc-1 allocations: */
   InfIoWatch** watches;
+  guint n_watches;
+  guint watches_alloc;
+
+  /* Native socket -> InfIoWatch* */
+  GHashTable* sockets;
+
+  /* poll backend: the wakeup pipe or event, followed by one entry for each
+   * watch. events_current is the index of the next entry to check for
+   * events which have not been processed yet. */
+  InfStandaloneIoNativeEvent* events;
+  guint events_alloc;
+  guint events_current;
+
+#ifdef HAVE_EPOLL
+  /* epoll backend: epoll_events holds epoll_ready events of which the ones
+   * from epoll_current on have not been processed yet. */
+  int epoll_fd;
+  struct epoll_event epoll_events[INF_STANDALONE_IO_EPOLL_MAX_EVENTS];
+  guint epoll_ready;
+  guint epoll_current;
+#endif
+
+  /* Binary min-heap of timeouts, ordered by their deadline */
+  InfIoTimeout** timeouts;
+  guint n_timeouts;
+  guint timeouts_alloc;
 
-  GList* timeouts;
   GList* dispatchs;
 
 #ifndef G_OS_WIN32
@@ -155,77 +230,895 @@ G_DEFINE_TYPE_WITH_CODE(InfStandaloneIo, inf_standalone_io, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfStandaloneIo)
   G_IMPLEMENT_INTERFACE(INF_TYPE_IO, inf_standalone_io_io_iface_init))
 
-static guint
-inf_standalone_io_timeval_diff(GTimeVal* first,
-                               GTimeVal* second)
+/* Moves the timeout at index up in the heap until its parent elapses
+ * earlier. */
+static void
+inf_standalone_io_timeout_heap_up(InfStandaloneIoPrivate* priv,
+                                  guint index)
 {
-  g_assert(first->tv_sec > second->tv_sec ||
-           (first->tv_sec == second->tv_sec &&
-            first->tv_usec >= second->tv_usec));
+  InfIoTimeout* timeout;
+  InfIoTimeout* parent;
+
+  timeout = priv->timeouts[index];
+  while(index > 0)
+  {
+    parent = priv->timeouts[(index - 1) / 2];
+    if(parent->deadline <= timeout->deadline)
+      break;
+
+    priv->timeouts[index] = parent;
+    parent->index = index;
+    index = (index - 1) / 2;
+  }
 
-  /* Don't risk overflow, don't need to convert to signed int */
-  return (first->tv_sec - second->tv_sec) * 1000 +
-         (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
+  priv->timeouts[index] = timeout;
+  timeout->index = index;
 }
 
-/* Run one iteration of the main loop. Call this only with the mutex locked
- * and a local reference added to io. */
+/* Moves the timeout at index down in the heap until both its children
+ * elapse later. */
 static void
-inf_standalone_io_iteration_impl(InfStandaloneIo* io,
-                                 InfStandaloneIoPollTimeout timeout)
+inf_standalone_io_timeout_heap_down(InfStandaloneIoPrivate* priv,
+                                    guint index)
+{
+  InfIoTimeout* timeout;
+  InfIoTimeout* child;
+  guint child_index;
+
+  timeout = priv->timeouts[index];
+  for(;;)
+  {
+    child_index = 2 * index + 1;
+    if(child_index >= priv->n_timeouts)
+      break;
+
+    if(child_index + 1 < priv->n_timeouts &&
+       priv->timeouts[child_index + 1]->deadline <
+       priv->timeouts[child_index]->deadline)
+    {
+      ++child_index;
+    }
+
+    child = priv->timeouts[child_index];
+    if(timeout->deadline <= child->deadline)
+      break;
+
+    priv->timeouts[index] = child;
+    child->index = index;
+    index = child_index;
+  }
+
+  priv->timeouts[index] = timeout;
+  timeout->index = index;
+}
+
+static void
+inf_standalone_io_timeout_heap_insert(InfStandaloneIoPrivate* priv,
+                                      InfIoTimeout* timeout)
+{
+  if(priv->n_timeouts == priv->timeouts_alloc)
+  {
+    priv->timeouts_alloc *= 2;
+
+    priv->timeouts = g_realloc(
+      priv->timeouts,
+      priv->timeouts_alloc * sizeof(InfIoTimeout*)
+    );
+  }
+
+  priv->timeouts[priv->n_timeouts] = timeout;
+  ++priv->n_timeouts;
+
+  inf_standalone_io_timeout_heap_up(priv, priv->n_timeouts - 1);
+}
+
+static void
+inf_standalone_io_timeout_heap_remove(InfStandaloneIoPrivate* priv,
+                                      InfIoTimeout* timeout)
+{
+  InfIoTimeout* last;
+
+  /* Replace by the last timeout, and then restore the heap property */
+  --priv->n_timeouts;
+  last = priv->timeouts[priv->n_timeouts];
+
+  if(last != timeout)
+  {
+    priv->timeouts[timeout->index] = last;
+    last->index = timeout->index;
+
+    if(last->deadline < timeout->deadline)
+      inf_standalone_io_timeout_heap_up(priv, last->index);
+    else
+      inf_standalone_io_timeout_heap_down(priv, last->index);
+  }
+}
+
+#ifndef G_OS_WIN32
+static void
+inf_standalone_io_read_wakeup(InfStandaloneIo* io,
+                              gboolean error)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoEvent events;
-  InfStandaloneIoPollResult result;
-  guint i;
+  ssize_t ret;
+  char buf[1];
 
-  GList* item;
-  GTimeVal current;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  if(error)
+  {
+    /* TODO: Read error from FD? */
+    g_warning("Error condition on wakeup pipe");
+    /* TODO: Is there anything we could do here?
+     * Try to re-establish pipe? */
+  }
+  else
+  {
+    ret = read(priv->wakeup_pipe[0], &buf, 1);
+    if(ret == -1)
+    {
+      g_warning(
+        "read() on wakeup pipe failed: %s",
+        strerror(errno)
+      );
+
+      /* TODO: Is there anything we could do here?
+       * Try to re-establish pipe? */
+    }
+    else if(ret == 0)
+    {
+      g_warning("Wakeup pipe received EOF");
+      /* TODO: Is there anything we could do here?
+       * Try to re-establish pipe? */
+    }
+    else
+    {
+      /* this is what we send as wakeup call */
+      g_assert(buf[0] == 'c');
+    }
+  }
+}
+#endif
+
+/*
+ * poll backend, using WSAWaitForMultipleEvents() on Windows
+ */
+
+static gboolean
+inf_standalone_io_poll_init(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+
+#ifdef G_OS_WIN32
+  gchar* error_message;
+#endif
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  priv->events_alloc = 4;
+  priv->events_current = G_MAXUINT;
+
+  priv->events =
+    g_malloc(sizeof(InfStandaloneIoNativeEvent) * priv->events_alloc);
+
+#ifdef G_OS_WIN32
+  priv->events[0] = WSACreateEvent();
+  if(priv->events[0] == WSA_INVALID_EVENT)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_error("Failed to create wakeup event: %s", error_message);
+    g_free(error_message); /* will not be called since g_error abort()s */
+  }
+#else
+  priv->events[0].fd = priv->wakeup_pipe[0];
+  priv->events[0].events = POLLIN | POLLERR;
+  priv->events[0].revents = 0;
+#endif
+
+  return TRUE;
+}
+
+static void
+inf_standalone_io_poll_finalize(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+
+#ifdef G_OS_WIN32
+  gchar* error_message;
   InfIoWatch* watch;
-  InfIoTimeout* cur_timeout;
-  InfIoDispatch* dispatch;
-  guint elapsed;
+  guint i;
+#endif
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+#ifdef G_OS_WIN32
+  for(i = 0; i < priv->n_watches; ++i)
+  {
+    watch = priv->watches[i];
+    if(WSAEventSelect(*watch->socket, priv->events[i + 1], 0) ==
+       SOCKET_ERROR)
+    {
+      error_message = g_win32_error_message(WSAGetLastError());
+      g_warning("WSAEventSelect() failed: %s", error_message);
+      g_free(error_message);
+    }
+  }
+
+  for(i = 0; i < priv->n_watches + 1; ++ i)
+  {
+    if(WSACloseEvent(priv->events[i]) == FALSE)
+    {
+      error_message = g_win32_error_message(WSAGetLastError());
+      g_warning("WSACloseEvent() failed: %s", error_message);
+      g_free(error_message);
+    }
+  }
+#endif
+
+  g_free(priv->events);
+}
+
+static long
+inf_standalone_io_poll_events(InfIoEvent events)
+{
+  long pevents;
+
+#ifdef G_OS_WIN32
+  pevents = 0;
+  if(events & INF_IO_INCOMING)
+    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
+  if(events & INF_IO_OUTGOING)
+    pevents |= (FD_WRITE | FD_CONNECT);
+#else
+  pevents = 0;
+  if(events & INF_IO_INCOMING)
+    pevents |= POLLIN;
+  if(events & INF_IO_OUTGOING)
+    pevents |= POLLOUT;
+  if(events & INF_IO_ERROR)
+    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
+#endif
+
+  return pevents;
+}
+
+static gboolean
+inf_standalone_io_poll_add_watch(InfStandaloneIo* io,
+                                 InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoNativeEvent* event;
+
+#ifdef G_OS_WIN32
+  gchar* error_message;
+#endif
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* TODO: If we are currently polling we should not modify the fds array
+   * array but do this after wakeup directly after the poll call. */
+  if(watch->index + 1 == priv->events_alloc)
+  {
+    priv->events_alloc *= 2;
+
+    priv->events = g_realloc(
+      priv->events,
+      priv->events_alloc * sizeof(InfStandaloneIoNativeEvent)
+    );
+  }
+
+  event = &priv->events[watch->index + 1];
+
+#ifdef G_OS_WIN32
+  *event = WSACreateEvent();
+  if(*event == WSA_INVALID_EVENT)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSACreateEvent() failed: %s", error_message);
+    g_free(error_message);
+    return FALSE;
+  }
+
+  if(WSAEventSelect(*watch->socket, *event,
+                    inf_standalone_io_poll_events(watch->events)) ==
+     SOCKET_ERROR)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSAEventSelect() failed: %s", error_message);
+    g_free(error_message);
+
+    WSACloseEvent(*event);
+    return FALSE;
+  }
+#else
+  event->fd = *watch->socket;
+  event->events = inf_standalone_io_poll_events(watch->events);
+  event->revents = 0;
+#endif
+
+  return TRUE;
+}
+
+static void
+inf_standalone_io_poll_update_watch(InfStandaloneIo* io,
+                                    InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+
+#ifdef G_OS_WIN32
+  gchar* error_message;
+#endif
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* TODO: If we are currently polling we should not modify the fds array
+   * array but do this after wakeup directly after the poll call. */
+#ifdef G_OS_WIN32
+  if(WSAEventSelect(*watch->socket, priv->events[watch->index + 1],
+                    inf_standalone_io_poll_events(watch->events)) ==
+     SOCKET_ERROR)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSAEventSelect() failed: %s", error_message);
+    g_free(error_message);
+  }
+#else
+  priv->events[watch->index + 1].events =
+    inf_standalone_io_poll_events(watch->events);
+#endif
+}
+
+static void
+inf_standalone_io_poll_remove_watch(InfStandaloneIo* io,
+                                    InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+  guint index;
+
+#ifdef G_OS_WIN32
+  gchar* error_message;
+#endif
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  index = watch->index + 1;
+
+#ifdef G_OS_WIN32
+  if(WSAEventSelect(*watch->socket, priv->events[index], 0) == SOCKET_ERROR)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSAEventSelect() failed: %s", error_message);
+    g_free(error_message);
+  }
+
+  if(WSACloseEvent(priv->events[index]) == FALSE)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSACloseEvent() failed: %s", error_message);
+    g_free(error_message);
+  }
+#endif
+
+  /* TODO: If we are currently polling we should not modify the fds array
+   * array but do this after wakeup directly after the poll call. */
+
+  /* Replace by the last event */
+  if(index != priv->n_watches)
+  {
+    memcpy(
+      &priv->events[index],
+      &priv->events[priv->n_watches],
+      sizeof(InfStandaloneIoNativeEvent)
+    );
+  }
+}
+
+static InfStandaloneIoPollStatus
+inf_standalone_io_poll_poll(InfStandaloneIo* io,
+                            InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPrivate* priv;
+#ifdef G_OS_WIN32
+  gchar* error_message;
+  DWORD result;
+#else
+  int result;
+#endif
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+#ifdef G_OS_WIN32
+  result = WSAWaitForMultipleEvents(
+    priv->n_watches + 1,
+    priv->events,
+    FALSE,
+    timeout,
+    TRUE
+  );
+
+  switch(result)
+  {
+  case WSA_WAIT_FAILED:
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSAWaitForMultipleEvents() failed: %s\n", error_message);
+    g_free(error_message);
+    return INF_STANDALONE_IO_POLL_FAILED;
+  case WSA_WAIT_IO_COMPLETION:
+    return INF_STANDALONE_IO_POLL_FAILED;
+  case WSA_WAIT_TIMEOUT:
+    return INF_STANDALONE_IO_POLL_TIMEOUT;
+  default:
+    /* WSAWaitForMultipleEvents() only reports the first event that is
+     * set. */
+    if(result >= WSA_WAIT_EVENT_0 &&
+       result < WSA_WAIT_EVENT_0 + priv->n_watches + 1)
+    {
+      priv->events_current = result - WSA_WAIT_EVENT_0;
+    }
+
+    return INF_STANDALONE_IO_POLL_EVENTS;
+  }
+#else
+  result = poll(priv->events, (nfds_t)(priv->n_watches + 1), timeout);
+
+  if(result == -1)
+  {
+    if(errno != EINTR)
+      g_warning("poll() failed: %s\n", strerror(errno));
+
+    return INF_STANDALONE_IO_POLL_FAILED;
+  }
+
+  if(result == 0)
+    return INF_STANDALONE_IO_POLL_TIMEOUT;
+
+  priv->events_current = 0;
+  return INF_STANDALONE_IO_POLL_EVENTS;
+#endif
+}
+
+static gboolean
+inf_standalone_io_poll_next_event(InfStandaloneIo* io,
+                                  InfIoWatch** watch,
+                                  InfIoEvent* events)
+{
+  InfStandaloneIoPrivate* priv;
+  guint index;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
   WSANETWORKEVENTS wsa_events;
   const InfStandaloneIoEventTableEntry* entry;
+  guint i;
 #else
-  ssize_t ret;
-  char buf[1];
+  short revents;
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
+#ifdef G_OS_WIN32
+  index = priv->events_current;
+  priv->events_current = G_MAXUINT;
+
+  if(index > priv->n_watches)
+    return FALSE;
+
+  if(index == 0)
+  {
+    /* wakeup call */
+    WSAResetEvent(priv->events[0]);
+    return FALSE;
+  }
+
+  *watch = priv->watches[index - 1];
+
+  if(WSAEnumNetworkEvents(*(*watch)->socket, priv->events[index],
+                          &wsa_events) == SOCKET_ERROR)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSAEnumNetworkEvents failed: %s\n", error_message);
+    g_free(error_message);
+
+    *events = INF_IO_ERROR;
+  }
+  else
+  {
+    *events = 0;
+    for(i = 0; i < G_N_ELEMENTS(inf_standalone_io_event_table); ++ i)
+    {
+      entry = &inf_standalone_io_event_table[i];
+      if(wsa_events.lNetworkEvents & entry->flag_val)
+      {
+        *events |= entry->io_val;
+        if(wsa_events.iErrorCode[entry->flag_bit])
+          *events |= INF_IO_ERROR;
+      }
+    }
+  }
+
+  return TRUE;
+#else
+  while(priv->events_current <= priv->n_watches)
+  {
+    index = priv->events_current++;
+    revents = priv->events[index].revents;
+    if(revents == 0)
+      continue;
+
+    priv->events[index].revents = 0;
+
+    if(index == 0)
+    {
+      /* wakeup call */
+
+      /* we were not polling for outgoing */
+      g_assert(~revents & POLLOUT);
+
+      inf_standalone_io_read_wakeup(
+        io,
+        (revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL)) != 0
+      );
+    }
+    else
+    {
+      *watch = priv->watches[index - 1];
+
+      *events = 0;
+      if(revents & POLLIN)
+        *events |= INF_IO_INCOMING;
+      if(revents & POLLOUT)
+        *events |= INF_IO_OUTGOING;
+      /* We treat POLLPRI as error because it should not occur in
+       * infinote. */
+      if(revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL))
+        *events |= INF_IO_ERROR;
+
+      /* The watch might have been updated since the poll() call */
+      *events &= ((*watch)->events | INF_IO_ERROR);
+      if(*events != 0)
+        return TRUE;
+    }
+  }
+
+  priv->events_current = G_MAXUINT;
+  return FALSE;
+#endif
+}
+
+static void
+inf_standalone_io_poll_drop_events(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* The revents of the remaining entries are overwritten by the next
+   * poll() call. */
+  priv->events_current = G_MAXUINT;
+}
+
+static const InfStandaloneIoBackend inf_standalone_io_poll_backend = {
+  "poll",
+  inf_standalone_io_poll_init,
+  inf_standalone_io_poll_finalize,
+  inf_standalone_io_poll_add_watch,
+  inf_standalone_io_poll_update_watch,
+  inf_standalone_io_poll_remove_watch,
+  inf_standalone_io_poll_poll,
+  inf_standalone_io_poll_next_event,
+  inf_standalone_io_poll_drop_events
+};
+
+#ifdef HAVE_EPOLL
+/*
+ * epoll backend
+ */
+
+static gboolean
+inf_standalone_io_epoll_init(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event event;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  priv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(priv->epoll_fd == -1)
+    return FALSE;
+
+  event.events = EPOLLIN;
+  event.data.fd = priv->wakeup_pipe[0];
+
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, priv->wakeup_pipe[0], &event)
+     == -1)
+  {
+    close(priv->epoll_fd);
+    return FALSE;
+  }
+
+  priv->epoll_ready = 0;
+  priv->epoll_current = 0;
+  return TRUE;
+}
+
+static void
+inf_standalone_io_epoll_finalize(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  if(close(priv->epoll_fd) == -1)
+    g_warning("Failed to close epoll instance: %s", strerror(errno));
+}
+
+static uint32_t
+inf_standalone_io_epoll_events(InfIoEvent events)
+{
+  uint32_t pevents;
+
+  pevents = 0;
+  if(events & INF_IO_INCOMING)
+    pevents |= EPOLLIN;
+  if(events & INF_IO_OUTGOING)
+    pevents |= EPOLLOUT;
+  if(events & INF_IO_ERROR)
+    pevents |= (EPOLLERR | EPOLLHUP | EPOLLPRI);
+
+  return pevents;
+}
+
+static gboolean
+inf_standalone_io_epoll_add_watch(InfStandaloneIo* io,
+                                  InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event event;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* Events are mapped back to their watch by the socket. Pending events
+   * are dropped when a watch is added or removed, so an event can never be
+   * mapped to a watch for a different socket with the same number. */
+  event.events = inf_standalone_io_epoll_events(watch->events);
+  event.data.fd = watch->native;
+
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, watch->native, &event) == -1)
+  {
+    g_warning("epoll_ctl() failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_standalone_io_epoll_update_watch(InfStandaloneIo* io,
+                                     InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event event;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  event.events = inf_standalone_io_epoll_events(watch->events);
+  event.data.fd = watch->native;
+
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_MOD, watch->native, &event) == -1)
+    g_warning("epoll_ctl() failed: %s", strerror(errno));
+}
+
+static void
+inf_standalone_io_epoll_remove_watch(InfStandaloneIo* io,
+                                     InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event event;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* If the socket has already been closed then it has been removed from
+   * the epoll set automatically. */
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_DEL, watch->native, &event) == -1 &&
+     errno != EBADF && errno != ENOENT)
+  {
+    g_warning("epoll_ctl() failed: %s", strerror(errno));
+  }
+}
+
+static InfStandaloneIoPollStatus
+inf_standalone_io_epoll_poll(InfStandaloneIo* io,
+                             InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPrivate* priv;
+  int result;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  result = epoll_wait(
+    priv->epoll_fd,
+    priv->epoll_events,
+    INF_STANDALONE_IO_EPOLL_MAX_EVENTS,
+    timeout
+  );
+
+  if(result == -1)
+  {
+    if(errno != EINTR)
+      g_warning("epoll_wait() failed: %s\n", strerror(errno));
+
+    return INF_STANDALONE_IO_POLL_FAILED;
+  }
+
+  if(result == 0)
+    return INF_STANDALONE_IO_POLL_TIMEOUT;
+
+  priv->epoll_ready = result;
+  priv->epoll_current = 0;
+  return INF_STANDALONE_IO_POLL_EVENTS;
+}
+
+static gboolean
+inf_standalone_io_epoll_next_event(InfStandaloneIo* io,
+                                   InfIoWatch** watch,
+                                   InfIoEvent* events)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event* event;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  while(priv->epoll_current < priv->epoll_ready)
+  {
+    event = &priv->epoll_events[priv->epoll_current++];
+
+    if(event->data.fd == priv->wakeup_pipe[0])
+    {
+      /* wakeup call */
+      inf_standalone_io_read_wakeup(
+        io,
+        (event->events & (EPOLLERR | EPOLLHUP)) != 0
+      );
+    }
+    else
+    {
+      *watch = g_hash_table_lookup(
+        priv->sockets,
+        INF_STANDALONE_IO_SOCKET_KEY(event->data.fd)
+      );
+
+      /* Pending events are dropped when a watch is removed, so this
+       * should not happen. */
+      if(*watch == NULL)
+        continue;
+
+      *events = 0;
+      if(event->events & EPOLLIN)
+        *events |= INF_IO_INCOMING;
+      if(event->events & EPOLLOUT)
+        *events |= INF_IO_OUTGOING;
+      /* We treat EPOLLPRI as error because it should not occur in
+       * infinote. */
+      if(event->events & (EPOLLERR | EPOLLPRI | EPOLLHUP))
+        *events |= INF_IO_ERROR;
+
+      /* The watch might have been updated since the epoll_wait() call */
+      *events &= ((*watch)->events | INF_IO_ERROR);
+      if(*events != 0)
+        return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+inf_standalone_io_epoll_drop_events(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  priv->epoll_current = priv->epoll_ready;
+}
+
+static const InfStandaloneIoBackend inf_standalone_io_epoll_backend = {
+  "epoll",
+  inf_standalone_io_epoll_init,
+  inf_standalone_io_epoll_finalize,
+  inf_standalone_io_epoll_add_watch,
+  inf_standalone_io_epoll_update_watch,
+  inf_standalone_io_epoll_remove_watch,
+  inf_standalone_io_epoll_poll,
+  inf_standalone_io_epoll_next_event,
+  inf_standalone_io_epoll_drop_events
+};
+#endif /* HAVE_EPOLL */
+
+/* Backends in order of preference */
+static const InfStandaloneIoBackend* const inf_standalone_io_backends[] = {
+#ifdef HAVE_EPOLL
+  &inf_standalone_io_epoll_backend,
+#endif
+  &inf_standalone_io_poll_backend
+};
+
+/* Runs the callback of a watch. Call this only with the mutex locked. */
+static void
+inf_standalone_io_run_watch(InfStandaloneIo* io,
+                            InfIoWatch* watch,
+                            InfIoEvent events)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* protect from removing the watch object via
+   * inf_io_remove_watch() when running the callback. */
+  watch->executing = TRUE;
+  g_mutex_unlock(&priv->mutex);
+
+  watch->func(watch->socket, events, watch->user_data);
+
+  g_mutex_lock(&priv->mutex);
+  watch->executing = FALSE;
+  if(watch->disposed == TRUE)
+  {
+    g_mutex_unlock(&priv->mutex);
+    if(watch->notify) watch->notify(watch->user_data);
+    g_slice_free(InfIoWatch, watch);
+    g_mutex_lock(&priv->mutex);
+  }
+}
+
+/* Run one iteration of the main loop. Call this only with the mutex locked
+ * and a local reference added to io. */
+static void
+inf_standalone_io_iteration_impl(InfStandaloneIo* io,
+                                 InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoPollStatus status;
+  InfIoEvent events;
+
+  gint64 current;
+  gint64 remaining;
+  InfIoWatch* watch;
+  InfIoTimeout* cur_timeout;
+  InfIoDispatch* dispatch;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* Process events left over from the previous poll first, before
+   * polling again. */
+  if(priv->backend->next_event(io, &watch, &events))
+  {
+    inf_standalone_io_run_watch(io, watch, events);
+    return;
+  }
+
   /* Find number of milliseconds to wait */
   if(priv->dispatchs != NULL)
   {
     /* TODO: Don't even poll */
     timeout = 0;
   }
-  else
+  else if(priv->n_timeouts > 0)
   {
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    /* The first timeout in the heap is the one to elapse next */
+    current = g_get_monotonic_time();
+    remaining = priv->timeouts[0]->deadline - current;
+
+    if(remaining <= 0)
+    {
+      /* already elapsed */
+      /* TODO: Don't even poll */
+      timeout = 0;
+    }
+    else
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
+      /* Round up, so that we do not wake up before the timeout elapsed */
+      remaining = MIN((remaining + 999) / 1000, G_MAXINT);
 
-      if(elapsed >= cur_timeout->msecs)
+      if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
+         (guint64)remaining < (guint64)timeout)
       {
-        /* already elapsed */
-        /* TODO: Don't even poll */
-        timeout = 0;
-        /* no need to check other timeouts */
-        break;
-      }
-      else
-      {
-        if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
-           cur_timeout->msecs - elapsed < (guint)timeout)
-        {
-          timeout = cur_timeout->msecs - elapsed;
-        }
+        timeout = remaining;
       }
     }
   }
@@ -233,202 +1126,47 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   priv->polling = TRUE;
   g_mutex_unlock(&priv->mutex);
 
-  result = inf_standalone_io_poll(priv->events, priv->fd_size, timeout);
+  status = priv->backend->poll(io, timeout);
 
   g_mutex_lock(&priv->mutex);
   priv->polling = FALSE;
 
-#ifdef G_OS_WIN32
-  switch(result)
-  {
-  case WSA_WAIT_FAILED:
-    error_message = g_win32_error_message(WSAGetLastError());
-    g_warning("WSAWaitForMultipleEvents() failed: %s\n", error_message);
-    g_free(error_message);
-    return;
-  case WSA_WAIT_IO_COMPLETION:
-    return;
-  default:
-    break;
-  }
-#else
-  if(result == -1)
+  switch(status)
   {
-    if(errno != EINTR)
-      g_warning("poll() failed: %s\n", strerror(errno));
-
+  case INF_STANDALONE_IO_POLL_FAILED:
     return;
-  }
-#endif
-
-  if(result == INF_STANDALONE_IO_POLL_TIMEOUT)
-  {
+  case INF_STANDALONE_IO_POLL_TIMEOUT:
     /* No file descriptor is active, so check whether a timeout elapsed */
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    if(priv->n_timeouts > 0 &&
+       priv->timeouts[0]->deadline <= g_get_monotonic_time())
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
-      if(elapsed >= cur_timeout->msecs)
-      {
-        priv->timeouts = g_list_delete_link(priv->timeouts, item);
-        g_mutex_unlock(&priv->mutex);
-
-        cur_timeout->func(cur_timeout->user_data);
-        if(cur_timeout->notify)
-          cur_timeout->notify(cur_timeout->user_data);
-        g_slice_free(InfIoTimeout, cur_timeout);
-
-        g_mutex_lock(&priv->mutex);
-        return;
-      }
-    }
-  }
-#ifdef G_OS_WIN32
-  else if(result >= WSA_WAIT_EVENT_0 &&
-          result < WSA_WAIT_EVENT_0 + priv->fd_size)
-  {
-    if(result == WSA_WAIT_EVENT_0)
-    {
-      /* wakeup call */
-      WSAResetEvent(priv->events[0]);
-    }
-    else
-    {
-      watch = priv->watches[result - WSA_WAIT_EVENT_0 - 1];
-
-      if(WSAEnumNetworkEvents(*watch->socket, *watch->event, &wsa_events) ==
-         SOCKET_ERROR)
-      {
-        error_message = g_win32_error_message(WSAGetLastError());
-        g_warning("WSAEnumNetworkEvents failed: %s\n", error_message);
-        g_free(error_message);
-
-        events = INF_IO_ERROR;
-      }
-      else
-      {
-        events = 0;
-        for(i = 0; i < G_N_ELEMENTS(inf_standalone_io_event_table); ++ i)
-        {
-          entry = &inf_standalone_io_event_table[i];
-          if(wsa_events.lNetworkEvents & entry->flag_val)
-          {
-            events |= entry->io_val;
-            if(wsa_events.iErrorCode[entry->flag_bit])
-              events |= INF_IO_ERROR;
-          }
-        }
-      }
-
-      /* protect from removing the watch object via
-       * inf_io_remove_watch() when running the callback. */
-      watch->executing = TRUE;
+      cur_timeout = priv->timeouts[0];
+      inf_standalone_io_timeout_heap_remove(priv, cur_timeout);
       g_mutex_unlock(&priv->mutex);
 
-      watch->func(watch->socket, events, watch->user_data);
+      cur_timeout->func(cur_timeout->user_data);
+      if(cur_timeout->notify)
+        cur_timeout->notify(cur_timeout->user_data);
+      g_slice_free(InfIoTimeout, cur_timeout);
 
       g_mutex_lock(&priv->mutex);
-      watch->executing = FALSE;
-      if(watch->disposed == TRUE)
-      {
-        g_mutex_unlock(&priv->mutex);
-        if(watch->notify) watch->notify(watch->user_data);
-        g_slice_free(InfIoWatch, watch);
-        g_mutex_lock(&priv->mutex);
-      }
-
       return;
     }
-  }
-#else
-  else if(result > 0)
-  {
-    while(result--)
+
+    break;
+  case INF_STANDALONE_IO_POLL_EVENTS:
+    if(priv->backend->next_event(io, &watch, &events))
     {
-      for(i = 0; i < priv->fd_size; ++ i)
-      {
-        if(priv->events[i].revents != 0)
-        {
-          events = 0;
-          if(priv->events[i].revents & POLLIN)
-            events |= INF_IO_INCOMING;
-          if(priv->events[i].revents & POLLOUT)
-            events |= INF_IO_OUTGOING;
-          /* We treat POLLPRI as error because it should not occur in
-           * infinote. */
-          if(priv->events[i].revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL))
-            events |= INF_IO_ERROR;
-
-          priv->events[i].revents = 0;
-
-          if(i == 0)
-          {
-            /* wakeup call */
-
-            /* we were not polling for outgoing */
-            g_assert(~events & INF_IO_OUTGOING);
-            if(events & INF_IO_ERROR)
-            {
-              /* TODO: Read error from FD? */
-              g_warning("Error condition on wakeup pipe");
-              /* TODO: Is there anything we could do here?
-               * Try to re-establish pipe? */
-            }
-            else
-            {
-              ret = read(priv->events[0].fd, &buf, 1);
-              if(ret == -1)
-              {
-                g_warning(
-                  "read() on wakeup pipe failed: %s",
-                  strerror(errno)
-                );
-
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else if(ret == 0)
-              {
-                g_warning("Wakeup pipe received EOF");
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else
-              {
-                /* this is what we send as wakeup call */
-                g_assert(buf[0] == 'c');
-              }
-            }
-          }
-          else
-          {
-            watch = priv->watches[i-1];
-
-            /* protect from removing the watch object via
-             * inf_io_remove_watch() when running the callback. */
-            watch->executing = TRUE;
-            g_mutex_unlock(&priv->mutex);
-
-            watch->func(watch->socket, events, watch->user_data);
-
-            g_mutex_lock(&priv->mutex);
-            watch->executing = FALSE;
-            if(watch->disposed == TRUE)
-            {
-              g_mutex_unlock(&priv->mutex);
-              if(watch->notify) watch->notify(watch->user_data);
-              g_slice_free(InfIoWatch, watch);
-              g_mutex_lock(&priv->mutex);
-            }
-
-            return;
-          }
-        }
-      }
+      inf_standalone_io_run_watch(io, watch, events);
+      return;
     }
+
+    /* only the wakeup call was active */
+    break;
+  default:
+    g_assert_not_reached();
+    break;
   }
-#endif
 
   /* neither timeout nor IO fired, so try a dispatched message */
   if(priv->dispatchs != NULL)
@@ -450,49 +1188,52 @@ static void
 inf_standalone_io_init(InfStandaloneIo* io)
 {
   InfStandaloneIoPrivate* priv;
-
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
+  const gchar* backend_name;
+  guint i;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_init(&priv->mutex);
 
-  priv->fd_size = 0;
-  priv->fd_alloc = 4;
+#ifndef G_OS_WIN32
+  if(pipe(priv->wakeup_pipe) == -1)
+    g_error("Failed to create wakeup pipe: %s", strerror(errno));
+#endif
 
-  priv->events =
-    g_malloc(sizeof(InfStandaloneIoNativeEvent) * priv->fd_alloc);
+  priv->watches_alloc = 4;
+  priv->n_watches = 0;
+  priv->watches = g_malloc(sizeof(InfIoWatch*) * priv->watches_alloc);
+  priv->sockets = g_hash_table_new(NULL, NULL);
 
-#ifdef G_OS_WIN32
-  priv->events[0] = WSACreateEvent();
-  if(priv->events[0] == WSA_INVALID_EVENT)
-  {
-    error_message = g_win32_error_message(WSAGetLastError());
-    g_error("Failed to create wakeup event: %s", error_message);
-    g_free(error_message); /* will not be called since g_error abort()s */
-  }
-  else
-  {
-    ++priv->fd_size;
-  }
-#else
-  if(pipe(priv->wakeup_pipe) == -1)
+  /* Use the first backend that is available, unless one is requested
+   * explicitly. The poll backend is always available. */
+  backend_name = g_getenv("LIBINFINITY_STANDALONE_IO_BACKEND");
+
+  priv->backend = NULL;
+  for(i = 0; i < G_N_ELEMENTS(inf_standalone_io_backends); ++i)
   {
-    g_error("Failed to create wakeup pipe: %s", strerror(errno));
+    if(backend_name != NULL &&
+       strcmp(backend_name, inf_standalone_io_backends[i]->name) != 0)
+    {
+      continue;
+    }
+
+    if(inf_standalone_io_backends[i]->init(io) == TRUE)
+    {
+      priv->backend = inf_standalone_io_backends[i];
+      break;
+    }
   }
-  else
+
+  if(priv->backend == NULL)
   {
-    priv->events[0].fd = priv->wakeup_pipe[0];
-    priv->events[0].events = POLLIN | POLLERR;
-    priv->events[0].revents = 0;
-    ++priv->fd_size;
+    priv->backend = &inf_standalone_io_poll_backend;
+    priv->backend->init(io);
   }
-#endif
 
-  priv->watches = g_malloc(sizeof(InfIoWatch*) * (priv->fd_alloc - 1) );
-  priv->timeouts = NULL;
+  priv->timeouts_alloc = 4;
+  priv->n_timeouts = 0;
+  priv->timeouts = g_malloc(sizeof(InfIoTimeout*) * priv->timeouts_alloc);
   priv->dispatchs = NULL;
 
   priv->polling = FALSE;
@@ -509,41 +1250,30 @@ inf_standalone_io_finalize(GObject* object)
   InfIoWatch* watch;
   InfIoTimeout* timeout;
   InfIoDispatch* dispatch;
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
 
   io = INF_STANDALONE_IO(object);
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  for(i = 1; i < priv->fd_size; ++i)
+  priv->backend->finalize(io);
+
+  for(i = 0; i < priv->n_watches; ++i)
   {
-    watch = priv->watches[i - 1];
+    watch = priv->watches[i];
 
     /* cannot dispose the IO while running a callback since the IO is
      * reffed on the stack. */
     g_assert(watch->executing == FALSE);
 
-#ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, 0) ==
-       SOCKET_ERROR)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSAEventSelect() failed: %s", error_message);
-      g_free(error_message);
-    }
-#endif
-
     if(watch->notify)
       watch->notify(watch->user_data);
     g_slice_free(InfIoWatch, watch);
   }
 
-  for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+  for(i = 0; i < priv->n_timeouts; ++i)
   {
-    timeout = (InfIoTimeout*)item->data;
+    timeout = priv->timeouts[i];
     if(timeout->notify)
       timeout->notify(timeout->user_data);
     g_slice_free(InfIoTimeout, timeout);
@@ -557,21 +1287,9 @@ inf_standalone_io_finalize(GObject* object)
     g_slice_free(InfIoDispatch, dispatch);
   }
 
-#ifdef G_OS_WIN32
-  for(i = 0; i < priv->fd_size; ++ i)
-  {
-    if(WSACloseEvent(priv->events[i]) == FALSE)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSACloseEvent() failed: %s", error_message);
-      g_free(error_message);
-    }
-  }
-#endif
-
-  g_free(priv->events);
   g_free(priv->watches);
-  g_list_free(priv->timeouts);
+  g_hash_table_destroy(priv->sockets);
+  g_free(priv->timeouts);
   g_list_free(priv->dispatchs);
 
 #ifndef G_OS_WIN32
@@ -598,35 +1316,15 @@ inf_standalone_io_finalize(GObject* object)
   G_OBJECT_CLASS(inf_standalone_io_parent_class)->finalize(object);
 }
 
-static InfIoWatch**
-inf_standalone_io_find_watch(InfStandaloneIo* io,
-                             InfIoWatch* watch)
-{
-  InfStandaloneIoPrivate* priv;
-  guint i;
-
-  priv = INF_STANDALONE_IO_PRIVATE(io);
-  for(i = 1; i < priv->fd_size; ++i)
-    if(priv->watches[i-1] == watch)
-      return &priv->watches[i-1];
-
-  return NULL;
-
-}
-
-static InfIoWatch**
-inf_standalone_io_find_watch_by_socket(InfStandaloneIo* io,
-                                       InfNativeSocket* socket)
+static gboolean
+inf_standalone_io_has_watch(InfStandaloneIo* io,
+                            InfIoWatch* watch)
 {
   InfStandaloneIoPrivate* priv;
-  guint i;
-
   priv = INF_STANDALONE_IO_PRIVATE(io);
-  for(i = 1; i < priv->fd_size; ++i)
-    if(priv->watches[i-1]->socket == socket)
-      return &priv->watches[i-1];
 
-  return NULL;
+  return watch->index < priv->n_watches &&
+    priv->watches[watch->index] == watch;
 }
 
 static void
@@ -699,106 +1397,58 @@ inf_standalone_io_io_add_watch(InfIo* io,
 {
   InfStandaloneIoPrivate* priv;
   InfIoWatch* watch;
-  long pevents;
-  guint i;
-
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
-#endif
-
   g_mutex_lock(&priv->mutex);
 
   /* Watching the same socket for different events at least won't work on
    * Windows since WSAEventSelect cancels the effect of previous
    * WSAEventSelect calls for the same socket. */
-  if(inf_standalone_io_find_watch_by_socket(INF_STANDALONE_IO(io), socket))
+  if(g_hash_table_lookup(priv->sockets, INF_STANDALONE_IO_SOCKET_KEY(*socket)))
   {
     g_mutex_unlock(&priv->mutex);
     return NULL;
   }
 
-  /* TODO: If we are currently polling we should not modify the fds array
-   * array but do this after wakeup directly after the poll call. */
-
   /* Socket is not already present, so create new watch */
-  if(priv->fd_size == priv->fd_alloc)
+  if(priv->n_watches == priv->watches_alloc)
   {
-    priv->fd_alloc += 4;
-
-    priv->events = g_realloc(
-      priv->events,
-      priv->fd_alloc * sizeof(InfStandaloneIoNativeEvent)
-    );
+    priv->watches_alloc *= 2;
 
     priv->watches = g_realloc(
       priv->watches,
-      (priv->fd_alloc - 1) * sizeof(InfIoWatch*)
+      priv->watches_alloc * sizeof(InfIoWatch*)
     );
-
-    /* Update event pointers, the location of the events in memory might have
-     * changed after realloc. */
-    for(i = 1; i < priv->fd_size; ++i)
-      priv->watches[i-1]->event = &priv->events[i];
-  }
-
-#ifdef G_OS_WIN32
-  priv->events[priv->fd_size] = WSACreateEvent();
-  if(priv->events[priv->fd_size] == WSA_INVALID_EVENT)
-  {
-    error_message = g_win32_error_message(WSAGetLastError());
-    g_warning("WSACreateEvent() failed: %s", error_message);
-    g_free(error_message);
-
-    g_mutex_unlock(&priv->mutex);
-    return NULL;
-  }
-
-  if(WSAEventSelect(*socket, priv->events[priv->fd_size], pevents) ==
-     SOCKET_ERROR)
-  {
-    error_message = g_win32_error_message(WSAGetLastError());
-    g_warning("WSAEventSelect() failed: %s", error_message);
-    g_free(error_message);
-
-    WSACloseEvent(priv->events[priv->fd_size]);
-    g_mutex_unlock(&priv->mutex);
-    return NULL;
   }
-#else
-  priv->events[priv->fd_size].fd = *socket;
-  priv->events[priv->fd_size].events = pevents;
-  priv->events[priv->fd_size].revents = 0;
-#endif
 
   watch = g_slice_new(InfIoWatch);
-  watch->event = &priv->events[priv->fd_size];
   watch->socket = socket;
+  watch->native = *socket;
+  watch->events = events;
+  watch->index = priv->n_watches;
   watch->func = func;
   watch->user_data = user_data;
   watch->notify = notify;
   watch->executing = FALSE;
   watch->disposed = FALSE;
 
-  priv->watches[priv->fd_size-1] = watch;
-  ++priv->fd_size;
+  if(priv->backend->add_watch(INF_STANDALONE_IO(io), watch) == FALSE)
+  {
+    g_slice_free(InfIoWatch, watch);
+    g_mutex_unlock(&priv->mutex);
+    return NULL;
+  }
+
+  priv->watches[priv->n_watches] = watch;
+  ++priv->n_watches;
+  priv->backend->drop_events(INF_STANDALONE_IO(io));
+
+  g_hash_table_insert(
+    priv->sockets,
+    INF_STANDALONE_IO_SOCKET_KEY(watch->native),
+    watch
+  );
 
   inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   g_mutex_unlock(&priv->mutex);
@@ -812,51 +1462,14 @@ inf_standalone_io_io_update_watch(InfIo* io,
                                   InfIoEvent events)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoWatch** watch_iter;
-  long pevents;
-
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
-
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
-#endif
-
   g_mutex_lock(&priv->mutex);
 
-  watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
-  if(watch_iter != NULL)
+  if(inf_standalone_io_has_watch(INF_STANDALONE_IO(io), watch))
   {
-    /* TODO: If we are currently polling we should not modify the fds array
-     * array but do this after wakeup directly after the poll call. */
-
-    /* Update */
-#ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, pevents) == SOCKET_ERROR)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSAEventSelect() failed: %s", error_message);
-      g_free(error_message);
-    }
-#else
-    watch->event->events = pevents;
-#endif
-
+    watch->events = events;
+    priv->backend->update_watch(INF_STANDALONE_IO(io), watch);
     inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   }
 
@@ -868,38 +1481,31 @@ inf_standalone_io_io_remove_watch(InfIo* io,
                                   InfIoWatch* watch)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoWatch** watch_iter;
-  guint index;
-
-#ifdef G_OS_WIN32
-  gchar* error_message;
-#endif
+  InfIoWatch* last;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
-  if(watch_iter != NULL)
+  if(inf_standalone_io_has_watch(INF_STANDALONE_IO(io), watch))
   {
-#ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, 0) == SOCKET_ERROR)
-    {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSAEventSelect() failed: %s", error_message);
-      g_free(error_message);
-    }
+    priv->backend->remove_watch(INF_STANDALONE_IO(io), watch);
+    priv->backend->drop_events(INF_STANDALONE_IO(io));
 
-    if(WSACloseEvent(*watch->event) == FALSE)
+    g_hash_table_remove(
+      priv->sockets,
+      INF_STANDALONE_IO_SOCKET_KEY(watch->native)
+    );
+
+    /* Remove watch by replacing it by the last watch */
+    --priv->n_watches;
+    last = priv->watches[priv->n_watches];
+    if(last != watch)
     {
-      error_message = g_win32_error_message(WSAGetLastError());
-      g_warning("WSACloseEvent() failed: %s", error_message);
-      g_free(error_message);
+      priv->watches[watch->index] = last;
+      last->index = watch->index;
     }
-#endif
 
-    /* TODO: If we are currently polling we should not modify the fds array
-     * array but do this after wakeup directly after the poll call. */
     if(watch->executing)
     {
       /* The callback of the watch is currently running. We don't want to
@@ -916,27 +1522,6 @@ inf_standalone_io_io_remove_watch(InfIo* io,
       g_slice_free(InfIoWatch, watch);
     }
 
-    /* Remove watch by replacing it by the last pollfd/watch */
-    index = 1 + (watch_iter - priv->watches);
-    if(index != priv->fd_size - 1)
-    {
-      memcpy(
-        &priv->events[index],
-        &priv->events[priv->fd_size - 1],
-        sizeof(InfStandaloneIoNativeEvent)
-      );
-
-      memcpy(
-        &priv->watches[index - 1],
-        &priv->watches[priv->fd_size - 2],
-        sizeof(InfIoWatch*)
-      );
-
-      priv->watches[index - 1]->event = &priv->events[index];
-    }
-
-    --priv->fd_size;
-
     inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   }
 
@@ -956,14 +1541,13 @@ inf_standalone_io_io_add_timeout(InfIo* io,
   priv = INF_STANDALONE_IO_PRIVATE(io);
   timeout = g_slice_new(InfIoTimeout);
 
-  g_get_current_time(&timeout->begin);
-  timeout->msecs = msecs;
+  timeout->deadline = g_get_monotonic_time() + (gint64)msecs * 1000;
   timeout->func = func;
   timeout->user_data = user_data;
   timeout->notify = notify;
 
   g_mutex_lock(&priv->mutex);
-  priv->timeouts = g_list_prepend(priv->timeouts, timeout);
+  inf_standalone_io_timeout_heap_insert(priv, timeout);
   inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   g_mutex_unlock(&priv->mutex);
 
@@ -975,16 +1559,15 @@ inf_standalone_io_io_remove_timeout(InfIo* io,
                                     InfIoTimeout* timeout)
 {
   InfStandaloneIoPrivate* priv;
-  GList* item;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  item = g_list_find(priv->timeouts, timeout);
-  if(item != NULL)
+  if(timeout->index < priv->n_timeouts &&
+     priv->timeouts[timeout->index] == timeout)
   {
-    priv->timeouts = g_list_delete_link(priv->timeouts, item);
+    inf_standalone_io_timeout_heap_remove(priv, timeout);
     g_mutex_unlock(&priv->mutex);
 
     if(timeout->notify)
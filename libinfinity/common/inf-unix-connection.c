@@ -0,0 +1,1198 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-unix-connection
+ * @title: InfUnixConnection
+ * @short_description: Connection to a local process
+ * @include: libinfinity/common/inf-unix-connection.h
+ * @see_also: #InfdUnixServer
+ * @stability: Unstable
+ *
+ * #InfUnixConnection is an #InfXmlConnection to another process on the
+ * same host, via a Unix domain socket. It is meant for clients and plugins
+ * which run next to the server, for which the overhead of TLS and XML
+ * parsing is not needed. Messages are transmitted in the same compact
+ * binary form that #InfXmppConnection uses once both sites have agreed on
+ * it.
+ *
+ * There is no encryption and no authentication. Anyone who can connect to
+ * the socket can talk to the server, so access needs to be restricted via
+ * the file system permissions of the socket, or of the directory it is
+ * placed in.
+ *
+ * Unix domain sockets are not supported on Windows.
+ */
+
+#include <libinfinity/common/inf-unix-connection.h>
+#include <libinfinity/common/inf-unix-connection-private.h>
+#include <libinfinity/common/inf-xml-binary-private.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-native-socket.h>
+#include <libinfinity/inf-i18n.h>
+
+#include "config.h"
+
+#ifndef G_OS_WIN32
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <unistd.h>
+# include <fcntl.h>
+
+# include <errno.h>
+#endif
+
+#include <string.h>
+
+/* Version of the protocol, exchanged in the <hello> message */
+#define INF_UNIX_CONNECTION_VERSION 1
+/* Amount of data to read from the socket at once */
+#define INF_UNIX_CONNECTION_READ_SIZE 65536
+
+/* A message which has not yet been written to the socket completely. The
+ * "sent" signal is emitted for it once the first end bytes of outbuf have
+ * been written. xml is NULL for the <hello> message. */
+typedef struct _InfUnixConnectionMessage InfUnixConnectionMessage;
+struct _InfUnixConnectionMessage {
+  xmlNodePtr xml;
+  gsize end;
+};
+
+typedef struct _InfUnixConnectionPrivate InfUnixConnectionPrivate;
+struct _InfUnixConnectionPrivate {
+  InfIo* io;
+  InfIoWatch* watch;
+  InfIoEvent events;
+
+  gchar* path;
+  InfNativeSocket socket;
+  InfXmlConnectionStatus status;
+
+  gchar* local_id;
+  gchar* remote_id;
+
+  InfXmlBinaryTable* out_names;
+  InfXmlBinaryTable* out_values;
+  InfXmlBinaryTable* in_names;
+  InfXmlBinaryTable* in_values;
+
+  GByteArray* encodebuf;
+  GByteArray* outbuf;
+  gsize out_written;
+  GQueue* messages;
+
+  GByteArray* inbuf;
+};
+
+enum {
+  PROP_0,
+
+  PROP_IO,
+  PROP_PATH,
+
+  /* From InfXmlConnection */
+  PROP_STATUS,
+  PROP_NETWORK,
+  PROP_LOCAL_ID,
+  PROP_REMOTE_ID,
+  PROP_LOCAL_CERTIFICATE,
+  PROP_REMOTE_CERTIFICATE
+};
+
+#define INF_UNIX_CONNECTION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_UNIX_CONNECTION, InfUnixConnectionPrivate))
+
+static void inf_unix_connection_xml_connection_iface_init(InfXmlConnectionInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfUnixConnection, inf_unix_connection, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfUnixConnection)
+  G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, inf_unix_connection_xml_connection_iface_init))
+
+static void
+inf_unix_connection_io(InfNativeSocket* socket,
+                       InfIoEvent events,
+                       gpointer user_data);
+
+/* Releases the socket and all per-session state, without notifying */
+static void
+inf_unix_connection_clear(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  InfUnixConnectionMessage* message;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  if(priv->watch != NULL)
+  {
+    inf_io_remove_watch(priv->io, priv->watch);
+    priv->watch = NULL;
+  }
+
+  priv->events = 0;
+
+  if(priv->socket != INVALID_SOCKET)
+  {
+    closesocket(priv->socket);
+    priv->socket = INVALID_SOCKET;
+  }
+
+  while((message = g_queue_pop_head(priv->messages)) != NULL)
+  {
+    if(message->xml != NULL)
+      xmlFreeNode(message->xml);
+    g_slice_free(InfUnixConnectionMessage, message);
+  }
+
+  /* Only the sizes are reset, so that data which is currently being
+   * processed stays valid. */
+  g_byte_array_set_size(priv->outbuf, 0);
+  g_byte_array_set_size(priv->inbuf, 0);
+  priv->out_written = 0;
+
+  if(priv->out_names != NULL)
+  {
+    _inf_xml_binary_table_free(priv->out_names);
+    _inf_xml_binary_table_free(priv->out_values);
+    _inf_xml_binary_table_free(priv->in_names);
+    _inf_xml_binary_table_free(priv->in_values);
+
+    priv->out_names = NULL;
+    priv->out_values = NULL;
+    priv->in_names = NULL;
+    priv->in_values = NULL;
+  }
+}
+
+static void
+inf_unix_connection_set_closed(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  inf_unix_connection_clear(connection);
+
+  if(priv->status != INF_XML_CONNECTION_CLOSED)
+  {
+    priv->status = INF_XML_CONNECTION_CLOSED;
+    g_object_notify(G_OBJECT(connection), "status");
+  }
+}
+
+/* Reports error and closes the connection */
+static void
+inf_unix_connection_fail(InfUnixConnection* connection,
+                         const GError* error)
+{
+  InfUnixConnectionPrivate* priv;
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  g_object_ref(connection);
+
+  inf_xml_connection_error(INF_XML_CONNECTION(connection), error);
+  if(priv->status != INF_XML_CONNECTION_CLOSED)
+    inf_unix_connection_set_closed(connection);
+
+  g_object_unref(connection);
+}
+
+static void
+inf_unix_connection_system_error(InfUnixConnection* connection,
+                                 int code)
+{
+  GError* error;
+  error = NULL;
+
+  inf_native_socket_make_error(code, &error);
+  inf_unix_connection_fail(connection, error);
+  g_error_free(error);
+}
+
+static void
+inf_unix_connection_protocol_error(InfUnixConnection* connection,
+                                   InfUnixConnectionError code,
+                                   const gchar* message)
+{
+  GError* error;
+  error = NULL;
+
+  g_set_error_literal(
+    &error,
+    inf_unix_connection_error_quark(),
+    code,
+    message
+  );
+
+  inf_unix_connection_fail(connection, error);
+  g_error_free(error);
+}
+
+static void
+inf_unix_connection_update_events(InfUnixConnection* connection,
+                                  InfIoEvent events)
+{
+  InfUnixConnectionPrivate* priv;
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  if(priv->events != events)
+  {
+    priv->events = events;
+    inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+}
+
+/* Writes as much of data as the socket accepts without blocking. Returns
+ * the number of bytes written, or -1 if an error occurred, in which case
+ * the connection has been closed. */
+static gssize
+inf_unix_connection_write(InfUnixConnection* connection,
+                          const guint8* data,
+                          gsize len)
+{
+  InfUnixConnectionPrivate* priv;
+  gsize written;
+  ssize_t result;
+  int errcode;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+  written = 0;
+
+  do
+  {
+    result = send(
+      priv->socket,
+      data + written,
+      len - written,
+      INF_NATIVE_SOCKET_SENDRECV_FLAGS
+    );
+
+    errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+
+    if(result < 0 &&
+       errcode != INF_NATIVE_SOCKET_EINTR &&
+       errcode != INF_NATIVE_SOCKET_EAGAIN)
+    {
+      inf_unix_connection_system_error(connection, errcode);
+      return -1;
+    }
+    else if(result > 0)
+    {
+      written += result;
+    }
+  } while(written < len && (result > 0 || errcode == INF_NATIVE_SOCKET_EINTR));
+
+  return written;
+}
+
+/* Encodes xml and sends it, or queues it if the socket does not accept all
+ * of it right now. Takes ownership of xml. */
+static void
+inf_unix_connection_send_node(InfUnixConnection* connection,
+                              xmlNodePtr xml,
+                              gboolean emit_sent)
+{
+  InfUnixConnectionPrivate* priv;
+  InfUnixConnectionMessage* message;
+  const guint8* data;
+  gsize len;
+  gssize written;
+  guint offset;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  offset = _inf_xml_binary_encode(
+    priv->out_names,
+    priv->out_values,
+    priv->encodebuf,
+    xml
+  );
+
+  if(!emit_sent)
+  {
+    xmlFreeNode(xml);
+    xml = NULL;
+  }
+
+  data = priv->encodebuf->data + offset;
+  len = priv->encodebuf->len - offset;
+
+  /* Write directly if nothing else is waiting to be written */
+  written = 0;
+  if(priv->out_written == priv->outbuf->len)
+  {
+    written = inf_unix_connection_write(connection, data, len);
+    if(written < 0)
+    {
+      if(xml != NULL)
+        xmlFreeNode(xml);
+      return;
+    }
+  }
+
+  if((gsize)written < len)
+  {
+    g_byte_array_append(priv->outbuf, data + written, len - written);
+
+    message = g_slice_new(InfUnixConnectionMessage);
+    message->xml = xml;
+    message->end = priv->outbuf->len;
+    g_queue_push_tail(priv->messages, message);
+
+    inf_unix_connection_update_events(
+      connection,
+      priv->events | INF_IO_OUTGOING
+    );
+  }
+  else if(xml != NULL)
+  {
+    inf_xml_connection_sent(INF_XML_CONNECTION(connection), xml);
+    xmlFreeNode(xml);
+  }
+}
+
+static void
+inf_unix_connection_send_hello(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"hello");
+  inf_xml_util_set_attribute_uint(xml, "version", INF_UNIX_CONNECTION_VERSION);
+  inf_xml_util_set_attribute(xml, "id", priv->local_id);
+
+  inf_unix_connection_send_node(connection, xml, FALSE);
+}
+
+/* Starts a session on a connected, non-blocking socket */
+static void
+inf_unix_connection_setup(InfUnixConnection* connection,
+                          InfNativeSocket socket)
+{
+  InfUnixConnectionPrivate* priv;
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_XML_CONNECTION_CLOSED);
+  g_assert(priv->watch == NULL);
+
+  priv->socket = socket;
+  priv->out_names = _inf_xml_binary_table_new(TRUE);
+  priv->out_values = _inf_xml_binary_table_new(TRUE);
+  priv->in_names = _inf_xml_binary_table_new(FALSE);
+  priv->in_values = _inf_xml_binary_table_new(FALSE);
+
+  priv->events = INF_IO_INCOMING | INF_IO_ERROR;
+  priv->watch = inf_io_add_watch(
+    priv->io,
+    &priv->socket,
+    priv->events,
+    inf_unix_connection_io,
+    connection,
+    NULL
+  );
+
+  priv->status = INF_XML_CONNECTION_OPENING;
+  g_object_notify(G_OBJECT(connection), "status");
+
+  /* Both sites send their hello right away, and the connection is open as
+   * soon as the one of the remote site has arrived. */
+  inf_unix_connection_send_hello(connection);
+}
+
+#ifndef G_OS_WIN32
+static gboolean
+inf_unix_connection_set_nonblocking(InfNativeSocket socket,
+                                    GError** error)
+{
+  int result;
+
+  result = fcntl(socket, F_GETFL);
+  if(result == -1)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    return FALSE;
+  }
+
+  if(fcntl(socket, F_SETFL, result | O_NONBLOCK) == -1)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+#endif
+
+static void
+inf_unix_connection_process_hello(InfUnixConnection* connection,
+                                  xmlNodePtr xml)
+{
+  InfUnixConnectionPrivate* priv;
+  xmlChar* id;
+  guint version;
+  GError* error;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+  error = NULL;
+
+  if(strcmp((const char*)xml->name, "hello") != 0)
+  {
+    inf_unix_connection_protocol_error(
+      connection,
+      INF_UNIX_CONNECTION_ERROR_INVALID_DATA,
+      _("The remote site did not start the session properly")
+    );
+
+    return;
+  }
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "version", &version,
+                                               &error))
+  {
+    inf_unix_connection_fail(connection, error);
+    g_error_free(error);
+    return;
+  }
+
+  if(version != INF_UNIX_CONNECTION_VERSION)
+  {
+    inf_unix_connection_protocol_error(
+      connection,
+      INF_UNIX_CONNECTION_ERROR_UNSUPPORTED_VERSION,
+      _("The remote site uses an unsupported protocol version")
+    );
+
+    return;
+  }
+
+  id = inf_xml_util_get_attribute_required(xml, "id", &error);
+  if(id == NULL)
+  {
+    inf_unix_connection_fail(connection, error);
+    g_error_free(error);
+    return;
+  }
+
+  g_free(priv->remote_id);
+  priv->remote_id = g_strdup((const gchar*)id);
+  xmlFree(id);
+
+  priv->status = INF_XML_CONNECTION_OPEN;
+
+  g_object_freeze_notify(G_OBJECT(connection));
+  g_object_notify(G_OBJECT(connection), "remote-id");
+  g_object_notify(G_OBJECT(connection), "status");
+  g_object_thaw_notify(G_OBJECT(connection));
+}
+
+/* Decodes all complete messages in inbuf */
+static void
+inf_unix_connection_process(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  const guint8* begin;
+  const guint8* cur;
+  const guint8* end;
+  guint64 size;
+  xmlNodePtr xml;
+  gsize processed;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+  processed = 0;
+
+  while(priv->status == INF_XML_CONNECTION_OPENING ||
+        priv->status == INF_XML_CONNECTION_OPEN)
+  {
+    begin = priv->inbuf->data + processed;
+    end = priv->inbuf->data + priv->inbuf->len;
+    cur = begin;
+
+    if(!_inf_xml_binary_get_uint(&cur, end, &size))
+    {
+      /* Wait for more data, unless the length is invalid */
+      if(end - begin >= INF_XML_BINARY_HEADER_SIZE)
+      {
+        inf_unix_connection_protocol_error(
+          connection,
+          INF_UNIX_CONNECTION_ERROR_INVALID_DATA,
+          _("Received invalid data")
+        );
+      }
+
+      break;
+    }
+
+    if(size > INF_XML_BINARY_MAX_STANZA_SIZE)
+    {
+      inf_unix_connection_protocol_error(
+        connection,
+        INF_UNIX_CONNECTION_ERROR_MESSAGE_TOO_LARGE,
+        _("Received message is too large")
+      );
+
+      break;
+    }
+
+    if(size > (guint64)(end - cur))
+      break;
+
+    processed += (cur - begin) + size;
+
+    end = cur + size;
+    xml = _inf_xml_binary_get_node(
+      priv->in_names,
+      priv->in_values,
+      &cur,
+      end
+    );
+
+    if(xml == NULL || cur != end)
+    {
+      if(xml != NULL)
+        xmlFreeNode(xml);
+
+      inf_unix_connection_protocol_error(
+        connection,
+        INF_UNIX_CONNECTION_ERROR_INVALID_DATA,
+        _("Received invalid data")
+      );
+
+      break;
+    }
+
+    if(priv->status == INF_XML_CONNECTION_OPENING)
+      inf_unix_connection_process_hello(connection, xml);
+    else
+      inf_xml_connection_received(INF_XML_CONNECTION(connection), xml);
+
+    xmlFreeNode(xml);
+  }
+
+  /* If the connection has been closed, then the buffer has been cleared
+   * already. */
+  if(priv->status != INF_XML_CONNECTION_CLOSED)
+    g_byte_array_remove_range(priv->inbuf, 0, processed);
+}
+
+static void
+inf_unix_connection_io_incoming(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  guint len;
+  ssize_t result;
+  int errcode;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  do
+  {
+    /* Read directly into the input buffer */
+    len = priv->inbuf->len;
+    g_byte_array_set_size(priv->inbuf, len + INF_UNIX_CONNECTION_READ_SIZE);
+
+    result = recv(
+      priv->socket,
+      priv->inbuf->data + len,
+      INF_UNIX_CONNECTION_READ_SIZE,
+      INF_NATIVE_SOCKET_SENDRECV_FLAGS
+    );
+
+    errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+    g_byte_array_set_size(priv->inbuf, len + MAX(result, 0));
+
+    if(result < 0 &&
+       errcode != INF_NATIVE_SOCKET_EINTR &&
+       errcode != INF_NATIVE_SOCKET_EAGAIN)
+    {
+      inf_unix_connection_system_error(connection, errcode);
+    }
+    else if(result == 0)
+    {
+      /* The remote site has closed the connection */
+      inf_unix_connection_set_closed(connection);
+    }
+    else if(result > 0)
+    {
+      inf_unix_connection_process(connection);
+    }
+  } while( ((result > 0) ||
+            (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
+           (priv->status == INF_XML_CONNECTION_OPENING ||
+            priv->status == INF_XML_CONNECTION_OPEN));
+}
+
+static void
+inf_unix_connection_io_outgoing(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  InfUnixConnectionMessage* message;
+  gssize written;
+  InfIoEvent events;
+  GList* item;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+  g_assert(priv->out_written < priv->outbuf->len);
+
+  written = inf_unix_connection_write(
+    connection,
+    priv->outbuf->data + priv->out_written,
+    priv->outbuf->len - priv->out_written
+  );
+
+  if(written < 0)
+    return;
+
+  priv->out_written += written;
+
+  /* Signal handlers might send more messages, which are appended to outbuf,
+   * or close the connection, which clears the queue. */
+  while((message = g_queue_peek_head(priv->messages)) != NULL &&
+        message->end <= priv->out_written)
+  {
+    g_queue_pop_head(priv->messages);
+
+    if(message->xml != NULL)
+    {
+      inf_xml_connection_sent(INF_XML_CONNECTION(connection), message->xml);
+      xmlFreeNode(message->xml);
+    }
+
+    g_slice_free(InfUnixConnectionMessage, message);
+  }
+
+  if(priv->status == INF_XML_CONNECTION_CLOSED)
+    return;
+
+  if(priv->out_written == priv->outbuf->len)
+  {
+    g_byte_array_set_size(priv->outbuf, 0);
+    priv->out_written = 0;
+
+    if(priv->status == INF_XML_CONNECTION_CLOSING)
+    {
+      inf_unix_connection_set_closed(connection);
+    }
+    else
+    {
+      events = priv->events & ~INF_IO_OUTGOING;
+      inf_unix_connection_update_events(connection, events);
+    }
+  }
+  else if(priv->out_written >= priv->outbuf->len / 2)
+  {
+    /* Move the remaining data to the front, so that the buffer does not
+     * grow indefinitely if the remote site is slow to read. */
+    g_byte_array_remove_range(priv->outbuf, 0, priv->out_written);
+    for(item = priv->messages->head; item != NULL; item = item->next)
+      ((InfUnixConnectionMessage*)item->data)->end -= priv->out_written;
+    priv->out_written = 0;
+  }
+}
+
+static void
+inf_unix_connection_io(InfNativeSocket* socket,
+                       InfIoEvent events,
+                       gpointer user_data)
+{
+  InfUnixConnection* connection;
+  InfUnixConnectionPrivate* priv;
+  socklen_t len;
+  int errcode;
+
+  connection = INF_UNIX_CONNECTION(user_data);
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+  g_object_ref(connection);
+
+  g_assert(priv->status != INF_XML_CONNECTION_CLOSED);
+
+  if(events & INF_IO_ERROR)
+  {
+    len = sizeof(int);
+#ifdef G_OS_WIN32
+    getsockopt(priv->socket, SOL_SOCKET, SO_ERROR, (char*)&errcode, &len);
+#else
+    getsockopt(priv->socket, SOL_SOCKET, SO_ERROR, &errcode, &len);
+#endif
+
+    if(errcode != 0)
+    {
+      inf_unix_connection_system_error(connection, errcode);
+      g_object_unref(connection);
+      return;
+    }
+  }
+
+  /* Read what the remote site has sent before it hung up */
+  if((events & INF_IO_INCOMING) &&
+     (priv->status == INF_XML_CONNECTION_OPENING ||
+      priv->status == INF_XML_CONNECTION_OPEN))
+  {
+    inf_unix_connection_io_incoming(connection);
+  }
+
+  if(priv->status != INF_XML_CONNECTION_CLOSED)
+  {
+    if(events & INF_IO_ERROR)
+    {
+      inf_unix_connection_set_closed(connection);
+    }
+    else if((events & INF_IO_OUTGOING) &&
+            (priv->out_written < priv->outbuf->len))
+    {
+      inf_unix_connection_io_outgoing(connection);
+    }
+  }
+
+  g_object_unref(connection);
+}
+
+/*
+ * GObject overrides
+ */
+
+static void
+inf_unix_connection_init(InfUnixConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  static gint serial = 0;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  priv->io = NULL;
+  priv->watch = NULL;
+  priv->events = 0;
+
+  priv->path = NULL;
+  priv->socket = INVALID_SOCKET;
+  priv->status = INF_XML_CONNECTION_CLOSED;
+
+  /* The process ID makes the ID unique among all the local processes which
+   * connect to the same server. */
+#ifndef G_OS_WIN32
+  priv->local_id = g_strdup_printf(
+    "local:%lu.%d",
+    (unsigned long)getpid(),
+    g_atomic_int_add(&serial, 1)
+  );
+#else
+  priv->local_id = g_strdup_printf(
+    "local:%d",
+    g_atomic_int_add(&serial, 1)
+  );
+#endif
+
+  priv->remote_id = NULL;
+
+  priv->out_names = NULL;
+  priv->out_values = NULL;
+  priv->in_names = NULL;
+  priv->in_values = NULL;
+
+  priv->encodebuf = g_byte_array_new();
+  priv->outbuf = g_byte_array_new();
+  priv->out_written = 0;
+  priv->messages = g_queue_new();
+
+  priv->inbuf = g_byte_array_new();
+}
+
+static void
+inf_unix_connection_dispose(GObject* object)
+{
+  InfUnixConnection* connection;
+  InfUnixConnectionPrivate* priv;
+
+  connection = INF_UNIX_CONNECTION(object);
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  if(priv->status != INF_XML_CONNECTION_CLOSED)
+    inf_unix_connection_set_closed(connection);
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
+  G_OBJECT_CLASS(inf_unix_connection_parent_class)->dispose(object);
+}
+
+static void
+inf_unix_connection_finalize(GObject* object)
+{
+  InfUnixConnection* connection;
+  InfUnixConnectionPrivate* priv;
+
+  connection = INF_UNIX_CONNECTION(object);
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  g_free(priv->path);
+  g_free(priv->local_id);
+  g_free(priv->remote_id);
+
+  g_byte_array_free(priv->encodebuf, TRUE);
+  g_byte_array_free(priv->outbuf, TRUE);
+  g_queue_free(priv->messages);
+  g_byte_array_free(priv->inbuf, TRUE);
+
+  G_OBJECT_CLASS(inf_unix_connection_parent_class)->finalize(object);
+}
+
+static void
+inf_unix_connection_set_property(GObject* object,
+                                 guint prop_id,
+                                 const GValue* value,
+                                 GParamSpec* pspec)
+{
+  InfUnixConnection* connection;
+  InfUnixConnectionPrivate* priv;
+
+  connection = INF_UNIX_CONNECTION(object);
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_assert(priv->io == NULL); /* construct only */
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_PATH:
+    g_assert(priv->path == NULL); /* construct only */
+    priv->path = g_value_dup_string(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_unix_connection_get_property(GObject* object,
+                                 guint prop_id,
+                                 GValue* value,
+                                 GParamSpec* pspec)
+{
+  InfUnixConnection* connection;
+  InfUnixConnectionPrivate* priv;
+
+  connection = INF_UNIX_CONNECTION(object);
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, G_OBJECT(priv->io));
+    break;
+  case PROP_PATH:
+    g_value_set_string(value, priv->path);
+    break;
+  case PROP_STATUS:
+    g_value_set_enum(value, priv->status);
+    break;
+  case PROP_NETWORK:
+    g_value_set_static_string(value, "local");
+    break;
+  case PROP_LOCAL_ID:
+    g_value_set_string(value, priv->local_id);
+    break;
+  case PROP_REMOTE_ID:
+    g_value_set_string(value, priv->remote_id);
+    break;
+  case PROP_LOCAL_CERTIFICATE:
+    g_value_set_pointer(value, NULL);
+    break;
+  case PROP_REMOTE_CERTIFICATE:
+    g_value_set_boxed(value, NULL);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * InfXmlConnection interface implementation
+ */
+
+static gboolean
+inf_unix_connection_xml_connection_open(InfXmlConnection* connection,
+                                        GError** error)
+{
+#ifndef G_OS_WIN32
+  InfUnixConnectionPrivate* priv;
+  struct sockaddr_un addr;
+  InfNativeSocket socket_;
+
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_XML_CONNECTION_CLOSED);
+  g_assert(priv->path != NULL);
+
+  if(strlen(priv->path) >= sizeof(addr.sun_path))
+  {
+    inf_native_socket_make_error(ENAMETOOLONG, error);
+    return FALSE;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, priv->path);
+
+  socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(socket_ == INVALID_SOCKET)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    return FALSE;
+  }
+
+  /* Connecting to a local socket does not block for long, so the socket is
+   * only made non-blocking afterwards. This avoids having to wait for the
+   * connection to be established. */
+  if(connect(socket_, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    closesocket(socket_);
+    return FALSE;
+  }
+
+  if(!inf_unix_connection_set_nonblocking(socket_, error))
+  {
+    closesocket(socket_);
+    return FALSE;
+  }
+
+  /* The server announces its ID in its hello, until then we use the path */
+  g_free(priv->remote_id);
+  priv->remote_id = g_strdup(priv->path);
+
+  inf_unix_connection_setup(INF_UNIX_CONNECTION(connection), socket_);
+  return TRUE;
+#else
+  g_set_error_literal(
+    error,
+    inf_unix_connection_error_quark(),
+    INF_UNIX_CONNECTION_ERROR_NOT_SUPPORTED,
+    _("Unix domain sockets are not supported on this platform")
+  );
+
+  return FALSE;
+#endif
+}
+
+static void
+inf_unix_connection_xml_connection_close(InfXmlConnection* connection)
+{
+  InfUnixConnectionPrivate* priv;
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_XML_CONNECTION_OPENING ||
+           priv->status == INF_XML_CONNECTION_OPEN);
+
+  if(priv->out_written < priv->outbuf->len)
+  {
+    /* Write out what has already been sent before closing the socket. No
+     * more data is read in the meanwhile. */
+    inf_unix_connection_update_events(
+      INF_UNIX_CONNECTION(connection),
+      INF_IO_OUTGOING | INF_IO_ERROR
+    );
+
+    priv->status = INF_XML_CONNECTION_CLOSING;
+    g_object_notify(G_OBJECT(connection), "status");
+  }
+  else
+  {
+    inf_unix_connection_set_closed(INF_UNIX_CONNECTION(connection));
+  }
+}
+
+static void
+inf_unix_connection_xml_connection_send(InfXmlConnection* connection,
+                                        xmlNodePtr xml)
+{
+  InfUnixConnectionPrivate* priv;
+  priv = INF_UNIX_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_XML_CONNECTION_OPEN);
+
+  g_object_ref(connection);
+  inf_unix_connection_send_node(INF_UNIX_CONNECTION(connection), xml, TRUE);
+  g_object_unref(connection);
+}
+
+/*
+ * GObject type registration
+ */
+
+static void
+inf_unix_connection_class_init(InfUnixConnectionClass* connection_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(connection_class);
+
+  object_class->dispose = inf_unix_connection_dispose;
+  object_class->finalize = inf_unix_connection_finalize;
+  object_class->set_property = inf_unix_connection_set_property;
+  object_class->get_property = inf_unix_connection_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "I/O handler",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_PATH,
+    g_param_spec_string(
+      "path",
+      "Path",
+      "File system path of the socket",
+      NULL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_override_property(object_class, PROP_STATUS, "status");
+  g_object_class_override_property(object_class, PROP_NETWORK, "network");
+  g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
+  g_object_class_override_property(object_class, PROP_REMOTE_ID, "remote-id");
+
+  g_object_class_override_property(
+    object_class,
+    PROP_LOCAL_CERTIFICATE,
+    "local-certificate"
+  );
+
+  g_object_class_override_property(
+    object_class,
+    PROP_REMOTE_CERTIFICATE,
+    "remote-certificate"
+  );
+}
+
+static void
+inf_unix_connection_xml_connection_iface_init(
+  InfXmlConnectionInterface* iface)
+{
+  iface->open = inf_unix_connection_xml_connection_open;
+  iface->close = inf_unix_connection_xml_connection_close;
+  iface->send = inf_unix_connection_xml_connection_send;
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * inf_unix_connection_error_quark:
+ *
+ * Error domain for errors of #InfUnixConnection. Errors in this domain
+ * will be from the #InfUnixConnectionError enumeration. See #GError for
+ * information on error domains.
+ *
+ * Returns: A #GQuark representing the INF_UNIX_CONNECTION_ERROR domain.
+ */
+GQuark
+inf_unix_connection_error_quark(void)
+{
+  return g_quark_from_static_string("INF_UNIX_CONNECTION_ERROR");
+}
+
+/**
+ * inf_unix_connection_new: (constructor)
+ * @io: A #InfIo object used to watch the socket for events.
+ * @path: The file system path of the socket to connect to.
+ *
+ * Creates a new #InfUnixConnection. The connection is not yet established.
+ * Use inf_xml_connection_open() to connect to the server listening on
+ * @path, such as a #InfdUnixServer.
+ *
+ * Returns: (transfer full): A new #InfUnixConnection. Free with
+ * g_object_unref().
+ **/
+InfUnixConnection*
+inf_unix_connection_new(InfIo* io,
+                        const gchar* path)
+{
+  GObject* object;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+
+  object = g_object_new(
+    INF_TYPE_UNIX_CONNECTION,
+    "io", io,
+    "path", path,
+    NULL
+  );
+
+  return INF_UNIX_CONNECTION(object);
+}
+
+/**
+ * inf_unix_connection_get_path:
+ * @connection: A #InfUnixConnection.
+ *
+ * Returns the file system path of the socket that @connection is connected
+ * to, or, for connections accepted by a server, the path that the server
+ * is listening on.
+ *
+ * Returns: The path of the socket, owned by @connection.
+ **/
+const gchar*
+inf_unix_connection_get_path(InfUnixConnection* connection)
+{
+  g_return_val_if_fail(INF_IS_UNIX_CONNECTION(connection), NULL);
+  return INF_UNIX_CONNECTION_PRIVATE(connection)->path;
+}
+
+/* Creates a new connection from an accepted socket. This is only used by
+ * InfdUnixServer and should not be considered regular API. Do not call
+ * this function. Language bindings should not wrap it. */
+InfUnixConnection*
+_inf_unix_connection_accepted(InfIo* io,
+                              InfNativeSocket socket,
+                              const gchar* path,
+                              GError** error)
+{
+  InfUnixConnection* connection;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(socket != INVALID_SOCKET, NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+
+#ifndef G_OS_WIN32
+  if(!inf_unix_connection_set_nonblocking(socket, error))
+    return NULL;
+#endif
+
+  connection = inf_unix_connection_new(io, path);
+  inf_unix_connection_setup(connection, socket);
+
+  return connection;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,98 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_UNIX_CONNECTION_H__
+#define __INF_UNIX_CONNECTION_H__
+
+#include <libinfinity/common/inf-io.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INF_TYPE_UNIX_CONNECTION                 (inf_unix_connection_get_type())
+#define INF_UNIX_CONNECTION(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INF_TYPE_UNIX_CONNECTION, InfUnixConnection))
+#define INF_UNIX_CONNECTION_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INF_TYPE_UNIX_CONNECTION, InfUnixConnectionClass))
+#define INF_IS_UNIX_CONNECTION(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INF_TYPE_UNIX_CONNECTION))
+#define INF_IS_UNIX_CONNECTION_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INF_TYPE_UNIX_CONNECTION))
+#define INF_UNIX_CONNECTION_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INF_TYPE_UNIX_CONNECTION, InfUnixConnectionClass))
+
+typedef struct _InfUnixConnection InfUnixConnection;
+typedef struct _InfUnixConnectionClass InfUnixConnectionClass;
+
+/**
+ * InfUnixConnectionError:
+ * @INF_UNIX_CONNECTION_ERROR_INVALID_DATA: The remote site has sent data
+ * which could not be decoded.
+ * @INF_UNIX_CONNECTION_ERROR_MESSAGE_TOO_LARGE: The remote site has sent a
+ * message which exceeds the maximum message size.
+ * @INF_UNIX_CONNECTION_ERROR_UNSUPPORTED_VERSION: The remote site uses a
+ * different version of the protocol.
+ * @INF_UNIX_CONNECTION_ERROR_NOT_SUPPORTED: Unix domain sockets are not
+ * available on this platform.
+ *
+ * Specifies the error codes in the
+ * <literal>INF_UNIX_CONNECTION_ERROR</literal> error domain.
+ */
+typedef enum _InfUnixConnectionError {
+  INF_UNIX_CONNECTION_ERROR_INVALID_DATA,
+  INF_UNIX_CONNECTION_ERROR_MESSAGE_TOO_LARGE,
+  INF_UNIX_CONNECTION_ERROR_UNSUPPORTED_VERSION,
+  INF_UNIX_CONNECTION_ERROR_NOT_SUPPORTED
+} InfUnixConnectionError;
+
+/**
+ * InfUnixConnectionClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfUnixConnectionClass {
+  /*< private >*/
+  GObjectClass parent_class;
+};
+
+/**
+ * InfUnixConnection:
+ *
+ * #InfUnixConnection is an opaque data type. You should only access it
+ * via the public API functions.
+ */
+struct _InfUnixConnection {
+  /*< private >*/
+  GObject parent;
+};
+
+GType
+inf_unix_connection_get_type(void) G_GNUC_CONST;
+
+GQuark
+inf_unix_connection_error_quark(void);
+
+InfUnixConnection*
+inf_unix_connection_new(InfIo* io,
+                        const gchar* path);
+
+const gchar*
+inf_unix_connection_get_path(InfUnixConnection* connection);
+
+G_END_DECLS
+
+#endif /* __INF_UNIX_CONNECTION_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,640 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Compact binary encoding of XML messages, shared by InfXmppConnection and
+ * InfUnixConnection. A message is sent as its length, followed by the
+ * element tree in the form written by _inf_xml_binary_put_node(). All
+ * integers are sent in a variable-length encoding with 7 bits per byte.
+ *
+ * Element and attribute names, and short attribute values, are sent in full
+ * only the first time. Both sites put them into a table, and later
+ * occurrences refer to their index in that table. Attribute values which
+ * are decimal numbers, such as positions and lengths of operations, are
+ * sent as integers. Text content is always sent as-is. */
+
+#include <libinfinity/common/inf-xml-binary-private.h>
+
+#include <string.h>
+
+/* Number of entries in each of the string tables */
+#define INF_XML_BINARY_TABLE_SIZE 1024
+/* Longer attribute values are not put into the table */
+#define INF_XML_BINARY_MAX_VALUE_LENGTH 64
+#define INF_XML_BINARY_MAX_DEPTH 256
+
+/* Tags for the children of an element */
+#define INF_XML_BINARY_CHILD_ELEMENT 0
+#define INF_XML_BINARY_CHILD_TEXT 1
+
+/* Values with special meaning when referring to a table entry. Table entry
+ * i is referred to by i + INF_XML_BINARY_NAME_TABLE or
+ * i + INF_XML_BINARY_VALUE_TABLE, respectively. */
+#define INF_XML_BINARY_LITERAL 0
+#define INF_XML_BINARY_NUMBER 1
+#define INF_XML_BINARY_NAME_TABLE 1
+#define INF_XML_BINARY_VALUE_TABLE 2
+
+struct _InfXmlBinaryTable {
+  gchar* entries[INF_XML_BINARY_TABLE_SIZE];
+  /* Maps strings to their slot plus one. Only needed for encoding. */
+  GHashTable* index;
+  guint next;
+};
+
+InfXmlBinaryTable*
+_inf_xml_binary_table_new(gboolean with_index)
+{
+  InfXmlBinaryTable* table;
+  table = g_new0(InfXmlBinaryTable, 1);
+
+  if(with_index)
+    table->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+  return table;
+}
+
+void
+_inf_xml_binary_table_free(InfXmlBinaryTable* table)
+{
+  guint i;
+
+  for(i = 0; i < INF_XML_BINARY_TABLE_SIZE; ++i)
+    g_free(table->entries[i]);
+
+  if(table->index != NULL)
+    g_hash_table_destroy(table->index);
+
+  g_free(table);
+}
+
+/* Returns the slot of str in table, or -1 if str is not in the table. */
+static gint
+inf_xml_binary_table_lookup(InfXmlBinaryTable* table,
+                            const gchar* str)
+{
+  g_assert(table->index != NULL);
+  return GPOINTER_TO_INT(g_hash_table_lookup(table->index, str)) - 1;
+}
+
+/* Adds a string to the table. When the table is full, the oldest entry is
+ * replaced. Both sites add the same strings in the same order, so the
+ * slots refer to the same strings on both sites. Returns the new entry. */
+static const gchar*
+inf_xml_binary_table_add(InfXmlBinaryTable* table,
+                         const gchar* str,
+                         gsize len)
+{
+  gchar** entry;
+
+  entry = &table->entries[table->next];
+  if(*entry != NULL)
+  {
+    if(table->index != NULL)
+      g_hash_table_remove(table->index, *entry);
+    g_free(*entry);
+  }
+
+  *entry = g_strndup(str, len);
+  if(table->index != NULL)
+  {
+    g_hash_table_insert(
+      table->index,
+      *entry,
+      GINT_TO_POINTER(table->next + 1)
+    );
+  }
+
+  table->next = (table->next + 1) % INF_XML_BINARY_TABLE_SIZE;
+  return *entry;
+}
+
+/* Writes value to out, which needs to have space for
+ * INF_XML_BINARY_HEADER_SIZE bytes. Returns the number of
+ * bytes written. */
+guint
+_inf_xml_binary_write_uint(guint8* out,
+                           guint64 value)
+{
+  guint len;
+
+  len = 0;
+  while(value >= 0x80)
+  {
+    out[len++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+
+  out[len++] = value;
+  return len;
+}
+
+static void
+inf_xml_binary_put_uint(GByteArray* buf,
+                        guint64 value)
+{
+  guint8 bytes[INF_XML_BINARY_HEADER_SIZE];
+  guint len;
+
+  len = _inf_xml_binary_write_uint(bytes, value);
+  g_byte_array_append(buf, bytes, len);
+}
+
+static void
+inf_xml_binary_put_string(GByteArray* buf,
+                          const gchar* str,
+                          gsize len)
+{
+  inf_xml_binary_put_uint(buf, len);
+  g_byte_array_append(buf, (const guint8*)str, len);
+}
+
+static void
+inf_xml_binary_put_name(InfXmlBinaryTable* table,
+                        GByteArray* buf,
+                        const xmlNs* ns,
+                        const xmlChar* name)
+{
+  gchar* qualified;
+  const gchar* str;
+  gint slot;
+  gsize len;
+
+  qualified = NULL;
+  if(ns != NULL && ns->prefix != NULL)
+  {
+    qualified = g_strconcat(
+      (const gchar*)ns->prefix,
+      ":",
+      (const gchar*)name,
+      NULL
+    );
+
+    str = qualified;
+  }
+  else
+  {
+    str = (const gchar*)name;
+  }
+
+  slot = inf_xml_binary_table_lookup(table, str);
+  if(slot >= 0)
+  {
+    inf_xml_binary_put_uint(
+      buf,
+      slot + INF_XML_BINARY_NAME_TABLE
+    );
+  }
+  else
+  {
+    len = strlen(str);
+    inf_xml_binary_put_uint(buf, INF_XML_BINARY_LITERAL);
+    inf_xml_binary_put_string(buf, str, len);
+    inf_xml_binary_table_add(table, str, len);
+  }
+
+  g_free(qualified);
+}
+
+/* Returns TRUE if value is a decimal number without leading zeros which
+ * can be sent as an integer, and stores the number in number. */
+static gboolean
+inf_xml_binary_is_number(const gchar* value,
+                         guint64* number)
+{
+  const gchar* pos;
+
+  if(value[0] == '\0' || (value[0] == '0' && value[1] != '\0'))
+    return FALSE;
+
+  /* Up to 19 digits always fit into 64 bits */
+  for(pos = value; *pos != '\0'; ++pos)
+    if(!g_ascii_isdigit(*pos) || pos - value >= 19)
+      return FALSE;
+
+  *number = g_ascii_strtoull(value, NULL, 10);
+  return TRUE;
+}
+
+static void
+inf_xml_binary_put_value(InfXmlBinaryTable* table,
+                         GByteArray* buf,
+                         const gchar* value)
+{
+  guint64 number;
+  gint slot;
+  gsize len;
+
+  if(inf_xml_binary_is_number(value, &number))
+  {
+    inf_xml_binary_put_uint(buf, INF_XML_BINARY_NUMBER);
+    inf_xml_binary_put_uint(buf, number);
+    return;
+  }
+
+  len = strlen(value);
+  if(len <= INF_XML_BINARY_MAX_VALUE_LENGTH)
+  {
+    slot = inf_xml_binary_table_lookup(table, value);
+    if(slot >= 0)
+    {
+      inf_xml_binary_put_uint(
+        buf,
+        slot + INF_XML_BINARY_VALUE_TABLE
+      );
+
+      return;
+    }
+  }
+
+  inf_xml_binary_put_uint(buf, INF_XML_BINARY_LITERAL);
+  inf_xml_binary_put_string(buf, value, len);
+
+  if(len <= INF_XML_BINARY_MAX_VALUE_LENGTH)
+    inf_xml_binary_table_add(table, value, len);
+}
+
+/* An element is written as its name, the number of attributes, each
+ * attribute as name and value, the number of children, and each child as
+ * a tag followed by either an element or a string. Namespace definitions
+ * are written as xmlns attributes. */
+void
+_inf_xml_binary_put_node(InfXmlBinaryTable* names,
+                         InfXmlBinaryTable* values,
+                         GByteArray* buf,
+                         xmlNodePtr xml)
+{
+  xmlNs xmlns;
+  xmlNsPtr ns;
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  xmlChar* value;
+  guint count;
+
+  /* Used to write namespace definitions as xmlns:prefix attributes */
+  memset(&xmlns, 0, sizeof(xmlns));
+
+  inf_xml_binary_put_name(names, buf, xml->ns, xml->name);
+
+  count = 0;
+  for(ns = xml->nsDef; ns != NULL; ns = ns->next)
+    ++count;
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+    ++count;
+  inf_xml_binary_put_uint(buf, count);
+
+  for(ns = xml->nsDef; ns != NULL; ns = ns->next)
+  {
+    xmlns.prefix = ns->prefix != NULL ? (const xmlChar*)"xmlns" : NULL;
+
+    inf_xml_binary_put_name(
+      names,
+      buf,
+      &xmlns,
+      ns->prefix != NULL ? ns->prefix : (const xmlChar*)"xmlns"
+    );
+
+    inf_xml_binary_put_value(
+      values,
+      buf,
+      ns->href != NULL ? (const gchar*)ns->href : ""
+    );
+  }
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    inf_xml_binary_put_name(names, buf, attr->ns, attr->name);
+
+    value = xmlNodeListGetString(NULL, attr->children, 1);
+
+    inf_xml_binary_put_value(
+      values,
+      buf,
+      value != NULL ? (const gchar*)value : ""
+    );
+
+    xmlFree(value);
+  }
+
+  count = 0;
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE ||
+       child->type == XML_TEXT_NODE ||
+       child->type == XML_CDATA_SECTION_NODE)
+    {
+      ++count;
+    }
+  }
+
+  inf_xml_binary_put_uint(buf, count);
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    switch(child->type)
+    {
+    case XML_ELEMENT_NODE:
+      inf_xml_binary_put_uint(buf, INF_XML_BINARY_CHILD_ELEMENT);
+
+      _inf_xml_binary_put_node(names, values, buf, child);
+      break;
+    case XML_TEXT_NODE:
+    case XML_CDATA_SECTION_NODE:
+      inf_xml_binary_put_uint(buf, INF_XML_BINARY_CHILD_TEXT);
+
+      inf_xml_binary_put_string(
+        buf,
+        (const gchar*)child->content,
+        child->content != NULL ? strlen((const gchar*)child->content) : 0
+      );
+
+      break;
+    default:
+      /* Comments and the like are not transmitted */
+      break;
+    }
+  }
+}
+
+gboolean
+_inf_xml_binary_get_uint(const guint8** data,
+                         const guint8* end,
+                         guint64* value)
+{
+  guint shift;
+  guint8 byte;
+
+  *value = 0;
+  for(shift = 0; *data < end && shift < 64; shift += 7)
+  {
+    byte = **data;
+    ++*data;
+
+    *value |= (guint64)(byte & 0x7f) << shift;
+    if((byte & 0x80) == 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Whether c matches the Char production of the XML specification */
+static gboolean
+inf_xml_binary_is_char(gunichar c)
+{
+  if(c < 0x20)
+    return c == '\t' || c == '\n' || c == '\r';
+  if(c < 0xd800)
+    return TRUE;
+  if(c < 0xe000)
+    return FALSE;
+  if(c < 0xfffe)
+    return TRUE;
+
+  return c >= 0x10000 && c <= 0x10ffff;
+}
+
+/* Strings need to be valid UTF-8 without characters that are not allowed
+ * in XML, so that received messages could also have been sent as XML. */
+static gboolean
+inf_xml_binary_get_string(const guint8** data,
+                          const guint8* end,
+                          const gchar** str,
+                          gsize* len)
+{
+  guint64 length;
+  const gchar* pos;
+  const gchar* str_end;
+
+  if(!_inf_xml_binary_get_uint(data, end, &length))
+    return FALSE;
+  if(length > (guint64)(end - *data))
+    return FALSE;
+
+  pos = (const gchar*)*data;
+  str_end = pos + length;
+
+  /* This also rejects embedded NUL characters */
+  if(!g_utf8_validate(pos, length, NULL))
+    return FALSE;
+
+  for(; pos < str_end; pos = g_utf8_next_char(pos))
+    if(!inf_xml_binary_is_char(g_utf8_get_char(pos)))
+      return FALSE;
+
+  *str = (const gchar*)*data;
+  *len = length;
+  *data += length;
+  return TRUE;
+}
+
+/* The returned name is owned by the table and is only valid until the next
+ * name is read. Names need to be valid XML names, since libxml2 writes
+ * them out verbatim when the message is forwarded or stored. Names in the
+ * table have been checked when they were added. */
+static const gchar*
+inf_xml_binary_get_name(InfXmlBinaryTable* table,
+                        const guint8** data,
+                        const guint8* end)
+{
+  guint64 ref;
+  const gchar* str;
+  gsize len;
+  gchar* name;
+  int res;
+
+  if(!_inf_xml_binary_get_uint(data, end, &ref))
+    return NULL;
+
+  if(ref == INF_XML_BINARY_LITERAL)
+  {
+    if(!inf_xml_binary_get_string(data, end, &str, &len))
+      return NULL;
+
+    /* This also rejects empty names */
+    name = g_strndup(str, len);
+    res = xmlValidateQName((const xmlChar*)name, 0);
+    g_free(name);
+
+    if(res != 0)
+      return NULL;
+
+    return inf_xml_binary_table_add(table, str, len);
+  }
+
+  ref -= INF_XML_BINARY_NAME_TABLE;
+  if(ref >= INF_XML_BINARY_TABLE_SIZE)
+    return NULL;
+
+  return table->entries[ref];
+}
+
+static gchar*
+inf_xml_binary_get_value(InfXmlBinaryTable* table,
+                         const guint8** data,
+                         const guint8* end)
+{
+  guint64 ref;
+  guint64 number;
+  const gchar* str;
+  gsize len;
+
+  if(!_inf_xml_binary_get_uint(data, end, &ref))
+    return NULL;
+
+  switch(ref)
+  {
+  case INF_XML_BINARY_LITERAL:
+    if(!inf_xml_binary_get_string(data, end, &str, &len))
+      return NULL;
+
+    if(len <= INF_XML_BINARY_MAX_VALUE_LENGTH)
+      inf_xml_binary_table_add(table, str, len);
+
+    return g_strndup(str, len);
+  case INF_XML_BINARY_NUMBER:
+    if(!_inf_xml_binary_get_uint(data, end, &number))
+      return NULL;
+
+    return g_strdup_printf("%" G_GUINT64_FORMAT, number);
+  default:
+    ref -= INF_XML_BINARY_VALUE_TABLE;
+    if(ref >= INF_XML_BINARY_TABLE_SIZE)
+      return NULL;
+
+    return g_strdup(table->entries[ref]);
+  }
+}
+
+static xmlNodePtr
+inf_xml_binary_get_element(InfXmlBinaryTable* names,
+                           InfXmlBinaryTable* values,
+                           const guint8** data,
+                           const guint8* end,
+                           guint depth)
+{
+  xmlNodePtr node;
+  xmlNodePtr child;
+  const gchar* name;
+  gchar* value;
+  const gchar* text;
+  gsize text_len;
+  guint64 count;
+  guint64 tag;
+  guint64 i;
+
+  if(depth >= INF_XML_BINARY_MAX_DEPTH)
+    return NULL;
+
+  name = inf_xml_binary_get_name(names, data, end);
+  if(name == NULL)
+    return NULL;
+
+  node = xmlNewNode(NULL, (const xmlChar*)name);
+
+  if(!_inf_xml_binary_get_uint(data, end, &count))
+    goto error;
+
+  for(i = 0; i < count; ++i)
+  {
+    name = inf_xml_binary_get_name(names, data, end);
+
+    if(name == NULL)
+      goto error;
+
+    value = inf_xml_binary_get_value(values, data, end);
+
+    if(value == NULL)
+      goto error;
+
+    xmlNewProp(node, (const xmlChar*)name, (const xmlChar*)value);
+    g_free(value);
+  }
+
+  if(!_inf_xml_binary_get_uint(data, end, &count))
+    goto error;
+
+  for(i = 0; i < count; ++i)
+  {
+    if(!_inf_xml_binary_get_uint(data, end, &tag))
+      goto error;
+
+    switch(tag)
+    {
+    case INF_XML_BINARY_CHILD_ELEMENT:
+      child = inf_xml_binary_get_element(names, values, data, end, depth + 1);
+      if(child == NULL)
+        goto error;
+
+      xmlAddChild(node, child);
+      break;
+    case INF_XML_BINARY_CHILD_TEXT:
+      if(!inf_xml_binary_get_string(data, end, &text, &text_len))
+        goto error;
+
+      xmlNodeAddContentLen(node, (const xmlChar*)text, text_len);
+      break;
+    default:
+      goto error;
+    }
+  }
+
+  return node;
+
+error:
+  xmlFreeNode(node);
+  return NULL;
+}
+
+/* Replaces the content of buf with xml in binary form, preceded by its
+ * length. Returns the offset in buf at which the data to be sent starts. */
+guint
+_inf_xml_binary_encode(InfXmlBinaryTable* names,
+                       InfXmlBinaryTable* values,
+                       GByteArray* buf,
+                       xmlNodePtr xml)
+{
+  guint8 header[INF_XML_BINARY_HEADER_SIZE];
+  guint size;
+
+  /* Leave space for the length in front of the message, so that both can
+   * be sent in one go. */
+  g_byte_array_set_size(buf, INF_XML_BINARY_HEADER_SIZE);
+  _inf_xml_binary_put_node(names, values, buf, xml);
+
+  size = _inf_xml_binary_write_uint(
+    header,
+    buf->len - INF_XML_BINARY_HEADER_SIZE
+  );
+
+  memcpy(buf->data + INF_XML_BINARY_HEADER_SIZE - size, header, size);
+  return INF_XML_BINARY_HEADER_SIZE - size;
+}
+
+/* Reads an element written by _inf_xml_binary_put_node(). Returns NULL if
+ * the data is not valid. */
+xmlNodePtr
+_inf_xml_binary_get_node(InfXmlBinaryTable* names,
+                         InfXmlBinaryTable* values,
+                         const guint8** data,
+                         const guint8* end)
+{
+  return inf_xml_binary_get_element(names, values, data, end, 0);
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -294,6 +294,47 @@ void inf_xml_connection_send(InfXmlConnection* connection,
   iface->send(connection, xml);
 }
 
+/**
+ * inf_xml_connection_send_serialized:
+ * @connection: A #InfXmlConnection.
+ * @xml: (transfer full): A XML message to send. The function takes ownership
+ * of the XML node.
+ * @serialized: (array) (transfer none) (allow-none): An array with one entry
+ * for every child of @xml, or %NULL.
+ *
+ * Sends the given XML message to the remote host, like
+ * inf_xml_connection_send(). In addition, the entries of @serialized can
+ * hold the serialized form of the corresponding children of @xml, as
+ * returned by inf_xml_util_serialize(), or %NULL for children which have
+ * not been serialized yet. Connections which transmit XML as text can write
+ * these directly instead of serializing the children again. This is useful
+ * when the same message is sent to many connections. If @connection does
+ * not make use of the serialized children, this is equivalent to
+ * inf_xml_connection_send().
+ **/
+void
+inf_xml_connection_send_serialized(InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   GBytes** serialized)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+
+  if(serialized != NULL && iface->send_serialized != NULL)
+  {
+    iface->send_serialized(connection, xml, serialized);
+  }
+  else
+  {
+    g_return_if_fail(iface->send != NULL);
+    iface->send(connection, xml);
+  }
+}
+
 /**
  * inf_xml_connection_sent:
  * @connection: A #InfXmlConnection.
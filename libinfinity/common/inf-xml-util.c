@@ -956,4 +956,34 @@ inf_xml_util_new_error_from_node(xmlNodePtr xml)
   return result;
 }
 
+/**
+ * inf_xml_util_serialize:
+ * @xml: A #xmlNodePtr.
+ *
+ * Serializes @xml, including all of its children, in the same way as
+ * #InfXmppConnection does when sending it. The result can be passed to
+ * inf_communication_registry_send_serialized() so that a message which is
+ * sent to many connections does not need to be serialized once for every
+ * connection.
+ *
+ * Returns: (transfer full): A #GBytes holding the serialized XML. Free
+ * with g_bytes_unref() when no longer needed.
+ */
+GBytes*
+inf_xml_util_serialize(xmlNodePtr xml)
+{
+  xmlBufferPtr buffer;
+  GBytes* bytes;
+
+  g_return_val_if_fail(xml != NULL, NULL);
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, xml->doc, xml, 0, 0);
+
+  bytes = g_bytes_new(xmlBufferContent(buffer), xmlBufferLength(buffer));
+  xmlBufferFree(buffer);
+
+  return bytes;
+}
+
 /* vim:set et sw=2 ts=2: */
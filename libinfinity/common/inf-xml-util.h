@@ -143,6 +143,9 @@ inf_xml_util_new_node_from_error(GError* error,
 GError*
 inf_xml_util_new_error_from_node(xmlNodePtr xml);
 
+GBytes*
+inf_xml_util_serialize(xmlNodePtr xml);
+
 G_END_DECLS
 
 #endif /* __INF_XML_UTIL_H__ */
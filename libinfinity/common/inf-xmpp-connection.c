@@ -33,10 +33,18 @@
  * not need to adhere to the XMPP standard. It is in the responsibility of the
  * user of this class to send only XML message that the remote counterpart can
  * understand.
+ *
+ * If both hosts use libinfinity, messages are not transmitted as XML text
+ * once authentication has completed, but in a more compact binary form.
+ * This is transparent to the user of this class, and can be turned off with
+ * the #InfXmppConnection:binary-encoding property. On top of the binary
+ * encoding, the stream is compressed with zlib unless the
+ * #InfXmppConnection:compression property is turned off.
  **/
 
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-binary-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
@@ -47,6 +55,8 @@
 
 #include <gnutls/x509.h>
 
+#include <zlib.h>
+
 #include <errno.h>
 #include <string.h>
 #include <ctype.h>
@@ -181,6 +191,31 @@ struct _InfXmppConnectionPrivate {
   xmlParserCtxtPtr parser;
   xmlNodePtr root;
   xmlNodePtr cur;
+  /* The chunk currently being parsed, and the number of bytes given to the
+   * XML parser before it */
+  const gchar* parse_data;
+  gsize parse_len;
+  glong parse_offset;
+
+  /* Binary encoding */
+  gboolean binary_encoding; /* Whether to offer/request it */
+  gboolean binary_in;
+  gboolean binary_out;
+  gsize binary_in_offset; /* Where binary data starts in parse_data */
+  GByteArray* binary_inbuf;
+  GByteArray* binary_outbuf;
+  InfXmlBinaryTable* binary_in_names;
+  InfXmlBinaryTable* binary_in_values;
+  InfXmlBinaryTable* binary_out_names;
+  InfXmlBinaryTable* binary_out_values;
+
+  /* Stream compression */
+  gboolean compression; /* Whether to offer/request it */
+  gboolean compress_in;
+  gboolean compress_out;
+  z_stream compress_in_stream;
+  z_stream compress_out_stream;
+  GByteArray* compress_outbuf;
 
   /* Transport layer security */
   gnutls_session_t session;
@@ -215,6 +250,9 @@ enum {
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
 
+  PROP_BINARY_ENCODING,
+  PROP_COMPRESSION,
+
   /* From InfXmlConnection */
   PROP_STATUS,
   PROP_NETWORK,
@@ -549,6 +587,84 @@ inf_xmpp_connection_auth_strerror(InfXmppConnectionAuthError code)
   }
 }
 
+/*
+ * Binary encoding
+ */
+
+/* If both sites support it, the client requests binary encoding after
+ * authentication by sending <binary/>, and the server acknowledges with
+ * <binary/> as well. Everything a site sends after its <binary/> is no
+ * longer XML text, but stanzas in the encoding implemented in
+ * inf-xml-binary.c. A length of zero stands for </stream:stream>. */
+
+#define INF_XMPP_CONNECTION_BINARY_NAMESPACE \
+  "http://infinote.org/protocol/binary"
+#define INF_XMPP_CONNECTION_BINARY_VERSION "1"
+
+/*
+ * Stream compression
+ */
+
+/* If both sites support it, and binary encoding is used, the server offers
+ * <compression/> in its features after authentication. The client then
+ * sends <compress/>, and the server acknowledges with <compressed/>. This
+ * follows XEP-0138, but since it only happens after the switch to binary
+ * encoding, the stream is not restarted. Everything a site sends after its
+ * <compress/> or <compressed/> is a single zlib stream. Each chunk of data
+ * passed to inf_xmpp_connection_send_chars() is flushed with Z_SYNC_FLUSH,
+ * so that the remote site can decode every message as soon as it arrives.
+ *
+ * zlib is the only method so far. Another one can be added by offering it
+ * in the <compression/> feature. */
+
+#define INF_XMPP_CONNECTION_COMPRESS_NAMESPACE \
+  "http://infinote.org/protocol/compress"
+#define INF_XMPP_CONNECTION_COMPRESS_METHOD "zlib"
+
+/* Size of the chunks of data that are compressed or decompressed at once */
+#define INF_XMPP_CONNECTION_COMPRESS_CHUNK_SIZE 4096
+/* A smaller window and memory level than zlib's defaults, since there
+ * might be many connections. Messages are small, so the compression ratio
+ * hardly suffers. */
+#define INF_XMPP_CONNECTION_COMPRESS_WINDOW_BITS 13
+#define INF_XMPP_CONNECTION_COMPRESS_MEM_LEVEL 6
+
+/* Appends the compressed form of data to out. */
+static void
+inf_xmpp_connection_compress(InfXmppConnectionPrivate* priv,
+                             GByteArray* out,
+                             gconstpointer data,
+                             guint len)
+{
+  z_stream* stream;
+  guint offset;
+  int ret;
+
+  stream = &priv->compress_out_stream;
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
+
+  /* Z_SYNC_FLUSH is complete once deflate() leaves output space unused */
+  do
+  {
+    offset = out->len;
+    g_byte_array_set_size(
+      out,
+      offset + INF_XMPP_CONNECTION_COMPRESS_CHUNK_SIZE
+    );
+
+    stream->next_out = out->data + offset;
+    stream->avail_out = INF_XMPP_CONNECTION_COMPRESS_CHUNK_SIZE;
+
+    ret = deflate(stream, Z_SYNC_FLUSH);
+    g_assert(ret == Z_OK || ret == Z_BUF_ERROR);
+
+    g_byte_array_set_size(out, out->len - stream->avail_out);
+  } while(stream->avail_out == 0);
+
+  g_assert(stream->avail_in == 0);
+}
+
 /*
  * Message queue
  */
@@ -676,6 +792,48 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
     }
   }
 
+  if(priv->binary_in)
+  {
+    _inf_xml_binary_table_free(priv->binary_in_names);
+    _inf_xml_binary_table_free(priv->binary_in_values);
+    g_byte_array_free(priv->binary_inbuf, TRUE);
+
+    priv->binary_in_names = NULL;
+    priv->binary_in_values = NULL;
+    priv->binary_inbuf = NULL;
+    priv->binary_in = FALSE;
+  }
+
+  if(priv->binary_out)
+  {
+    _inf_xml_binary_table_free(priv->binary_out_names);
+    _inf_xml_binary_table_free(priv->binary_out_values);
+    g_byte_array_free(priv->binary_outbuf, TRUE);
+
+    priv->binary_out_names = NULL;
+    priv->binary_out_values = NULL;
+    priv->binary_outbuf = NULL;
+    priv->binary_out = FALSE;
+  }
+
+  if(priv->compress_in)
+  {
+    inflateEnd(&priv->compress_in_stream);
+    priv->compress_in = FALSE;
+  }
+
+  if(priv->compress_out)
+  {
+    deflateEnd(&priv->compress_out_stream);
+    priv->compress_out = FALSE;
+  }
+
+  if(priv->compress_outbuf != NULL)
+  {
+    g_byte_array_free(priv->compress_outbuf, TRUE);
+    priv->compress_outbuf = NULL;
+  }
+
   while(priv->messages != NULL)
     inf_xmpp_connection_pop_message(xmpp);
 
@@ -702,6 +860,7 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
                                guint len)
 {
   InfXmppConnectionPrivate* priv;
+  GByteArray* compressed;
   ssize_t cur_bytes;
   GError* error;
 
@@ -710,9 +869,25 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
            priv->status != INF_XMPP_CONNECTION_CLOSED);
 
-  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+  /* Binary data is printed as XML before it is encoded */
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC && !priv->binary_out)
     printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
 
+  compressed = NULL;
+  if(priv->compress_out)
+  {
+    /* Take the buffer away while sending, since a "sent" callback might
+     * send another message before we are done with this one. */
+    compressed = priv->compress_outbuf;
+    priv->compress_outbuf = NULL;
+    if(compressed == NULL)
+      compressed = g_byte_array_new();
+
+    inf_xmpp_connection_compress(priv, compressed, data, len);
+    data = compressed->data;
+    len = compressed->len;
+  }
+
   /* From here on we go into a GnuTLS callback. Set this flag to prevent
    * premature cleanup -- make sure that if the connection is being brought
    * down from a GnuTLS callback then we keep the GnuTLS context around
@@ -758,6 +933,19 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
     inf_tcp_connection_send(priv->tcp, data, len);
   }
 
+  if(compressed != NULL)
+  {
+    if(priv->compress_out && priv->compress_outbuf == NULL)
+    {
+      g_byte_array_set_size(compressed, 0);
+      priv->compress_outbuf = compressed;
+    }
+    else
+    {
+      g_byte_array_free(compressed, TRUE);
+    }
+  }
+
   g_assert(priv->parsing > 0);
   if(--priv->parsing == 0)
   {
@@ -773,9 +961,145 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   }
 }
 
+/* Writes xml into priv->buf. The entries of serialized, if given, hold the
+ * serialization of the corresponding children of xml, or NULL. The
+ * serialized children are copied as-is instead of serializing them again. */
 static void
-inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
-                             xmlNodePtr xml)
+inf_xmpp_connection_dump_xml(InfXmppConnection* xmpp,
+                             xmlNodePtr xml,
+                             GBytes** serialized)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  xmlChar* value;
+  gconstpointer data;
+  gsize size;
+  guint i;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  /* Namespaces would need to be written out as well; we do not need this
+   * since only the containers of group messages are serialized this way. */
+  if(serialized != NULL && (xml->ns != NULL || xml->nsDef != NULL))
+    serialized = NULL;
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+    if(attr->ns != NULL)
+      serialized = NULL;
+
+  if(serialized == NULL)
+  {
+    xmlDocSetRootElement(priv->doc, xml);
+    xmlNodeDump(priv->buf, priv->doc, xml, 0, 0);
+    xmlUnlinkNode(xml);
+    xmlSetListDoc(xml, NULL);
+    return;
+  }
+
+  xmlBufferWriteChar(priv->buf, "<");
+  xmlBufferWriteCHAR(priv->buf, xml->name);
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    value = xmlNodeListGetString(NULL, attr->children, 1);
+
+    xmlBufferWriteChar(priv->buf, " ");
+    xmlBufferWriteCHAR(priv->buf, attr->name);
+    xmlBufferWriteChar(priv->buf, "=\"");
+    if(value != NULL)
+      xmlAttrSerializeTxtContent(priv->buf, priv->doc, attr, value);
+    xmlBufferWriteChar(priv->buf, "\"");
+
+    xmlFree(value);
+  }
+
+  if(xml->children == NULL)
+  {
+    xmlBufferWriteChar(priv->buf, "/>");
+  }
+  else
+  {
+    xmlBufferWriteChar(priv->buf, ">");
+
+    for(child = xml->children, i = 0; child != NULL; child = child->next, ++i)
+    {
+      if(serialized[i] != NULL)
+      {
+        data = g_bytes_get_data(serialized[i], &size);
+        xmlBufferAdd(priv->buf, data, size);
+      }
+      else
+      {
+        xmlNodeDump(priv->buf, priv->doc, child, 0, 0);
+      }
+    }
+
+    xmlBufferWriteChar(priv->buf, "</");
+    xmlBufferWriteCHAR(priv->buf, xml->name);
+    xmlBufferWriteChar(priv->buf, ">");
+  }
+}
+
+/* Prints xml to stdout for LIBINFINITY_DEBUG_PRINT_TRAFFIC, if it is not
+ * sent or received as XML text. */
+static void
+inf_xmpp_connection_print_xml(InfXmppConnection* xmpp,
+                              xmlNodePtr xml,
+                              const gchar* color)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  inf_xmpp_connection_dump_xml(xmpp, xml, NULL);
+
+  printf(
+    "\033[%sm%.*s\033[00;00m\n",
+    color,
+    (int)xmlBufferLength(priv->buf),
+    (const char*)xmlBufferContent(priv->buf)
+  );
+
+  xmlBufferEmpty(priv->buf);
+}
+
+static void
+inf_xmpp_connection_send_binary(InfXmppConnection* xmpp,
+                                xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  guint offset;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+    inf_xmpp_connection_print_xml(xmpp, xml, "00;34");
+
+  offset = _inf_xml_binary_encode(
+    priv->binary_out_names,
+    priv->binary_out_values,
+    priv->binary_outbuf,
+    xml
+  );
+
+  g_object_ref(xmpp);
+
+  inf_xmpp_connection_send_chars(
+    xmpp,
+    priv->binary_outbuf->data + offset,
+    priv->binary_outbuf->len - offset
+  );
+
+  /* The connection might have been cleared by send_chars */
+  if(priv->binary_outbuf != NULL)
+    g_byte_array_set_size(priv->binary_outbuf, 0);
+
+  g_object_unref(xmpp);
+}
+
+static void
+inf_xmpp_connection_send_xml_serialized(InfXmppConnection* xmpp,
+                                        xmlNodePtr xml,
+                                        GBytes** serialized)
 {
   InfXmppConnectionPrivate* priv;
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -783,10 +1107,14 @@ inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
   g_return_if_fail(priv->doc != NULL);
   g_return_if_fail(priv->buf != NULL);
 
-  xmlDocSetRootElement(priv->doc, xml);
-  xmlNodeDump(priv->buf, priv->doc, xml, 0, 0);
-  xmlUnlinkNode(xml);
-  xmlSetListDoc(xml, NULL);
+  /* The serialized children are XML text, which is of no use here */
+  if(priv->binary_out)
+  {
+    inf_xmpp_connection_send_binary(xmpp, xml);
+    return;
+  }
+
+  inf_xmpp_connection_dump_xml(xmpp, xml, serialized);
 
   /* Keep the object alive during the send_chars call, so that we can check
    * the buffer variable afterwards. */
@@ -807,6 +1135,13 @@ inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
   g_object_unref(xmpp);
 }
 
+static void
+inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
+                             xmlNodePtr xml)
+{
+  inf_xmpp_connection_send_xml_serialized(xmpp, xml, NULL);
+}
+
 /*
  * Helper functions
  */
@@ -847,6 +1182,60 @@ inf_xmpp_connection_node_new_sasl(const gchar* name)
   );
 }
 
+static xmlNodePtr
+inf_xmpp_connection_node_new_binary(const gchar* name)
+{
+  return inf_xmpp_connection_node_new(
+    name,
+    INF_XMPP_CONNECTION_BINARY_NAMESPACE
+  );
+}
+
+static xmlNodePtr
+inf_xmpp_connection_node_new_compress(const gchar* name)
+{
+  return inf_xmpp_connection_node_new(
+    name,
+    INF_XMPP_CONNECTION_COMPRESS_NAMESPACE
+  );
+}
+
+/* Sends </stream:stream>, or its binary equivalent */
+static void
+inf_xmpp_connection_send_stream_end(InfXmppConnection* xmpp)
+{
+  static const gchar xmpp_connection_deinit_request[] = "</stream:stream>";
+  static const guint8 xmpp_connection_binary_deinit_request[] = { 0 };
+
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->binary_out)
+  {
+    if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+    {
+      printf(
+        "\033[00;34m%s\033[00;00m\n",
+        xmpp_connection_deinit_request
+      );
+    }
+
+    inf_xmpp_connection_send_chars(
+      xmpp,
+      xmpp_connection_binary_deinit_request,
+      sizeof(xmpp_connection_binary_deinit_request)
+    );
+  }
+  else
+  {
+    inf_xmpp_connection_send_chars(
+      xmpp,
+      xmpp_connection_deinit_request,
+      sizeof(xmpp_connection_deinit_request) - 1
+    );
+  }
+}
+
 /*
  * XMPP deinitialization
  */
@@ -855,8 +1244,6 @@ inf_xmpp_connection_node_new_sasl(const gchar* name)
 static void
 inf_xmpp_connection_terminate(InfXmppConnection* xmpp)
 {
-  static const gchar xmpp_connection_deinit_request[] = "</stream:stream>";
-
   InfXmppConnectionPrivate* priv;
   xmlNodePtr abort;
 
@@ -890,13 +1277,7 @@ inf_xmpp_connection_terminate(InfXmppConnection* xmpp)
       /* inf_xmpp_connection_send_xml() above might have caused
        * status update: */
       if(priv->status != INF_XMPP_CONNECTION_CLOSED)
-      {
-        inf_xmpp_connection_send_chars(
-          xmpp,
-          xmpp_connection_deinit_request,
-          sizeof(xmpp_connection_deinit_request) - 1
-        );
-      }
+        inf_xmpp_connection_send_stream_end(xmpp);
     }
 
     /* One of the send() calls above might have caused status update */
@@ -1038,9 +1419,6 @@ inf_xmpp_connection_terminate_error(InfXmppConnection* xmpp,
 static void
 inf_xmpp_connection_deinitiate(InfXmppConnection* xmpp)
 {
-  static const gchar xmpp_connection_deinitiate_request[] =
-    "</stream:stream>";
-
   InfXmppConnectionPrivate* priv;
   xmlNodePtr abort;
 
@@ -1074,11 +1452,7 @@ inf_xmpp_connection_deinitiate(InfXmppConnection* xmpp)
     }
   }
 
-  inf_xmpp_connection_send_chars(
-    xmpp,
-    xmpp_connection_deinitiate_request,
-    sizeof(xmpp_connection_deinitiate_request) - 1
-  );
+  inf_xmpp_connection_send_stream_end(xmpp);
 
   priv->status = INF_XMPP_CONNECTION_CLOSING_STREAM;
   g_object_notify(G_OBJECT(xmpp), "status");
@@ -1930,6 +2304,8 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   xmlNodePtr features;
   xmlNodePtr starttls;
+  xmlNodePtr binary;
+  xmlNodePtr compression;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
   gchar* mechanism_dup;
@@ -1979,6 +2355,37 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
     }
   }
 
+  /* Offer binary encoding once authenticated. The client switches to it
+   * right after having received the features, so offering it earlier would
+   * interfere with TLS and SASL. */
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED &&
+     priv->binary_encoding)
+  {
+    binary = inf_xmpp_connection_node_new_binary("binary");
+    xmlNewProp(
+      binary,
+      (const xmlChar*)"version",
+      (const xmlChar*)INF_XMPP_CONNECTION_BINARY_VERSION
+    );
+
+    xmlAddChild(features, binary);
+
+    /* Compression is only used together with binary encoding, where
+     * stanza boundaries are known before the stanza is parsed. */
+    if(priv->compression)
+    {
+      compression = inf_xmpp_connection_node_new_compress("compression");
+      xmlNewChild(
+        compression,
+        NULL,
+        (const xmlChar*)"method",
+        (const xmlChar*)INF_XMPP_CONNECTION_COMPRESS_METHOD
+      );
+
+      xmlAddChild(features, compression);
+    }
+  }
+
   if(priv->status == INF_XMPP_CONNECTION_INITIATED)
   {
     /* Not yet authenticated, so give the client a list of authentication
@@ -2308,69 +2715,346 @@ inf_xmpp_connection_sasl_suggest_mechanism(InfXmppConnection* xmpp,
   return suggestion;
 }
 
+/* Called when the remote site has sent <binary/>, after which it sends
+ * binary data instead of XML. We are in an XML parser callback here. The
+ * data following the element in the current chunk is already binary, so
+ * remember where it begins, and stop the XML parser. */
 static void
-inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
-                                     xmlNodePtr xml)
+inf_xmpp_connection_binary_switch_input(InfXmppConnection* xmpp)
 {
   InfXmppConnectionPrivate* priv;
-  xmlNodePtr child;
-  xmlNodePtr req;
-  xmlNodePtr starttls;
-  const char* suggestion;
-  GError* error;
+  glong consumed;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
-  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
-  g_assert(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES ||
-           priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES);
+  g_assert(priv->binary_in == FALSE);
+  g_assert(priv->parse_data != NULL);
 
-  if(strcmp((const gchar*)xml->name, "stream:features") != 0)
+  consumed = xmlByteConsumed(priv->parser);
+  g_assert(consumed >= priv->parse_offset);
+  g_assert((gsize)(consumed - priv->parse_offset) <= priv->parse_len);
+
+  priv->binary_in = TRUE;
+  priv->binary_in_offset = consumed - priv->parse_offset;
+  priv->binary_inbuf = g_byte_array_new();
+  priv->binary_in_names = _inf_xml_binary_table_new(FALSE);
+  priv->binary_in_values = _inf_xml_binary_table_new(FALSE);
+
+  xmlStopParser(priv->parser);
+}
+
+static void
+inf_xmpp_connection_binary_switch_output(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr binary;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->binary_out == FALSE);
+
+  binary = inf_xmpp_connection_node_new_binary("binary");
+  inf_xmpp_connection_send_xml(xmpp, binary);
+  xmlFreeNode(binary);
+
+  /* Sending might have brought the connection down */
+  if(priv->status != INF_XMPP_CONNECTION_CLOSED)
   {
-    /* Server sent something else. Don't know what it is, so let us ignore it.
-     * Perhaps the <stream:features> we are waiting for follows later. */
-    return;
+    priv->binary_out = TRUE;
+    priv->binary_outbuf = g_byte_array_new();
+    priv->binary_out_names = _inf_xml_binary_table_new(TRUE);
+    priv->binary_out_values = _inf_xml_binary_table_new(TRUE);
   }
-  /* Don't try TLS anymore if we are already authenticated. This can happen
-   * if the server only offers TLS after authentication, but that's stupid. */
-  else if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES &&
-          priv->session == NULL)
-  {
-    for(child = xml->children; child != NULL; child = child->next)
-      if(strcmp((const gchar*)child->name, "starttls") == 0)
-        break;
+}
 
-    /* Server has no StartTLS feature. We don't like that. */
-    if(child == NULL &&
-       priv->security_policy == INF_XMPP_CONNECTION_SECURITY_ONLY_TLS)
-    {
-      error = g_error_new_literal(
-        inf_xmpp_connection_error_quark(),
-        INF_XMPP_CONNECTION_ERROR_TLS_UNSUPPORTED,
-        _("The server does not support transport layer security (TLS)")
-      );
+/* Handles <binary/> from the remote site in the READY or CLOSING_STREAM
+ * states. Returns FALSE if xml is a different message. */
+static gboolean
+inf_xmpp_connection_process_binary(InfXmppConnection* xmpp,
+                                   xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlChar* xmlns;
+  gboolean is_binary;
 
-      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
-      g_error_free(error);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-      inf_xmpp_connection_deinitiate(xmpp);
-    }
-    else if(child != NULL)
-    {
-      for(req = child->children; req != NULL; req = req->next)
-        if(strcmp((const gchar*)req->name, "required") == 0)
-          break;
+  if(priv->binary_in || strcmp((const gchar*)xml->name, "binary") != 0)
+    return FALSE;
 
-      if(req != NULL &&
-         priv->security_policy == INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
-      {
-        error = NULL;
+  xmlns = xmlGetProp(xml, (const xmlChar*)"xmlns");
+  is_binary = xmlns != NULL &&
+    strcmp((const gchar*)xmlns, INF_XMPP_CONNECTION_BINARY_NAMESPACE) == 0;
+  xmlFree(xmlns);
 
-        g_set_error_literal(
-          &error,
-          inf_xmpp_connection_error_quark(),
-          INF_XMPP_CONNECTION_ERROR_TLS_REQUIRED,
-          _("The server requires transport layer security (TLS)")
-        );
+  if(!is_binary)
+    return FALSE;
+
+  /* The server only offers binary encoding if it supports it, and the
+   * client only switches after having requested it. */
+  if( (priv->site == INF_XMPP_CONNECTION_SERVER && !priv->binary_encoding) ||
+      (priv->site == INF_XMPP_CONNECTION_CLIENT && !priv->binary_out))
+  {
+    if(priv->status == INF_XMPP_CONNECTION_READY)
+    {
+      inf_xmpp_connection_terminate_error(
+        xmpp,
+        INF_XMPP_CONNECTION_STREAM_ERROR_UNSUPPORTED_ENCODING,
+        _("Binary encoding was not negotiated")
+      );
+    }
+    else
+    {
+      inf_xmpp_connection_terminate(xmpp);
+    }
+
+    return TRUE;
+  }
+
+  inf_xmpp_connection_binary_switch_input(xmpp);
+
+  /* Acknowledge the client's request, unless we are closing the stream
+   * anyway. */
+  if(priv->site == INF_XMPP_CONNECTION_SERVER &&
+     priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    inf_xmpp_connection_binary_switch_output(xmpp);
+  }
+
+  return TRUE;
+}
+
+/* Called when the remote site has sent <compress/> or <compressed/>. This
+ * always happens in the binary decoder, which passes the rest of the data
+ * it has received through the decompressor. */
+static void
+inf_xmpp_connection_compress_switch_input(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->compress_in == FALSE);
+  g_assert(priv->binary_in == TRUE);
+
+  memset(&priv->compress_in_stream, 0, sizeof(z_stream));
+  ret = inflateInit(&priv->compress_in_stream);
+  if(ret != Z_OK)
+    g_error("Failed to initialize zlib: %s", zError(ret));
+
+  priv->compress_in = TRUE;
+}
+
+/* Sends <compress/> as a client or <compressed/> as a server, and
+ * compresses everything sent afterwards. */
+static void
+inf_xmpp_connection_compress_switch_output(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr compress;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->compress_out == FALSE);
+  g_assert(priv->binary_out == TRUE);
+
+  if(priv->site == INF_XMPP_CONNECTION_CLIENT)
+  {
+    compress = inf_xmpp_connection_node_new_compress("compress");
+    xmlNewChild(
+      compress,
+      NULL,
+      (const xmlChar*)"method",
+      (const xmlChar*)INF_XMPP_CONNECTION_COMPRESS_METHOD
+    );
+  }
+  else
+  {
+    compress = inf_xmpp_connection_node_new_compress("compressed");
+  }
+
+  inf_xmpp_connection_send_xml(xmpp, compress);
+  xmlFreeNode(compress);
+
+  /* Sending might have brought the connection down */
+  if(priv->status != INF_XMPP_CONNECTION_CLOSED)
+  {
+    memset(&priv->compress_out_stream, 0, sizeof(z_stream));
+    ret = deflateInit2(
+      &priv->compress_out_stream,
+      Z_DEFAULT_COMPRESSION,
+      Z_DEFLATED,
+      INF_XMPP_CONNECTION_COMPRESS_WINDOW_BITS,
+      INF_XMPP_CONNECTION_COMPRESS_MEM_LEVEL,
+      Z_DEFAULT_STRATEGY
+    );
+
+    if(ret != Z_OK)
+      g_error("Failed to initialize zlib: %s", zError(ret));
+
+    priv->compress_out = TRUE;
+  }
+}
+
+/* Returns the content of the first <method> child of xml, or NULL. The
+ * result needs to be freed with xmlFree(). */
+static xmlChar*
+inf_xmpp_connection_compress_get_method(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+
+  for(child = xml->children; child != NULL; child = child->next)
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const gchar*)child->name, "method") == 0)
+      return xmlNodeGetContent(child);
+
+  return NULL;
+}
+
+/* Handles <compress/> or <compressed/> from the remote site in the READY or
+ * CLOSING_STREAM states. Returns FALSE if xml is a different message. */
+static gboolean
+inf_xmpp_connection_process_compress(InfXmppConnection* xmpp,
+                                     xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  const gchar* expected;
+  xmlChar* xmlns;
+  xmlChar* method;
+  gboolean is_compress;
+  gboolean supported;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->site == INF_XMPP_CONNECTION_SERVER)
+    expected = "compress";
+  else
+    expected = "compressed";
+
+  if(priv->compress_in || strcmp((const gchar*)xml->name, expected) != 0)
+    return FALSE;
+
+  xmlns = xmlGetProp(xml, (const xmlChar*)"xmlns");
+  is_compress = xmlns != NULL &&
+    strcmp((const gchar*)xmlns, INF_XMPP_CONNECTION_COMPRESS_NAMESPACE) == 0;
+  xmlFree(xmlns);
+
+  if(!is_compress)
+    return FALSE;
+
+  /* The server only offers compression together with binary encoding, and
+   * the client only switches after having requested it. Either way, the
+   * switch must be sent in binary form. */
+  if(!priv->binary_in)
+  {
+    supported = FALSE;
+  }
+  else if(priv->site == INF_XMPP_CONNECTION_SERVER)
+  {
+    method = inf_xmpp_connection_compress_get_method(xml);
+    supported = priv->compression && method != NULL &&
+      strcmp((const gchar*)method, INF_XMPP_CONNECTION_COMPRESS_METHOD) == 0;
+    xmlFree(method);
+  }
+  else
+  {
+    supported = priv->compress_out;
+  }
+
+  if(!supported)
+  {
+    if(priv->status == INF_XMPP_CONNECTION_READY)
+    {
+      inf_xmpp_connection_terminate_error(
+        xmpp,
+        INF_XMPP_CONNECTION_STREAM_ERROR_UNSUPPORTED_ENCODING,
+        _("Compression was not negotiated")
+      );
+    }
+    else
+    {
+      inf_xmpp_connection_terminate(xmpp);
+    }
+
+    return TRUE;
+  }
+
+  inf_xmpp_connection_compress_switch_input(xmpp);
+
+  /* Acknowledge the client's request, unless we are closing the stream
+   * anyway. */
+  if(priv->site == INF_XMPP_CONNECTION_SERVER &&
+     priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    inf_xmpp_connection_compress_switch_output(xmpp);
+  }
+
+  return TRUE;
+}
+
+static void
+inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
+                                     xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr child;
+  xmlNodePtr req;
+  xmlNodePtr starttls;
+  xmlChar* version;
+  xmlChar* method;
+  const char* suggestion;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES ||
+           priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES);
+
+  if(strcmp((const gchar*)xml->name, "stream:features") != 0)
+  {
+    /* Server sent something else. Don't know what it is, so let us ignore it.
+     * Perhaps the <stream:features> we are waiting for follows later. */
+    return;
+  }
+  /* Don't try TLS anymore if we are already authenticated. This can happen
+   * if the server only offers TLS after authentication, but that's stupid. */
+  else if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES &&
+          priv->session == NULL)
+  {
+    for(child = xml->children; child != NULL; child = child->next)
+      if(strcmp((const gchar*)child->name, "starttls") == 0)
+        break;
+
+    /* Server has no StartTLS feature. We don't like that. */
+    if(child == NULL &&
+       priv->security_policy == INF_XMPP_CONNECTION_SECURITY_ONLY_TLS)
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark(),
+        INF_XMPP_CONNECTION_ERROR_TLS_UNSUPPORTED,
+        _("The server does not support transport layer security (TLS)")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      inf_xmpp_connection_deinitiate(xmpp);
+    }
+    else if(child != NULL)
+    {
+      for(req = child->children; req != NULL; req = req->next)
+        if(strcmp((const gchar*)req->name, "required") == 0)
+          break;
+
+      if(req != NULL &&
+         priv->security_policy == INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
+      {
+        error = NULL;
+
+        g_set_error_literal(
+          &error,
+          inf_xmpp_connection_error_quark(),
+          INF_XMPP_CONNECTION_ERROR_TLS_REQUIRED,
+          _("The server requires transport layer security (TLS)")
+        );
 
         inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
         g_error_free(error);
@@ -2435,8 +3119,58 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   }
   else if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
   {
-    priv->status = INF_XMPP_CONNECTION_READY;
-    g_object_notify(G_OBJECT(xmpp), "status");
+    if(priv->binary_encoding)
+    {
+      for(child = xml->children; child != NULL; child = child->next)
+        if(strcmp((const gchar*)child->name, "binary") == 0)
+          break;
+
+      if(child != NULL)
+      {
+        version = xmlGetProp(child, (const xmlChar*)"version");
+
+        /* Everything we send from now on is binary. The server will
+         * acknowledge with <binary/> as well. */
+        if(version != NULL &&
+           strcmp((const gchar*)version,
+                  INF_XMPP_CONNECTION_BINARY_VERSION) == 0)
+        {
+          inf_xmpp_connection_binary_switch_output(xmpp);
+        }
+
+        xmlFree(version);
+      }
+    }
+
+    if(priv->compression && priv->binary_out &&
+       priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
+    {
+      for(child = xml->children; child != NULL; child = child->next)
+        if(strcmp((const gchar*)child->name, "compression") == 0)
+          break;
+
+      if(child != NULL)
+      {
+        method = inf_xmpp_connection_compress_get_method(child);
+
+        /* Everything we send from now on is compressed. The server will
+         * acknowledge with <compressed/>. */
+        if(method != NULL &&
+           strcmp((const gchar*)method,
+                  INF_XMPP_CONNECTION_COMPRESS_METHOD) == 0)
+        {
+          inf_xmpp_connection_compress_switch_output(xmpp);
+        }
+
+        xmlFree(method);
+      }
+    }
+
+    if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
+    {
+      priv->status = INF_XMPP_CONNECTION_READY;
+      g_object_notify(G_OBJECT(xmpp), "status");
+    }
   }
 }
 
@@ -2632,11 +3366,11 @@ inf_xmpp_connection_process_authentication(InfXmppConnection* xmpp,
   }
 }
 
-/* This actually processes the end element after having handled some
- * special cases in sax_end_element(). */
+/* Processes a complete toplevel XML message received from the remote
+ * site. */
 static void
-inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
-                                        const xmlChar* name)
+inf_xmpp_connection_process_stanza(InfXmppConnection* xmpp,
+                                   xmlNodePtr xml)
 {
   InfXmppConnectionPrivate* priv;
   InfXmppConnectionStreamError stream_code;
@@ -2644,88 +3378,108 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-  g_assert(priv->cur != NULL);
-  /* This should have raised a sax_error. */
-  g_assert(strcmp((const gchar*)priv->cur->name, (const gchar*)name) == 0);
-
-  priv->cur = priv->cur->parent;
-  if(priv->cur == NULL)
+  if(strcmp((const gchar*)xml->name, "stream:error") == 0)
   {
-    /* Got a complete XML message */
-    if(strcmp((const gchar*)name, "stream:error") == 0)
+    /* Just emit error signal in this case. If the stream is supposed to
+     * be closed, a </stream:stream> should follow. */
+    stream_code = INF_XMPP_CONNECTION_STREAM_ERROR_FAILED;
+    if(xml->children != NULL)
     {
-      /* Just emit error signal in this case. If the stream is supposed to
-       * be closed, a </stream:stream> should follow. */
-      stream_code = INF_XMPP_CONNECTION_STREAM_ERROR_FAILED;
-      if(priv->root->children != NULL)
-      {
-        stream_code = inf_xmpp_connection_stream_error_from_condition(
-          (const gchar*)priv->root->children->name
-        );
-      }
-
-      error = NULL;
-      g_set_error_literal(
-        &error,
-        inf_xmpp_connection_stream_error_quark,
-        stream_code,
-        inf_xmpp_connection_stream_strerror(stream_code)
+      stream_code = inf_xmpp_connection_stream_error_from_condition(
+        (const gchar*)xml->children->name
       );
+    }
 
-      /* TODO: Incorporate text child of the stream:error request, if any */
+    error = NULL;
+    g_set_error_literal(
+      &error,
+      inf_xmpp_connection_stream_error_quark,
+      stream_code,
+      inf_xmpp_connection_stream_strerror(stream_code)
+    );
 
-      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
-      g_error_free(error);
-    }
-    else
+    /* TODO: Incorporate text child of the stream:error request, if any */
+
+    inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+    g_error_free(error);
+  }
+  else
+  {
+    switch(priv->status)
     {
-      switch(priv->status)
+    case INF_XMPP_CONNECTION_INITIATED:
+      /* The client should be waiting for <stream:stream> from the server
+       * in this state, and sax_end_element() should not have called this
+       * function. */
+      g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+      inf_xmpp_connection_process_initiated(xmpp, xml);
+      break;
+    case INF_XMPP_CONNECTION_AWAITING_FEATURES:
+    case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
+      /* This is a client-only state */
+      g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+      inf_xmpp_connection_process_features(xmpp, xml);
+      break;
+    case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+      /* This is a client-only state */
+      g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+      inf_xmpp_connection_process_encryption(xmpp, xml);
+      break;
+    case INF_XMPP_CONNECTION_AUTHENTICATING:
+      inf_xmpp_connection_process_authentication(xmpp, xml);
+      break;
+    case INF_XMPP_CONNECTION_READY:
+      if(!inf_xmpp_connection_process_binary(xmpp, xml) &&
+         !inf_xmpp_connection_process_compress(xmpp, xml))
       {
-      case INF_XMPP_CONNECTION_INITIATED:
-        /* The client should be waiting for <stream:stream> from the server
-         * in this state, and sax_end_element() should not have called this
-         * function. */
-        g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
-        inf_xmpp_connection_process_initiated(xmpp, priv->root);
-        break;
-      case INF_XMPP_CONNECTION_AWAITING_FEATURES:
-      case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
-        /* This is a client-only state */
-        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
-        inf_xmpp_connection_process_features(xmpp, priv->root);
-        break;
-      case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
-        /* This is a client-only state */
-        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
-        inf_xmpp_connection_process_encryption(xmpp, priv->root);
-        break;
-      case INF_XMPP_CONNECTION_AUTHENTICATING:
-        inf_xmpp_connection_process_authentication(xmpp, priv->root);
-        break;
-      case INF_XMPP_CONNECTION_READY:
-        inf_xml_connection_received(INF_XML_CONNECTION(xmpp), priv->root);
-        break;
-      case INF_XMPP_CONNECTION_CLOSING_STREAM:
-        /* We are waiting for </stream:stream>. It can be that we receive
-         * other XML nodes from the remote side before that happens, but we
-         * ignore them here. */
-        break;
-      case INF_XMPP_CONNECTION_AUTH_INITIATED:
-        /* The client should be waiting for <stream:stream> from the server
-         * in this state, and sax_end_element should not have called this
-         * function. Also, this is a client-only state (the server goes
-         * directly to READY after having received <stream:stream>). */
-      case INF_XMPP_CONNECTION_CONNECTING:
-      case INF_XMPP_CONNECTION_CONNECTED:
-      case INF_XMPP_CONNECTION_AUTH_CONNECTED:
-      case INF_XMPP_CONNECTION_HANDSHAKING:
-      case INF_XMPP_CONNECTION_CLOSING_GNUTLS:
-      case INF_XMPP_CONNECTION_CLOSED:
-      default:
-        g_assert_not_reached();
-        break;
+        inf_xml_connection_received(INF_XML_CONNECTION(xmpp), xml);
       }
+      break;
+    case INF_XMPP_CONNECTION_CLOSING_STREAM:
+      /* We are waiting for </stream:stream>. It can be that we receive
+       * other XML nodes from the remote side before that happens, but we
+       * ignore them here. Only a switch to binary encoding or compression
+       * needs to be handled, since it changes how the rest of the stream
+       * is read. */
+      if(!inf_xmpp_connection_process_binary(xmpp, xml))
+        inf_xmpp_connection_process_compress(xmpp, xml);
+      break;
+    case INF_XMPP_CONNECTION_AUTH_INITIATED:
+      /* The client should be waiting for <stream:stream> from the server
+       * in this state, and sax_end_element should not have called this
+       * function. Also, this is a client-only state (the server goes
+       * directly to READY after having received <stream:stream>). */
+    case INF_XMPP_CONNECTION_CONNECTING:
+    case INF_XMPP_CONNECTION_CONNECTED:
+    case INF_XMPP_CONNECTION_AUTH_CONNECTED:
+    case INF_XMPP_CONNECTION_HANDSHAKING:
+    case INF_XMPP_CONNECTION_CLOSING_GNUTLS:
+    case INF_XMPP_CONNECTION_CLOSED:
+    default:
+      g_assert_not_reached();
+      break;
     }
+  }
+}
+
+/* This actually processes the end element after having handled some
+ * special cases in sax_end_element(). */
+static void
+inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
+                                        const xmlChar* name)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->cur != NULL);
+  /* This should have raised a sax_error. */
+  g_assert(strcmp((const gchar*)priv->cur->name, (const gchar*)name) == 0);
+
+  priv->cur = priv->cur->parent;
+  if(priv->cur == NULL)
+  {
+    /* Got a complete XML message */
+    inf_xmpp_connection_process_stanza(xmpp, priv->root);
 
     xmlFreeNode(priv->root);
     priv->root = NULL;
@@ -2733,6 +3487,50 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
   }
 }
 
+/* Processes </stream:stream> from the remote site. */
+static void
+inf_xmpp_connection_process_stream_end(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  switch(priv->status)
+  {
+  case INF_XMPP_CONNECTION_CLOSING_STREAM:
+    /* This is the </stream:stream> we were waiting for. */
+  case INF_XMPP_CONNECTION_AUTHENTICATING:
+    /* I think we should receive a failure first, but some evil server
+     * might send </stream:stream> directly. */
+  case INF_XMPP_CONNECTION_INITIATED:
+  case INF_XMPP_CONNECTION_AUTH_INITIATED:
+  case INF_XMPP_CONNECTION_AWAITING_FEATURES:
+  case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
+  case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_READY:
+    /* Also terminate stream in these states */
+    inf_xmpp_connection_terminate(xmpp);
+    break;
+  case INF_XMPP_CONNECTION_CLOSED:
+  case INF_XMPP_CONNECTION_CLOSING_GNUTLS:
+    /* This can happen if the connection was terminated by start_element and
+     * the XML parser processed the corresponding end tag in the same
+     * xmlParseChunk() invocation. */
+    break;
+  case INF_XMPP_CONNECTION_CONNECTED:
+  case INF_XMPP_CONNECTION_AUTH_CONNECTED:
+    /* We should not get </stream:stream> before we got <stream:stream>,
+     * which would have caused us to change into the INITIATED state. The
+     * XML parser should have reported an error in this case. */
+  case INF_XMPP_CONNECTION_HANDSHAKING:
+    /* received_cb should not call the XML parser in these states */
+  case INF_XMPP_CONNECTION_CONNECTING:
+    /* We should not even receive something in these states */
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
 static void
 inf_xmpp_connection_sax_start_element(void* context,
                                       const xmlChar* name,
@@ -2857,41 +3655,7 @@ inf_xmpp_connection_sax_end_element(void* context,
              priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
              priv->status == INF_XMPP_CONNECTION_CLOSED);
 
-    switch(priv->status)
-    {
-    case INF_XMPP_CONNECTION_CLOSING_STREAM:
-      /* This is the </stream:stream> we were waiting for. */
-    case INF_XMPP_CONNECTION_AUTHENTICATING:
-      /* I think we should receive a failure first, but some evil server
-       * might send </stream:stream> directly. */
-    case INF_XMPP_CONNECTION_INITIATED:
-    case INF_XMPP_CONNECTION_AUTH_INITIATED:
-    case INF_XMPP_CONNECTION_AWAITING_FEATURES:
-    case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
-    case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
-    case INF_XMPP_CONNECTION_READY:
-      /* Also terminate stream in these states */
-      inf_xmpp_connection_terminate(xmpp);
-      break;
-    case INF_XMPP_CONNECTION_CLOSED:
-    case INF_XMPP_CONNECTION_CLOSING_GNUTLS:
-      /* This can happen if the connection was terminated by start_element and
-       * the XML parser processed the corresponding end tag in the same
-       * xmlParseChunk() invocation. */
-      break;
-    case INF_XMPP_CONNECTION_CONNECTED:
-    case INF_XMPP_CONNECTION_AUTH_CONNECTED:
-      /* We should not get </stream:stream> before we got <stream:stream>,
-       * which would have caused us to change into the INITIATED state. The
-       * XML parser should have reported an error in this case. */
-    case INF_XMPP_CONNECTION_HANDSHAKING:
-      /* received_cb should not call the XML parser in these states */
-    case INF_XMPP_CONNECTION_CONNECTING:
-      /* We should not even receive something in these states */
-    default:
-      g_assert_not_reached();
-      break;
-    }
+    inf_xmpp_connection_process_stream_end(xmpp);
   }
 }
 
@@ -3040,6 +3804,240 @@ static xmlSAXHandler inf_xmpp_connection_handler = {
   NULL                                    /* serror */
 };
 
+/* Required by inf_xmpp_connection_binary_received */
+static void
+inf_xmpp_connection_receive(InfXmppConnection* xmpp,
+                            const gchar* data,
+                            gsize len);
+
+/* Processes data received from the remote site after it switched to binary
+ * encoding. */
+static void
+inf_xmpp_connection_binary_received(InfXmppConnection* xmpp,
+                                    const guint8* data,
+                                    gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  const guint8* begin;
+  const guint8* cur;
+  const guint8* end;
+  guint64 size;
+  xmlNodePtr xml;
+  gsize processed;
+  gboolean compressed;
+  GByteArray* inbuf;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->binary_in);
+
+  compressed = priv->compress_in;
+
+  g_byte_array_append(priv->binary_inbuf, data, len);
+
+  processed = 0;
+  while(priv->status != INF_XMPP_CONNECTION_CLOSING_GNUTLS &&
+        priv->status != INF_XMPP_CONNECTION_CLOSED)
+  {
+    begin = priv->binary_inbuf->data + processed;
+    end = priv->binary_inbuf->data + priv->binary_inbuf->len;
+    cur = begin;
+
+    if(!_inf_xml_binary_get_uint(&cur, end, &size))
+    {
+      /* Wait for more data, unless the length is invalid */
+      if(end - begin >= INF_XML_BINARY_HEADER_SIZE)
+      {
+        inf_xmpp_connection_terminate_error(
+          xmpp,
+          INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+          _("Received invalid binary data")
+        );
+      }
+
+      break;
+    }
+
+    if(size > INF_XML_BINARY_MAX_STANZA_SIZE)
+    {
+      inf_xmpp_connection_terminate_error(
+        xmpp,
+        INF_XMPP_CONNECTION_STREAM_ERROR_POLICY_VIOLATION,
+        _("Received message is too large")
+      );
+
+      break;
+    }
+
+    if(size > (guint64)(end - cur))
+      break;
+
+    processed += (cur - begin) + size;
+
+    if(size == 0)
+    {
+      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+        printf("\033[00;32m</stream:stream>\033[00;00m\n");
+
+      inf_xmpp_connection_process_stream_end(xmpp);
+    }
+    else
+    {
+      end = cur + size;
+      xml = _inf_xml_binary_get_node(
+        priv->binary_in_names,
+        priv->binary_in_values,
+        &cur,
+        end
+      );
+
+      if(xml == NULL || cur != end)
+      {
+        if(xml != NULL)
+          xmlFreeNode(xml);
+
+        inf_xmpp_connection_terminate_error(
+          xmpp,
+          INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+          _("Received invalid binary data")
+        );
+      }
+      else
+      {
+        if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+          inf_xmpp_connection_print_xml(xmpp, xml, "00;32");
+
+        inf_xmpp_connection_process_stanza(xmpp, xml);
+        xmlFreeNode(xml);
+
+        /* The remote site might have switched to compression with this
+         * stanza, in which case the rest of the data is compressed. */
+        if(!compressed && priv->compress_in &&
+           priv->status != INF_XMPP_CONNECTION_CLOSING_GNUTLS &&
+           priv->status != INF_XMPP_CONNECTION_CLOSED)
+        {
+          inbuf = priv->binary_inbuf;
+          priv->binary_inbuf = g_byte_array_new();
+
+          inf_xmpp_connection_receive(
+            xmpp,
+            (const gchar*)inbuf->data + processed,
+            inbuf->len - processed
+          );
+
+          g_byte_array_free(inbuf, TRUE);
+          return;
+        }
+      }
+    }
+  }
+
+  /* The buffer is not cleared while we are being called from received_cb,
+   * so it is still there even if the connection has been closed. */
+  g_byte_array_remove_range(priv->binary_inbuf, 0, processed);
+}
+
+/* Feeds data received from the remote site into the XML parser, or into
+ * the binary decoder once the remote site has switched to binary
+ * encoding. */
+static void
+inf_xmpp_connection_parse(InfXmppConnection* xmpp,
+                          const gchar* data,
+                          gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->binary_in)
+  {
+    inf_xmpp_connection_binary_received(xmpp, (const guint8*)data, len);
+  }
+  else
+  {
+    priv->parse_data = data;
+    priv->parse_len = len;
+
+    xmlParseChunk(priv->parser, data, len, 0);
+
+    priv->parse_data = NULL;
+    priv->parse_len = 0;
+    priv->parse_offset += len;
+
+    /* The remote site might have switched to binary encoding in the middle
+     * of this chunk. */
+    if(priv->binary_in &&
+       priv->binary_in_offset < len &&
+       priv->status != INF_XMPP_CONNECTION_CLOSING_GNUTLS &&
+       priv->status != INF_XMPP_CONNECTION_CLOSED)
+    {
+      inf_xmpp_connection_binary_received(
+        xmpp,
+        (const guint8*)data + priv->binary_in_offset,
+        len - priv->binary_in_offset
+      );
+    }
+  }
+}
+
+/* Feeds data received from the remote site into inf_xmpp_connection_parse(),
+ * decompressing it first if the remote site has switched to compression. */
+static void
+inf_xmpp_connection_receive(InfXmppConnection* xmpp,
+                            const gchar* data,
+                            gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  z_stream* stream;
+  guint8 buffer[INF_XMPP_CONNECTION_COMPRESS_CHUNK_SIZE];
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(!priv->compress_in)
+  {
+    inf_xmpp_connection_parse(xmpp, data, len);
+    return;
+  }
+
+  stream = &priv->compress_in_stream;
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
+
+  do
+  {
+    stream->next_out = buffer;
+    stream->avail_out = sizeof(buffer);
+
+    /* The remote site never ends its zlib stream, so Z_STREAM_END is an
+     * error as well. */
+    ret = inflate(stream, Z_SYNC_FLUSH);
+    if(ret != Z_OK && ret != Z_BUF_ERROR)
+    {
+      inf_xmpp_connection_terminate_error(
+        xmpp,
+        INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+        _("Received invalid compressed data")
+      );
+
+      break;
+    }
+
+    if(stream->avail_out < sizeof(buffer))
+    {
+      inf_xmpp_connection_parse(
+        xmpp,
+        (const gchar*)buffer,
+        sizeof(buffer) - stream->avail_out
+      );
+
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        break;
+      }
+    }
+  } while(stream->avail_in > 0 || stream->avail_out == 0);
+}
+
 static void
 inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
 {
@@ -3065,6 +4063,8 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
     NULL
   );
 
+  priv->parse_offset = 0;
+
   /* Create XML buffer for outgoing data */
   if(priv->buf == NULL)
   {
@@ -3258,9 +4258,9 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
         else
         {
           /* Feed decoded data into XML parser */
-          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC && !priv->binary_in)
             printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
+          inf_xmpp_connection_receive(xmpp, buffer, res);
 
           /* If the callback changed made us disconnect then don't try
            * to read more data. */
@@ -3275,9 +4275,9 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
     else
     {
       /* Feed input directly into XML parser */
-      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC && !priv->binary_in)
         printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_receive(xmpp, data, len);
     }
   }
 
@@ -3614,6 +4614,25 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->parser = NULL;
   priv->root = NULL;
   priv->cur = NULL;
+  priv->parse_data = NULL;
+  priv->parse_len = 0;
+  priv->parse_offset = 0;
+
+  priv->binary_encoding = TRUE;
+  priv->binary_in = FALSE;
+  priv->binary_out = FALSE;
+  priv->binary_in_offset = 0;
+  priv->binary_inbuf = NULL;
+  priv->binary_outbuf = NULL;
+  priv->binary_in_names = NULL;
+  priv->binary_in_values = NULL;
+  priv->binary_out_names = NULL;
+  priv->binary_out_values = NULL;
+
+  priv->compression = TRUE;
+  priv->compress_in = FALSE;
+  priv->compress_out = FALSE;
+  priv->compress_outbuf = NULL;
 
   priv->doc = NULL;
   priv->buf = NULL;
@@ -3826,6 +4845,14 @@ inf_xmpp_connection_set_property(GObject* object,
     g_free(priv->sasl_local_mechanisms);
     priv->sasl_local_mechanisms = g_value_dup_string(value);
     break;
+  case PROP_BINARY_ENCODING:
+    /* Only has an effect on the next stream setup */
+    priv->binary_encoding = g_value_get_boolean(value);
+    break;
+  case PROP_COMPRESSION:
+    /* Only has an effect on the next stream setup */
+    priv->compression = g_value_get_boolean(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -3876,6 +4903,12 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_SASL_MECHANISMS:
     g_value_set_string(value, priv->sasl_local_mechanisms);
     break;
+  case PROP_BINARY_ENCODING:
+    g_value_set_boolean(value, priv->binary_encoding);
+    break;
+  case PROP_COMPRESSION:
+    g_value_set_boolean(value, priv->compression);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, inf_xmpp_connection_get_xml_status(xmpp));
     break;
@@ -4016,15 +5049,20 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
 }
 
 static void
-inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
-                                        xmlNodePtr xml)
+inf_xmpp_connection_xml_connection_send_serialized(InfXmlConnection* conn,
+                                                   xmlNodePtr xml,
+                                                   GBytes** serialized)
 {
   InfXmppConnectionPrivate* priv;
-  priv = INF_XMPP_CONNECTION_PRIVATE(connection);
+  priv = INF_XMPP_CONNECTION_PRIVATE(conn);
 
   g_assert(priv->status == INF_XMPP_CONNECTION_READY);
 
-  inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+  inf_xmpp_connection_send_xml_serialized(
+    INF_XMPP_CONNECTION(conn),
+    xml,
+    serialized
+  );
 
   /* It can happen that while calling inf_xmpp_connection_send_xml we
    * notice that the connection is down. Only proceed with sent notification
@@ -4032,7 +5070,7 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
   if(priv->status == INF_XMPP_CONNECTION_READY)
   {
     inf_xmpp_connection_push_message(
-      INF_XMPP_CONNECTION(connection),
+      INF_XMPP_CONNECTION(conn),
       inf_xmpp_connection_xml_connection_send_sent,
       inf_xmpp_connection_xml_connection_send_free,
       xml
@@ -4044,6 +5082,13 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
   }
 }
 
+static void
+inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
+                                        xmlNodePtr xml)
+{
+  inf_xmpp_connection_xml_connection_send_serialized(connection, xml, NULL);
+}
+
 /*
  * GObject type registration
  */
@@ -4178,6 +5223,32 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_BINARY_ENCODING,
+    g_param_spec_boolean(
+      "binary-encoding",
+      "Binary encoding",
+      "Whether to offer (as a server) or to request (as a client) a compact "
+      "binary encoding of messages instead of XML text",
+      TRUE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION,
+    g_param_spec_boolean(
+      "compression",
+      "Compression",
+      "Whether to offer (as a server) or to request (as a client) zlib "
+      "compression of the stream. Only used together with binary encoding",
+      TRUE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -4203,6 +5274,8 @@ inf_xmpp_connection_xml_connection_iface_init(
   iface->open = inf_xmpp_connection_xml_connection_open;
   iface->close = inf_xmpp_connection_xml_connection_close;
   iface->send = inf_xmpp_connection_xml_connection_send;
+  iface->send_serialized =
+    inf_xmpp_connection_xml_connection_send_serialized;
 }
 
 /*
@@ -4321,6 +5394,51 @@ inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp)
   return TRUE;
 }
 
+/**
+ * inf_xmpp_connection_get_binary_enabled:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns whether messages sent to the remote host are transmitted in
+ * binary form instead of XML text. This is negotiated after authentication
+ * if both hosts support it, see #InfXmppConnection:binary-encoding. The
+ * remote host switches to binary encoding for the messages it sends as well,
+ * though possibly a little later.
+ *
+ * Returns: %TRUE if binary encoding is used and %FALSE otherwise.
+ */
+gboolean
+inf_xmpp_connection_get_binary_enabled(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  return priv->binary_out;
+}
+
+/**
+ * inf_xmpp_connection_get_compression_enabled:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns whether the data sent to the remote host is compressed. This is
+ * negotiated after the switch to binary encoding if both hosts support it,
+ * see #InfXmppConnection:compression. The remote host compresses the data
+ * it sends as well, though possibly a little later.
+ *
+ * Returns: %TRUE if the stream is compressed and %FALSE otherwise.
+ */
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  return priv->compress_out;
+}
+
 /**
  * inf_xmpp_connection_get_own_certificate:
  * @xmpp: A #InfXmppConnection.
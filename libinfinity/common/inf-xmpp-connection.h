@@ -329,6 +329,12 @@ inf_xmpp_connection_new(InfTcpConnection* tcp,
 gboolean
 inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp);
 
+gboolean
+inf_xmpp_connection_get_binary_enabled(InfXmppConnection* xmpp);
+
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp);
+
 gnutls_x509_crt_t
 inf_xmpp_connection_get_own_certificate(InfXmppConnection* xmpp);
 
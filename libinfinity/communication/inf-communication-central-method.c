@@ -32,6 +32,7 @@
 #include <libinfinity/communication/inf-communication-central-method.h>
 #include <libinfinity/communication/inf-communication-hosted-group.h>
 #include <libinfinity/communication/inf-communication-registry.h>
+#include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-signals.h>
 
 typedef struct _InfCommunicationCentralMethodPrivate
@@ -72,8 +73,10 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   InfXmlConnection* connection;
   gboolean is_registered;
   InfXmlConnectionStatus status;
+  GBytes* serialized;
 
   priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+  serialized = NULL;
 
   /* Each of the inf_communication_registry_send() calls can do a callback
    * which might possibly screw up our connection list completely. So be safe
@@ -106,22 +109,36 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
        status == INF_XML_CONNECTION_OPEN &&
        connection != except)
     {
+      /* Serialize the message only once if it is sent to more than one
+       * connection, instead of letting every connection serialize its own
+       * copy. */
+      if(serialized == NULL && connections->next != NULL)
+        serialized = inf_xml_util_serialize(xml);
+
       if(connections->next != NULL)
       {
         /* Keep ownership of XML if there might be more connections we should
          * send it to. */
-        inf_communication_registry_send(
+        inf_communication_registry_send_serialized(
           registry,
           group,
           connection,
-          xmlCopyNode(xml, 1)
+          xmlCopyNode(xml, 1),
+          serialized
         );
       }
       else
       {
         /* Pass ownership of XML if this is definitely the last connection
          * in the list. */
-        inf_communication_registry_send(registry, group, connection, xml);
+        inf_communication_registry_send_serialized(
+          registry,
+          group,
+          connection,
+          xml,
+          serialized
+        );
+
         xml = NULL;
       }
     }
@@ -134,6 +151,8 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   g_object_unref(registry);
   g_object_unref(group);
 
+  if(serialized != NULL)
+    g_bytes_unref(serialized);
   if(xml != NULL)
     xmlFreeNode(xml);
 }
@@ -303,6 +322,26 @@ inf_communication_central_method_cancel_messages(InfCommunicationMethod* meth,
   );
 }
 
+static void
+inf_communication_central_method_send_lazy(InfCommunicationMethod* method,
+                                           InfXmlConnection* connection,
+                                           InfCommunicationMessageFunc func,
+                                           gpointer user_data,
+                                           GDestroyNotify notify)
+{
+  InfCommunicationCentralMethodPrivate* priv;
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  inf_communication_registry_send_lazy(
+    priv->registry,
+    priv->group,
+    connection,
+    func,
+    user_data,
+    notify
+  );
+}
+
 static InfCommunicationScope
 inf_communication_central_method_received(InfCommunicationMethod* method,
                                           InfXmlConnection* connection,
@@ -643,6 +682,7 @@ inf_communication_central_method_method_iface_init(
   iface->received = inf_communication_central_method_received;
   iface->enqueued = inf_communication_central_method_enqueued;
   iface->sent = inf_communication_central_method_sent;
+  iface->send_lazy = inf_communication_central_method_send_lazy;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -751,6 +751,54 @@ inf_communication_group_send_group_message(InfCommunicationGroup* group,
   }
 }
 
+/**
+ * inf_communication_group_send_lazy:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection to which to send the messages.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data once @func has
+ * returned %NULL or the messages have been cancelled, or %NULL.
+ *
+ * Sends a sequence of messages to @connection which is a member of @group.
+ * The messages are produced by calling @func repeatedly until it returns
+ * %NULL. They are sent in order, and before any message that is sent to
+ * @connection afterwards, but @func is only called when the connection is
+ * ready to send more data. This allows to send a large number of messages
+ * without keeping all of them in memory at the same time.
+ *
+ * Like other messages, messages which have not been produced yet are
+ * dropped by inf_communication_group_cancel_messages().
+ */
+void
+inf_communication_group_send_lazy(InfCommunicationGroup* group,
+                                  InfXmlConnection* connection,
+                                  InfCommunicationMessageFunc func,
+                                  gpointer user_data,
+                                  GDestroyNotify notify)
+{
+  InfCommunicationMethod* method;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(func != NULL);
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_if_fail(method != NULL);
+
+  inf_communication_method_send_lazy(
+    method,
+    connection,
+    func,
+    user_data,
+    notify
+  );
+}
+
 /**
  * inf_communication_group_cancel_messages:
  * @group: A #InfCommunicationGroup.
@@ -108,6 +108,13 @@ void
 inf_communication_group_send_group_message(InfCommunicationGroup* group,
                                            xmlNodePtr xml);
 
+void
+inf_communication_group_send_lazy(InfCommunicationGroup* group,
+                                  InfXmlConnection* connection,
+                                  InfCommunicationMessageFunc func,
+                                  gpointer user_data,
+                                  GDestroyNotify notify);
+
 void
 inf_communication_group_cancel_messages(InfCommunicationGroup* group,
                                         InfXmlConnection* connection);
@@ -233,6 +233,66 @@ inf_communication_method_cancel_messages(InfCommunicationMethod* method,
   iface->cancel_messages(method, connection);
 }
 
+/**
+ * inf_communication_method_send_lazy:
+ * @method: A #InfCommunicationMethod.
+ * @connection: A #InfXmlConnection that is a group member.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data once @func has
+ * returned %NULL or the messages have been cancelled, or %NULL.
+ *
+ * Sends the messages produced by @func to @connection, in the order in
+ * which @func produces them. Messages that are sent to @connection later
+ * are sent after the last message produced by @func. If @method supports
+ * it, @func is only called when @connection is ready to send more data, so
+ * that the messages do not need to be kept in memory all at once.
+ * Otherwise, all messages are produced and sent right away.
+ */
+void
+inf_communication_method_send_lazy(InfCommunicationMethod* method,
+                                   InfXmlConnection* connection,
+                                   InfCommunicationMessageFunc func,
+                                   gpointer user_data,
+                                   GDestroyNotify notify)
+{
+  InfCommunicationMethodInterface* iface;
+  GBytes* serialized;
+  xmlNodePtr xml;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_METHOD(method));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(inf_communication_method_is_member(method, connection));
+  g_return_if_fail(func != NULL);
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(method);
+
+  if(iface->send_lazy != NULL)
+  {
+    iface->send_lazy(method, connection, func, user_data, notify);
+  }
+  else
+  {
+    g_return_if_fail(iface->send_single != NULL);
+
+    serialized = NULL;
+    while((xml = func(&serialized, user_data)) != NULL)
+    {
+      /* send_single() has no way to make use of the serialized form */
+      if(serialized != NULL)
+      {
+        g_bytes_unref(serialized);
+        serialized = NULL;
+      }
+
+      iface->send_single(method, connection, xml);
+    }
+
+    if(notify != NULL)
+      notify(user_data);
+  }
+}
+
 /**
  * inf_communication_method_received:
  * @method: A #InfCommunicationMethod.
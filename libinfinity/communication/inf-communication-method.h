@@ -62,6 +62,9 @@ typedef struct _InfCommunicationMethodInterface InfCommunicationMethodInterface;
  * @enqueued: Handles when a message has been enqueued to be sent on a
  * registered connection.
  * @sent: Handles when a message has been sent to a registered connection.
+ * @send_lazy: Sends the messages produced by @func to a single connection,
+ * calling @func only when the connection is ready to send more data. If
+ * this is %NULL, all messages are produced and sent right away.
  *
  * The default signal handlers of virtual methods of #InfCommunicationMethod.
  * These implement communication within a #InfCommunicationGroup.
@@ -88,7 +91,6 @@ struct _InfCommunicationMethodInterface {
                    xmlNodePtr xml);
   void (*cancel_messages)(InfCommunicationMethod* method,
                           InfXmlConnection* connection);
-
   InfCommunicationScope (*received)(InfCommunicationMethod* method,
                                     InfXmlConnection* connection,
                                     xmlNodePtr xml);
@@ -98,6 +100,13 @@ struct _InfCommunicationMethodInterface {
   void (*sent)(InfCommunicationMethod* method,
                InfXmlConnection* connection,
                xmlNodePtr xml);
+
+  /* Virtual table, continued */
+  void (*send_lazy)(InfCommunicationMethod* method,
+                    InfXmlConnection* connection,
+                    InfCommunicationMessageFunc func,
+                    gpointer user_data,
+                    GDestroyNotify notify);
 };
 
 GType
@@ -128,6 +137,13 @@ void
 inf_communication_method_cancel_messages(InfCommunicationMethod* method,
                                          InfXmlConnection* connection);
 
+void
+inf_communication_method_send_lazy(InfCommunicationMethod* method,
+                                   InfXmlConnection* connection,
+                                   InfCommunicationMessageFunc func,
+                                   gpointer user_data,
+                                   GDestroyNotify notify);
+
 InfCommunicationScope
 inf_communication_method_received(InfCommunicationMethod* method,
                                   InfXmlConnection* connection,
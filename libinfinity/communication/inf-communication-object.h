@@ -48,6 +48,25 @@ typedef enum _InfCommunicationScope {
   INF_COMMUNICATION_SCOPE_GROUP
 } InfCommunicationScope;
 
+/**
+ * InfCommunicationMessageFunc:
+ * @serialized: (out) (transfer full): Location to store the serialized form
+ * of the returned message. It is %NULL when the function is called.
+ * @user_data: User data passed along with the function.
+ *
+ * This function produces the messages of a message sequence one at a time,
+ * see inf_communication_group_send_lazy(). If the message has been
+ * serialized already, for example because it is sent to several
+ * connections, the function can store the serialized form in @serialized so
+ * that it is not serialized again, see
+ * inf_communication_registry_send_serialized().
+ *
+ * Returns: (transfer full): The next message, or %NULL if the sequence is
+ * complete.
+ */
+typedef xmlNodePtr(*InfCommunicationMessageFunc)(GBytes** serialized,
+                                                 gpointer user_data);
+
 /**
  * InfCommunicationObject:
  *
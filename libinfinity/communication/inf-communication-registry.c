@@ -53,6 +53,18 @@ struct _InfCommunicationRegistryKey {
   const gchar* group_name;
 };
 
+/* A sequence of messages that is produced on demand. It occupies a place in
+ * the queue of its entry via a placeholder node. When the placeholder
+ * reaches the front of the queue, messages are taken from the function
+ * instead, until it returns NULL. */
+typedef struct _InfCommunicationRegistrySource InfCommunicationRegistrySource;
+struct _InfCommunicationRegistrySource {
+  xmlNodePtr placeholder;
+  InfCommunicationMessageFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
 typedef struct _InfCommunicationRegistryEntry InfCommunicationRegistryEntry;
 struct _InfCommunicationRegistryEntry {
   InfCommunicationRegistry* registry;
@@ -67,6 +79,9 @@ struct _InfCommunicationRegistryEntry {
   xmlNodePtr queue_begin;
   xmlNodePtr queue_end;
 
+  /* Sources with a placeholder in the queue, in queue order */
+  GQueue sources;
+
   /* Activation status */
   gboolean registered;
   guint activation_count; /* # messages to be sent until activation */
@@ -97,6 +112,134 @@ G_DEFINE_TYPE_WITH_CODE(InfCommunicationRegistry, inf_communication_registry, G_
 /* Maximum number of messages enqueued at the same time */
 static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT = 5;
 
+static void
+inf_communication_registry_source_free(InfCommunicationRegistrySource* source)
+{
+  if(source->notify != NULL)
+    source->notify(source->user_data);
+
+  g_slice_free(InfCommunicationRegistrySource, source);
+}
+
+/* While a message is owned by the registry, its _private field holds the
+ * serialized form of the message as passed to
+ * inf_communication_registry_send_serialized(), or NULL. */
+static void
+inf_communication_registry_free_queue(InfCommunicationRegistryEntry* entry)
+{
+  InfCommunicationRegistrySource* source;
+  xmlNodePtr xml;
+
+  for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
+  {
+    if(xml->_private != NULL)
+    {
+      g_bytes_unref((GBytes*)xml->_private);
+      xml->_private = NULL;
+    }
+  }
+
+  xmlFreeNodeList(entry->queue_begin);
+  entry->queue_begin = NULL;
+  entry->queue_end = NULL;
+
+  while((source = g_queue_pop_head(&entry->sources)) != NULL)
+    inf_communication_registry_source_free(source);
+}
+
+/* Removes the first message from the queue, taking it from a source if the
+ * source's placeholder is at the front. Returns NULL if the queue is
+ * empty. */
+static xmlNodePtr
+inf_communication_registry_dequeue(InfCommunicationRegistryEntry* entry)
+{
+  InfCommunicationRegistrySource* source;
+  GBytes* serialized;
+  xmlNodePtr xml;
+
+  while((xml = entry->queue_begin) != NULL)
+  {
+    source = g_queue_peek_head(&entry->sources);
+    if(source != NULL && source->placeholder == xml)
+    {
+      serialized = NULL;
+      xml = source->func(&serialized, source->user_data);
+      if(xml != NULL)
+      {
+        xml->_private = serialized;
+        return xml;
+      }
+
+      g_assert(serialized == NULL);
+
+      /* The source is exhausted, so remove its placeholder and continue
+       * with the message behind it. */
+      g_queue_pop_head(&entry->sources);
+      xml = source->placeholder;
+    }
+    else
+    {
+      source = NULL;
+    }
+
+    entry->queue_begin = entry->queue_begin->next;
+    if(entry->queue_begin == NULL) entry->queue_end = NULL;
+    xmlUnlinkNode(xml);
+
+    if(source == NULL)
+      return xml;
+
+    xmlFreeNode(xml);
+    inf_communication_registry_source_free(source);
+  }
+
+  return NULL;
+}
+
+static void
+inf_communication_registry_send_container(InfXmlConnection* connection,
+                                          xmlNodePtr container)
+{
+  GBytes** serialized;
+  xmlNodePtr child;
+  gboolean have_serialized;
+  guint n_children;
+  guint i;
+
+  n_children = 0;
+  have_serialized = FALSE;
+  for(child = container->children; child != NULL; child = child->next)
+  {
+    if(child->_private != NULL)
+      have_serialized = TRUE;
+    ++n_children;
+  }
+
+  if(have_serialized)
+  {
+    /* The connection takes ownership of the container, so take the
+     * serialized messages out of the nodes before handing it over. */
+    serialized = g_new(GBytes*, n_children);
+    for(child = container->children, i = 0; child != NULL;
+        child = child->next, ++i)
+    {
+      serialized[i] = (GBytes*)child->_private;
+      child->_private = NULL;
+    }
+
+    inf_xml_connection_send_serialized(connection, container, serialized);
+
+    for(i = 0; i < n_children; ++i)
+      if(serialized[i] != NULL)
+        g_bytes_unref(serialized[i]);
+    g_free(serialized);
+  }
+  else
+  {
+    inf_xml_connection_send(connection, container);
+  }
+}
+
 static void
 inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
                                      guint num_messages)
@@ -121,16 +264,22 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
 
   inf_xml_util_set_attribute(container, "name", entry->key.group_name);
 
-  for(i = 0; i < num_messages && ((xml = entry->queue_begin) != NULL); ++ i)
+  for(i = 0; i < num_messages; ++ i)
   {
-    entry->queue_begin = entry->queue_begin->next;
-    if(entry->queue_begin == NULL) entry->queue_end = NULL;
-    ++ entry->inner_count;
+    xml = inf_communication_registry_dequeue(entry);
+    if(xml == NULL) break;
 
-    xmlUnlinkNode(xml);
+    ++ entry->inner_count;
     xmlAddChild(container, xml);
   }
 
+  /* The queue might only have contained exhausted sources */
+  if(container->children == NULL)
+  {
+    xmlFreeNode(container);
+    return;
+  }
+
   /* Keep order of enqueued() calls and inf_xml_connection_send() calls
    * intact even if this function is run recursively in one of the
    * functions mentioned above. */
@@ -180,7 +329,7 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
        * will simply append to entry->enqueued_list, and we will enqueue and
        * send the messages within the next iteration(s).
        */
-      inf_xml_connection_send(connection, xml);
+      inf_communication_registry_send_container(connection, xml);
 
       /* Break if sending the data lead to connection closure */
       g_object_get(G_OBJECT(connection), "status", &status, NULL);
@@ -227,6 +376,10 @@ inf_communication_registry_entry_free(gpointer data)
     if(entry->queue_begin != NULL)
       inf_communication_registry_send_real(entry, G_MAXUINT);
   }
+  else
+  {
+    inf_communication_registry_free_queue(entry);
+  }
 
   if(entry->group)
   {
@@ -858,6 +1011,7 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     entry->inner_count = 0;
     entry->queue_begin = NULL;
     entry->queue_end = NULL;
+    g_queue_init(&entry->sources);
 
     entry->registered = TRUE;
     entry->activation_count = 0;
@@ -917,7 +1071,12 @@ inf_communication_registry_unregister(InfCommunicationRegistry* registry,
      status != INF_XML_CONNECTION_CLOSED)
   {
     /* The entry has still messages to send, so don't remove it right now
-     * but wait until all scheduled messages have been sent. */
+     * but wait until all scheduled messages have been sent. Messages that
+     * have not yet been produced are sent right away, so that we know how
+     * many messages there are. */
+    if(!g_queue_is_empty(&entry->sources))
+      inf_communication_registry_send_real(entry, G_MAXUINT);
+
     entry->registered = FALSE;
     entry->activation_count = entry->inner_count;
     for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
@@ -975,37 +1134,18 @@ inf_communication_registry_is_registered(InfCommunicationRegistry* registry,
   return entry != NULL && entry->registered == TRUE;
 }
 
-/**
- * inf_communication_registry_send:
- * @registry: A #InfCommunicationRegistry.
- * @group: The group for which to send the message #InfCommunicationGroup.
- * @connection: A registered #InfXmlConnection.
- * @xml: (transfer full): The message to send.
- *
- * Sends an XML message to @connection. @connection must have been registered
- * with inf_communication_registry_register() before. If the message has been
- * sent, inf_communication_method_sent() is called on the method the
- * connection was registered with. inf_communication_method_enqueued() is
- * called when sending the message can no longer be cancelled via
- * inf_communication_registry_cancel_messages().
- *
- * This function takes ownership of @xml.
- */
-void
-inf_communication_registry_send(InfCommunicationRegistry* registry,
-                                InfCommunicationGroup* group,
-                                InfXmlConnection* connection,
-                                xmlNodePtr xml)
+static void
+inf_communication_registry_send_impl(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     InfXmlConnection* connection,
+                                     xmlNodePtr xml,
+                                     GBytes* serialized,
+                                     InfCommunicationRegistrySource* source)
 {
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
 
-  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
-  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
-  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
-  g_return_if_fail(xml != NULL);
-
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
   key.connection = connection;
   key.publisher_id =
@@ -1016,6 +1156,13 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   xmlUnlinkNode(xml);
+  xml->_private = serialized != NULL ? g_bytes_ref(serialized) : NULL;
+
+  /* If xml is the placeholder of a source, the source must be known before
+   * sending below, which might already take messages from it. */
+  if(source != NULL)
+    g_queue_push_tail(&entry->sources, source);
+
   if(entry->queue_end == NULL)
   {
     entry->queue_begin = xml;
@@ -1040,6 +1187,135 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
   g_free(key.publisher_id);
 }
 
+/**
+ * inf_communication_registry_send:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connection: A registered #InfXmlConnection.
+ * @xml: (transfer full): The message to send.
+ *
+ * Sends an XML message to @connection. @connection must have been registered
+ * with inf_communication_registry_register() before. If the message has been
+ * sent, inf_communication_method_sent() is called on the method the
+ * connection was registered with. inf_communication_method_enqueued() is
+ * called when sending the message can no longer be cancelled via
+ * inf_communication_registry_cancel_messages().
+ *
+ * This function takes ownership of @xml.
+ */
+void
+inf_communication_registry_send(InfCommunicationRegistry* registry,
+                                InfCommunicationGroup* group,
+                                InfXmlConnection* connection,
+                                xmlNodePtr xml)
+{
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+
+  inf_communication_registry_send_impl(
+    registry,
+    group,
+    connection,
+    xml,
+    NULL,
+    NULL
+  );
+}
+
+/**
+ * inf_communication_registry_send_serialized:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connection: A registered #InfXmlConnection.
+ * @xml: (transfer full): The message to send.
+ * @serialized: (transfer none) (allow-none): The serialized form of @xml,
+ * as returned by inf_xml_util_serialize(), or %NULL.
+ *
+ * Sends an XML message to @connection, like
+ * inf_communication_registry_send(). Connections which support it transmit
+ * @serialized instead of serializing @xml again, see
+ * inf_xml_connection_send_serialized(). This allows to share the serialized
+ * message between all connections when the same message is sent to many of
+ * them. If @serialized is %NULL, this function behaves exactly like
+ * inf_communication_registry_send().
+ *
+ * This function takes ownership of @xml.
+ */
+void
+inf_communication_registry_send_serialized(InfCommunicationRegistry* registry,
+                                           InfCommunicationGroup* group,
+                                           InfXmlConnection* connection,
+                                           xmlNodePtr xml,
+                                           GBytes* serialized)
+{
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+
+  inf_communication_registry_send_impl(
+    registry,
+    group,
+    connection,
+    xml,
+    serialized,
+    NULL
+  );
+}
+
+/**
+ * inf_communication_registry_send_lazy:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the messages.
+ * @connection: A registered #InfXmlConnection.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data once @func has
+ * returned %NULL or the messages have been cancelled, or %NULL.
+ *
+ * Schedules the messages produced by @func to be sent to @connection. The
+ * messages take the place in the queue that a message sent with
+ * inf_communication_registry_send() at this point would take, but @func is
+ * only called when the message is about to be passed to the connection.
+ * @func is called repeatedly until it returns %NULL. Then @notify is called,
+ * and messages sent after this call follow.
+ *
+ * inf_communication_registry_cancel_messages() drops the messages which have
+ * not yet been produced, calling @notify.
+ */
+void
+inf_communication_registry_send_lazy(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     InfXmlConnection* connection,
+                                     InfCommunicationMessageFunc func,
+                                     gpointer user_data,
+                                     GDestroyNotify notify)
+{
+  InfCommunicationRegistrySource* source;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(func != NULL);
+
+  source = g_slice_new(InfCommunicationRegistrySource);
+  source->placeholder = xmlNewNode(NULL, (const xmlChar*)"source");
+  source->func = func;
+  source->user_data = user_data;
+  source->notify = notify;
+
+  inf_communication_registry_send_impl(
+    registry,
+    group,
+    connection,
+    source->placeholder,
+    NULL,
+    source
+  );
+}
+
 /**
  * inf_communication_registry_cancel_messages:
  * @registry: A #InfCommunicationRegistry.
@@ -1072,9 +1348,7 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   /* TODO: Don't cancel messages prior activation? */
-  xmlFreeNodeList(entry->queue_begin);
-  entry->queue_begin = NULL;
-  entry->queue_end = NULL;
+  inf_communication_registry_free_queue(entry);
 
   g_free(key.publisher_id);
 }
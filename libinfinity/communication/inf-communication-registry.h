@@ -83,6 +83,21 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml);
 
+void
+inf_communication_registry_send_serialized(InfCommunicationRegistry* registry,
+                                           InfCommunicationGroup* group,
+                                           InfXmlConnection* connection,
+                                           xmlNodePtr xml,
+                                           GBytes* serialized);
+
+void
+inf_communication_registry_send_lazy(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     InfXmlConnection* connection,
+                                     InfCommunicationMessageFunc func,
+                                     gpointer user_data,
+                                     GDestroyNotify notify);
+
 void
 inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
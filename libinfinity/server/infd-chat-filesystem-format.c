@@ -180,6 +180,20 @@ infd_chat_filesystem_format_read(InfdFilesystemStorage* storage,
   return TRUE;
 }
 
+static xmlDocPtr
+infd_chat_filesystem_format_write_xml_func(gpointer data,
+                                           GError** error)
+{
+  xmlDocPtr doc;
+  xmlNodePtr root;
+
+  root = xmlNewNode(NULL, (const xmlChar*)"inf-chat-session");
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  xmlDocSetRootElement(doc, root);
+  return doc;
+}
+
 /**
  * infd_chat_filesystem_format_write:
  * @storage: A #InfdFilesystemStorage.
@@ -200,57 +214,77 @@ infd_chat_filesystem_format_write(InfdFilesystemStorage* storage,
                                   InfChatBuffer* buffer,
                                   GError** error)
 {
-  FILE* stream;
   xmlDocPtr doc;
-  xmlNodePtr root;
-  xmlErrorPtr xmlerror;
+  gboolean result;
 
   g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
   g_return_val_if_fail(path != NULL, FALSE);
   g_return_val_if_fail(INF_IS_CHAT_BUFFER(buffer), FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
+  doc = infd_chat_filesystem_format_write_xml_func(NULL, error);
+
+  result = infd_filesystem_storage_write_xml_file(
+    storage,
     "InfChat",
     path,
-    "w",
-    NULL,
+    doc,
     error
   );
 
-  if(stream == NULL)
-    return FALSE;
-
-  root = xmlNewNode(NULL, (const xmlChar*)"inf-chat-session");
-
-  doc = xmlNewDoc((const xmlChar*)"1.0");
-  xmlDocSetRootElement(doc, root);
-
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
-  {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
-
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
-    );
-
-    return FALSE;
-  }
-
-  infd_filesystem_storage_stream_close(stream);
   xmlFreeDoc(doc);
-  return TRUE;
+  return result;
+}
+
+/**
+ * infd_chat_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the thread in which @func is to be called.
+ * @path: Storage path where to write the session to.
+ * @buffer: The #InfChatBuffer to write.
+ * @func: (scope notified): Function to be called when the session has been
+ * written.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given buffer into the filesystem storage at @path, like
+ * infd_chat_filesystem_format_write(), but performs the file I/O in a
+ * worker thread. See infd_filesystem_storage_write_xml_file_async() for
+ * details.
+ *
+ * Returns: (transfer none) (allow-none): The running #InfAsyncOperation,
+ * or %NULL on error.
+ */
+InfAsyncOperation*
+infd_chat_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                        InfIo* io,
+                                        const gchar* path,
+                                        InfChatBuffer* buffer,
+                                        InfdStorageWriteFunc func,
+                                        gpointer user_data,
+                                        GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_CHAT_BUFFER(buffer), NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  /* The chat history is not stored, so there is nothing to take a
+   * snapshot of. */
+  return infd_filesystem_storage_write_xml_file_async(
+    storage,
+    io,
+    "InfChat",
+    path,
+    infd_chat_filesystem_format_write_xml_func,
+    NULL,
+    NULL,
+    func,
+    user_data,
+    error
+  );
 }
 
 /* vim:set et sw=2 ts=2: */
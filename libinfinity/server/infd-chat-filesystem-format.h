@@ -51,6 +51,15 @@ infd_chat_filesystem_format_write(InfdFilesystemStorage* storage,
                                   InfChatBuffer* buffer,
                                   GError** error);
 
+InfAsyncOperation*
+infd_chat_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                        InfIo* io,
+                                        const gchar* path,
+                                        InfChatBuffer* buffer,
+                                        InfdStorageWriteFunc func,
+                                        gpointer user_data,
+                                        GError** error);
+
 G_END_DECLS
 
 #endif /* __INFD_CHAT_FILESYSTEM_FORMAT_H__ */
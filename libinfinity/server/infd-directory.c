@@ -40,6 +40,7 @@
 #include <libinfinity/server/infd-progress-request.h>
 #include <libinfinity/common/inf-session.h>
 #include <libinfinity/common/inf-chat-session.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-request-result.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/common/inf-protocol.h>
@@ -49,6 +50,7 @@
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
+#include <libxml/parser.h>
 #include <gnutls/gnutls.h>
 
 #include <string.h>
@@ -60,6 +62,7 @@ typedef enum _InfdDirectoryNodeType {
 } InfdDirectoryNodeType;
 
 typedef struct _InfdDirectoryNode InfdDirectoryNode;
+typedef struct _InfdDirectorySessionSave InfdDirectorySessionSave;
 struct _InfdDirectoryNode {
   InfdDirectoryNode* parent;
   InfdDirectoryNode* prev;
@@ -67,11 +70,20 @@ struct _InfdDirectoryNode {
 
   InfAclSheetSet* acl;
   GSList* acl_connections;
+  /* Effective permissions of accounts on this node, including the ones
+   * inherited from parent nodes, by account ID. Created on first use. */
+  GHashTable* acl_cache;
 
   InfdDirectoryNodeType type;
   guint id;
   gchar* name;
 
+  /* Collation key of the case-folded name, used to look up the node in its
+   * parent's name index, and the node's position in the parent's sorted
+   * child sequence. Both are NULL for the root node. */
+  gchar* name_key;
+  GSequenceIter* sorted_iter;
+
   union {
     struct {
       /* Running session, or NULL */
@@ -80,6 +92,8 @@ struct _InfdDirectoryNode {
       const InfdNotePlugin* plugin;
       /* Timeout to save the session when inactive for some time */
       InfIoTimeout* save_timeout;
+      /* Asynchronous save started by the save timeout, or NULL */
+      InfdDirectorySessionSave* save;
       /* Whether we hold a weak reference or a strong reference on session */
       gboolean weakref;
     } note;
@@ -95,6 +109,11 @@ struct _InfdDirectoryNode {
       GSList* connections;
       /* First child node */
       InfdDirectoryNode* child;
+      /* Children by name key, and children sorted by name. Both are created
+       * when the first child is linked, and the child list above follows
+       * the order of the sequence. */
+      GHashTable* names;
+      GSequence* sorted;
       /* Whether we requested the node already from the background storage.
        * This is required because the nodes field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
@@ -110,6 +129,23 @@ struct _InfdDirectorySessionSaveTimeoutData {
   InfdDirectoryNode* node;
 };
 
+struct _InfdDirectorySessionSave {
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfAsyncOperation* operation;
+};
+
+/* Result of a synchronous save made by
+ * infd_directory_iter_save_session_async() for plugins which do not
+ * support asynchronous saving. */
+typedef struct _InfdDirectorySaveResult InfdDirectorySaveResult;
+struct _InfdDirectorySaveResult {
+  InfdStorage* storage;
+  GError* error;
+  InfdStorageWriteFunc func;
+  gpointer user_data;
+};
+
 typedef struct _InfdDirectorySyncIn InfdDirectorySyncIn;
 struct _InfdDirectorySyncIn {
   InfdDirectory* directory;
@@ -175,6 +211,58 @@ struct _InfdDirectoryConnectionInfo {
   InfAclAccountId account_id;
 };
 
+/* A subdirectory that a connection explores page by page. The connection
+ * is in the node's connection list from the beginning, so it is told about
+ * new children right away. Only the children that existed when the
+ * exploration began are sent in pages. */
+typedef struct _InfdDirectoryExploration InfdDirectoryExploration;
+struct _InfdDirectoryExploration {
+  InfXmlConnection* connection;
+  InfdDirectoryNode* node;
+  gchar* seq;
+  guint page_size;
+  /* Children that have not been sent yet, and a mapping from each of
+   * them to its link in the queue */
+  GQueue pending;
+  GHashTable* pending_links;
+  /* Number of pending children that were removed before being sent */
+  guint skipped;
+};
+
+/* State of infd_directory_prefetch(). Subdirectories are read from storage
+ * in worker threads, and the results are filled into the tree in the main
+ * thread. */
+typedef struct _InfdDirectoryPrefetch InfdDirectoryPrefetch;
+struct _InfdDirectoryPrefetch {
+  InfdDirectoryPrefetchFunc func;
+  gpointer user_data;
+  /* Shared by all ACLs read while prefetching, so that each account is
+   * looked up only once */
+  GHashTable* verify_table;
+  /* IDs of subdirectory nodes waiting to be read */
+  GQueue queue;
+  /* InfdDirectoryPrefetchJobs reading a subdirectory */
+  GSList* jobs;
+  guint explored;
+};
+
+typedef struct _InfdDirectoryPrefetchJob InfdDirectoryPrefetchJob;
+struct _InfdDirectoryPrefetchJob {
+  InfdDirectory* directory;
+  InfdStorage* storage;
+  guint node_id;
+  gchar* path;
+  InfAsyncOperation* operation;
+};
+
+/* Written by the worker thread */
+typedef struct _InfdDirectoryPrefetchResult InfdDirectoryPrefetchResult;
+struct _InfdDirectoryPrefetchResult {
+  GSList* list;
+  GPtrArray* acls;
+  GError* error;
+};
+
 typedef struct _InfdDirectoryTransientAccount InfdDirectoryTransientAccount;
 struct _InfdDirectoryTransientAccount {
   InfAclAccount account;
@@ -205,6 +293,8 @@ struct _InfdDirectoryPrivate {
 
   GSList* sync_ins;
   GSList* subscription_requests;
+  GSList* explorations;
+  InfdDirectoryPrefetch* prefetch;
 
   InfdSessionProxy* chat_session;
 };
@@ -279,6 +369,12 @@ static GQuark infd_directory_node_id_quark;
 /* TODO: This should be a property: */
 static const guint INFD_DIRECTORY_SAVE_TIMEOUT = 60000;
 
+/* Maximum number of subdirectories being read in parallel when prefetching.
+ * In addition, at most half of the InfAsyncOperation worker threads (but at
+ * least one) are used, so that name lookups and saves are not held up by
+ * the prefetch. */
+static const guint INFD_DIRECTORY_PREFETCH_MAX_JOBS = 4;
+
 static void infd_directory_communication_object_iface_init(InfCommunicationObjectInterface* iface);
 static void infd_directory_browser_iface_init(InfBrowserInterface* iface);
 G_DEFINE_TYPE_WITH_CODE(InfdDirectory, infd_directory, G_TYPE_OBJECT,
@@ -367,6 +463,192 @@ infd_directory_node_make_path(InfdDirectoryNode* node,
   g_string_free(str, FALSE);
 }
 
+/*
+ * ACL evaluation
+ */
+
+/* Applies the permissions defined by sheet on top of perms */
+static void
+infd_directory_apply_acl_sheet(const InfAclSheet* sheet,
+                               InfAclMask* perms)
+{
+  InfAclMask tmp_mask;
+
+  inf_acl_mask_neg(&sheet->mask, &tmp_mask);
+  inf_acl_mask_and(perms, &tmp_mask, perms);
+  inf_acl_mask_and(&sheet->mask, &sheet->perms, &tmp_mask);
+  inf_acl_mask_or(perms, &tmp_mask, perms);
+}
+
+static const InfAclMask*
+infd_directory_node_lookup_permissions(InfdDirectoryNode* node,
+                                       InfAclAccountId account)
+{
+  if(node->acl_cache == NULL)
+    return NULL;
+
+  return g_hash_table_lookup(
+    node->acl_cache,
+    INF_ACL_ACCOUNT_ID_TO_POINTER(account)
+  );
+}
+
+/* Computes the permissions of account on node from the permissions on the
+ * node's parent, or from none for the root node, and caches them. */
+static const InfAclMask*
+infd_directory_node_cache_permissions(InfdDirectoryNode* node,
+                                      InfAclAccountId account,
+                                      const InfAclMask* parent_perms)
+{
+  InfAclAccountId default_id;
+  const InfAclSheet* sheet;
+  InfAclMask* perms;
+
+  if(parent_perms != NULL)
+  {
+    perms = inf_acl_mask_copy(parent_perms);
+  }
+  else
+  {
+    /* The root node always has a default sheet which defines all
+     * permissions. */
+    perms = g_slice_new(InfAclMask);
+    inf_acl_mask_clear(perms);
+  }
+
+  if(node->acl != NULL)
+  {
+    default_id = inf_acl_account_id_from_string("default");
+    if(account != default_id)
+    {
+      sheet = inf_acl_sheet_set_find_const_sheet(node->acl, default_id);
+      if(sheet != NULL)
+        infd_directory_apply_acl_sheet(sheet, perms);
+    }
+
+    /* The account's own sheet takes precedence over the default sheet */
+    sheet = inf_acl_sheet_set_find_const_sheet(node->acl, account);
+    if(sheet != NULL)
+      infd_directory_apply_acl_sheet(sheet, perms);
+  }
+
+  if(node->acl_cache == NULL)
+  {
+    node->acl_cache = g_hash_table_new_full(
+      NULL,
+      NULL,
+      NULL,
+      (GDestroyNotify)inf_acl_mask_free
+    );
+  }
+
+  g_hash_table_insert(
+    node->acl_cache,
+    INF_ACL_ACCOUNT_ID_TO_POINTER(account),
+    perms
+  );
+
+  return perms;
+}
+
+/* Returns the permissions account has on node. This is the same as what
+ * inf_browser_check_acl() computes by walking up the tree, but the result
+ * is built from the parent node's permissions and cached in each node.
+ * Therefore, if a node has a cache entry for an account, then all of its
+ * ancestors have one as well. */
+static const InfAclMask*
+infd_directory_node_get_permissions(InfdDirectoryNode* node,
+                                    InfAclAccountId account)
+{
+  const InfAclMask* perms;
+  const InfAclMask* parent_perms;
+
+  perms = infd_directory_node_lookup_permissions(node, account);
+  if(perms != NULL)
+    return perms;
+
+  parent_perms = NULL;
+  if(node->parent != NULL)
+    parent_perms = infd_directory_node_get_permissions(node->parent, account);
+
+  return infd_directory_node_cache_permissions(node, account, parent_perms);
+}
+
+/* Removes the cached permissions of the accounts that sheet_set has sheets
+ * for from node and all nodes below it. If sheet_set has a sheet for the
+ * default account, then the permissions of all accounts are removed. This
+ * needs to be called whenever the ACL of node changes. */
+static void
+infd_directory_node_invalidate_permissions(InfdDirectoryNode* node,
+                                           const InfAclSheetSet* sheet_set)
+{
+  InfdDirectoryNode* child;
+  InfAclAccountId default_id;
+  gboolean removed;
+  guint i;
+
+  /* If this node has no entry for an account, then neither has any node
+   * below it. */
+  if(node->acl_cache == NULL || g_hash_table_size(node->acl_cache) == 0)
+    return;
+
+  default_id = inf_acl_account_id_from_string("default");
+  if(inf_acl_sheet_set_find_const_sheet(sheet_set, default_id) != NULL)
+  {
+    g_hash_table_remove_all(node->acl_cache);
+    removed = TRUE;
+  }
+  else
+  {
+    removed = FALSE;
+    for(i = 0; i < sheet_set->n_sheets; ++i)
+    {
+      if(g_hash_table_remove(node->acl_cache,
+                             INF_ACL_ACCOUNT_ID_TO_POINTER(
+                               sheet_set->sheets[i].account)))
+      {
+        removed = TRUE;
+      }
+    }
+  }
+
+  if(removed == TRUE &&
+     node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+     node->shared.subdir.explored == TRUE)
+  {
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+      infd_directory_node_invalidate_permissions(child, sheet_set);
+  }
+}
+
+/* Same as inf_browser_check_acl(), but using the cached permissions */
+static gboolean
+infd_directory_node_check_acl(InfdDirectoryNode* node,
+                              InfAclAccountId account,
+                              const InfAclMask* check_mask,
+                              InfAclMask* out_mask)
+{
+  InfAclMask perms;
+
+  if(account == 0)
+  {
+    if(out_mask != NULL)
+      *out_mask = *check_mask;
+    return TRUE;
+  }
+
+  inf_acl_mask_and(
+    infd_directory_node_get_permissions(node, account),
+    check_mask,
+    &perms
+  );
+
+  if(out_mask != NULL)
+    *out_mask = perms;
+
+  return inf_acl_mask_equal(&perms, check_mask);
+}
+
 /*
  * Save timeout
  */
@@ -383,47 +665,149 @@ infd_directory_session_save_timeout_data_free(gpointer data)
   g_slice_free(InfdDirectorySessionSaveTimeoutData, data);
 }
 
+static void
+infd_directory_cancel_session_save(InfdDirectoryNode* node)
+{
+  InfdDirectorySessionSave* save;
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.save != NULL);
+
+  save = node->shared.note.save;
+  inf_async_operation_free(save->operation);
+  g_slice_free(InfdDirectorySessionSave, save);
+
+  node->shared.note.save = NULL;
+}
+
+static void
+infd_directory_session_save_done_cb(InfdStorage* storage,
+                                    const GError* error,
+                                    gpointer user_data)
+{
+  InfdDirectorySessionSave* save;
+  InfdDirectoryNode* node;
+  gchar* path;
+
+  save = (InfdDirectorySessionSave*)user_data;
+  node = save->node;
+
+  g_assert(node->shared.note.save == save);
+  g_assert(node->shared.note.weakref == FALSE);
+
+  /* The operation frees itself after this callback has run */
+  node->shared.note.save = NULL;
+
+  if(error != NULL)
+  {
+    infd_directory_node_get_path(node, &path, NULL);
+
+    g_warning(
+      _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
+        "save attempt will be made when the server is shut down."),
+      path,
+      error->message
+    );
+
+    g_free(path);
+  }
+  else if(node->shared.note.save_timeout == NULL &&
+          infd_session_proxy_is_idle(node->shared.note.session))
+  {
+    /* Nobody has used the session while it was being written, so what is
+     * on disk is up to date. If the session has been in use in the
+     * meanwhile, then a new save timeout is started once it is idle
+     * again. */
+    infd_directory_node_unlink_session(save->directory, node, NULL);
+  }
+
+  g_slice_free(InfdDirectorySessionSave, save);
+}
+
 static void
 infd_directory_session_save_timeout_func(gpointer user_data)
 {
   InfdDirectorySessionSaveTimeoutData* timeout_data;
   InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  const InfdNotePlugin* plugin;
+  InfdDirectorySessionSave* save;
   GError* error;
   gchar* path;
   gboolean result;
   InfSession* session;
 
   timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
+  node = timeout_data->node;
 
-  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.save_timeout != NULL);
   priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
+  plugin = node->shared.note.plugin;
   error = NULL;
 
-  infd_directory_node_get_path(timeout_data->node, &path, NULL);
+  infd_directory_node_get_path(node, &path, NULL);
 
   g_object_get(
-    G_OBJECT(timeout_data->node->shared.note.session),
+    G_OBJECT(node->shared.note.session),
     "session", &session,
     NULL
   );
 
   /* TODO: Only write if the buffer modified-flag is set */
 
-  result = timeout_data->node->shared.note.plugin->session_write(
-    priv->storage,
-    session,
-    path,
-    timeout_data->node->shared.note.plugin->user_data,
-    &error
-  );
+  if(plugin->session_write_async != NULL)
+  {
+    /* Write a snapshot of the session in the background, so that other
+     * sessions are not blocked while a large document is being saved. The
+     * session is kept in memory until the write has finished. A previous
+     * write which is still running is superseded by this one. */
+    if(node->shared.note.save != NULL)
+      infd_directory_cancel_session_save(node);
+
+    save = g_slice_new(InfdDirectorySessionSave);
+    save->directory = timeout_data->directory;
+    save->node = node;
+
+    save->operation = plugin->session_write_async(
+      priv->storage,
+      priv->io,
+      session,
+      path,
+      plugin->user_data,
+      infd_directory_session_save_done_cb,
+      save,
+      &error
+    );
+
+    if(save->operation != NULL)
+    {
+      node->shared.note.save = save;
+      result = TRUE;
+    }
+    else
+    {
+      g_slice_free(InfdDirectorySessionSave, save);
+      result = FALSE;
+    }
+  }
+  else
+  {
+    result = plugin->session_write(
+      priv->storage,
+      session,
+      path,
+      plugin->user_data,
+      &error
+    );
+  }
 
   g_object_unref(session);
 
   /* TODO: Unset modified flag of buffer if result == TRUE */
 
   /* The timeout is removed automatically after it has elapsed */
-  timeout_data->node->shared.note.save_timeout = NULL;
+  node->shared.note.save_timeout = NULL;
 
   if(result == FALSE)
   {
@@ -436,11 +820,11 @@ infd_directory_session_save_timeout_func(gpointer user_data)
 
     g_error_free(error);
   }
-  else
+  else if(node->shared.note.save == NULL)
   {
     infd_directory_node_unlink_session(
       timeout_data->directory,
-      timeout_data->node,
+      node,
       NULL
     );
   }
@@ -482,6 +866,7 @@ infd_directory_session_weak_ref_cb(gpointer data,
   g_assert(G_OBJECT(node->shared.note.session) == where_the_object_was);
   g_assert(node->shared.note.weakref == TRUE);
   g_assert(node->shared.note.save_timeout == NULL);
+  g_assert(node->shared.note.save == NULL);
 
   node->shared.note.session = NULL;
   node->shared.note.weakref = FALSE;
@@ -548,7 +933,6 @@ infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
   InfdDirectoryNode* node;
 
   InfdDirectoryConnectionInfo* info;
-  InfBrowserIter iter;
   InfAclMask check_mask;
   gboolean result;
 
@@ -564,14 +948,10 @@ infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
     info = g_hash_table_lookup(priv->connections, connection);
     g_assert(info != NULL);
 
-    iter.node_id = node->id;
-    iter.node = node;
-
     inf_acl_mask_set1(&check_mask, INF_ACL_CAN_JOIN_USER);
 
-    result = inf_browser_check_acl(
-      INF_BROWSER(directory),
-      &iter,
+    result = infd_directory_node_check_acl(
+      node,
       info->account_id,
       &check_mask,
       NULL
@@ -610,6 +990,9 @@ infd_directory_release_session(InfdDirectory* directory,
     node->shared.note.save_timeout = NULL;
   }
 
+  if(node->shared.note.save != NULL)
+    infd_directory_cancel_session_save(node);
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(session),
     G_CALLBACK(infd_directory_session_idle_notify_cb),
@@ -646,69 +1029,231 @@ infd_directory_release_session(InfdDirectory* directory,
 }
 
 /*
- * ACLs
+ * Paginated exploration
  */
 
-static void
-infd_directory_announce_acl_account(InfdDirectory* directory,
-                                    const InfAclAccount* account,
-                                    InfXmlConnection* except)
+static InfdDirectoryExploration*
+infd_directory_exploration_new(InfdDirectory* directory,
+                               InfXmlConnection* connection,
+                               InfdDirectoryNode* node,
+                               const gchar* seq,
+                               guint page_size)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowser* browser;
-  xmlNodePtr xml;
-  InfBrowserIter iter;
-  InfAclMask mask;
-
-  GHashTableIter hash_iter;
-  gpointer key;
-  gpointer value;
-
-  InfXmlConnection* connection;
-  InfdDirectoryConnectionInfo* conn_info;
-  InfAclAccountId account_id;
+  InfdDirectoryExploration* exploration;
+  InfdDirectoryNode* child;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  browser = INF_BROWSER(directory);
 
-  xml = xmlNewNode(NULL, (const xmlChar*)"add-acl-account");
-  inf_acl_account_to_xml(account, xml);
-
-  iter.node = priv->root;
-  iter.node_id = priv->root->id;
-  inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+  exploration = g_slice_new(InfdDirectoryExploration);
+  exploration->connection = connection;
+  exploration->node = node;
+  exploration->seq = g_strdup(seq);
+  exploration->page_size = page_size;
+  g_queue_init(&exploration->pending);
+  exploration->pending_links = g_hash_table_new(NULL, NULL);
+  exploration->skipped = 0;
 
-  /* Send to all connections that have the INF_ACL_CAN_QUERY_ACCOUNT_LIST
-   * permission. */
-  g_hash_table_iter_init(&hash_iter, priv->connections);
-  while(g_hash_table_iter_next(&hash_iter, &key, &value))
+  for(child = node->shared.subdir.child; child != NULL; child = child->next)
   {
-    connection = INF_XML_CONNECTION(key);
-    conn_info = (InfdDirectoryConnectionInfo*)value;
-    account_id = conn_info->account_id;
-    g_assert(account_id != 0);
-
-    if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL) &&
-       connection != except)
-    {
-      inf_communication_group_send_message(
-        INF_COMMUNICATION_GROUP(priv->group),
-        connection,
-        xmlCopyNode(xml, 1)
-      );
-    }
+    g_queue_push_tail(&exploration->pending, child);
+    g_hash_table_insert(
+      exploration->pending_links,
+      child,
+      g_queue_peek_tail_link(&exploration->pending)
+    );
   }
 
-  inf_browser_acl_account_added(INF_BROWSER(directory), account, NULL);
-
-  xmlFreeNode(xml);
+  priv->explorations = g_slist_prepend(priv->explorations, exploration);
+  return exploration;
 }
 
-/* acl_connections is a list of connections which have queried the full ACL.
- * It can be NULL in which case only the default sheet and the sheet for that
- * particular connection are sent. */
-static gboolean
-infd_directory_acl_sheets_to_xml_for_connection(InfdDirectory* directory,
+static void
+infd_directory_exploration_free(InfdDirectory* directory,
+                                InfdDirectoryExploration* exploration)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  priv->explorations = g_slist_remove(priv->explorations, exploration);
+
+  g_hash_table_destroy(exploration->pending_links);
+  g_queue_clear(&exploration->pending);
+  g_free(exploration->seq);
+  g_slice_free(InfdDirectoryExploration, exploration);
+}
+
+static InfdDirectoryExploration*
+infd_directory_find_exploration(InfdDirectory* directory,
+                                InfXmlConnection* connection,
+                                InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploration* exploration;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  for(item = priv->explorations; item != NULL; item = item->next)
+  {
+    exploration = (InfdDirectoryExploration*)item->data;
+    if(exploration->connection == connection && exploration->node == node)
+      return exploration;
+  }
+
+  return NULL;
+}
+
+/* Removes all explorations of the given connection, or of the given node,
+ * if they are not NULL. */
+static void
+infd_directory_remove_explorations(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploration* exploration;
+  GSList* item;
+  GSList* next;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  for(item = priv->explorations; item != NULL; item = next)
+  {
+    next = item->next;
+    exploration = (InfdDirectoryExploration*)item->data;
+
+    if( (connection == NULL || exploration->connection == connection) &&
+        (node == NULL || exploration->node == node))
+    {
+      infd_directory_exploration_free(directory, exploration);
+    }
+  }
+}
+
+/* Returns whether connection has been sent node. This is not the case if
+ * connection is still exploring the parent of node, and node is not among
+ * the pages sent so far. Such connections must not be told about changes
+ * to node. */
+static gboolean
+infd_directory_node_is_announced(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfXmlConnection* connection)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploration* exploration;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(node->parent == NULL)
+    return TRUE;
+
+  for(item = priv->explorations; item != NULL; item = item->next)
+  {
+    exploration = (InfdDirectoryExploration*)item->data;
+    if(exploration->connection == connection &&
+       exploration->node == node->parent)
+    {
+      return g_hash_table_lookup(exploration->pending_links, node) == NULL;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Called when node is removed from the directory. Explorations of node are
+ * dropped, and node is no longer sent to connections exploring its parent
+ * page by page. */
+static void
+infd_directory_explorations_node_removed(InfdDirectory* directory,
+                                         InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploration* exploration;
+  GList* link;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
+    infd_directory_remove_explorations(directory, NULL, node);
+
+  for(item = priv->explorations; item != NULL; item = item->next)
+  {
+    exploration = (InfdDirectoryExploration*)item->data;
+    if(exploration->node == node->parent)
+    {
+      link = g_hash_table_lookup(exploration->pending_links, node);
+      if(link != NULL)
+      {
+        g_hash_table_remove(exploration->pending_links, node);
+        g_queue_delete_link(&exploration->pending, link);
+        ++exploration->skipped;
+      }
+    }
+  }
+}
+
+/*
+ * ACLs
+ */
+
+static void
+infd_directory_announce_acl_account(InfdDirectory* directory,
+                                    const InfAclAccount* account,
+                                    InfXmlConnection* except)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr xml;
+  InfAclMask mask;
+
+  GHashTableIter hash_iter;
+  gpointer key;
+  gpointer value;
+
+  InfXmlConnection* connection;
+  InfdDirectoryConnectionInfo* conn_info;
+  InfAclAccountId account_id;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"add-acl-account");
+  inf_acl_account_to_xml(account, xml);
+
+  inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+
+  /* Send to all connections that have the INF_ACL_CAN_QUERY_ACCOUNT_LIST
+   * permission. */
+  g_hash_table_iter_init(&hash_iter, priv->connections);
+  while(g_hash_table_iter_next(&hash_iter, &key, &value))
+  {
+    connection = INF_XML_CONNECTION(key);
+    conn_info = (InfdDirectoryConnectionInfo*)value;
+    account_id = conn_info->account_id;
+    g_assert(account_id != 0);
+
+    if(infd_directory_node_check_acl(priv->root, account_id, &mask, NULL) &&
+       connection != except)
+    {
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        connection,
+        xmlCopyNode(xml, 1)
+      );
+    }
+  }
+
+  inf_browser_acl_account_added(INF_BROWSER(directory), account, NULL);
+
+  xmlFreeNode(xml);
+}
+
+/* acl_connections is a list of connections which have queried the full ACL.
+ * It can be NULL in which case only the default sheet and the sheet for that
+ * particular connection are sent. */
+static gboolean
+infd_directory_acl_sheets_to_xml_for_connection(InfdDirectory* directory,
                                                 GSList* acl_connections,
                                                 const InfAclSheetSet* sheets,
                                                 InfXmlConnection* connection,
@@ -849,7 +1394,8 @@ infd_directory_announce_acl_sheets(InfdDirectory* directory,
         local_item != NULL;
         local_item = g_slist_next(local_item))
     {
-      if(local_item->data != except)
+      if(local_item->data != except &&
+         infd_directory_node_is_announced(directory, node, local_item->data))
       {
         infd_directory_announce_acl_sheets_for_connection(
           directory,
@@ -1305,6 +1851,8 @@ infd_directory_verify_acl_for_node(InfdDirectory* directory,
 
     if(removed_sheets != NULL)
     {
+      infd_directory_node_invalidate_permissions(node, removed_sheets);
+
       iter.node = node;
       iter.node_id = node->id;
 
@@ -1404,23 +1952,21 @@ infd_directory_verify_all_acls(InfdDirectory* directory,
     g_hash_table_destroy(own_table);
 }
 
-/* node can be NULL. If node is not NULL, additional sheets are returned
- * which correspond to erasure of the current ACL for the node. This allows
- * the ACL change to be performed atomically on the node.
+/* Turns an ACL as read from storage into a sheet set. node can be NULL. If
+ * node is not NULL, additional sheets are returned which correspond to
+ * erasure of the current ACL for the node. This allows the ACL change to be
+ * performed atomically on the node.
  *
  * The verify_accounts table is a cache when verifying whether the accounts
  * present in the sheet exist or not. */
 static InfAclSheetSet*
-infd_directory_read_acl(InfdDirectory* directory,
-                        const gchar* path,
-                        InfdDirectoryNode* node,
-                        GHashTable* verify_accounts,
-                        GError** error)
+infd_directory_acl_from_storage(InfdDirectory* directory,
+                                const gchar* path,
+                                InfdDirectoryNode* node,
+                                GSList* acl,
+                                GHashTable* verify_accounts)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  GError* local_error;
-  GSList* acl;
   GSList* item;
   InfdStorageAcl* storage_acl;
   InfAclSheetSet* sheet_set;
@@ -1430,17 +1976,6 @@ infd_directory_read_acl(InfdDirectory* directory,
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(priv->storage != NULL);
-
-  local_error = NULL;
-  acl = infd_storage_read_acl(priv->storage, path, &local_error);
-
-  if(local_error != NULL)
-  {
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
-
   /* If there are any ACLs set already for this node, then clear them. This
    * should usually not happen because we only call this function for new
    * nodes, but it can happen when the storage is changed on the fly and the
@@ -1464,8 +1999,6 @@ infd_directory_read_acl(InfdDirectory* directory,
     sheet->perms = storage_acl->perms;
   }
 
-  infd_storage_acl_list_free(acl);
-
   if(priv->account_storage != NULL)
   {
     verify_sheets = infd_directory_verify_acl(
@@ -1490,6 +2023,45 @@ infd_directory_read_acl(InfdDirectory* directory,
   return sheet_set;
 }
 
+/* Reads the ACL at path from storage, see infd_directory_acl_from_storage()
+ * for the meaning of node and verify_accounts. */
+static InfAclSheetSet*
+infd_directory_read_acl(InfdDirectory* directory,
+                        const gchar* path,
+                        InfdDirectoryNode* node,
+                        GHashTable* verify_accounts,
+                        GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  GError* local_error;
+  GSList* acl;
+  InfAclSheetSet* sheet_set;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+
+  local_error = NULL;
+  acl = infd_storage_read_acl(priv->storage, path, &local_error);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return NULL;
+  }
+
+  sheet_set = infd_directory_acl_from_storage(
+    directory,
+    path,
+    node,
+    acl,
+    verify_accounts
+  );
+
+  infd_storage_acl_list_free(acl);
+  return sheet_set;
+}
+
 static void
 infd_directory_report_support(InfdDirectory* directory,
                               gboolean* add_account,
@@ -1635,6 +2207,7 @@ infd_directory_update_root_acl(InfdDirectory* directory)
   {
     inf_acl_sheet_set_free(priv->root->acl);
     priv->root->acl = copy_set;
+    infd_directory_node_invalidate_permissions(priv->root, merge_sheets);
 
     infd_directory_announce_acl_sheets(
       directory,
@@ -1714,6 +2287,8 @@ infd_directory_read_root_acl(InfdDirectory* directory)
       sheet_set
     );
 
+    infd_directory_node_invalidate_permissions(priv->root, sheet_set);
+
     if(priv->root->acl != NULL)
       priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
     else
@@ -1764,6 +2339,8 @@ infd_directory_read_root_acl(InfdDirectory* directory)
       sheet_set
     );
 
+    infd_directory_node_invalidate_permissions(priv->root, sheet_set);
+
     infd_directory_announce_acl_sheets(
       directory,
       priv->root,
@@ -2109,43 +2686,127 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
   }
 }
 
+/* Two names are equal in the sense of infd_directory_node_name_equal()
+ * exactly if their keys compare equal with strcmp(). */
+static gchar*
+infd_directory_node_make_name_key(const gchar* name)
+{
+  gchar* folded;
+  gchar* key;
+
+  folded = g_utf8_casefold(name, -1);
+  key = g_utf8_collate_key(folded, -1);
+  g_free(folded);
+
+  return key;
+}
+
+static gint
+infd_directory_node_compare(gconstpointer first,
+                            gconstpointer second,
+                            gpointer user_data)
+{
+  const InfdDirectoryNode* node1;
+  const InfdDirectoryNode* node2;
+  int result;
+
+  node1 = (const InfdDirectoryNode*)first;
+  node2 = (const InfdDirectoryNode*)second;
+
+  result = strcmp(node1->name_key, node2->name_key);
+  if(result != 0) return result;
+
+  /* Names can only be equal for nodes read from a storage which
+   * distinguishes case. Still keep a deterministic order. */
+  result = strcmp(node1->name, node2->name);
+  if(result != 0) return result;
+
+  if(node1->id < node2->id) return -1;
+  if(node1->id > node2->id) return 1;
+  return 0;
+}
+
 static void
 infd_directory_node_link(InfdDirectoryNode* node,
                          InfdDirectoryNode* parent)
 {
+  GSequenceIter* iter;
+
   g_return_if_fail(node != NULL);
   g_return_if_fail(parent != NULL);
   infd_directory_return_if_subdir_fail(parent);
 
-  node->prev = NULL;
-  if(parent->shared.subdir.child != NULL)
+  if(parent->shared.subdir.names == NULL)
   {
-    parent->shared.subdir.child->prev = node;
-    node->next = parent->shared.subdir.child;
+    g_assert(parent->shared.subdir.sorted == NULL);
+
+    parent->shared.subdir.names = g_hash_table_new(g_str_hash, g_str_equal);
+    parent->shared.subdir.sorted = g_sequence_new(NULL);
   }
+
+  /* If there is already a node with an equal name (which can only happen
+   * for nodes read from storage), keep that one in the index. */
+  if(g_hash_table_lookup(parent->shared.subdir.names, node->name_key) == NULL)
+    g_hash_table_insert(parent->shared.subdir.names, node->name_key, node);
+
+  node->sorted_iter = g_sequence_insert_sorted(
+    parent->shared.subdir.sorted,
+    node,
+    infd_directory_node_compare,
+    NULL
+  );
+
+  iter = g_sequence_iter_prev(node->sorted_iter);
+  if(iter != node->sorted_iter)
+    node->prev = (InfdDirectoryNode*)g_sequence_get(iter);
+  else
+    node->prev = NULL;
+
+  iter = g_sequence_iter_next(node->sorted_iter);
+  if(!g_sequence_iter_is_end(iter))
+    node->next = (InfdDirectoryNode*)g_sequence_get(iter);
   else
-  {
     node->next = NULL;
-  }
 
-  parent->shared.subdir.child = node;
+  if(node->prev != NULL)
+    node->prev->next = node;
+  else
+    parent->shared.subdir.child = node;
+
+  if(node->next != NULL)
+    node->next->prev = node;
 }
 
 static void
 infd_directory_node_unlink(InfdDirectoryNode* node)
 {
+  GHashTable* names;
+
   g_return_if_fail(node != NULL);
   g_return_if_fail(node->parent != NULL);
+  g_assert(node->parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
 
-  if(node->prev != NULL)
+  names = node->parent->shared.subdir.names;
+  if(g_hash_table_lookup(names, node->name_key) == node)
   {
-    node->prev->next = node->next;
+    g_hash_table_remove(names, node->name_key);
+
+    /* Nodes with equal names are adjacent in the sorted order, so index
+     * one of them instead, if any. */
+    if(node->prev != NULL && strcmp(node->prev->name_key, node->name_key) == 0)
+      g_hash_table_insert(names, node->prev->name_key, node->prev);
+    else if(node->next != NULL &&
+            strcmp(node->next->name_key, node->name_key) == 0)
+      g_hash_table_insert(names, node->next->name_key, node->next);
   }
-  else 
-  {
-    g_assert(node->parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+
+  g_sequence_remove(node->sorted_iter);
+  node->sorted_iter = NULL;
+
+  if(node->prev != NULL)
+    node->prev->next = node->next;
+  else
     node->parent->shared.subdir.child = node->next;
-  }
 
   if(node->next != NULL)
     node->next->prev = node->prev;
@@ -2179,8 +2840,15 @@ infd_directory_node_new_common(InfdDirectory* directory,
   node->type = type;
   node->id = node_id;
   node->name = name;
+  node->sorted_iter = NULL;
   node->acl = NULL;
   node->acl_connections = NULL;
+  node->acl_cache = NULL;
+
+  if(parent != NULL)
+    node->name_key = infd_directory_node_make_name_key(name);
+  else
+    node->name_key = NULL;
 
   if(sheet_set != NULL)
   {
@@ -2225,6 +2893,8 @@ infd_directory_node_new_subdirectory(InfdDirectory* directory,
 
   node->shared.subdir.connections = NULL;
   node->shared.subdir.child = NULL;
+  node->shared.subdir.names = NULL;
+  node->shared.subdir.sorted = NULL;
   node->shared.subdir.explored = FALSE;
 
   return node;
@@ -2254,6 +2924,7 @@ infd_directory_node_new_note(InfdDirectory* directory,
   node->shared.note.session = NULL;
   node->shared.note.plugin = plugin;
   node->shared.note.save_timeout = NULL;
+  node->shared.note.save = NULL;
   node->shared.note.weakref = FALSE;
 
   return node;
@@ -2327,6 +2998,14 @@ infd_directory_node_free(InfdDirectory* directory,
       }
     }
 
+    if(node->shared.subdir.names != NULL)
+    {
+      g_hash_table_destroy(node->shared.subdir.names);
+      g_sequence_free(node->shared.subdir.sorted);
+      node->shared.subdir.names = NULL;
+      node->shared.subdir.sorted = NULL;
+    }
+
     break;
   case INFD_DIRECTORY_NODE_NOTE:
     /* Sessions must have been explicitely unlinked before; we might still
@@ -2353,13 +3032,23 @@ infd_directory_node_free(InfdDirectory* directory,
   }
 
   if(node->parent != NULL)
+  {
+    infd_directory_explorations_node_removed(directory, node);
     infd_directory_node_unlink(node);
+  }
+  else if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
+  {
+    infd_directory_remove_explorations(directory, NULL, node);
+  }
+
   g_slist_free(node->acl_connections);
 
   /* Only clear ACL table after unlink, so that ACL has effect until the very
    * moment where the node does not exist anymore, to avoid possible races. */
   if(node->acl != NULL)
     inf_acl_sheet_set_free(node->acl);
+  if(node->acl_cache != NULL)
+    g_hash_table_destroy(node->acl_cache);
 
   /* Remove sync-ins whose parent is gone */
   for(item = priv->sync_ins; item != NULL; item = next)
@@ -2403,6 +3092,7 @@ infd_directory_node_free(InfdDirectory* directory,
   removed = g_hash_table_remove(priv->nodes, GUINT_TO_POINTER(node->id));
   g_assert(removed == TRUE);
 
+  g_free(node->name_key);
   g_free(node->name);
   g_slice_free(InfdDirectoryNode, node);
 }
@@ -2505,8 +3195,6 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
   InfdDirectoryConnectionInfo* info;
   InfAclAccountId account;
 
-  InfBrowser* browser;
-  InfBrowserIter iter;
   InfAclMask mask;
   xmlNodePtr child_xml;
   InfdDirectoryNode* child;
@@ -2523,10 +3211,6 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
   g_assert(info != NULL);
   account = info->account_id;
 
-  browser = INF_BROWSER(directory);
-  iter.node = node;
-  iter.node_id = node->id;
-
   retval = TRUE;
   if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
   {
@@ -2536,10 +3220,11 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
        * if one of the parent folders is no longer explored */
       inf_acl_mask_set1(&mask, INF_ACL_CAN_EXPLORE_NODE);
       if(!is_explored ||
-         !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+         !infd_directory_node_check_acl(node, account, &mask, NULL))
       {
         node->shared.subdir.connections =
           g_slist_remove(node->shared.subdir.connections, connection);
+        infd_directory_remove_explorations(directory, connection, node);
         retval = FALSE;
 
         /* If there are subscription requests to create a node into this node
@@ -2625,7 +3310,7 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
            * is no longer explored */
           inf_acl_mask_set1(&mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
           if(!is_explored ||
-             !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+             !infd_directory_node_check_acl(node, account, &mask, NULL))
           {
             infd_session_proxy_unsubscribe(proxy, connection);
           }
@@ -2643,7 +3328,7 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
   {
     inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACL);
     if(!is_explored ||
-       !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+       !infd_directory_node_check_acl(node, account, &mask, NULL))
     {
       node->acl_connections =
         g_slist_remove(node->acl_connections, connection);
@@ -2689,7 +3374,8 @@ infd_directory_enforce_acl(InfdDirectory* directory,
   /* If this node has ACLs set for the new account, then add this to the
    * reply XML, so that the remote host knows its own permissions
    * on the node */
-  if(reply_xml != NULL)
+  if(reply_xml != NULL &&
+     infd_directory_node_is_announced(directory, node, conn))
   {
     if(node->acl != NULL)
     {
@@ -3156,9 +3842,9 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
   InfAclAccountId account_id;
   InfAclAccountId default_id;
 
-  InfBrowser* browser;
-  InfBrowserIter iter;
   InfAclMask mask;
+  InfAclSheet sheet;
+  InfAclSheetSet sheet_set;
 
   GHashTableIter hash_iter;
   gpointer key;
@@ -3175,9 +3861,6 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
   default_id = inf_acl_account_id_from_string("default");
   g_assert(account_id != default_id);
 
-  browser = INF_BROWSER(directory);
-  iter.node = priv->root;
-  iter.node_id = priv->root->id;
   inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
 
   /* First, demote all connections with this account to the default account,
@@ -3203,7 +3886,7 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
     }
     else
     {
-      if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL))
+      if(infd_directory_node_check_acl(priv->root, account_id, &mask, NULL))
       {
         /* Notify if CAN_QUERY_ACCOUNT_LIST permission is set */
         notify_connections = g_slist_prepend(notify_connections, key);
@@ -3232,6 +3915,17 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
     g_hash_table_destroy(table);
   }
 
+  /* Forget the cached permissions of the account */
+  sheet.account = account_id;
+  inf_acl_mask_clear(&sheet.mask);
+  inf_acl_mask_clear(&sheet.perms);
+
+  sheet_set.own_sheets = NULL;
+  sheet_set.sheets = &sheet;
+  sheet_set.n_sheets = 1;
+
+  infd_directory_node_invalidate_permissions(priv->root, &sheet_set);
+
   /* Then, send requests */
   if(connection != NULL)
     if(g_slist_find(notify_connections, connection) == NULL)
@@ -3606,12 +4300,15 @@ infd_directory_node_unregister(InfdDirectory* directory,
       item != NULL;
       item = g_slist_next(item))
   {
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
-      INF_XML_CONNECTION(item->data),
-      xmlCopyNode(xml, 1)
-    );
-  }
+    if(infd_directory_node_is_announced(directory, node, item->data))
+    {
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        INF_XML_CONNECTION(item->data),
+        xmlCopyNode(xml, 1)
+      );
+    }
+  }
 
   xmlFreeNode(xml);
 }
@@ -4224,14 +4921,18 @@ infd_directory_node_find_child_by_name(InfdDirectoryNode* parent,
                                        const gchar* name)
 {
   InfdDirectoryNode* node;
+  gchar* key;
 
   infd_directory_return_val_if_subdir_fail(parent, NULL);
 
-  for(node = parent->shared.subdir.child; node != NULL; node = node->next)
-    if(infd_directory_node_name_equal(node->name, name))
-      return node;
+  if(parent->shared.subdir.names == NULL)
+    return NULL;
+
+  key = infd_directory_node_make_name_key(name);
+  node = g_hash_table_lookup(parent->shared.subdir.names, key);
+  g_free(key);
 
-  return NULL;
+  return node;
 }
 
 /* Checks whether a node with the given name can be created in the given
@@ -4306,208 +5007,568 @@ infd_directory_node_is_name_available(InfdDirectory* directory,
     return FALSE;
   }
 
-  return TRUE;
+  return TRUE;
+}
+
+static gchar*
+infd_directory_make_child_path(const gchar* path,
+                               const gchar* name)
+{
+  if(path[0] == '/' && path[1] == '\0')
+    return g_strconcat("/", name, NULL);
+  else
+    return g_strconcat(path, "/", name, NULL);
+}
+
+static void
+infd_directory_storage_acls_free(GPtrArray* acls)
+{
+  guint i;
+
+  for(i = 0; i < acls->len; ++i)
+    infd_storage_acl_list_free(g_ptr_array_index(acls, i));
+  g_ptr_array_free(acls, TRUE);
+}
+
+/* Reads the children of the subdirectory at path from storage, together
+ * with the ACL of each child. acls is set to an array with one list of
+ * InfdStorageAcl per child, in the order of list. If there is a problem
+ * reading the ACL for one node, the whole operation fails. This only
+ * accesses the storage and not the directory, so it can be run in a
+ * worker thread. */
+static gboolean
+infd_directory_read_subdirectory(InfdStorage* storage,
+                                 const gchar* path,
+                                 GSList** list,
+                                 GPtrArray** acls,
+                                 GError** error)
+{
+  InfdStorageNode* storage_node;
+  GError* local_error;
+  GSList* item;
+  GSList* acl;
+  gchar* child_path;
+
+  local_error = NULL;
+  *acls = NULL;
+  *list = infd_storage_read_subdirectory(storage, path, &local_error);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  *acls = g_ptr_array_sized_new(16);
+  for(item = *list; item != NULL; item = g_slist_next(item))
+  {
+    storage_node = (InfdStorageNode*)item->data;
+
+    child_path = infd_directory_make_child_path(path, storage_node->name);
+    acl = infd_storage_read_acl(storage, child_path, &local_error);
+    g_free(child_path);
+
+    if(local_error != NULL)
+    {
+      infd_directory_storage_acls_free(*acls);
+      infd_storage_node_list_free(*list);
+      *acls = NULL;
+      *list = NULL;
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    g_ptr_array_add(*acls, acl);
+  }
+
+  return TRUE;
+}
+
+/* Fills the children of node from what infd_directory_read_subdirectory()
+ * read from storage at path. Takes ownership of list and acls.
+ * verify_table caches account lookups for the children's ACLs, and can be
+ * NULL. */
+static void
+infd_directory_node_explore_with(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfdProgressRequest* request,
+                                 const gchar* path,
+                                 GSList* list,
+                                 GPtrArray* acls,
+                                 GHashTable* verify_table)
+{
+  InfdDirectoryPrivate* priv;
+  InfdStorageNode* storage_node;
+  InfdDirectoryNode* new_node;
+  InfBrowserIter iter;
+  InfdNotePlugin* plugin;
+  InfAclSheetSet* sheet_set;
+  GHashTable* own_table;
+  GSList* item;
+  gchar* child_path;
+  guint index;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
+
+  own_table = NULL;
+  if(verify_table == NULL)
+  {
+    own_table = g_hash_table_new(NULL, NULL);
+    verify_table = own_table;
+  }
+
+  node->shared.subdir.explored = TRUE;
+  if(request != NULL) infd_progress_request_initiated(request, acls->len);
+
+  for(item = list, index = 0;
+      item != NULL;
+      item = g_slist_next(item), ++index)
+  {
+    storage_node = (InfdStorageNode*)item->data;
+    new_node = NULL;
+
+    child_path = infd_directory_make_child_path(path, storage_node->name);
+
+    sheet_set = infd_directory_acl_from_storage(
+      directory,
+      child_path,
+      NULL,
+      g_ptr_array_index(acls, index),
+      verify_table
+    );
+
+    g_free(child_path);
+
+    switch(storage_node->type)
+    {
+    case INFD_STORAGE_NODE_SUBDIRECTORY:
+      new_node = infd_directory_node_new_subdirectory(
+        directory,
+        node,
+        priv->node_counter++,
+        g_strdup(storage_node->name),
+        sheet_set,
+        FALSE
+      );
+
+      break;
+    case INFD_STORAGE_NODE_NOTE:
+      /* TODO: Currently we ignore notes of unknown type. Perhaps we should
+       * report some error. */
+      plugin = g_hash_table_lookup(priv->plugins, storage_node->identifier);
+      if(plugin != NULL)
+      {
+        new_node = infd_directory_node_new_note(
+          directory,
+          node,
+          priv->node_counter++,
+          g_strdup(storage_node->name),
+          sheet_set,
+          FALSE,
+          plugin
+        );
+      }
+      else
+      {
+        new_node = infd_directory_node_new_unknown(
+          directory,
+          node,
+          priv->node_counter++,
+          g_strdup(storage_node->name),
+          sheet_set,
+          FALSE,
+          storage_node->identifier
+        );
+      }
+
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+
+    inf_acl_sheet_set_free(sheet_set);
+
+    if(new_node != NULL)
+    {
+      /* Announce the new node. In most cases, this does nothing on the
+       * network because there are no connections that have this node open
+       * (otherwise, we would already have explored the node earlier).
+       * However, if the background storage is replaced by a new one, the root
+       * folder of the new storage will be explored immediately (see below in
+       * infd_directory_set_storage()) and there might still be connections
+       * interesting in root folder changes (because they opened the root
+       * folder from the old storage). Also, local users might be interested
+       * in the new node. */
+      infd_directory_node_register(
+        directory,
+        new_node,
+        INFD_REQUEST(request),
+        NULL,
+        NULL
+      );
+    }
+
+    if(request != NULL) infd_progress_request_progress(request);
+  }
+
+  if(own_table != NULL)
+    g_hash_table_destroy(own_table);
+
+  infd_directory_storage_acls_free(acls);
+  infd_storage_node_list_free(list);
+
+  if(request != NULL)
+  {
+    iter.node_id = node->id;
+    iter.node = node;
+
+    inf_request_finish(
+      INF_REQUEST(request),
+      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
+    );
+  }
+}
+
+static gboolean
+infd_directory_node_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node,
+                            InfdProgressRequest* request,
+                            GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  GError* local_error;
+  GSList* list;
+  GPtrArray* acls;
+  gchar* path;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
+
+  local_error = NULL;
+  infd_directory_node_get_path(node, &path, NULL);
+
+  infd_directory_read_subdirectory(
+    priv->storage,
+    path,
+    &list,
+    &acls,
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    g_free(path);
+    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  infd_directory_node_explore_with(
+    directory,
+    node,
+    request,
+    path,
+    list,
+    acls,
+    NULL
+  );
+
+  g_free(path);
+  return TRUE;
+}
+
+/*
+ * Prefetching
+ */
+
+static void
+infd_directory_prefetch_result_free(gpointer data)
+{
+  InfdDirectoryPrefetchResult* result;
+  result = (InfdDirectoryPrefetchResult*)data;
+
+  if(result->acls != NULL)
+    infd_directory_storage_acls_free(result->acls);
+  infd_storage_node_list_free(result->list);
+  if(result->error != NULL)
+    g_error_free(result->error);
+
+  g_slice_free(InfdDirectoryPrefetchResult, result);
+}
+
+/* Called when the async operation is freed, possibly in a worker thread */
+static void
+infd_directory_prefetch_job_free(gpointer data)
+{
+  InfdDirectoryPrefetchJob* job;
+  job = (InfdDirectoryPrefetchJob*)data;
+
+  g_object_unref(job->storage);
+  g_free(job->path);
+  g_slice_free(InfdDirectoryPrefetchJob, job);
+}
+
+static void
+infd_directory_prefetch_free(InfdDirectoryPrefetch* prefetch)
+{
+  GSList* item;
+  InfdDirectoryPrefetchJob* job;
+
+  for(item = prefetch->jobs; item != NULL; item = item->next)
+  {
+    job = (InfdDirectoryPrefetchJob*)item->data;
+    inf_async_operation_free(job->operation);
+  }
+
+  g_slist_free(prefetch->jobs);
+  g_queue_clear(&prefetch->queue);
+  g_hash_table_destroy(prefetch->verify_table);
+  g_slice_free(InfdDirectoryPrefetch, prefetch);
+}
+
+/* Queues node if it has not been explored yet, or otherwise all
+ * unexplored subdirectories below it. */
+static void
+infd_directory_prefetch_enqueue(InfdDirectoryPrefetch* prefetch,
+                                InfdDirectoryNode* node)
+{
+  InfdDirectoryNode* child;
+
+  if(node->type != INFD_DIRECTORY_NODE_SUBDIRECTORY)
+    return;
+
+  if(node->shared.subdir.explored == FALSE)
+  {
+    g_queue_push_tail(&prefetch->queue, GUINT_TO_POINTER(node->id));
+  }
+  else
+  {
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+      infd_directory_prefetch_enqueue(prefetch, child);
+  }
+}
+
+static void
+infd_directory_prefetch_job_run(gpointer* run_data,
+                                GDestroyNotify* run_notify,
+                                gpointer user_data)
+{
+  InfdDirectoryPrefetchJob* job;
+  InfdDirectoryPrefetchResult* result;
+
+  job = (InfdDirectoryPrefetchJob*)user_data;
+
+  result = g_slice_new(InfdDirectoryPrefetchResult);
+  result->error = NULL;
+
+  infd_directory_read_subdirectory(
+    job->storage,
+    job->path,
+    &result->list,
+    &result->acls,
+    &result->error
+  );
+
+  *run_data = result;
+  *run_notify = infd_directory_prefetch_result_free;
 }
 
-static gboolean
-infd_directory_node_explore(InfdDirectory* directory,
-                            InfdDirectoryNode* node,
-                            InfdProgressRequest* request,
-                            GError** error)
+static void
+infd_directory_prefetch_job_done(gpointer run_data,
+                                 gpointer user_data);
+
+/* Starts reading as many queued subdirectories as allowed, and reports
+ * progress. error is the reason why the subdirectory that was handled last
+ * could not be read, if any. */
+static void
+infd_directory_prefetch_continue(InfdDirectory* directory,
+                                 const GError* error)
 {
   InfdDirectoryPrivate* priv;
-  InfdStorageNode* storage_node;
-  InfdDirectoryNode* new_node;
-  InfBrowserIter iter;
-  InfdNotePlugin* plugin;
+  InfdDirectoryPrefetch* prefetch;
+  InfdDirectoryPrefetchJob* job;
+  InfdDirectoryNode* node;
+  InfdDirectoryPrefetchFunc func;
+  gpointer user_data;
   GError* local_error;
-  GSList* list;
-  InfAclSheetSet* sheet_set;
-  GPtrArray* acls;
-  GHashTable* verify_table;
-  GSList* item;
-  gchar* path;
-  gsize len;
-  gsize node_len;
-  gsize sep_len;
-  gsize path_len;
-  guint index;
+  guint max_jobs;
+  guint node_id;
+  guint explored;
+  guint remaining;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  prefetch = priv->prefetch;
+  g_assert(prefetch != NULL);
 
-  g_assert(priv->storage != NULL);
-  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-  g_assert(node->shared.subdir.explored == FALSE);
-
-  local_error = NULL;
-  infd_directory_node_get_path(node, &path, &len);
-  list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
-
-  if(local_error != NULL)
+  max_jobs = inf_async_operation_get_max_threads() / 2;
+  if(max_jobs == 0)
   {
-    g_free(path);
-    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
+    /* No limit, or only a single worker thread */
+    if(inf_async_operation_get_max_threads() == 0)
+      max_jobs = INFD_DIRECTORY_PREFETCH_MAX_JOBS;
+    else
+      max_jobs = 1;
   }
-
-  /* First pass: Count the total number of items and read the ACLs for each
-   * node. If there is a problem reading the ACL for one node, cancel the
-   * full exploration. */
-  path_len = len;
-  acls = g_ptr_array_sized_new(16);
-  verify_table = g_hash_table_new(NULL, NULL);
-  for(item = list; item != NULL; item = g_slist_next(item))
+  else if(max_jobs > INFD_DIRECTORY_PREFETCH_MAX_JOBS)
   {
-    storage_node = (InfdStorageNode*)item->data;
-
-    /* Construct the storage path for this node */
-    node_len = strlen(storage_node->name);
+    max_jobs = INFD_DIRECTORY_PREFETCH_MAX_JOBS;
+  }
 
-    sep_len = 1;
-    if(path[len - 1] == '/') sep_len = 0;
+  while(g_slist_length(prefetch->jobs) < max_jobs &&
+        !g_queue_is_empty(&prefetch->queue))
+  {
+    node_id = GPOINTER_TO_UINT(g_queue_pop_head(&prefetch->queue));
+    node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id));
 
-    if(len + sep_len + node_len < path_len)
+    /* The node might have been removed in the meanwhile, or explored
+     * because someone needed it before we got to it. */
+    if(node == NULL) continue;
+    if(node->shared.subdir.explored == TRUE)
     {
-      path_len = len + sep_len + node_len;
-      path = g_realloc(path, path_len + sep_len);
+      infd_directory_prefetch_enqueue(prefetch, node);
+      continue;
     }
 
-    if(sep_len > 0)
-      path[len] = '/';
-
-    memcpy(path + len + sep_len, storage_node->name, node_len + 1);
+    job = g_slice_new(InfdDirectoryPrefetchJob);
+    job->directory = directory;
+    job->storage = g_object_ref(priv->storage);
+    job->node_id = node_id;
+    infd_directory_node_get_path(node, &job->path, NULL);
 
-    /* Read ACL */
-    sheet_set = infd_directory_read_acl(
-      directory,
-      path,
-      NULL,
-      verify_table,
-      &local_error
+    job->operation = inf_async_operation_new_full(
+      priv->io,
+      infd_directory_prefetch_job_run,
+      infd_directory_prefetch_job_done,
+      job,
+      infd_directory_prefetch_job_free
     );
 
-    if(local_error != NULL)
-    {
-      for(index = 0; index < acls->len; ++index)
-        inf_acl_sheet_set_free(g_ptr_array_index(acls, index));
-      g_ptr_array_free(acls, TRUE);
-      g_hash_table_destroy(verify_table);
-      infd_storage_node_list_free(list);
-      g_free(path);
-      if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
-
-    g_ptr_array_add(acls, sheet_set);
-  }
-
-  g_hash_table_destroy(verify_table);
-  node->shared.subdir.explored = TRUE;
-
-  g_free(path);
-  if(request != NULL) infd_progress_request_initiated(request, acls->len);
-
-  /* Second pass, fill the directory tree */
-  index = 0;
-  for(item = list, index = 0;
-      item != NULL;
-      item = g_slist_next(item), ++index)
-  {
-    storage_node = (InfdStorageNode*)item->data;
-    sheet_set = (InfAclSheetSet*)g_ptr_array_index(acls, index);
-    new_node = NULL;
+    prefetch->jobs = g_slist_prepend(prefetch->jobs, job);
 
-    switch(storage_node->type)
+    local_error = NULL;
+    if(!inf_async_operation_start(job->operation, &local_error))
     {
-    case INFD_STORAGE_NODE_SUBDIRECTORY:
-      new_node = infd_directory_node_new_subdirectory(
-        directory,
-        node,
-        priv->node_counter++,
-        g_strdup(storage_node->name),
-        sheet_set,
-        FALSE
-      );
+      /* The operation, and the job with it, has been freed already */
+      prefetch->jobs = g_slist_remove(prefetch->jobs, job);
+      g_queue_push_head(&prefetch->queue, GUINT_TO_POINTER(node_id));
 
-      break;
-    case INFD_STORAGE_NODE_NOTE:
-      /* TODO: Currently we ignore notes of unknown type. Perhaps we should
-       * report some error. */
-      plugin = g_hash_table_lookup(priv->plugins, storage_node->identifier);
-      if(plugin != NULL)
-      {
-        new_node = infd_directory_node_new_note(
-          directory,
-          node,
-          priv->node_counter++,
-          g_strdup(storage_node->name),
-          sheet_set,
-          FALSE,
-          plugin
-        );
-      }
-      else
+      if(prefetch->jobs == NULL)
       {
-        new_node = infd_directory_node_new_unknown(
-          directory,
-          node,
-          priv->node_counter++,
-          g_strdup(storage_node->name),
-          sheet_set,
-          FALSE,
-          storage_node->identifier
+        /* There is nothing running which could make room in the thread
+         * pool, so give up. The remaining subdirectories are explored on
+         * demand, as usual. */
+        g_warning(
+          _("Failed to prefetch the directory tree: %s"),
+          local_error->message
         );
+
+        g_queue_clear(&prefetch->queue);
       }
 
-      break;
-    default:
-      g_assert_not_reached();
+      g_error_free(local_error);
       break;
     }
+  }
 
-    inf_acl_sheet_set_free(sheet_set);
+  func = prefetch->func;
+  user_data = prefetch->user_data;
+  explored = prefetch->explored;
+  remaining =
+    g_queue_get_length(&prefetch->queue) + g_slist_length(prefetch->jobs);
 
-    if(new_node != NULL)
+  if(remaining == 0)
+  {
+    priv->prefetch = NULL;
+    infd_directory_prefetch_free(prefetch);
+  }
+
+  if(func != NULL)
+    func(directory, explored, remaining, error, user_data);
+}
+
+static void
+infd_directory_prefetch_job_done(gpointer run_data,
+                                 gpointer user_data)
+{
+  InfdDirectoryPrefetchJob* job;
+  InfdDirectoryPrefetchResult* result;
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryPrefetch* prefetch;
+  InfdDirectoryNode* node;
+  const GError* error;
+
+  job = (InfdDirectoryPrefetchJob*)user_data;
+  result = (InfdDirectoryPrefetchResult*)run_data;
+  directory = job->directory;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  prefetch = priv->prefetch;
+
+  g_assert(prefetch != NULL);
+  prefetch->jobs = g_slist_remove(prefetch->jobs, job);
+
+  error = NULL;
+  node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(job->node_id));
+
+  if(node != NULL && node->shared.subdir.explored == FALSE)
+  {
+    if(result->error != NULL)
     {
-      /* Announce the new node. In most cases, this does nothing on the
-       * network because there are no connections that have this node open
-       * (otherwise, we would already have explored the node earlier).
-       * However, if the background storage is replaced by a new one, the root
-       * folder of the new storage will be explored immediately (see below in
-       * infd_directory_set_storage()) and there might still be connections
-       * interesting in root folder changes (because they opened the root
-       * folder from the old storage). Also, local users might be interested
-       * in the new node. */
-      infd_directory_node_register(
+      error = result->error;
+    }
+    else
+    {
+      infd_directory_node_explore_with(
         directory,
-        new_node,
-        INFD_REQUEST(request),
+        node,
         NULL,
-        NULL
+        job->path,
+        result->list,
+        result->acls,
+        prefetch->verify_table
       );
-    }
 
-    if(request != NULL) infd_progress_request_progress(request);
+      result->list = NULL;
+      result->acls = NULL;
+      ++prefetch->explored;
+    }
   }
 
-  g_ptr_array_free(acls, TRUE);
+  if(node != NULL && node->shared.subdir.explored == TRUE)
+    infd_directory_prefetch_enqueue(prefetch, node);
 
-  if(request != NULL)
-  {
-    iter.node_id = node->id;
-    iter.node = node;
+  infd_directory_prefetch_continue(directory, error);
+}
 
-    inf_request_finish(
-      INF_REQUEST(request),
-      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
-    );
-  }
+/* Drops cached account lookups when the set of accounts changes */
+static void
+infd_directory_prefetch_reset_accounts(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  infd_storage_node_list_free(list);
+  if(priv->prefetch != NULL)
+    g_hash_table_remove_all(priv->prefetch->verify_table);
+}
 
-  return TRUE;
+static void
+infd_directory_prefetch_cancel(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->prefetch != NULL)
+  {
+    infd_directory_prefetch_free(priv->prefetch);
+    priv->prefetch = NULL;
+  }
 }
 
 static InfdDirectoryNode*
@@ -5196,19 +6257,14 @@ infd_directory_check_auth(InfdDirectory* directory,
 {
   InfdDirectoryPrivate* priv;
   InfdDirectoryConnectionInfo* info;
-  InfBrowserIter iter;
   gboolean result;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
   info = g_hash_table_lookup(priv->connections, connection);
   g_assert(info != NULL);
 
-  iter.node_id = node->id;
-  iter.node = node;
-
-  result = inf_browser_check_acl(
-    INF_BROWSER(directory),
-    &iter,
+  result = infd_directory_node_check_acl(
+    node,
     info->account_id,
     mask,
     NULL
@@ -5564,6 +6620,97 @@ infd_directory_get_node_from_xml_typed(InfdDirectory* directory,
   return node;
 }
 
+/* Sends child to connection as part of an exploration of its parent */
+static void
+infd_directory_send_explored_child(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   InfdDirectoryNode* child,
+                                   const gchar* seq)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr reply_xml;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  reply_xml = infd_directory_node_register_to_xml(child);
+  if(seq != NULL)
+    inf_xml_util_set_attribute(reply_xml, "seq", seq);
+
+  if(child->acl != NULL)
+  {
+    infd_directory_acl_sheets_to_xml_for_connection(
+      directory,
+      child->acl_connections,
+      child->acl,
+      connection,
+      reply_xml
+    );
+  }
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
+}
+
+/* Sends the next page of children of a paginated exploration, followed by
+ * explore-end if there are no more children to send. In that case, the
+ * exploration is freed. */
+static void
+infd_directory_exploration_send_page(InfdDirectory* directory,
+                                     InfdDirectoryExploration* exploration)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* child;
+  xmlNodePtr reply_xml;
+  guint i;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  for(i = 0; i < exploration->page_size; ++i)
+  {
+    child = g_queue_pop_head(&exploration->pending);
+    if(child == NULL) break;
+
+    g_hash_table_remove(exploration->pending_links, child);
+
+    infd_directory_send_explored_child(
+      directory,
+      exploration->connection,
+      child,
+      exploration->seq
+    );
+  }
+
+  if(g_queue_is_empty(&exploration->pending))
+  {
+    reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
+
+    if(exploration->seq != NULL)
+      inf_xml_util_set_attribute(reply_xml, "seq", exploration->seq);
+
+    /* Children counted in explore-begin's total which the client will not
+     * receive, because they have been removed in the meanwhile */
+    if(exploration->skipped > 0)
+    {
+      inf_xml_util_set_attribute_uint(
+        reply_xml,
+        "skipped",
+        exploration->skipped
+      );
+    }
+
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      exploration->connection,
+      reply_xml
+    );
+
+    infd_directory_exploration_free(directory, exploration);
+  }
+}
+
 static gboolean
 infd_directory_handle_explore_node(InfdDirectory* directory,
                                    InfXmlConnection* connection,
@@ -5573,15 +6720,16 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfAclMask perms;
-  GSList* item;
   InfdProgressRequest* request;
   InfBrowserIter iter;
   GError* local_error;
   InfdDirectoryNode* child;
+  InfdDirectoryExploration* exploration;
   xmlNodePtr reply_xml;
   gchar* seq;
   guint total;
-  const InfAclSheetSet* sheet_set;
+  guint page_size;
+  gboolean has_page_size;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
@@ -5599,6 +6747,26 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
+  /* Clients which want to explore large directories page by page tell us
+   * how many children to send at a time. Otherwise, all children are sent
+   * at once. */
+  local_error = NULL;
+  has_page_size = inf_xml_util_get_attribute_uint(
+    xml,
+    "page-size",
+    &page_size,
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  if(!has_page_size)
+    page_size = 0;
+
   if(node->shared.subdir.explored == FALSE)
   {
     request = INFD_PROGRESS_REQUEST(
@@ -5619,7 +6787,6 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
       INF_REQUEST(request)
     );
 
-    local_error = NULL;
     infd_directory_node_explore(directory, node, request, &local_error);
     g_object_unref(request);
 
@@ -5660,22 +6827,33 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     reply_xml
   );
 
-  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+  /* Remember that this connection explored that node so that it gets
+   * notified when changes occur. */
+  node->shared.subdir.connections = g_slist_prepend(
+    node->shared.subdir.connections,
+    connection
+  );
+
+  if(page_size > 0)
+  {
+    exploration = infd_directory_exploration_new(
+      directory,
+      connection,
+      node,
+      seq,
+      page_size
+    );
+
+    infd_directory_exploration_send_page(directory, exploration);
+  }
+  else
   {
-    reply_xml = infd_directory_node_register_to_xml(child);
-    if(seq != NULL)
-      inf_xml_util_set_attribute(reply_xml, "seq", seq);
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+      infd_directory_send_explored_child(directory, connection, child, seq);
 
-    if(child->acl != NULL)
-    {
-      infd_directory_acl_sheets_to_xml_for_connection(
-        directory,
-        child->acl_connections,
-        child->acl,
-        connection,
-        reply_xml
-      );
-    }
+    reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
+
+    if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
     inf_communication_group_send_message(
       INF_COMMUNICATION_GROUP(priv->group),
@@ -5684,24 +6862,50 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     );
   }
 
-  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
+  g_free(seq);
+  return TRUE;
+}
 
-  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+static gboolean
+infd_directory_handle_explore_continue(InfdDirectory* directory,
+                                       InfXmlConnection* connection,
+                                       const xmlNodePtr xml,
+                                       GError** error)
+{
+  InfdDirectoryNode* node;
+  InfdDirectoryExploration* exploration;
 
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    reply_xml
+  node = infd_directory_get_node_from_xml_typed(
+    directory,
+    xml,
+    "id",
+    INFD_DIRECTORY_NODE_SUBDIRECTORY,
+    error
   );
 
-  /* Remember that this connection explored that node so that it gets
-   * notified when changes occur. */
-  node->shared.subdir.connections = g_slist_prepend(
-    node->shared.subdir.connections,
-    connection
-  );
+  if(node == NULL) return FALSE;
 
-  g_free(seq);
+  exploration = infd_directory_find_exploration(directory, connection, node);
+  if(exploration == NULL)
+  {
+    /* The client may ask for another page while explore-end is on its way
+     * to it, so only complain if it never explored the node. */
+    if(g_slist_find(node->shared.subdir.connections, connection) == NULL)
+    {
+      g_set_error_literal(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NOT_EXPLORED,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_NOT_EXPLORED)
+      );
+
+      return FALSE;
+    }
+
+    return TRUE;
+  }
+
+  infd_directory_exploration_send_page(directory, exploration);
   return TRUE;
 }
 
@@ -7111,6 +8315,7 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
   );
 
   node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+  infd_directory_node_invalidate_permissions(node, sheet_set);
   if(node == priv->root)
   {
     priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
@@ -7854,6 +9059,8 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
       infd_directory_remove_subreq(directory, request);
   }
 
+  infd_directory_remove_explorations(directory, connection, NULL);
+
   if(priv->root != NULL)
   {
     if(priv->root->shared.subdir.explored == TRUE)
@@ -7896,6 +9103,7 @@ infd_directory_account_storage_account_added_cb(InfdAccountStorage* storage,
                                                 gpointer user_data)
 {
   /* An account has been externally added to the storage: Announce */
+  infd_directory_prefetch_reset_accounts(INFD_DIRECTORY(user_data));
   infd_directory_announce_acl_account(INFD_DIRECTORY(user_data), acc, NULL);
 }
 
@@ -7906,6 +9114,7 @@ infd_directory_account_storage_account_removed_cb(InfdAccountStorage* storage,
 {
   /* An account has been externally removed from the storage: Cleanup ACL
    * sheets and announce. */
+  infd_directory_prefetch_reset_accounts(INFD_DIRECTORY(user_data));
   infd_directory_cleanup_acl_account(
     INFD_DIRECTORY(user_data),
     acc,
@@ -7931,6 +9140,9 @@ infd_directory_set_storage(InfdDirectory* directory,
   priv = INFD_DIRECTORY_PRIVATE(directory);
   g_assert(priv->root != NULL);
 
+  /* Subdirectories read in the background belong to the old storage */
+  infd_directory_prefetch_cancel(directory);
+
   /* If we are setting a new storage, then remove all documents. If we are
    * going to no storage, then keep current set of documents. */
   if(storage != NULL)
@@ -8454,6 +9666,7 @@ infd_directory_set_account_storage(InfdDirectory* directory,
 
   prev_account_storage = priv->account_storage;
   priv->account_storage = account_storage;
+  infd_directory_prefetch_reset_accounts(directory);
 
   /* Fix all client accounts */
   infd_directory_relogin_clients(directory);
@@ -8561,6 +9774,8 @@ infd_directory_init(InfdDirectory* directory)
   priv->orig_root_acl = NULL;
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
+  priv->explorations = NULL;
+  priv->prefetch = NULL;
 
   priv->chat_session = NULL;
 }
@@ -8656,6 +9871,7 @@ infd_directory_dispose(GObject* object)
   g_assert(g_hash_table_size(priv->connections) == 0);
   g_assert(priv->subscription_requests == NULL);
   g_assert(priv->sync_ins == NULL);
+  g_assert(priv->explorations == NULL);
 
   /* We have dropped all references to connections now, so these do not try
    * to tell anyone that the directory tree has gone or whatever. */
@@ -8865,6 +10081,15 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
       &local_error
     );
   }
+  else if(strcmp((const char*)node->name, "explore-continue") == 0)
+  {
+    infd_directory_handle_explore_continue(
+      directory,
+      connection,
+      node,
+      &local_error
+    );
+  }
   else if(strcmp((const char*)node->name, "add-node") == 0)
   {
     infd_directory_handle_add_node(
@@ -9135,6 +10360,12 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
       node->shared.note.save_timeout = NULL;
     }
 
+    /* A running save is cancelled as well, since it would unlink the
+     * session when done. Whoever unlinks the session has either saved it
+     * already, or does not want it to be saved. */
+    if(node->shared.note.save != NULL)
+      infd_directory_cancel_session_save(node);
+
     g_object_weak_ref(
       G_OBJECT(node->shared.note.session),
       infd_directory_session_weak_ref_cb,
@@ -10468,6 +11699,7 @@ infd_directory_browser_set_acl(InfBrowser* browser,
   }
 
   node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+  infd_directory_node_invalidate_permissions(node, sheet_set);
   if(node == priv->root)
   {
     priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
@@ -10905,6 +12137,7 @@ infd_directory_add_plugin(InfdDirectory* directory,
       node->shared.note.session = NULL;
       node->shared.note.plugin = plugin;
       node->shared.note.save_timeout = NULL;
+      node->shared.note.save = NULL;
       node->shared.note.weakref = FALSE;
     }
   }
@@ -10973,6 +12206,7 @@ infd_directory_remove_plugin(InfdDirectory* directory,
       g_assert(node->shared.note.session == NULL);
       g_assert(node->shared.note.plugin == plugin);
       g_assert(node->shared.note.save_timeout == NULL);
+      g_assert(node->shared.note.save == NULL);
       g_assert(node->shared.note.weakref == FALSE);
 
       /* Then, change the type to unknown */
@@ -11294,6 +12528,224 @@ infd_directory_foreach_connection(InfdDirectory* directory,
   g_list_free(keys);
 }
 
+/**
+ * infd_directory_prefetch:
+ * @directory: A #InfdDirectory with a background storage.
+ * @func: (scope async) (allow-none): Function to be called to report
+ * progress, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Explores all subdirectories of @directory in the background, so that
+ * clients do not need to wait for the storage to be read when they browse
+ * the directory tree for the first time. Subdirectories and their ACLs are
+ * read from the background storage in worker threads, so the storage needs
+ * to support being read from multiple threads at the same time, as
+ * #InfdFilesystemStorage does. The nodes are created and the ACLs are
+ * verified in the main thread, and account lookups are shared between all
+ * subdirectories.
+ *
+ * The directory can be used normally while prefetching is in progress. In
+ * particular, subdirectories that a client requests are explored
+ * immediately, as usual.
+ *
+ * @func is called once when prefetching starts, and then every time a
+ * subdirectory has been read. When its remaining parameter is zero, then
+ * prefetching has finished. If the storage of @directory is changed, or
+ * the directory is disposed, prefetching stops without @func being called
+ * again.
+ *
+ * Only one prefetch operation can run at a time for a given directory.
+ */
+void
+infd_directory_prefetch(InfdDirectory* directory,
+                        InfdDirectoryPrefetchFunc func,
+                        gpointer user_data)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryPrefetch* prefetch;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_return_if_fail(priv->storage != NULL);
+  g_return_if_fail(priv->prefetch == NULL);
+
+  /* The storage might use libxml in the worker threads */
+  xmlInitParser();
+
+  prefetch = g_slice_new(InfdDirectoryPrefetch);
+  prefetch->func = func;
+  prefetch->user_data = user_data;
+  prefetch->verify_table = g_hash_table_new(NULL, NULL);
+  g_queue_init(&prefetch->queue);
+  prefetch->jobs = NULL;
+  prefetch->explored = 0;
+
+  priv->prefetch = prefetch;
+
+  infd_directory_prefetch_enqueue(prefetch, priv->root);
+  infd_directory_prefetch_continue(directory, NULL);
+}
+
+/**
+ * infd_directory_iter_get_child_by_name:
+ * @directory: A #InfdDirectory.
+ * @iter: (inout): A #InfBrowserIter pointing to an explored subdirectory
+ * node in @directory.
+ * @name: The name of the child node to look up.
+ *
+ * Sets @iter to point to the child of the subdirectory node it currently
+ * points to whose name is @name. Names are compared the same way as when
+ * checking whether a new node's name is available, i.e. case-insensitively.
+ * If there is no such child, @iter is left untouched and the function
+ * returns %FALSE.
+ *
+ * Children are indexed by name, so this does not depend on the number of
+ * nodes in the subdirectory.
+ *
+ * Returns: %TRUE if @iter was moved or %FALSE otherwise.
+ */
+gboolean
+infd_directory_iter_get_child_by_name(InfdDirectory* directory,
+                                      InfBrowserIter* iter,
+                                      const gchar* name)
+{
+  InfdDirectoryNode* node;
+  InfdDirectoryNode* child;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), FALSE);
+  infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+
+  node = (InfdDirectoryNode*)iter->node;
+  infd_directory_return_val_if_subdir_fail(node, FALSE);
+  g_return_val_if_fail(node->shared.subdir.explored == TRUE, FALSE);
+
+  child = infd_directory_node_find_child_by_name(node, name);
+  if(child == NULL) return FALSE;
+
+  iter->node_id = child->id;
+  iter->node = child;
+  return TRUE;
+}
+
+/**
+ * infd_directory_iter_check_acl:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to a node in @directory.
+ * @account: The ID of the account whose permission to check, or 0.
+ * @check_mask: A bitmask of #InfAclSetting<!-- -->s with permissions to
+ * check.
+ * @out_mask: (out) (allow-none): Output parameter with the granted
+ * permissions, or %NULL.
+ *
+ * Does the same as inf_browser_check_acl(), but instead of evaluating the
+ * ACL sheets of @iter and all of its parent nodes each time, the effective
+ * permissions of an account on a node are cached, and computed from the
+ * cached permissions of the parent node if needed. The cache is updated
+ * whenever an ACL in @directory changes.
+ *
+ * Returns: %TRUE if all checked permissions are granted, or %FALSE otherwise.
+ */
+gboolean
+infd_directory_iter_check_acl(InfdDirectory* directory,
+                              const InfBrowserIter* iter,
+                              InfAclAccountId account,
+                              const InfAclMask* check_mask,
+                              InfAclMask* out_mask)
+{
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), FALSE);
+  infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
+  g_return_val_if_fail(check_mask != NULL, FALSE);
+
+  return infd_directory_node_check_acl(
+    (InfdDirectoryNode*)iter->node,
+    account,
+    check_mask,
+    out_mask
+  );
+}
+
+/**
+ * infd_directory_iter_get_child_permissions:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to an explored subdirectory node in
+ * @directory.
+ * @account: The ID of the account whose permissions to obtain, or 0.
+ * @n_children: (out): Location to store the number of children of the
+ * node @iter points to.
+ *
+ * Returns the permissions @account has on each child of the subdirectory
+ * node @iter points to, in the order in which inf_browser_get_child() and
+ * inf_browser_get_next() iterate over the children. This evaluates the
+ * permissions on the subdirectory once, and then the ACL of each child on
+ * top of it, and caches the results for later calls to
+ * infd_directory_iter_check_acl(). If @account is 0, all permissions are
+ * granted on all children.
+ *
+ * Returns: (array length=n_children) (transfer full): The permissions on
+ * the children, or %NULL if there are no children. Free with g_free() when
+ * no longer needed.
+ */
+InfAclMask*
+infd_directory_iter_get_child_permissions(InfdDirectory* directory,
+                                          const InfBrowserIter* iter,
+                                          InfAclAccountId account,
+                                          guint* n_children)
+{
+  InfdDirectoryNode* node;
+  InfdDirectoryNode* child;
+  const InfAclMask* parent_perms;
+  const InfAclMask* perms;
+  InfAclMask* result;
+  guint n;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), NULL);
+  infd_directory_return_val_if_iter_fail(directory, iter, NULL);
+  g_return_val_if_fail(n_children != NULL, NULL);
+
+  node = (InfdDirectoryNode*)iter->node;
+  infd_directory_return_val_if_subdir_fail(node, NULL);
+  g_return_val_if_fail(node->shared.subdir.explored == TRUE, NULL);
+
+  n = 0;
+  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+    ++n;
+
+  *n_children = n;
+  if(n == 0)
+    return NULL;
+
+  result = g_new(InfAclMask, n);
+  if(account == 0)
+  {
+    for(n = 0; n < *n_children; ++n)
+      result[n] = INF_ACL_MASK_ALL;
+    return result;
+  }
+
+  parent_perms = infd_directory_node_get_permissions(node, account);
+
+  for(child = node->shared.subdir.child, n = 0;
+      child != NULL;
+      child = child->next, ++n)
+  {
+    perms = infd_directory_node_lookup_permissions(child, account);
+    if(perms == NULL)
+    {
+      perms = infd_directory_node_cache_permissions(
+        child,
+        account,
+        parent_perms
+      );
+    }
+
+    result[n] = *perms;
+  }
+
+  return result;
+}
+
 /**
  * infd_directory_iter_save_session:
  * @directory: A #InfdDirectory.
@@ -11358,6 +12810,148 @@ infd_directory_iter_save_session(InfdDirectory* directory,
   return result;
 }
 
+static void
+infd_directory_save_result_done(gpointer run_data,
+                                gpointer user_data)
+{
+  InfdDirectorySaveResult* result;
+  result = (InfdDirectorySaveResult*)user_data;
+
+  result->func(result->storage, result->error, result->user_data);
+}
+
+static void
+infd_directory_save_result_free(gpointer user_data)
+{
+  InfdDirectorySaveResult* result;
+  result = (InfdDirectorySaveResult*)user_data;
+
+  if(result->error != NULL)
+    g_error_free(result->error);
+
+  g_object_unref(result->storage);
+  g_slice_free(InfdDirectorySaveResult, result);
+}
+
+/**
+ * infd_directory_iter_save_session_async:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to a note in @directory.
+ * @func: (scope notified): Function to be called when the session has been
+ * written.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information.
+ *
+ * Attempts to store the session the node @iter points to represents into the
+ * background storage, like infd_directory_iter_save_session(), but without
+ * blocking. A snapshot of the session is taken, and written to the storage
+ * in a worker thread. Once done, @func is called, with its error argument
+ * set to %NULL on success. Changes made to the session after this function
+ * returned are not written.
+ *
+ * If the note plugin for the session does not support asynchronous saving,
+ * then the session is saved synchronously, and @func is called from the
+ * main loop nevertheless.
+ *
+ * The returned operation can be cancelled with inf_async_operation_free(),
+ * in which case @func is not called. It must be cancelled if @directory is
+ * disposed, or the note is removed, before it finishes.
+ *
+ * Returns: (transfer none) (allow-none): The running #InfAsyncOperation,
+ * or %NULL if the operation could not be started.
+ */
+InfAsyncOperation*
+infd_directory_iter_save_session_async(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  const InfdNotePlugin* plugin;
+  InfdDirectorySaveResult* result;
+  InfAsyncOperation* operation;
+  gchar* path;
+  InfSession* session;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), NULL);
+  infd_directory_return_val_if_iter_fail(directory, iter, NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = (InfdDirectoryNode*)iter->node;
+  g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_NOTE, NULL);
+
+  if(priv->storage == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE,
+      _("No background storage available")
+    );
+
+    return NULL;
+  }
+
+  plugin = node->shared.note.plugin;
+  infd_directory_node_get_path(node, &path, NULL);
+
+  g_object_get(
+    G_OBJECT(node->shared.note.session),
+    "session", &session,
+    NULL
+  );
+
+  if(plugin->session_write_async != NULL)
+  {
+    operation = plugin->session_write_async(
+      priv->storage,
+      priv->io,
+      session,
+      path,
+      plugin->user_data,
+      func,
+      user_data,
+      error
+    );
+  }
+  else
+  {
+    result = g_slice_new(InfdDirectorySaveResult);
+    result->storage = priv->storage;
+    result->error = NULL;
+    result->func = func;
+    result->user_data = user_data;
+    g_object_ref(priv->storage);
+
+    plugin->session_write(
+      priv->storage,
+      session,
+      path,
+      plugin->user_data,
+      &result->error
+    );
+
+    /* The session has been written already, so only the result needs to
+     * be passed to the main loop. */
+    operation = inf_async_operation_new_full(
+      priv->io,
+      NULL,
+      infd_directory_save_result_done,
+      result,
+      infd_directory_save_result_free
+    );
+
+    inf_async_operation_complete(operation, NULL, NULL);
+  }
+
+  g_object_unref(session);
+  g_free(path);
+  return operation;
+}
+
 /**
  * infd_directory_enable_chat:
  * @directory: A #InfdDirectory.
@@ -86,6 +86,26 @@ struct _InfdDirectory {
 typedef void(*InfdDirectoryForeachConnectionFunc)(InfXmlConnection* conn,
                                                   gpointer user_data);
 
+/**
+ * InfdDirectoryPrefetchFunc:
+ * @directory: The #InfdDirectory whose tree is being prefetched.
+ * @explored: The number of subdirectories read from storage so far.
+ * @remaining: The number of subdirectories known to still need reading.
+ * @error: Reason why the subdirectory just handled could not be read, or
+ * %NULL.
+ * @user_data: Additional data passed to the call to
+ * infd_directory_prefetch().
+ *
+ * This is the signature of the callback function passed to
+ * infd_directory_prefetch(). Prefetching has finished when @remaining
+ * is 0.
+ */
+typedef void(*InfdDirectoryPrefetchFunc)(InfdDirectory* directory,
+                                         guint explored,
+                                         guint remaining,
+                                         const GError* error,
+                                         gpointer user_data);
+
 GType
 infd_directory_get_type(void) G_GNUC_CONST;
 
@@ -144,11 +164,41 @@ infd_directory_foreach_connection(InfdDirectory* directory,
                                   InfdDirectoryForeachConnectionFunc func,
                                   gpointer user_data);
 
+void
+infd_directory_prefetch(InfdDirectory* directory,
+                        InfdDirectoryPrefetchFunc func,
+                        gpointer user_data);
+
+gboolean
+infd_directory_iter_get_child_by_name(InfdDirectory* directory,
+                                      InfBrowserIter* iter,
+                                      const gchar* name);
+
+gboolean
+infd_directory_iter_check_acl(InfdDirectory* directory,
+                              const InfBrowserIter* iter,
+                              InfAclAccountId account,
+                              const InfAclMask* check_mask,
+                              InfAclMask* out_mask);
+
+InfAclMask*
+infd_directory_iter_get_child_permissions(InfdDirectory* directory,
+                                          const InfBrowserIter* iter,
+                                          InfAclAccountId account,
+                                          guint* n_children);
+
 gboolean
 infd_directory_iter_save_session(InfdDirectory* directory,
                                  const InfBrowserIter* iter,
                                  GError** error);
 
+InfAsyncOperation*
+infd_directory_iter_save_session_async(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
 void
 infd_directory_enable_chat(InfdDirectory* directory,
                            gboolean enable);
@@ -22,6 +22,7 @@
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-storage.h>
 #include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -44,6 +45,43 @@
 typedef struct _InfdFilesystemStoragePrivate InfdFilesystemStoragePrivate;
 struct _InfdFilesystemStoragePrivate {
   gchar* root_directory;
+
+  /* Files are written to a temporary file first, which is then renamed to
+   * the target file name. Each write is assigned a serial number when the
+   * content to be written is determined. A write is only committed if no
+   * write with a higher serial has been committed to the same file before,
+   * so that a slow asynchronous write never overwrites newer content. A
+   * path is only tracked while writes to it are in progress. The mutex
+   * protects write_serial and write_serials, which are accessed from
+   * worker threads. */
+  GMutex write_mutex;
+  guint64 write_serial;
+  /* full path -> InfdFilesystemStorageWriteState */
+  GHashTable* write_serials;
+};
+
+typedef struct _InfdFilesystemStorageWriteState
+  InfdFilesystemStorageWriteState;
+struct _InfdFilesystemStorageWriteState {
+  /* Serial of the last committed or invalidating write */
+  guint64 serial;
+  /* Number of writes in progress */
+  guint writes;
+};
+
+typedef struct _InfdFilesystemStorageWriteOperation
+  InfdFilesystemStorageWriteOperation;
+struct _InfdFilesystemStorageWriteOperation {
+  InfdFilesystemStorage* storage;
+  gchar* full_path;
+  guint64 serial;
+
+  InfdFilesystemStorageXmlFunc xml_func;
+  gpointer xml_data;
+  GDestroyNotify xml_notify;
+
+  InfdStorageWriteFunc func;
+  gpointer user_data;
 };
 
 enum {
@@ -204,6 +242,7 @@ infd_filesystem_storage_open_impl(InfdFilesystemStorage* storage,
 #else
   if(strcmp(mode, "r") == 0) open_mode = O_RDONLY;
   else if(strcmp(mode, "w") == 0) open_mode = O_CREAT | O_WRONLY | O_TRUNC;
+  else if(strcmp(mode, "a") == 0) open_mode = O_CREAT | O_WRONLY | O_APPEND;
   else g_assert_not_reached();
   fd = open(path, O_NOFOLLOW | open_mode, 0644);
   if(fd == -1)
@@ -294,29 +333,186 @@ infd_filesystem_storage_read_xml_file_impl(InfdFilesystemStorage* storage,
   return doc;
 }
 
-gboolean
+static void
+infd_filesystem_storage_write_state_free(gpointer data)
+{
+  g_slice_free(InfdFilesystemStorageWriteState, data);
+}
+
+/* Registers a write to path and returns its serial. Each call must be
+ * matched by a call to infd_filesystem_storage_end_write() once the write
+ * has been committed, has failed or has been cancelled. This function can
+ * be called from any thread. */
+static guint64
+infd_filesystem_storage_begin_write(InfdFilesystemStorage* storage,
+                                    const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWriteState* state;
+  guint64 serial;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->write_mutex);
+
+  state = g_hash_table_lookup(priv->write_serials, path);
+  if(state == NULL)
+  {
+    state = g_slice_new(InfdFilesystemStorageWriteState);
+    state->serial = 0;
+    state->writes = 0;
+    g_hash_table_insert(priv->write_serials, g_strdup(path), state);
+  }
+
+  ++state->writes;
+  serial = ++priv->write_serial;
+
+  g_mutex_unlock(&priv->write_mutex);
+  return serial;
+}
+
+/* Forgets about path once no more writes to it are in progress. This
+ * function can be called from any thread. */
+static void
+infd_filesystem_storage_end_write(InfdFilesystemStorage* storage,
+                                  const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWriteState* state;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->write_mutex);
+
+  state = g_hash_table_lookup(priv->write_serials, path);
+  g_assert(state != NULL && state->writes > 0);
+
+  if(--state->writes == 0)
+    g_hash_table_remove(priv->write_serials, path);
+
+  g_mutex_unlock(&priv->write_mutex);
+}
+
+/* Makes sure that writes to path which are still in progress are not
+ * committed anymore, for example because the file has been removed. */
+static void
+infd_filesystem_storage_invalidate_writes(InfdFilesystemStorage* storage,
+                                          const gchar* path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWriteState* state;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->write_mutex);
+
+  state = g_hash_table_lookup(priv->write_serials, path);
+  if(state != NULL)
+    state->serial = ++priv->write_serial;
+
+  g_mutex_unlock(&priv->write_mutex);
+}
+
+/* Moves the temporary file at temp_path to path, unless a write with a
+ * higher serial has been committed already, in which case the temporary
+ * file is removed. This function can be called from any thread. */
+static gboolean
+infd_filesystem_storage_commit_write(InfdFilesystemStorage* storage,
+                                     const gchar* temp_path,
+                                     const gchar* path,
+                                     guint64 serial,
+                                     GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWriteState* state;
+  int save_errno;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  g_mutex_lock(&priv->write_mutex);
+
+  /* The write has been registered with
+   * infd_filesystem_storage_begin_write() */
+  state = g_hash_table_lookup(priv->write_serials, path);
+  g_assert(state != NULL);
+
+  if(state->serial > serial)
+  {
+    /* Newer content has been written already */
+    g_mutex_unlock(&priv->write_mutex);
+    g_unlink(temp_path);
+    return TRUE;
+  }
+
+#ifdef G_OS_WIN32
+  /* rename() does not replace existing files on Windows */
+  g_unlink(path);
+#endif
+
+  if(g_rename(temp_path, path) == -1)
+  {
+    save_errno = errno;
+    g_mutex_unlock(&priv->write_mutex);
+
+    g_unlink(temp_path);
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  state->serial = serial;
+  g_mutex_unlock(&priv->write_mutex);
+  return TRUE;
+}
+
+/* This function can be called from any thread. */
+static gboolean
 infd_filesystem_storage_write_xml_file_impl(InfdFilesystemStorage* storage,
                                             const gchar* path,
                                             xmlDocPtr doc,
+                                            guint64 serial,
                                             GError** error)
 {
-  InfdFilesystemStoragePrivate* priv;
+  gchar* temp_path;
   FILE* file;
+  int fd;
+  gboolean result;
 
   int save_errno;
   xmlErrorPtr xmlerror;
 
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  /* Write into a temporary file in the same directory first, so that the
+   * previous version of the file stays intact if writing fails. */
+  temp_path = g_strconcat(path, ".XXXXXX", NULL);
+#ifdef G_OS_WIN32
+  fd = g_mkstemp(temp_path);
+#else
+  fd = g_mkstemp_full(temp_path, O_WRONLY, 0644);
+#endif
 
-  file = infd_filesystem_storage_open_impl(storage, path, "w", error);
+  if(fd == -1)
+  {
+    save_errno = errno;
+    g_free(temp_path);
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  file = fdopen(fd, "w");
   if(file == NULL)
+  {
+    save_errno = errno;
+    g_close(fd, NULL);
+    g_unlink(temp_path);
+    g_free(temp_path);
+    infd_filesystem_storage_system_error(save_errno, error);
     return FALSE;
+  }
 
   if(xmlDocFormatDump(file, doc, 1) == -1)
   {
     xmlerror = xmlGetLastError();
     fclose(file);
-    /* TODO: unlink? */
+    g_unlink(temp_path);
+    g_free(temp_path);
 
     g_set_error_literal(
       error,
@@ -331,11 +527,89 @@ infd_filesystem_storage_write_xml_file_impl(InfdFilesystemStorage* storage,
   if(fclose(file) != 0)
   {
     save_errno = errno;
+    g_unlink(temp_path);
+    g_free(temp_path);
     infd_filesystem_storage_system_error(save_errno, error);
     return FALSE;
   }
 
-  return TRUE;
+  result = infd_filesystem_storage_commit_write(
+    storage,
+    temp_path,
+    path,
+    serial,
+    error
+  );
+
+  g_free(temp_path);
+  return result;
+}
+
+static void
+infd_filesystem_storage_write_operation_run(gpointer* run_data,
+                                            GDestroyNotify* run_notify,
+                                            gpointer user_data)
+{
+  InfdFilesystemStorageWriteOperation* operation;
+  xmlDocPtr doc;
+  GError* error;
+
+  operation = (InfdFilesystemStorageWriteOperation*)user_data;
+  error = NULL;
+
+  doc = operation->xml_func(operation->xml_data, &error);
+  if(doc != NULL)
+  {
+    infd_filesystem_storage_write_xml_file_impl(
+      operation->storage,
+      operation->full_path,
+      doc,
+      operation->serial,
+      &error
+    );
+
+    xmlFreeDoc(doc);
+  }
+
+  if(error != NULL)
+  {
+    *run_data = error;
+    *run_notify = (GDestroyNotify)g_error_free;
+  }
+}
+
+static void
+infd_filesystem_storage_write_operation_done(gpointer run_data,
+                                             gpointer user_data)
+{
+  InfdFilesystemStorageWriteOperation* operation;
+  operation = (InfdFilesystemStorageWriteOperation*)user_data;
+
+  operation->func(
+    INFD_STORAGE(operation->storage),
+    (const GError*)run_data,
+    operation->user_data
+  );
+}
+
+/* Called when the async operation is freed, possibly in a worker thread */
+static void
+infd_filesystem_storage_write_operation_free(gpointer user_data)
+{
+  InfdFilesystemStorageWriteOperation* operation;
+  operation = (InfdFilesystemStorageWriteOperation*)user_data;
+
+  if(operation->xml_notify != NULL)
+    operation->xml_notify(operation->xml_data);
+
+  infd_filesystem_storage_end_write(
+    operation->storage,
+    operation->full_path
+  );
+
+  g_object_unref(operation->storage);
+  g_free(operation->full_path);
+  g_slice_free(InfdFilesystemStorageWriteOperation, operation);
 }
 
 static gchar*
@@ -366,6 +640,16 @@ infd_filesystem_storage_init(InfdFilesystemStorage* storage)
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
   priv->root_directory = NULL;
+
+  g_mutex_init(&priv->write_mutex);
+  priv->write_serial = 0;
+  priv->write_serials =
+    g_hash_table_new_full(
+      g_str_hash,
+      g_str_equal,
+      g_free,
+      infd_filesystem_storage_write_state_free
+    );
 }
 
 static void
@@ -378,6 +662,8 @@ infd_filesystem_storage_finalize(GObject* object)
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
   g_free(priv->root_directory);
+  g_hash_table_destroy(priv->write_serials);
+  g_mutex_clear(&priv->write_mutex);
 
   G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->finalize(object);
 }
@@ -550,6 +836,43 @@ infd_filesystem_storage_storage_create_subdirectory(InfdStorage* storage,
   return result;
 }
 
+/* Removes a file that is stored next to the node at converted_name, such
+ * as its ACL. It is not an error if the file does not exist. */
+static gboolean
+infd_filesystem_storage_remove_companion(InfdFilesystemStorage* storage,
+                                         const gchar* converted_name,
+                                         const gchar* suffix,
+                                         GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  gchar* disk_name;
+  gchar* full_name;
+  int save_errno;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  disk_name = g_strconcat(converted_name, suffix, NULL);
+  full_name = g_build_filename(priv->root_directory, disk_name, NULL);
+  g_free(disk_name);
+
+  /* Make sure a pending asynchronous write does not re-create the file */
+  infd_filesystem_storage_invalidate_writes(storage, full_name);
+
+  if(g_unlink(full_name) == -1)
+  {
+    save_errno = errno;
+    if(save_errno != ENOENT)
+    {
+      infd_filesystem_storage_system_error(save_errno, error);
+      g_free(full_name);
+      return FALSE;
+    }
+  }
+
+  g_free(full_name);
+  return TRUE;
+}
+
 static gboolean
 infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
                                             const gchar* identifier,
@@ -562,7 +885,6 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   gchar* disk_name;
   gchar* full_name;
   gboolean result;
-  int save_errno;
 
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
@@ -586,26 +908,32 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   full_name = g_build_filename(priv->root_directory, disk_name, NULL);
   if(disk_name != converted_name) g_free(disk_name);
 
+  /* Make sure a pending asynchronous write does not re-create the file */
+  infd_filesystem_storage_invalidate_writes(fs_storage, full_name);
   result = inf_file_util_delete(full_name, error);
   g_free(full_name);
 
   if(result == TRUE)
   {
-    disk_name = g_strconcat(converted_name, ".xml.acl", NULL);
-    full_name = g_build_filename(priv->root_directory, disk_name, NULL);
-    g_free(disk_name);
-
-    if(g_unlink(full_name) == -1)
-    {
-      save_errno = errno;
-      if(save_errno != ENOENT)
-      {
-        infd_filesystem_storage_system_error(save_errno, error);
-        result = FALSE;
-      }
-    }
+    result = infd_filesystem_storage_remove_companion(
+      fs_storage,
+      converted_name,
+      ".xml.acl",
+      error
+    );
+  }
 
-    g_free(full_name);
+  /* The journal of a text note, see inf-text-filesystem-format.c. It
+   * contains the history of the note, and must not be picked up by a new
+   * note created under the same name. */
+  if(result == TRUE && identifier != NULL)
+  {
+    result = infd_filesystem_storage_remove_companion(
+      fs_storage,
+      converted_name,
+      ".journal",
+      error
+    );
   }
 
   g_free(converted_name);
@@ -780,12 +1108,15 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
     xmlDocSetRootElement(doc, root);
 
     result = infd_filesystem_storage_write_xml_file_impl(
-      INFD_FILESYSTEM_STORAGE(storage),
+      fs_storage,
       full_path,
       doc,
+      infd_filesystem_storage_begin_write(fs_storage, full_path),
       error
     );
 
+    infd_filesystem_storage_end_write(fs_storage, full_path);
+
     xmlFreeDoc(doc);
 
     if(result == FALSE)
@@ -918,13 +1249,15 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * @storage: A #InfdFilesystemStorage.
  * @identifier: The type of node to open.
  * @path: The path to open, in UTF-8.
- * @mode: Either "r" for reading or "w" for writing.
+ * @mode: Either "r" for reading, "w" for writing or "a" for appending.
  * @full_path: (out) (type filename) (transfer full): Return location
  * of the full filename, or %NULL.
  * @error: Location to store error information, if any.
  *
  * Opens a file in the given path within the storage's root directory. If
  * the file exists already, and @mode is set to "w", the file is overwritten.
+ * If @mode is set to "a", everything written is appended to the end of the
+ * file, and the file is created if it does not exist yet.
  *
  * If @full_path is not %NULL, then it will be set to a newly allocated
  * string which contains the full name of the opened file, in the Glib file
@@ -1047,6 +1380,9 @@ infd_filesystem_storage_read_xml_file(InfdFilesystemStorage* storage,
  * by @identifier and @path. See infd_filesystem_storage_open() for how
  * @identifier and @path should be interpreted.
  *
+ * The document is written into a temporary file first, which then replaces
+ * the existing file, so that the previous content is kept if writing fails.
+ *
  * Returns: %TRUE on success or %FALSE on error.
  **/
 gboolean
@@ -1079,13 +1415,119 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
     storage,
     full_name,
     doc,
+    infd_filesystem_storage_begin_write(storage, full_name),
     error
   );
 
+  infd_filesystem_storage_end_write(storage, full_name);
+
   g_free(full_name);
   return result;
 }
 
+/**
+ * infd_filesystem_storage_write_xml_file_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the thread in which @func is to be called.
+ * @identifier: The type of node to write.
+ * @path: The path to write to, in UTF-8.
+ * @xml_func: (scope notified): Function creating the XML document to write.
+ * @xml_data: Data to pass to @xml_func.
+ * @xml_notify: Function to free @xml_data, or %NULL.
+ * @func: (scope notified): Function to be called when the file has been
+ * written.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Writes an XML document into a file in the filesystem, like
+ * infd_filesystem_storage_write_xml_file(), but without blocking the calling
+ * thread. Both @xml_func, which creates the XML document, and the file I/O
+ * run in a worker thread, so @xml_data should be a snapshot of the content
+ * to write that is not accessed by other threads while the operation is
+ * running. @xml_notify is called on @xml_data when the operation has
+ * finished or has been cancelled, possibly from the worker thread.
+ *
+ * Once the file has been written, @func is called in the thread of @io. Its
+ * error argument is %NULL if the file was written successfully.
+ *
+ * Writes to the same file are committed in the order in which they were
+ * initiated, not in the order in which they finish, so that content written
+ * by a later call is never overwritten by an earlier, slower one.
+ *
+ * The returned operation can be cancelled with inf_async_operation_free(),
+ * in which case @func is not called. If the operation cannot be started,
+ * the function returns %NULL and @error is set. In that case, @xml_notify
+ * is called on @xml_data as well.
+ *
+ * Returns: (transfer none) (allow-none): The running #InfAsyncOperation,
+ * or %NULL on error.
+ **/
+InfAsyncOperation*
+infd_filesystem_storage_write_xml_file_async(InfdFilesystemStorage* storage,
+                                             InfIo* io,
+                                             const gchar* identifier,
+                                             const gchar* path,
+                                             InfdFilesystemStorageXmlFunc xml_func,
+                                             gpointer xml_data,
+                                             GDestroyNotify xml_notify,
+                                             InfdStorageWriteFunc func,
+                                             gpointer user_data,
+                                             GError** error)
+{
+  InfdFilesystemStorageWriteOperation* operation;
+  InfAsyncOperation* async;
+  gchar* full_name;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(identifier != NULL, NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(xml_func != NULL, NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  full_name = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    error
+  );
+
+  if(full_name == NULL)
+  {
+    if(xml_notify != NULL) xml_notify(xml_data);
+    return NULL;
+  }
+
+  /* Make sure libxml2 is initialized before it is used from a worker thread
+   * for the first time. */
+  xmlInitParser();
+
+  operation = g_slice_new(InfdFilesystemStorageWriteOperation);
+  operation->storage = storage;
+  operation->full_path = full_name;
+  operation->serial = infd_filesystem_storage_begin_write(storage, full_name);
+  operation->xml_func = xml_func;
+  operation->xml_data = xml_data;
+  operation->xml_notify = xml_notify;
+  operation->func = func;
+  operation->user_data = user_data;
+  g_object_ref(storage);
+
+  async = inf_async_operation_new_full(
+    io,
+    infd_filesystem_storage_write_operation_run,
+    infd_filesystem_storage_write_operation_done,
+    operation,
+    infd_filesystem_storage_write_operation_free
+  );
+
+  if(!inf_async_operation_start(async, error))
+    return NULL;
+
+  return async;
+}
+
 /**
  * infd_filesystem_storage_stream_close:
  * @file: A #FILE opened with infd_filesystem_storage_open().
@@ -20,6 +20,10 @@
 #ifndef __INFD_FILESYSTEM_STORAGE_H__
 #define __INFD_FILESYSTEM_STORAGE_H__
 
+#include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-async-operation.h>
+#include <libinfinity/common/inf-io.h>
+
 #include <glib-object.h>
 
 #include <libxml/tree.h>
@@ -57,6 +61,20 @@ struct _InfdFilesystemStorage {
   GObject parent;
 };
 
+/**
+ * InfdFilesystemStorageXmlFunc:
+ * @user_data: Data passed to infd_filesystem_storage_write_xml_file_async().
+ * @error: Location to store error information, if any.
+ *
+ * This function creates the XML document to be written by
+ * infd_filesystem_storage_write_xml_file_async(). It is called in a worker
+ * thread.
+ *
+ * Returns: (transfer full): A new XML document, or %NULL on error.
+ */
+typedef xmlDocPtr(*InfdFilesystemStorageXmlFunc)(gpointer user_data,
+                                                 GError** error);
+
 GType
 infd_filesystem_storage_get_type(void) G_GNUC_CONST;
 
@@ -91,6 +109,18 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
                                        xmlDocPtr doc,
                                        GError** error);
 
+InfAsyncOperation*
+infd_filesystem_storage_write_xml_file_async(InfdFilesystemStorage* storage,
+                                             InfIo* io,
+                                             const gchar* identifier,
+                                             const gchar* path,
+                                             InfdFilesystemStorageXmlFunc xml_func,
+                                             gpointer xml_data,
+                                             GDestroyNotify xml_notify,
+                                             InfdStorageWriteFunc func,
+                                             gpointer user_data,
+                                             GError** error);
+
 int
 infd_filesystem_storage_stream_close(FILE* file);
 
@@ -24,6 +24,7 @@
 #include <libinfinity/communication/inf-communication-manager.h>
 #include <libinfinity/communication/inf-communication-hosted-group.h>
 #include <libinfinity/common/inf-session.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-io.h>
 
 #include <glib-object.h>
@@ -53,6 +54,16 @@ typedef gboolean(*InfdNotePluginSessionWrite)(InfdStorage*,
                                               gpointer,
                                               GError**);
 
+typedef InfAsyncOperation*(*InfdNotePluginSessionWriteAsync)(
+  InfdStorage*,
+  InfIo*,
+  InfSession*,
+  const gchar*,
+  gpointer,
+  InfdStorageWriteFunc,
+  gpointer,
+  GError**);
+
 typedef struct _InfdNotePlugin InfdNotePlugin;
 struct _InfdNotePlugin {
   gpointer user_data;
@@ -67,6 +78,11 @@ struct _InfdNotePlugin {
   InfdNotePluginSessionNew session_new;
   InfdNotePluginSessionRead session_read;
   InfdNotePluginSessionWrite session_write;
+
+  /* Optional. Takes a snapshot of the session and writes it to the storage
+   * without blocking. Returns the running operation, which can be cancelled
+   * with inf_async_operation_free(), or NULL on error. */
+  InfdNotePluginSessionWriteAsync session_write_async;
 };
 
 G_END_DECLS
@@ -58,13 +58,28 @@ struct _InfdStorageAcl {
   InfAclMask perms;  
 };
 
+/**
+ * InfdStorageWriteFunc:
+ * @storage: The #InfdStorage that has written the data.
+ * @error: Reason of the failure, or %NULL if the data has been written
+ * successfully.
+ * @user_data: Additional data that was passed when the write operation was
+ * started.
+ *
+ * This function is called when an asynchronous write operation to a storage
+ * has finished.
+ */
+typedef void(*InfdStorageWriteFunc)(InfdStorage* storage,
+                                    const GError* error,
+                                    gpointer user_data);
+
 struct _InfdStorageInterface {
   GTypeInterface parent;
 
   /* All these calls are supposed to be synchronous, e.g. completly perform
-   * the required task. Some day, we could implement asynchronous
-   * behaviour in InfdDirectory (e.g. it caches operations and executes
-   * them via the storage in the background). */
+   * the required task. Writing the content of notes, which is what takes
+   * time for large documents, is done by the note plugins, which can
+   * perform it asynchronously, see InfdNotePlugin. */
 
   /* Virtual Table */
   GSList* (*read_subdirectory)(InfdStorage* storage,
@@ -0,0 +1,572 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:infd-unix-server
+ * @title: InfdUnixServer
+ * @short_description: Accepting connections from local processes
+ * @include: libinfinity/server/infd-unix-server.h
+ * @see_also: #InfUnixConnection, #InfdServerPool
+ * @stability: Unstable
+ *
+ * #InfdUnixServer listens on a Unix domain socket and creates an
+ * #InfUnixConnection for each process connecting to it. It implements
+ * #InfdXmlServer, so it can be added to an #InfdServerPool next to the
+ * #InfdXmppServer<!-- -->s serving remote clients.
+ *
+ * Connections are neither encrypted nor authenticated. Only make the socket
+ * accessible to users who should be allowed to use the server, by placing
+ * it in a directory with suitable permissions.
+ */
+
+#include <libinfinity/server/infd-unix-server.h>
+#include <libinfinity/server/infd-xml-server.h>
+#include <libinfinity/common/inf-unix-connection-private.h>
+#include <libinfinity/common/inf-native-socket.h>
+#include <libinfinity/inf-i18n.h>
+
+#include "config.h"
+
+#ifndef G_OS_WIN32
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <unistd.h>
+# include <fcntl.h>
+
+# include <errno.h>
+# include <string.h>
+#endif
+
+/* Some Windows header #defines ERROR for no good */
+#ifdef G_OS_WIN32
+# ifdef ERROR
+#  undef ERROR
+# endif
+#endif
+
+typedef struct _InfdUnixServerPrivate InfdUnixServerPrivate;
+struct _InfdUnixServerPrivate {
+  InfIo* io;
+  InfIoWatch* watch;
+
+  gchar* path;
+  InfNativeSocket socket;
+  InfdXmlServerStatus status;
+};
+
+enum {
+  PROP_0,
+
+  PROP_IO,
+  PROP_PATH,
+
+  /* Overridden from XML server */
+  PROP_STATUS
+};
+
+enum {
+  ERROR,
+
+  LAST_SIGNAL
+};
+
+#define INFD_UNIX_SERVER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_UNIX_SERVER, InfdUnixServerPrivate))
+
+static guint unix_server_signals[LAST_SIGNAL];
+
+static void infd_unix_server_xml_server_iface_init(InfdXmlServerInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfdUnixServer, infd_unix_server, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfdUnixServer)
+  G_IMPLEMENT_INTERFACE(INFD_TYPE_XML_SERVER, infd_unix_server_xml_server_iface_init))
+
+static void
+infd_unix_server_system_error(InfdUnixServer* server,
+                              int code)
+{
+  GError* error;
+  error = NULL;
+
+  inf_native_socket_make_error(code, &error);
+
+  g_signal_emit(G_OBJECT(server), unix_server_signals[ERROR], 0, error);
+  g_error_free(error);
+}
+
+static void
+infd_unix_server_io(InfNativeSocket* socket,
+                    InfIoEvent events,
+                    gpointer user_data)
+{
+  InfdUnixServer* server;
+  InfdUnixServerPrivate* priv;
+  socklen_t len;
+  InfNativeSocket new_socket;
+  int errcode;
+  InfUnixConnection* connection;
+  GError* error;
+
+  server = INFD_UNIX_SERVER(user_data);
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+  g_object_ref(server);
+
+  if(events & INF_IO_ERROR)
+  {
+    len = sizeof(int);
+#ifdef G_OS_WIN32
+    getsockopt(priv->socket, SOL_SOCKET, SO_ERROR, (char*)&errcode, &len);
+#else
+    getsockopt(priv->socket, SOL_SOCKET, SO_ERROR, &errcode, &len);
+#endif
+    infd_unix_server_system_error(server, errcode);
+  }
+  else if(events & INF_IO_INCOMING)
+  {
+    do
+    {
+      new_socket = accept(priv->socket, NULL, NULL);
+      errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+
+      if(new_socket == INVALID_SOCKET &&
+         errcode != INF_NATIVE_SOCKET_EINTR &&
+         errcode != INF_NATIVE_SOCKET_EAGAIN)
+      {
+        infd_unix_server_system_error(server, errcode);
+      }
+      else if(new_socket != INVALID_SOCKET)
+      {
+        error = NULL;
+        connection = _inf_unix_connection_accepted(
+          priv->io,
+          new_socket,
+          priv->path,
+          &error
+        );
+
+        if(connection != NULL)
+        {
+          infd_xml_server_new_connection(
+            INFD_XML_SERVER(server),
+            INF_XML_CONNECTION(connection)
+          );
+
+          g_object_unref(connection);
+        }
+        else
+        {
+          g_signal_emit(
+            G_OBJECT(server),
+            unix_server_signals[ERROR],
+            0,
+            error
+          );
+
+          g_error_free(error);
+          closesocket(new_socket);
+        }
+      }
+    } while( (new_socket != INVALID_SOCKET ||
+              (new_socket == INVALID_SOCKET &&
+               errcode == INF_NATIVE_SOCKET_EINTR)) &&
+             (priv->socket != INVALID_SOCKET));
+  }
+
+  g_object_unref(server);
+}
+
+#ifndef G_OS_WIN32
+/* Checks whether path is a socket left behind by a server which is no
+ * longer running, so that it can be removed. */
+static gboolean
+infd_unix_server_is_stale(const struct sockaddr_un* addr)
+{
+  struct stat st;
+  InfNativeSocket sock;
+  gboolean stale;
+
+  if(lstat(addr->sun_path, &st) == -1 || !S_ISSOCK(st.st_mode))
+    return FALSE;
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(sock == INVALID_SOCKET)
+    return FALSE;
+
+  stale = FALSE;
+  if(connect(sock, (const struct sockaddr*)addr, sizeof(*addr)) == -1)
+    if(INF_NATIVE_SOCKET_LAST_ERROR == ECONNREFUSED)
+      stale = TRUE;
+
+  closesocket(sock);
+  return stale;
+}
+#endif
+
+static void
+infd_unix_server_init(InfdUnixServer* server)
+{
+  InfdUnixServerPrivate* priv;
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+
+  priv->io = NULL;
+  priv->watch = NULL;
+
+  priv->path = NULL;
+  priv->socket = INVALID_SOCKET;
+  priv->status = INFD_XML_SERVER_CLOSED;
+}
+
+static void
+infd_unix_server_dispose(GObject* object)
+{
+  InfdUnixServer* server;
+  InfdUnixServerPrivate* priv;
+
+  server = INFD_UNIX_SERVER(object);
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+
+  if(priv->status != INFD_XML_SERVER_CLOSED)
+    infd_xml_server_close(INFD_XML_SERVER(server));
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
+  G_OBJECT_CLASS(infd_unix_server_parent_class)->dispose(object);
+}
+
+static void
+infd_unix_server_finalize(GObject* object)
+{
+  InfdUnixServer* server;
+  InfdUnixServerPrivate* priv;
+
+  server = INFD_UNIX_SERVER(object);
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+
+  g_free(priv->path);
+
+  G_OBJECT_CLASS(infd_unix_server_parent_class)->finalize(object);
+}
+
+static void
+infd_unix_server_set_property(GObject* object,
+                              guint prop_id,
+                              const GValue* value,
+                              GParamSpec* pspec)
+{
+  InfdUnixServer* server;
+  InfdUnixServerPrivate* priv;
+
+  server = INFD_UNIX_SERVER(object);
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_assert(priv->io == NULL); /* construct only */
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_PATH:
+    g_assert(priv->path == NULL); /* construct only */
+    priv->path = g_value_dup_string(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+infd_unix_server_get_property(GObject* object,
+                              guint prop_id,
+                              GValue* value,
+                              GParamSpec* pspec)
+{
+  InfdUnixServer* server;
+  InfdUnixServerPrivate* priv;
+
+  server = INFD_UNIX_SERVER(object);
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, G_OBJECT(priv->io));
+    break;
+  case PROP_PATH:
+    g_value_set_string(value, priv->path);
+    break;
+  case PROP_STATUS:
+    g_value_set_enum(value, priv->status);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+infd_unix_server_error(InfdUnixServer* server,
+                       GError* error)
+{
+  InfdUnixServerPrivate* priv;
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+
+  /* Like InfdTcpServer, stop accepting connections on error */
+  if(priv->status == INFD_XML_SERVER_OPEN)
+    infd_xml_server_close(INFD_XML_SERVER(server));
+}
+
+static void
+infd_unix_server_xml_server_close(InfdXmlServer* xml)
+{
+  InfdUnixServerPrivate* priv;
+  priv = INFD_UNIX_SERVER_PRIVATE(xml);
+
+  g_return_if_fail(priv->status == INFD_XML_SERVER_OPEN);
+
+  g_assert(priv->watch != NULL);
+  inf_io_remove_watch(priv->io, priv->watch);
+  priv->watch = NULL;
+
+  closesocket(priv->socket);
+  priv->socket = INVALID_SOCKET;
+
+#ifndef G_OS_WIN32
+  unlink(priv->path);
+#endif
+
+  priv->status = INFD_XML_SERVER_CLOSED;
+  g_object_notify(G_OBJECT(xml), "status");
+}
+
+static void
+infd_unix_server_class_init(InfdUnixServerClass* unix_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(unix_class);
+
+  object_class->dispose = infd_unix_server_dispose;
+  object_class->finalize = infd_unix_server_finalize;
+  object_class->set_property = infd_unix_server_set_property;
+  object_class->get_property = infd_unix_server_get_property;
+
+  unix_class->error = infd_unix_server_error;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "I/O handler",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_PATH,
+    g_param_spec_string(
+      "path",
+      "Path",
+      "File system path of the socket to listen on",
+      NULL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_override_property(object_class, PROP_STATUS, "status");
+
+  /**
+   * InfdUnixServer::error:
+   * @server: The #InfdUnixServer emitting the signal.
+   * @error: A #GError describing what went wrong.
+   *
+   * This signal is emitted when accepting connections fails. The default
+   * handler closes @server.
+   */
+  unix_server_signals[ERROR] = g_signal_new(
+    "error",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET(InfdUnixServerClass, error),
+    NULL, NULL,
+    g_cclosure_marshal_VOID__BOXED,
+    G_TYPE_NONE,
+    1,
+    G_TYPE_ERROR
+  );
+}
+
+static void
+infd_unix_server_xml_server_iface_init(InfdXmlServerInterface* iface)
+{
+  iface->close = infd_unix_server_xml_server_close;
+}
+
+/**
+ * infd_unix_server_new: (constructor)
+ * @io: A #InfIo object used to watch the socket for events.
+ * @path: The file system path of the socket.
+ *
+ * Creates a new #InfdUnixServer which will listen on @path. Call
+ * infd_unix_server_open() to actually start accepting connections.
+ *
+ * Returns: (transfer full): A new #InfdUnixServer.
+ **/
+InfdUnixServer*
+infd_unix_server_new(InfIo* io,
+                     const gchar* path)
+{
+  GObject* object;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+
+  object = g_object_new(
+    INFD_TYPE_UNIX_SERVER,
+    "io", io,
+    "path", path,
+    NULL
+  );
+
+  return INFD_UNIX_SERVER(object);
+}
+
+/**
+ * infd_unix_server_open:
+ * @server: A #InfdUnixServer.
+ * @error: Location to store error information, if any.
+ *
+ * Creates the socket at @server's path and starts accepting connections.
+ * If a socket already exists at that path but no server is listening on it
+ * anymore, it is replaced. The socket is removed again when the server is
+ * closed.
+ *
+ * The socket is created with the permissions given by the process umask.
+ *
+ * Returns: %TRUE on success, or %FALSE if an error occurred.
+ **/
+gboolean
+infd_unix_server_open(InfdUnixServer* server,
+                      GError** error)
+{
+  InfdUnixServerPrivate* priv;
+#ifndef G_OS_WIN32
+  struct sockaddr_un addr;
+  int result;
+#endif
+
+  g_return_val_if_fail(INFD_IS_UNIX_SERVER(server), FALSE);
+
+  priv = INFD_UNIX_SERVER_PRIVATE(server);
+  g_return_val_if_fail(priv->status == INFD_XML_SERVER_CLOSED, FALSE);
+
+#ifndef G_OS_WIN32
+  if(strlen(priv->path) >= sizeof(addr.sun_path))
+  {
+    inf_native_socket_make_error(ENAMETOOLONG, error);
+    return FALSE;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, priv->path);
+
+  priv->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(priv->socket == INVALID_SOCKET)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    return FALSE;
+  }
+
+  result = bind(priv->socket, (struct sockaddr*)&addr, sizeof(addr));
+  if(result == -1 && INF_NATIVE_SOCKET_LAST_ERROR == EADDRINUSE &&
+     infd_unix_server_is_stale(&addr))
+  {
+    unlink(priv->path);
+    result = bind(priv->socket, (struct sockaddr*)&addr, sizeof(addr));
+  }
+
+  if(result == -1)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    closesocket(priv->socket);
+    priv->socket = INVALID_SOCKET;
+    return FALSE;
+  }
+
+  result = fcntl(priv->socket, F_GETFL);
+  if(result == -1 ||
+     fcntl(priv->socket, F_SETFL, result | O_NONBLOCK) == -1 ||
+     listen(priv->socket, 5) == -1)
+  {
+    inf_native_socket_make_error(INF_NATIVE_SOCKET_LAST_ERROR, error);
+    closesocket(priv->socket);
+    priv->socket = INVALID_SOCKET;
+    unlink(priv->path);
+    return FALSE;
+  }
+
+  priv->watch = inf_io_add_watch(
+    priv->io,
+    &priv->socket,
+    INF_IO_INCOMING | INF_IO_ERROR,
+    infd_unix_server_io,
+    server,
+    NULL
+  );
+
+  priv->status = INFD_XML_SERVER_OPEN;
+  g_object_notify(G_OBJECT(server), "status");
+
+  return TRUE;
+#else
+  g_set_error_literal(
+    error,
+    inf_unix_connection_error_quark(),
+    INF_UNIX_CONNECTION_ERROR_NOT_SUPPORTED,
+    _("Unix domain sockets are not supported on this platform")
+  );
+
+  return FALSE;
+#endif
+}
+
+/**
+ * infd_unix_server_get_path:
+ * @server: A #InfdUnixServer.
+ *
+ * Returns the file system path of the socket that @server listens on.
+ *
+ * Returns: The path of the socket, owned by @server.
+ **/
+const gchar*
+infd_unix_server_get_path(InfdUnixServer* server)
+{
+  g_return_val_if_fail(INFD_IS_UNIX_SERVER(server), NULL);
+  return INFD_UNIX_SERVER_PRIVATE(server)->path;
+}
+
+/* vim:set et sw=2 ts=2: */
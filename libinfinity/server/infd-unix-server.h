@@ -0,0 +1,70 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFD_UNIX_SERVER_H__
+#define __INFD_UNIX_SERVER_H__
+
+#include <libinfinity/common/inf-unix-connection.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INFD_TYPE_UNIX_SERVER                 (infd_unix_server_get_type())
+#define INFD_UNIX_SERVER(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INFD_TYPE_UNIX_SERVER, InfdUnixServer))
+#define INFD_UNIX_SERVER_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INFD_TYPE_UNIX_SERVER, InfdUnixServerClass))
+#define INFD_IS_UNIX_SERVER(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INFD_TYPE_UNIX_SERVER))
+#define INFD_IS_UNIX_SERVER_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_UNIX_SERVER))
+#define INFD_UNIX_SERVER_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_UNIX_SERVER, InfdUnixServerClass))
+
+typedef struct _InfdUnixServer InfdUnixServer;
+typedef struct _InfdUnixServerClass InfdUnixServerClass;
+
+struct _InfdUnixServerClass {
+  GObjectClass parent_class;
+
+  /* Signals */
+  void (*error)(InfdUnixServer* server,
+                GError* error);
+};
+
+struct _InfdUnixServer {
+  GObject parent;
+};
+
+GType
+infd_unix_server_get_type(void) G_GNUC_CONST;
+
+InfdUnixServer*
+infd_unix_server_new(InfIo* io,
+                     const gchar* path);
+
+gboolean
+infd_unix_server_open(InfdUnixServer* server,
+                      GError** error);
+
+const gchar*
+infd_unix_server_get_path(InfdUnixServer* server);
+
+G_END_DECLS
+
+#endif /* __INFD_UNIX_SERVER_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -256,6 +256,87 @@ inf_text_buffer_erase_text(InfTextBuffer* buffer,
   iface->erase_text(buffer, pos, len, user);
 }
 
+/**
+ * inf_text_buffer_offset_to_line:
+ * @buffer: A #InfTextBuffer.
+ * @pos: A character offset into @buffer.
+ *
+ * Returns the line that the character at @pos is part of, counted from
+ * zero, i.e. the number of newline characters in front of @pos. See
+ * inf_text_chunk_offset_to_line() for what counts as a newline character.
+ * Buffers which keep track of their lines, such as #InfTextDefaultBuffer,
+ * answer this in logarithmic time. For other buffers, the text in front of
+ * @pos is scanned.
+ *
+ * Returns: The line containing @pos.
+ **/
+guint
+inf_text_buffer_offset_to_line(InfTextBuffer* buffer,
+                               guint pos)
+{
+  InfTextBufferInterface* iface;
+  InfTextChunk* chunk;
+  guint line;
+
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), 0);
+  g_return_val_if_fail(pos <= inf_text_buffer_get_length(buffer), 0);
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+
+  if(iface->offset_to_line != NULL)
+    return iface->offset_to_line(buffer, pos);
+
+  chunk = inf_text_buffer_get_slice(buffer, 0, pos);
+  line = inf_text_chunk_get_line_count(chunk) - 1;
+  inf_text_chunk_free(chunk);
+
+  return line;
+}
+
+/**
+ * inf_text_buffer_line_to_offset:
+ * @buffer: A #InfTextBuffer.
+ * @line: A line number, counted from zero.
+ *
+ * Returns the character offset at which @line starts, i.e. the offset
+ * behind the @line<!-- -->th newline character in @buffer. If @buffer has
+ * no such line, the length of @buffer is returned. Buffers which keep track
+ * of their lines, such as #InfTextDefaultBuffer, answer this in logarithmic
+ * time. For other buffers, the whole buffer content is scanned.
+ *
+ * Returns: The offset of the first character of @line.
+ **/
+guint
+inf_text_buffer_line_to_offset(InfTextBuffer* buffer,
+                               guint line)
+{
+  InfTextBufferInterface* iface;
+  InfTextChunk* chunk;
+  guint offset;
+
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), 0);
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+
+  if(iface->line_to_offset != NULL)
+    return iface->line_to_offset(buffer, line);
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  if(line < inf_text_chunk_get_line_count(chunk))
+    offset = inf_text_chunk_line_to_offset(chunk, line);
+  else
+    offset = inf_text_chunk_get_length(chunk);
+
+  inf_text_chunk_free(chunk);
+
+  return offset;
+}
+
 /**
  * inf_text_buffer_create_begin_iter:
  * @buffer: A #InfTextBuffer.
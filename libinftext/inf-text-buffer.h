@@ -83,6 +83,11 @@ typedef struct _InfTextBufferIter InfTextBufferIter;
  * signal.
  * @text_erased: Default signal handler of the #InfTextBuffer::text-erased
  * signal.
+ * @offset_to_line: Virtual function to obtain the line a character offset
+ * is part of. Can be %NULL, in which case the buffer content is scanned.
+ * @line_to_offset: Virtual function to obtain the character offset at which
+ * a line starts, or the length of the buffer if there is no such line. Can
+ * be %NULL, in which case the buffer content is scanned.
  *
  * This structure contains virtual functions and signal handlers of the
  * #InfTextBuffer interface.
@@ -150,6 +155,13 @@ struct _InfTextBufferInterface {
                      guint pos,
                      InfTextChunk* chunk,
                      InfUser* user);
+
+  /* Virtual table, continued */
+  guint(*offset_to_line)(InfTextBuffer* buffer,
+                         guint pos);
+
+  guint(*line_to_offset)(InfTextBuffer* buffer,
+                         guint line);
 };
 
 GType
@@ -186,6 +198,14 @@ inf_text_buffer_erase_text(InfTextBuffer* buffer,
                            guint len,
                            InfUser* user);
 
+guint
+inf_text_buffer_offset_to_line(InfTextBuffer* buffer,
+                               guint pos);
+
+guint
+inf_text_buffer_line_to_offset(InfTextBuffer* buffer,
+                               guint line);
+
 InfTextBufferIter*
 inf_text_buffer_create_begin_iter(InfTextBuffer* buffer);
 
@@ -41,14 +41,23 @@
  * of an #InfTextChunk is not fixed, but it can be freely chosen.
  * #InfTextChunk then uses iconv to convert between bytes and character
  * offsets where necessary. For a small set of selected encodings which are
- * very popular, most notably UTF-8, there exist more optimized code paths to
- * do the conversion.
+ * very popular, there exist more optimized code paths to do the conversion:
+ * UTF-8, UTF-16 and UTF-32 with explicit byte order, and the common
+ * single-byte encodings such as ASCII and the ISO-8859 family.
+ *
+ * A chunk also keeps track of the newline characters it contains, so that
+ * inf_text_chunk_offset_to_line() and inf_text_chunk_line_to_offset() can
+ * map between character offsets and line numbers in logarithmic time.
+ * Only the line feed character (U+000A) starts a new line; a CR LF
+ * sequence counts as a single line break, and a lone carriage return does
+ * not count at all.
  */
 
 #include <libinftext/inf-text-chunk.h>
 #include <libinfinity/common/inf-xml-util.h>
 
 #include <string.h>
+#include <errno.h>
 
 G_DEFINE_BOXED_TYPE(InfTextChunkIter, inf_text_chunk_iter, inf_text_chunk_iter_copy, inf_text_chunk_iter_free)
 G_DEFINE_BOXED_TYPE(InfTextChunk, inf_text_chunk, inf_text_chunk_copy, inf_text_chunk_free)
@@ -56,33 +65,153 @@ G_DEFINE_BOXED_TYPE(InfTextChunk, inf_text_chunk, inf_text_chunk_copy, inf_text_
 /* Don't check integrity in stable releases */
 /*#define CHUNK_CHECK_INTEGRITY*/
 
+/* Number of characters between two checkpoints within a segment, see
+ * below. */
+#define INF_TEXT_CHUNK_CHECKPOINT_DISTANCE 1024
+
 typedef struct _InfTextChunkPath InfTextChunkPath;
 struct _InfTextChunkPath {
   gsize (*get_byte_index)(InfTextChunk* chunk,
                           gchar* text,
                           gsize bytes,
                           guint offset);
+
+  /* Returns the number of newline characters in text. If starts is not
+   * NULL, the character offset behind each of them is written to it. */
+  guint (*find_newlines)(InfTextChunk* chunk,
+                         gchar* text,
+                         gsize bytes,
+                         guint* starts);
+
+  /* Whether get_byte_index needs to scan the text. If not, the encoding
+   * has a fixed width and segments do not keep checkpoints. */
+  gboolean use_checkpoints;
 };
 
-struct _InfTextChunk {
-  GSequence* segments;
-  guint length; /* in characters */
-  GQuark encoding;
+/* The text of segments is stored in reference-counted storage blocks.
+ * Several segments can refer to (different parts of) the same block, for
+ * example after a segment has been split or a substring has been taken
+ * from it. A block is only modified in place if a single segment refers
+ * to it, otherwise the segment makes a copy before modifying its text. */
+typedef struct _InfTextChunkStorage InfTextChunkStorage;
+struct _InfTextChunkStorage {
+  gint ref_count;
+  gchar data[1];
+};
 
-  const InfTextChunkPath* path;
+/* The character offsets at which the lines in a segment's text start,
+ * excluding the first one, i.e. the offset behind each newline character.
+ * It is built the first time a lookup needs it, and dropped when the text
+ * of the segment changes. It is never modified, so it can be shared when a
+ * segment is copied. */
+typedef struct _InfTextChunkLines InfTextChunkLines;
+struct _InfTextChunkLines {
+  gint ref_count;
+  guint starts[1];
 };
 
+/* Converting a character offset into a byte index requires scanning the
+ * text in front of it for all encodings that are not fixed-width. For long
+ * segments, we remember the byte index of every
+ * INF_TEXT_CHUNK_CHECKPOINT_DISTANCE-th character, so that the scan can
+ * start at the closest checkpoint instead of at the beginning of the
+ * segment. Checkpoints are added when a lookup had to scan a long way, and
+ * they are adjusted when the text of the segment is modified. They are
+ * sorted by offset, and the beginning of the segment is not stored
+ * explicitly. Like storage blocks, they are shared when a segment is copied,
+ * and copied before being modified if shared. */
+typedef struct _InfTextChunkCheckpoint InfTextChunkCheckpoint;
+struct _InfTextChunkCheckpoint {
+  guint offset;
+  gsize index;
+};
+
+typedef struct _InfTextChunkCheckpoints InfTextChunkCheckpoints;
+struct _InfTextChunkCheckpoints {
+  gint ref_count;
+  guint len;
+  guint allocated;
+  InfTextChunkCheckpoint data[1];
+};
+
+/* The segments of a chunk are stored in a treap, i.e. a binary search tree
+ * ordered by position in the text which is at the same time a heap with
+ * respect to a randomly chosen priority, which keeps it balanced in the
+ * expected case. Segments do not store their absolute offset, but every
+ * segment stores the number of characters and bytes in the subtree rooted
+ * at it. This allows to find the segment at a given offset in O(log n),
+ * and inserting or removing text only needs to update the segments on the
+ * path from the root to the modified segment, instead of all segments
+ * behind it.
+ *
+ * Segments are reference-counted and can be shared between several chunks,
+ * so that copying a chunk or taking a substring does not need to copy all
+ * of the text. Before a segment is modified, it is made sure that it is not
+ * shared, by copying it if necessary. Since a segment does not know its
+ * parent, this only needs to copy the segments on the path from the root
+ * to the modified segment. */
 typedef struct _InfTextChunkSegment InfTextChunkSegment;
 struct _InfTextChunkSegment {
+  gint ref_count;
+
+  InfTextChunkSegment* left;
+  InfTextChunkSegment* right;
+  guint32 priority;
+
   guint author;
-  /* This is gchar so that we can do pointer arithmetic. It does not
-   * necessarily store a full character in each byte. This depends on the
-   * encoding specified in the InfTextChunk. */
+  InfTextChunkStorage* storage;
+  /* Points into storage. This is gchar so that we can do pointer
+   * arithmetic. It does not necessarily store a full character in each
+   * byte. This depends on the encoding specified in the InfTextChunk. */
   gchar* text;
-  gsize length; /* in bytes */
-  guint offset; /* absolute to chunk begin in characters, sort criteria */
+  gsize bytes; /* length of text in bytes */
+  guint length; /* length of text in characters */
+  guint newlines; /* number of newline characters in text */
+
+  /* Can be NULL, see above. If not, then its first newlines entries
+   * refer to the current text. */
+  InfTextChunkLines* lines;
+  /* Can be NULL if there are no checkpoints */
+  InfTextChunkCheckpoints* checkpoints;
+
+  /* Totals of this segment and all segments in its subtree */
+  gsize subtree_bytes;
+  guint subtree_length;
+  guint subtree_newlines;
 };
 
+struct _InfTextChunk {
+  InfTextChunkSegment* root;
+  GQuark encoding;
+
+  /* State of the PRNG that generates segment priorities */
+  guint32 seed;
+
+  const InfTextChunkPath* path;
+
+  /* Converter from the chunk's encoding to UCS-4BE for the iconv path. It
+   * is opened on first use and kept until the chunk is freed. */
+  GIConv converter;
+};
+
+/* Returns the chunk's converter to UCS-4BE, in its initial state */
+static GIConv
+inf_text_chunk_get_converter(InfTextChunk* self)
+{
+  if(self->converter == NULL)
+  {
+    self->converter =
+      g_iconv_open("UCS-4BE", g_quark_to_string(self->encoding));
+    g_assert(self->converter != (GIConv)-1);
+  }
+  else
+  {
+    g_iconv(self->converter, NULL, NULL, NULL, NULL);
+  }
+
+  return self->converter;
+}
+
 /*
  * get_byte_index paths
  */
@@ -92,236 +221,1838 @@ gsize inf_text_chunk_get_byte_index_utf8(InfTextChunk* self,
                                          gsize bytes,
                                          guint offset)
 {
+  /* Every character starts with a byte that is not a continuation byte of
+   * the form 10xxxxxx. We count these eight bytes at a time, and skip the
+   * eight bytes as long as they do not contain the character we are
+   * looking for. This is several times faster than stepping through the
+   * text character by character. */
+  const guint64 high_bits = G_GUINT64_CONSTANT(0x8080808080808080);
+  const guint64 low_bits = G_GUINT64_CONSTANT(0x0101010101010101);
+  guint64 word;
+  guint count;
+  gsize index;
+
 #ifdef CHUNK_CHECK_INTEGRITY
   g_assert(offset <= g_utf8_strlen(text, bytes));
 #endif
 
-  return g_utf8_offset_to_pointer(text, offset) - text;
+  index = 0;
+  while(index + 8 <= bytes)
+  {
+    memcpy(&word, text + index, 8);
+
+    /* Afterwards, only bit 7 of the continuation bytes is set. The
+     * multiplication adds up all bytes in the topmost one. */
+    word = word & ~(word << 1) & high_bits;
+    count = 8 - (guint)(((word >> 7) * low_bits) >> 56);
+
+    if(count >= offset) break;
+
+    offset -= count;
+    index += 8;
+  }
+
+  for(; index < bytes; ++index)
+  {
+    if(((guchar)text[index] & 0xc0) != 0x80)
+    {
+      if(offset == 0) break;
+      --offset;
+    }
+  }
+
+  return index;
 }
 
-gsize inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
+gsize inf_text_chunk_get_byte_index_8bit(InfTextChunk* self,
+                                         gchar* text,
+                                         gsize bytes,
+                                         guint offset)
+{
+  return offset;
+}
+
+static gsize
+inf_text_chunk_get_byte_index_utf16(gchar* text,
+                                    gsize bytes,
+                                    guint offset,
+                                    gboolean big_endian)
+{
+  /* A character is a single 16 bit unit, or two if the first is a high
+   * surrogate. We only need to look at the byte holding the upper bits of
+   * each unit. */
+  const guchar* high;
+  gsize index;
+
+  high = (const guchar*)text + (big_endian ? 0 : 1);
+  index = 0;
+
+  for(; offset > 0; --offset)
+  {
+    g_assert(index + 2 <= bytes);
+
+    if((high[index] & 0xfc) == 0xd8)
+      index += 4;
+    else
+      index += 2;
+  }
+
+  return index;
+}
+
+gsize inf_text_chunk_get_byte_index_utf16le(InfTextChunk* self,
+                                            gchar* text,
+                                            gsize bytes,
+                                            guint offset)
+{
+  return inf_text_chunk_get_byte_index_utf16(text, bytes, offset, FALSE);
+}
+
+gsize inf_text_chunk_get_byte_index_utf16be(InfTextChunk* self,
+                                            gchar* text,
+                                            gsize bytes,
+                                            guint offset)
+{
+  return inf_text_chunk_get_byte_index_utf16(text, bytes, offset, TRUE);
+}
+
+gsize inf_text_chunk_get_byte_index_utf32(InfTextChunk* self,
                                           gchar* text,
                                           gsize bytes,
                                           guint offset)
 {
-  /* We convert the segment's text into UCS-4, character by character.
-   * This assumes every UCS-4 character is 4 bytes in length */
-
-  /* This is quite inefficient, but a general-purpose solution. It looks like
-   * libicu has a function, UCharIteratorMove, which would allow us to move
-   * directly N characters ahead and get the new byte index.
-   * TODO: We could profile it, and if it brings a benefit, we could use it,
-   * maybe with an option to fall back to iconv at configure time */
+  return (gsize)offset * 4;
+}
 
+gsize inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
+                                          gchar* text,
+                                          gsize bytes,
+                                          guint offset)
+{
+  /* We convert the segment's text into UCS-4, which has four bytes per
+   * character. By limiting the output buffer to the number of characters
+   * we still need to skip, iconv stops exactly at the character we are
+   * looking for, while still converting many characters per call. */
   GIConv cd;
-  gchar buffer[4];
+  guint32 buffer[256];
 
   gchar* inbuf;
   gchar* outbuf;
   gsize inlen;
   gsize outlen;
-  guint count;
   gsize result;
 
-  cd = g_iconv_open("UCS-4", g_quark_to_string(self->encoding));
-  g_assert(cd != (GIConv)-1);
+  cd = inf_text_chunk_get_converter(self);
 
   inbuf = text;
   inlen = bytes;
 
-  for(count = 0; count < offset; ++count)
+  while(offset > 0)
   {
     g_assert(inlen > 0);
 
-    outbuf = buffer;
-    outlen = 4;
+    outbuf = (gchar*)buffer;
+    outlen = MIN(offset, G_N_ELEMENTS(buffer)) * 4;
 
     result = g_iconv(cd, &inbuf, &inlen, &outbuf, &outlen);
-    g_assert(result == (size_t)(-1)); /* errno == E2BIG */
+    g_assert(result != (gsize)(-1) || errno == E2BIG);
+
+    offset -= (MIN(offset, G_N_ELEMENTS(buffer)) * 4 - outlen) / 4;
   }
 
-  g_iconv_close(cd);
   return bytes - inlen;
 }
 
+/*
+ * find_newlines paths
+ */
+
+guint inf_text_chunk_find_newlines_utf8(InfTextChunk* self,
+                                        gchar* text,
+                                        gsize bytes,
+                                        guint* starts)
+{
+  /* A newline byte cannot be part of a multibyte sequence in UTF-8, so we
+   * only need to look at the characters in between if we are asked for the
+   * character offsets. */
+  gchar* pos;
+  gchar* end;
+  gchar* newline;
+  guint offset;
+  guint count;
+
+  pos = text;
+  end = text + bytes;
+  offset = 0;
+  count = 0;
+
+  while(pos < end && (newline = memchr(pos, '\n', end - pos)) != NULL)
+  {
+    if(starts != NULL)
+    {
+      offset += g_utf8_strlen(pos, newline - pos) + 1;
+      starts[count] = offset;
+    }
+
+    ++count;
+    pos = newline + 1;
+  }
+
+  return count;
+}
+
+guint inf_text_chunk_find_newlines_8bit(InfTextChunk* self,
+                                        gchar* text,
+                                        gsize bytes,
+                                        guint* starts)
+{
+  gchar* pos;
+  gchar* end;
+  gchar* newline;
+  guint count;
+
+  pos = text;
+  end = text + bytes;
+  count = 0;
+
+  while(pos < end && (newline = memchr(pos, '\n', end - pos)) != NULL)
+  {
+    if(starts != NULL) starts[count] = newline + 1 - text;
+    ++count;
+    pos = newline + 1;
+  }
+
+  return count;
+}
+
+static guint
+inf_text_chunk_find_newlines_utf16(gchar* text,
+                                   gsize bytes,
+                                   guint* starts,
+                                   gboolean big_endian)
+{
+  const guchar* high;
+  const guchar* low;
+  gsize index;
+  guint offset;
+  guint count;
+
+  high = (const guchar*)text + (big_endian ? 0 : 1);
+  low = (const guchar*)text + (big_endian ? 1 : 0);
+  offset = 0;
+  count = 0;
+
+  for(index = 0; index + 2 <= bytes; index += 2)
+  {
+    /* The second half of a surrogate pair does not start a character */
+    if((high[index] & 0xfc) == 0xdc)
+      continue;
+
+    ++offset;
+    if(high[index] == 0x00 && low[index] == '\n')
+    {
+      if(starts != NULL) starts[count] = offset;
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+guint inf_text_chunk_find_newlines_utf16le(InfTextChunk* self,
+                                           gchar* text,
+                                           gsize bytes,
+                                           guint* starts)
+{
+  return inf_text_chunk_find_newlines_utf16(text, bytes, starts, FALSE);
+}
+
+guint inf_text_chunk_find_newlines_utf16be(InfTextChunk* self,
+                                           gchar* text,
+                                           gsize bytes,
+                                           guint* starts)
+{
+  return inf_text_chunk_find_newlines_utf16(text, bytes, starts, TRUE);
+}
+
+static guint
+inf_text_chunk_find_newlines_utf32(gchar* text,
+                                   gsize bytes,
+                                   guint* starts,
+                                   gboolean big_endian)
+{
+  guint32 character;
+  gsize index;
+  guint count;
+
+  count = 0;
+
+  for(index = 0; index + 4 <= bytes; index += 4)
+  {
+    memcpy(&character, text + index, 4);
+    if(big_endian)
+      character = GUINT32_FROM_BE(character);
+    else
+      character = GUINT32_FROM_LE(character);
+
+    if(character == '\n')
+    {
+      if(starts != NULL) starts[count] = index / 4 + 1;
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+guint inf_text_chunk_find_newlines_utf32le(InfTextChunk* self,
+                                           gchar* text,
+                                           gsize bytes,
+                                           guint* starts)
+{
+  return inf_text_chunk_find_newlines_utf32(text, bytes, starts, FALSE);
+}
+
+guint inf_text_chunk_find_newlines_utf32be(InfTextChunk* self,
+                                           gchar* text,
+                                           gsize bytes,
+                                           guint* starts)
+{
+  return inf_text_chunk_find_newlines_utf32(text, bytes, starts, TRUE);
+}
+
+guint inf_text_chunk_find_newlines_iconv(InfTextChunk* self,
+                                         gchar* text,
+                                         gsize bytes,
+                                         guint* starts)
+{
+  /* Convert the text to UCS-4 a block at a time, and look at the code
+   * points. */
+  GIConv cd;
+  guint32 buffer[256];
+
+  gchar* inbuf;
+  gchar* outbuf;
+  gsize inlen;
+  gsize outlen;
+  gsize result;
+  guint converted;
+  guint offset;
+  guint count;
+  guint i;
+
+  cd = inf_text_chunk_get_converter(self);
+
+  inbuf = text;
+  inlen = bytes;
+  offset = 0;
+  count = 0;
+
+  while(inlen > 0)
+  {
+    outbuf = (gchar*)buffer;
+    outlen = sizeof(buffer);
+
+    result = g_iconv(cd, &inbuf, &inlen, &outbuf, &outlen);
+    g_assert(result != (gsize)(-1) || errno == E2BIG);
+
+    converted = (sizeof(buffer) - outlen) / 4;
+    for(i = 0; i < converted; ++i)
+    {
+      ++offset;
+      if(GUINT32_FROM_BE(buffer[i]) == '\n')
+      {
+        if(starts != NULL) starts[count] = offset;
+        ++count;
+      }
+    }
+  }
+
+  return count;
+}
+
 const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF8 = {
-  inf_text_chunk_get_byte_index_utf8
+  inf_text_chunk_get_byte_index_utf8,
+  inf_text_chunk_find_newlines_utf8,
+  TRUE
+};
+
+const InfTextChunkPath INF_TEXT_CHUNK_PATH_8BIT = {
+  inf_text_chunk_get_byte_index_8bit,
+  inf_text_chunk_find_newlines_8bit,
+  FALSE
+};
+
+const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF16LE = {
+  inf_text_chunk_get_byte_index_utf16le,
+  inf_text_chunk_find_newlines_utf16le,
+  TRUE
+};
+
+const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF16BE = {
+  inf_text_chunk_get_byte_index_utf16be,
+  inf_text_chunk_find_newlines_utf16be,
+  TRUE
+};
+
+const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF32LE = {
+  inf_text_chunk_get_byte_index_utf32,
+  inf_text_chunk_find_newlines_utf32le,
+  FALSE
+};
+
+const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF32BE = {
+  inf_text_chunk_get_byte_index_utf32,
+  inf_text_chunk_find_newlines_utf32be,
+  FALSE
 };
 
 const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
-  inf_text_chunk_get_byte_index_iconv
+  inf_text_chunk_get_byte_index_iconv,
+  inf_text_chunk_find_newlines_iconv,
+  TRUE
+};
+
+/* Encodings which have a dedicated path. Everything else goes through
+ * iconv. Plain UTF-16 and UTF-32 are not listed, since they may start with
+ * a byte order mark. */
+static const struct {
+  const gchar* name;
+  const InfTextChunkPath* path;
+} INF_TEXT_CHUNK_PATHS[] = {
+  { "UTF-8", &INF_TEXT_CHUNK_PATH_UTF8 },
+  { "UTF8", &INF_TEXT_CHUNK_PATH_UTF8 },
+  { "UTF-16LE", &INF_TEXT_CHUNK_PATH_UTF16LE },
+  { "UTF-16BE", &INF_TEXT_CHUNK_PATH_UTF16BE },
+  { "UTF-32LE", &INF_TEXT_CHUNK_PATH_UTF32LE },
+  { "UTF-32BE", &INF_TEXT_CHUNK_PATH_UTF32BE },
+  { "UCS-4LE", &INF_TEXT_CHUNK_PATH_UTF32LE },
+  { "UCS-4BE", &INF_TEXT_CHUNK_PATH_UTF32BE },
+  { "ASCII", &INF_TEXT_CHUNK_PATH_8BIT },
+  { "US-ASCII", &INF_TEXT_CHUNK_PATH_8BIT },
+  { "ANSI_X3.4-1968", &INF_TEXT_CHUNK_PATH_8BIT },
+  { "KOI8-R", &INF_TEXT_CHUNK_PATH_8BIT },
+  { "KOI8-U", &INF_TEXT_CHUNK_PATH_8BIT }
 };
 
+/* Prefixes of single-byte encoding families */
+static const gchar* const INF_TEXT_CHUNK_8BIT_PREFIXES[] = {
+  "ISO-8859-",
+  "ISO8859-",
+  "ISO_8859-",
+  "LATIN",
+  "WINDOWS-125",
+  "CP125"
+};
+
+static const InfTextChunkPath*
+inf_text_chunk_find_path(const gchar* encoding)
+{
+  guint i;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEXT_CHUNK_PATHS); ++i)
+    if(g_ascii_strcasecmp(encoding, INF_TEXT_CHUNK_PATHS[i].name) == 0)
+      return INF_TEXT_CHUNK_PATHS[i].path;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEXT_CHUNK_8BIT_PREFIXES); ++i)
+  {
+    if(g_ascii_strncasecmp(encoding, INF_TEXT_CHUNK_8BIT_PREFIXES[i],
+                           strlen(INF_TEXT_CHUNK_8BIT_PREFIXES[i])) == 0)
+    {
+      return &INF_TEXT_CHUNK_PATH_8BIT;
+    }
+  }
+
+  return &INF_TEXT_CHUNK_PATH_ICONV;
+}
+
 /*
  * Helper functions
  */
 
-static void
-inf_text_chunk_segment_free(InfTextChunkSegment* segment)
+static guint32
+inf_text_chunk_next_priority(InfTextChunk* self)
 {
-  g_free(segment->text);
-  g_slice_free(InfTextChunkSegment, segment);
+  /* xorshift32, good enough to keep the tree balanced */
+  self->seed ^= self->seed << 13;
+  self->seed ^= self->seed >> 17;
+  self->seed ^= self->seed << 5;
+  return self->seed;
 }
 
-static int
-inf_text_chunk_segment_cmp(gconstpointer first,
-                           gconstpointer second,
-                           gpointer userdata)
+static guint
+inf_text_chunk_segment_subtree_length(InfTextChunkSegment* segment)
 {
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
- 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
+  if(segment == NULL) return 0;
+  return segment->subtree_length;
+}
 
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
+static gsize
+inf_text_chunk_segment_subtree_bytes(InfTextChunkSegment* segment)
+{
+  if(segment == NULL) return 0;
+  return segment->subtree_bytes;
+}
 
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return 0;
-  else
-    return 1;
+static guint
+inf_text_chunk_segment_subtree_newlines(InfTextChunkSegment* segment)
+{
+  if(segment == NULL) return 0;
+  return segment->subtree_newlines;
 }
 
-/* This is a special comparison function which is only used
- * in inf_text_chunk_get_segment. It makes sure that when two segments
- * have the same offset, the second one gets sorted behind. This ensures
- * that the first segment in the sequence is never returned, since it
- * always has offset 0, which is a precondition for the algorithm
- * in inf_text_chunk_get_segment. See also libinfinity github issue #10. */
-static int
-inf_text_chunk_segment_cmp_for_get_segment(gconstpointer first,
-                                           gconstpointer second,
-                                           gpointer userdata)
+static void
+inf_text_chunk_segment_update(InfTextChunkSegment* segment)
 {
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
+  segment->subtree_length = segment->length +
+    inf_text_chunk_segment_subtree_length(segment->left) +
+    inf_text_chunk_segment_subtree_length(segment->right);
 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
+  segment->subtree_bytes = segment->bytes +
+    inf_text_chunk_segment_subtree_bytes(segment->left) +
+    inf_text_chunk_segment_subtree_bytes(segment->right);
 
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
+  segment->subtree_newlines = segment->newlines +
+    inf_text_chunk_segment_subtree_newlines(segment->left) +
+    inf_text_chunk_segment_subtree_newlines(segment->right);
+}
 
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return -1;
-  else
-    return 1;
+static InfTextChunkStorage*
+inf_text_chunk_storage_new(gconstpointer text,
+                           gsize bytes)
+{
+  InfTextChunkStorage* storage;
+
+  storage = g_malloc(G_STRUCT_OFFSET(InfTextChunkStorage, data) + bytes);
+  storage->ref_count = 1;
+  memcpy(storage->data, text, bytes);
+  return storage;
 }
 
-static guint
-inf_text_chunk_next_offset(InfTextChunk* self,
-                           GSequenceIter* iter)
+static void
+inf_text_chunk_storage_unref(InfTextChunkStorage* storage)
 {
-  GSequenceIter* next_iter;
+  if(g_atomic_int_dec_and_test(&storage->ref_count))
+    g_free(storage);
+}
 
-  g_assert(iter != g_sequence_get_end_iter(self->segments));
-  
-  next_iter = g_sequence_iter_next(iter);
-  if(next_iter == g_sequence_get_end_iter(self->segments))
-    return self->length;
-  else
-    return ((InfTextChunkSegment*)g_sequence_get(next_iter))->offset;
+static void
+inf_text_chunk_lines_unref(InfTextChunkLines* lines)
+{
+  if(lines != NULL && g_atomic_int_dec_and_test(&lines->ref_count))
+    g_free(lines);
 }
 
-#ifdef CHUNK_CHECK_INTEGRITY
-static gboolean
-inf_text_chunk_check_integrity(InfTextChunk* self)
+static InfTextChunkCheckpoints*
+inf_text_chunk_checkpoints_new(guint allocated)
 {
-  GSequenceIter* iter;
-  InfTextChunkSegment* segment;
-  guint offset;
-  guint new_offset;
+  InfTextChunkCheckpoints* checkpoints;
 
-  offset = 0;
+  checkpoints = g_malloc(
+    G_STRUCT_OFFSET(InfTextChunkCheckpoints, data) +
+    allocated * sizeof(InfTextChunkCheckpoint)
+  );
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    if(offset != segment->offset)
-      return FALSE;
+  checkpoints->ref_count = 1;
+  checkpoints->len = 0;
+  checkpoints->allocated = allocated;
+  return checkpoints;
+}
 
-    new_offset = inf_text_chunk_next_offset(self, iter);
-    if(new_offset <= offset)
-      return FALSE;
+static void
+inf_text_chunk_checkpoints_unref(InfTextChunkCheckpoints* checkpoints)
+{
+  if(checkpoints != NULL && g_atomic_int_dec_and_test(&checkpoints->ref_count))
+    g_free(checkpoints);
+}
 
-    if(new_offset - offset > segment->length)
-      return FALSE;
+/* Returns the number of checkpoints at or before position pos */
+static guint
+inf_text_chunk_checkpoints_find(InfTextChunkCheckpoints* checkpoints,
+                                guint pos)
+{
+  guint begin;
+  guint end;
+  guint mid;
 
-    offset = new_offset;
+  begin = 0;
+  end = checkpoints->len;
+  while(begin < end)
+  {
+    mid = begin + (end - begin) / 2;
+    if(checkpoints->data[mid].offset <= pos)
+      begin = mid + 1;
+    else
+      end = mid;
   }
 
-  return TRUE;
+  return begin;
 }
-#endif
 
-static GSequenceIter*
-inf_text_chunk_get_segment(InfTextChunk* self,
-                           guint pos,
-                           gsize* index)
+static InfTextChunkSegment*
+inf_text_chunk_segment_new(InfTextChunk* chunk,
+                           guint author,
+                           gconstpointer text,
+                           gsize bytes,
+                           guint length,
+                           guint newlines)
 {
-  InfTextChunkSegment* found;
-  InfTextChunkSegment key;
-  GSequenceIter* iter;
+  InfTextChunkSegment* segment;
 
-  g_assert(pos <= self->length);
+  segment = g_slice_new(InfTextChunkSegment);
+  segment->ref_count = 1;
+  segment->left = NULL;
+  segment->right = NULL;
+  segment->priority = inf_text_chunk_next_priority(chunk);
+
+  segment->author = author;
+  segment->storage = inf_text_chunk_storage_new(text, bytes);
+  segment->text = segment->storage->data;
+  segment->bytes = bytes;
+  segment->length = length;
+  segment->newlines = newlines;
+  segment->lines = NULL;
+  segment->checkpoints = NULL;
+
+  segment->subtree_bytes = bytes;
+  segment->subtree_length = length;
+  segment->subtree_newlines = newlines;
+  return segment;
+}
 
-  /* only offset is relevant for lookup */
-  key.offset = pos;
+/* Creates a new segment for a part of the text of segment, starting at
+ * character pos and byte index, sharing its storage. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new_view(InfTextChunk* chunk,
+                                InfTextChunkSegment* segment,
+                                guint pos,
+                                gsize index,
+                                gsize bytes,
+                                guint length,
+                                guint newlines)
+{
+  InfTextChunkSegment* view;
+  guint first;
+  guint last;
+  guint i;
+
+  view = g_slice_new(InfTextChunkSegment);
+  view->ref_count = 1;
+  view->left = NULL;
+  view->right = NULL;
+  view->priority = inf_text_chunk_next_priority(chunk);
+
+  view->author = segment->author;
+  view->storage = segment->storage;
+  view->text = segment->text + index;
+  view->bytes = bytes;
+  view->length = length;
+  view->newlines = newlines;
+  view->lines = NULL;
+  view->checkpoints = NULL;
+
+  /* Take over the checkpoints within the part */
+  if(segment->checkpoints != NULL)
+  {
+    first = inf_text_chunk_checkpoints_find(segment->checkpoints, pos);
+    last = inf_text_chunk_checkpoints_find(
+      segment->checkpoints,
+      pos + length - 1
+    );
 
-  /* TODO: Verify this does binary search */
-  iter = g_sequence_search(
-    self->segments,
-    &key,
-    inf_text_chunk_segment_cmp_for_get_segment,
-    NULL
-  );
+    if(last > first)
+    {
+      view->checkpoints = inf_text_chunk_checkpoints_new(last - first);
+      view->checkpoints->len = last - first;
 
-  if(self->length > 0)
-  {
-    g_assert(iter != g_sequence_get_begin_iter(self->segments));
+      for(i = first; i < last; ++i)
+      {
+        view->checkpoints->data[i - first].offset =
+          segment->checkpoints->data[i].offset - pos;
+        view->checkpoints->data[i - first].index =
+          segment->checkpoints->data[i].index - index;
+      }
+    }
+  }
 
-    iter = g_sequence_iter_prev(iter);
-    found = g_sequence_get(iter);
+  view->subtree_bytes = bytes;
+  view->subtree_length = length;
+  view->subtree_newlines = newlines;
+
+  g_atomic_int_inc(&view->storage->ref_count);
+  return view;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_ref(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    g_atomic_int_inc(&segment->ref_count);
+  return segment;
+}
+
+static void
+inf_text_chunk_segment_unref(InfTextChunkSegment* segment)
+{
+  if(segment != NULL && g_atomic_int_dec_and_test(&segment->ref_count))
+  {
+    inf_text_chunk_segment_unref(segment->left);
+    inf_text_chunk_segment_unref(segment->right);
+    inf_text_chunk_storage_unref(segment->storage);
+    inf_text_chunk_lines_unref(segment->lines);
+    inf_text_chunk_checkpoints_unref(segment->checkpoints);
+    g_slice_free(InfTextChunkSegment, segment);
+  }
+}
+
+/* Takes over the caller's reference on segment, and returns a segment with
+ * the same content that only the caller holds a reference on, so that it
+ * can be modified. The children of the returned segment may still be
+ * shared. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_unshare(InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* copy;
+
+  if(g_atomic_int_get(&segment->ref_count) == 1)
+    return segment;
+
+  copy = g_slice_new(InfTextChunkSegment);
+  *copy = *segment;
+  copy->ref_count = 1;
+
+  inf_text_chunk_segment_ref(copy->left);
+  inf_text_chunk_segment_ref(copy->right);
+  g_atomic_int_inc(&copy->storage->ref_count);
+  if(copy->lines != NULL)
+    g_atomic_int_inc(&copy->lines->ref_count);
+  if(copy->checkpoints != NULL)
+    g_atomic_int_inc(&copy->checkpoints->ref_count);
+
+  inf_text_chunk_segment_unref(segment);
+  return copy;
+}
+
+/* Makes sure that the checkpoints of segment are not shared with another
+ * segment, and that there is room for n more. */
+static InfTextChunkCheckpoints*
+inf_text_chunk_segment_unshare_checkpoints(InfTextChunkSegment* segment,
+                                           guint n)
+{
+  InfTextChunkCheckpoints* checkpoints;
+  InfTextChunkCheckpoints* copy;
+  guint allocated;
+
+  checkpoints = segment->checkpoints;
+  allocated = checkpoints->allocated;
+  if(checkpoints->len + n > allocated)
+    allocated = MAX(checkpoints->len + n, 2 * allocated);
+
+  if(allocated > checkpoints->allocated ||
+     g_atomic_int_get(&checkpoints->ref_count) > 1)
+  {
+    copy = inf_text_chunk_checkpoints_new(allocated);
+    copy->len = checkpoints->len;
+
+    memcpy(
+      copy->data,
+      checkpoints->data,
+      checkpoints->len * sizeof(InfTextChunkCheckpoint)
+    );
+
+    inf_text_chunk_checkpoints_unref(checkpoints);
+    segment->checkpoints = copy;
+  }
+
+  return segment->checkpoints;
+}
+
+/* Removes the checkpoints at or behind position pos */
+static void
+inf_text_chunk_segment_truncate_checkpoints(InfTextChunkSegment* segment,
+                                            guint pos)
+{
+  InfTextChunkCheckpoints* checkpoints;
+  guint len;
+
+  if(segment->checkpoints != NULL)
+  {
+    len = inf_text_chunk_checkpoints_find(segment->checkpoints, pos - 1);
+    if(len < segment->checkpoints->len)
+    {
+      checkpoints = inf_text_chunk_segment_unshare_checkpoints(segment, 0);
+      checkpoints->len = len;
+    }
+  }
+}
+
+/* Replaces the characters [begin, end) of the text of segment, which are at
+ * the bytes [begin_index, end_index), by text, which has the given number
+ * of bytes and characters. The segment must not be shared. Its storage is
+ * copied if it is shared with other segments. Does not update the newline
+ * count. */
+static void
+inf_text_chunk_segment_splice(InfTextChunkSegment* segment,
+                              guint begin,
+                              gsize begin_index,
+                              guint end,
+                              gsize end_index,
+                              gconstpointer text,
+                              gsize bytes,
+                              guint length)
+{
+  InfTextChunkStorage* storage;
+  InfTextChunkCheckpoints* checkpoints;
+  InfTextChunkCheckpoint checkpoint;
+  gsize new_bytes;
+  gsize offset;
+  guint i;
+  guint n;
+
+  g_assert(segment->ref_count == 1);
+  g_assert(begin <= end && end <= segment->length);
+  g_assert(begin_index <= end_index && end_index <= segment->bytes);
+
+  new_bytes = segment->bytes - (end_index - begin_index) + bytes;
+
+  /* Line starts are still valid if only the end is cut off, since the
+   * caller reduces the number of newlines accordingly. */
+  if(bytes > 0 || end_index < segment->bytes)
+  {
+    inf_text_chunk_lines_unref(segment->lines);
+    segment->lines = NULL;
+  }
+
+  /* Checkpoints in front of the modified text stay where they are,
+   * checkpoints within it are removed, and the ones behind it are moved. */
+  if(segment->checkpoints != NULL &&
+     segment->checkpoints->len > 0 &&
+     segment->checkpoints->data[segment->checkpoints->len - 1].offset >= begin)
+  {
+    checkpoints = inf_text_chunk_segment_unshare_checkpoints(segment, 0);
+
+    n = 0;
+    for(i = 0; i < checkpoints->len; ++i)
+    {
+      checkpoint = checkpoints->data[i];
+      if(checkpoint.offset >= end)
+      {
+        checkpoint.offset = checkpoint.offset - end + begin + length;
+        checkpoint.index = checkpoint.index - end_index + begin_index + bytes;
+      }
+      else if(checkpoint.offset >= begin)
+      {
+        continue;
+      }
+
+      /* The beginning of the segment is not stored */
+      if(checkpoint.offset > 0)
+        checkpoints->data[n++] = checkpoint;
+    }
+
+    checkpoints->len = n;
+  }
+
+  if(bytes == 0 && begin_index == 0)
+  {
+    /* Cut off the beginning, no need to touch the storage */
+    segment->text += end_index;
+  }
+  else if(bytes == 0 && end_index == segment->bytes)
+  {
+    /* Cut off the end, no need to touch the storage either */
+  }
+  else if(g_atomic_int_get(&segment->storage->ref_count) == 1)
+  {
+    if(new_bytes > segment->bytes)
+    {
+      offset = segment->text - segment->storage->data;
+
+      segment->storage = g_realloc(
+        segment->storage,
+        G_STRUCT_OFFSET(InfTextChunkStorage, data) + offset + new_bytes
+      );
+
+      segment->text = segment->storage->data + offset;
+    }
+
+    if(end_index < segment->bytes)
+    {
+      g_memmove(
+        segment->text + begin_index + bytes,
+        segment->text + end_index,
+        segment->bytes - end_index
+      );
+    }
+
+    if(bytes > 0)
+      memcpy(segment->text + begin_index, text, bytes);
+  }
+  else
+  {
+    storage = g_malloc(
+      G_STRUCT_OFFSET(InfTextChunkStorage, data) + new_bytes
+    );
+
+    storage->ref_count = 1;
+
+    memcpy(storage->data, segment->text, begin_index);
+    if(bytes > 0)
+      memcpy(storage->data + begin_index, text, bytes);
+    memcpy(
+      storage->data + begin_index + bytes,
+      segment->text + end_index,
+      segment->bytes - end_index
+    );
+
+    inf_text_chunk_storage_unref(segment->storage);
+    segment->storage = storage;
+    segment->text = storage->data;
+  }
+
+  segment->bytes = new_bytes;
+  segment->length = segment->length - (end - begin) + length;
+}
+
+/* Adds checkpoints between the (i-1)th checkpoint (or the beginning of the
+ * segment if i is 0) and position pos, which must lie in front of the ith
+ * checkpoint. Returns the number of checkpoints in front of pos
+ * afterwards. */
+static guint
+inf_text_chunk_segment_add_checkpoints(InfTextChunk* self,
+                                       InfTextChunkSegment* segment,
+                                       guint i,
+                                       guint pos)
+{
+  InfTextChunkCheckpoints* checkpoints;
+  guint offset;
+  gsize index;
+  guint n;
+  guint k;
+
+  if(i > 0)
+  {
+    offset = segment->checkpoints->data[i - 1].offset;
+    index = segment->checkpoints->data[i - 1].index;
+  }
+  else
+  {
+    offset = 0;
+    index = 0;
+  }
+
+  /* Number of checkpoints that fit in front of pos */
+  n = (pos - offset - 1) / INF_TEXT_CHUNK_CHECKPOINT_DISTANCE;
+  checkpoints = inf_text_chunk_segment_unshare_checkpoints(segment, n);
+
+  g_memmove(
+    checkpoints->data + i + n,
+    checkpoints->data + i,
+    (checkpoints->len - i) * sizeof(InfTextChunkCheckpoint)
+  );
+
+  checkpoints->len += n;
+
+  for(k = 0; k < n; ++k)
+  {
+    index += self->path->get_byte_index(
+      self,
+      segment->text + index,
+      segment->bytes - index,
+      INF_TEXT_CHUNK_CHECKPOINT_DISTANCE
+    );
+
+    offset += INF_TEXT_CHUNK_CHECKPOINT_DISTANCE;
+
+    checkpoints->data[i + k].offset = offset;
+    checkpoints->data[i + k].index = index;
+  }
+
+  return i + n;
+}
+
+/* Returns the byte index of the character at position pos within segment.
+ * If this requires scanning a long part of the text, checkpoints are added
+ * on the way, so that the next lookup nearby is quick. */
+static gsize
+inf_text_chunk_segment_get_index(InfTextChunk* self,
+                                 InfTextChunkSegment* segment,
+                                 guint pos)
+{
+  guint i;
+  guint offset;
+  gsize index;
+
+  g_assert(pos <= segment->length);
+
+  if(pos == 0)
+    return 0;
+  if(pos == segment->length)
+    return segment->bytes;
+
+  if(segment->checkpoints != NULL)
+    i = inf_text_chunk_checkpoints_find(segment->checkpoints, pos);
+  else
+    i = 0;
+
+  if(i > 0)
+    offset = segment->checkpoints->data[i - 1].offset;
+  else
+    offset = 0;
+
+  if(self->path->use_checkpoints &&
+     pos - offset > 2 * INF_TEXT_CHUNK_CHECKPOINT_DISTANCE)
+  {
+    if(segment->checkpoints == NULL)
+      segment->checkpoints = inf_text_chunk_checkpoints_new(0);
+
+    i = inf_text_chunk_segment_add_checkpoints(self, segment, i, pos);
+  }
+
+  if(i > 0)
+  {
+    offset = segment->checkpoints->data[i - 1].offset;
+    index = segment->checkpoints->data[i - 1].index;
+  }
+  else
+  {
+    offset = 0;
+    index = 0;
+  }
+
+  return index + self->path->get_byte_index(
+    self,
+    segment->text + index,
+    segment->bytes - index,
+    pos - offset
+  );
+}
+
+/* Returns the start offsets of the lines within segment, building them if
+ * necessary. */
+static const guint*
+inf_text_chunk_segment_get_lines(InfTextChunk* self,
+                                 InfTextChunkSegment* segment)
+{
+  InfTextChunkLines* lines;
+  guint count;
+
+  if(segment->lines == NULL)
+  {
+    lines = g_malloc(
+      G_STRUCT_OFFSET(InfTextChunkLines, starts) +
+      segment->newlines * sizeof(guint)
+    );
+
+    lines->ref_count = 1;
+
+    count = self->path->find_newlines(
+      self,
+      segment->text,
+      segment->bytes,
+      lines->starts
+    );
+
+    g_assert(count == segment->newlines);
+    segment->lines = lines;
+  }
+
+  return segment->lines->starts;
+}
+
+/* Returns the number of lines within segment that start at or before the
+ * character at position pos, i.e. the number of newline characters in front
+ * of pos. */
+static guint
+inf_text_chunk_segment_get_line(InfTextChunk* self,
+                                InfTextChunkSegment* segment,
+                                guint pos)
+{
+  const guint* starts;
+  guint begin;
+  guint end;
+  guint mid;
+
+  g_assert(pos <= segment->length);
+
+  if(pos == 0 || segment->newlines == 0)
+    return 0;
+  if(pos == segment->length)
+    return segment->newlines;
+
+  starts = inf_text_chunk_segment_get_lines(self, segment);
+
+  begin = 0;
+  end = segment->newlines;
+  while(begin < end)
+  {
+    mid = begin + (end - begin) / 2;
+    if(starts[mid] <= pos)
+      begin = mid + 1;
+    else
+      end = mid;
+  }
+
+  return begin;
+}
+
+/* Returns the number of newline characters between the characters at
+ * positions begin and end within segment, whose byte indices are begin_index
+ * and end_index. In contrast to inf_text_chunk_segment_get_line(), this does
+ * not build the line starts if they are not available yet, but scans the
+ * text in between. It is used when segments are modified, in which case the
+ * line starts would need to be built again anyway. */
+static guint
+inf_text_chunk_segment_count_newlines(InfTextChunk* self,
+                                      InfTextChunkSegment* segment,
+                                      guint begin,
+                                      gsize begin_index,
+                                      guint end,
+                                      gsize end_index)
+{
+  if(segment->newlines == 0 || begin == end)
+    return 0;
+
+  if(segment->lines != NULL)
+  {
+    return inf_text_chunk_segment_get_line(self, segment, end) -
+      inf_text_chunk_segment_get_line(self, segment, begin);
+  }
+
+  return self->path->find_newlines(
+    self,
+    segment->text + begin_index,
+    end_index - begin_index,
+    NULL
+  );
+}
+
+/* Concatenates the two trees first and second, without merging
+ * adjacent segments. Takes over the caller's references on both trees. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_merge(InfTextChunkSegment* first,
+                             InfTextChunkSegment* second)
+{
+  if(first == NULL) return second;
+  if(second == NULL) return first;
+
+  if(first->priority >= second->priority)
+  {
+    first = inf_text_chunk_segment_unshare(first);
+    first->right = inf_text_chunk_segment_merge(first->right, second);
+    inf_text_chunk_segment_update(first);
+    return first;
+  }
+  else
+  {
+    second = inf_text_chunk_segment_unshare(second);
+    second->left = inf_text_chunk_segment_merge(first, second->left);
+    inf_text_chunk_segment_update(second);
+    return second;
+  }
+}
+
+/* Splits the tree rooted at segment such that the first pos characters end
+ * up in first and the rest ends up in second. If pos lies within a segment,
+ * that segment is cut into two, and the part behind pos is returned in tail
+ * as a separate, single segment. It has a new priority, and therefore cannot
+ * simply be put where the original segment was. Takes over the caller's
+ * reference on segment. */
+static void
+inf_text_chunk_segment_split_impl(InfTextChunk* self,
+                                  InfTextChunkSegment* segment,
+                                  guint pos,
+                                  InfTextChunkSegment** first,
+                                  InfTextChunkSegment** tail,
+                                  InfTextChunkSegment** second)
+{
+  guint left_length;
+  gsize index;
+  guint newlines;
+
+  if(segment == NULL)
+  {
+    *first = NULL;
+    *second = NULL;
+    return;
+  }
+
+  left_length = inf_text_chunk_segment_subtree_length(segment->left);
+
+  if(pos == 0)
+  {
+    *first = NULL;
+    *second = segment;
+  }
+  else if(pos == segment->subtree_length)
+  {
+    *first = segment;
+    *second = NULL;
+  }
+  else if(pos <= left_length)
+  {
+    segment = inf_text_chunk_segment_unshare(segment);
+
+    inf_text_chunk_segment_split_impl(
+      self,
+      segment->left,
+      pos,
+      first,
+      tail,
+      &segment->left
+    );
+
+    inf_text_chunk_segment_update(segment);
+    *second = segment;
+  }
+  else if(pos >= left_length + segment->length)
+  {
+    segment = inf_text_chunk_segment_unshare(segment);
+
+    inf_text_chunk_segment_split_impl(
+      self,
+      segment->right,
+      pos - left_length - segment->length,
+      &segment->right,
+      tail,
+      second
+    );
+
+    inf_text_chunk_segment_update(segment);
+    *first = segment;
+  }
+  else
+  {
+    segment = inf_text_chunk_segment_unshare(segment);
+
+    pos -= left_length;
+    index = inf_text_chunk_segment_get_index(self, segment, pos);
+
+    /* Count the newlines in whichever part is shorter */
+    if(index <= segment->bytes - index)
+    {
+      newlines = inf_text_chunk_segment_count_newlines(
+        self, segment, 0, 0, pos, index
+      );
+    }
+    else
+    {
+      newlines = segment->newlines - inf_text_chunk_segment_count_newlines(
+        self, segment, pos, index, segment->length, segment->bytes
+      );
+    }
+
+    /* Both parts share the storage of the segment. The line starts of the
+     * segment remain valid for the first part. */
+    *tail = inf_text_chunk_segment_new_view(
+      self,
+      segment,
+      pos,
+      index,
+      segment->bytes - index,
+      segment->length - pos,
+      segment->newlines - newlines
+    );
+
+    inf_text_chunk_segment_truncate_checkpoints(segment, pos);
+    segment->bytes = index;
+    segment->length = pos;
+    segment->newlines = newlines;
+
+    *second = segment->right;
+    segment->right = NULL;
+
+    inf_text_chunk_segment_update(segment);
+    *first = segment;
+  }
+}
+
+/* Splits the tree rooted at segment such that the first pos characters end
+ * up in first and the rest ends up in second. If pos lies within a segment,
+ * that segment is split into two. Takes over the caller's reference
+ * on segment. */
+static void
+inf_text_chunk_segment_split(InfTextChunk* self,
+                             InfTextChunkSegment* segment,
+                             guint pos,
+                             InfTextChunkSegment** first,
+                             InfTextChunkSegment** second)
+{
+  InfTextChunkSegment* tail;
+
+  tail = NULL;
+  inf_text_chunk_segment_split_impl(self, segment, pos, first, &tail, second);
+
+  if(tail != NULL)
+    *second = inf_text_chunk_segment_merge(tail, *second);
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_first(InfTextChunkSegment* segment)
+{
+  while(segment->left != NULL)
+    segment = segment->left;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_last(InfTextChunkSegment* segment)
+{
+  while(segment->right != NULL)
+    segment = segment->right;
+  return segment;
+}
+
+/* Removes the first segment from the tree rooted at segment, and returns
+ * the new root. The removed segment is stored in removed, and the caller
+ * owns a reference on it. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_remove_first(InfTextChunkSegment* segment,
+                                    InfTextChunkSegment** removed)
+{
+  InfTextChunkSegment* first;
+  InfTextChunkSegment** link;
+  gsize bytes;
+  guint length;
+  guint newlines;
+
+  first = inf_text_chunk_segment_first(segment);
+  bytes = first->bytes;
+  length = first->length;
+  newlines = first->newlines;
+
+  link = &segment;
+  *link = inf_text_chunk_segment_unshare(*link);
+
+  while((*link)->left != NULL)
+  {
+    (*link)->subtree_length -= length;
+    (*link)->subtree_bytes -= bytes;
+    (*link)->subtree_newlines -= newlines;
+
+    link = &(*link)->left;
+    *link = inf_text_chunk_segment_unshare(*link);
+  }
+
+  first = *link;
+  *link = first->right;
+
+  first->right = NULL;
+  inf_text_chunk_segment_update(first);
+
+  *removed = first;
+  return segment;
+}
+
+/* Appends text to the last segment of the tree rooted at segment, and
+ * returns the new root. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_append(InfTextChunkSegment* segment,
+                              gconstpointer text,
+                              gsize bytes,
+                              guint length,
+                              guint newlines)
+{
+  InfTextChunkSegment** link;
+
+  link = &segment;
+  for(;;)
+  {
+    *link = inf_text_chunk_segment_unshare(*link);
+    (*link)->subtree_length += length;
+    (*link)->subtree_bytes += bytes;
+    (*link)->subtree_newlines += newlines;
+
+    if((*link)->right == NULL) break;
+    link = &(*link)->right;
+  }
+
+  inf_text_chunk_segment_splice(
+    *link,
+    (*link)->length,
+    (*link)->bytes,
+    (*link)->length,
+    (*link)->bytes,
+    text,
+    bytes,
+    length
+  );
+
+  (*link)->newlines += newlines;
+  return segment;
+}
+
+/* Concatenates the two trees first and second. If the last segment of first
+ * and the first segment of second are written by the same author, they are
+ * merged into a single segment, so that adjacent segments always have
+ * different authors. Takes over the caller's references on both trees. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_join(InfTextChunkSegment* first,
+                            InfTextChunkSegment* second)
+{
+  InfTextChunkSegment* removed;
+
+  if(first == NULL) return second;
+  if(second == NULL) return first;
+
+  if(inf_text_chunk_segment_last(first)->author ==
+     inf_text_chunk_segment_first(second)->author)
+  {
+    second = inf_text_chunk_segment_remove_first(second, &removed);
+
+    first = inf_text_chunk_segment_append(
+      first,
+      removed->text,
+      removed->bytes,
+      removed->length,
+      removed->newlines
+    );
+
+    inf_text_chunk_segment_unref(removed);
+  }
+
+  return inf_text_chunk_segment_merge(first, second);
+}
+
+/* Inserts text into an existing segment of the given author that contains,
+ * begins or ends at position pos, if there is one. Returns FALSE if there is
+ * no such segment, in which case the tree content is left untouched. The
+ * segments visited are unshared, and link is updated accordingly. */
+static gboolean
+inf_text_chunk_segment_insert_text(InfTextChunk* self,
+                                   InfTextChunkSegment** link,
+                                   guint pos,
+                                   gconstpointer text,
+                                   gsize bytes,
+                                   guint length,
+                                   guint newlines,
+                                   guint author)
+{
+  InfTextChunkSegment* segment;
+  guint left_length;
+  gsize index;
+  gboolean result;
+
+  if(*link == NULL)
+    return FALSE;
+
+  segment = inf_text_chunk_segment_unshare(*link);
+  *link = segment;
+
+  left_length = inf_text_chunk_segment_subtree_length(segment->left);
+
+  if(pos < left_length)
+  {
+    result = inf_text_chunk_segment_insert_text(
+      self, &segment->left, pos, text, bytes, length, newlines, author
+    );
+  }
+  else if(pos > left_length + segment->length)
+  {
+    result = inf_text_chunk_segment_insert_text(
+      self, &segment->right, pos - left_length - segment->length,
+      text, bytes, length, newlines, author
+    );
+  }
+  else if(segment->author == author)
+  {
+    pos -= left_length;
+    index = inf_text_chunk_segment_get_index(self, segment, pos);
+
+    inf_text_chunk_segment_splice(
+      segment,
+      pos,
+      index,
+      pos,
+      index,
+      text,
+      bytes,
+      length
+    );
+
+    segment->newlines += newlines;
+    result = TRUE;
+  }
+  else if(pos == left_length)
+  {
+    /* Inserting at the beginning of this segment, try the previous one */
+    result = inf_text_chunk_segment_insert_text(
+      self, &segment->left, pos, text, bytes, length, newlines, author
+    );
+  }
+  else if(pos == left_length + segment->length)
+  {
+    /* Inserting at the end of this segment, try the next one */
+    result = inf_text_chunk_segment_insert_text(
+      self, &segment->right, 0, text, bytes, length, newlines, author
+    );
+  }
+  else
+  {
+    result = FALSE;
+  }
+
+  if(result == TRUE)
+  {
+    segment->subtree_length += length;
+    segment->subtree_bytes += bytes;
+    segment->subtree_newlines += newlines;
+  }
+
+  return result;
+}
+
+/* Erases text from within a single segment, if [begin, begin + length) is
+ * contained in one segment and does not cover all of it. Returns FALSE if
+ * this is not the case, in which case the tree content is left untouched.
+ * The segments visited are unshared, and link is updated accordingly. */
+static gboolean
+inf_text_chunk_segment_erase(InfTextChunk* self,
+                             InfTextChunkSegment** link,
+                             guint begin,
+                             guint length)
+{
+  InfTextChunkSegment* segment;
+  guint left_length;
+  gsize begin_index;
+  gsize end_index;
+  gboolean result;
+
+  if(*link == NULL)
+    return FALSE;
+
+  segment = inf_text_chunk_segment_unshare(*link);
+  *link = segment;
+
+  left_length = inf_text_chunk_segment_subtree_length(segment->left);
+
+  if(begin + length <= left_length)
+  {
+    result = inf_text_chunk_segment_erase(
+      self,
+      &segment->left,
+      begin,
+      length
+    );
+  }
+  else if(begin >= left_length + segment->length)
+  {
+    result = inf_text_chunk_segment_erase(
+      self,
+      &segment->right,
+      begin - left_length - segment->length,
+      length
+    );
+  }
+  else if(begin >= left_length &&
+          begin + length <= left_length + segment->length &&
+          length < segment->length)
+  {
+    begin -= left_length;
+
+    begin_index = inf_text_chunk_segment_get_index(self, segment, begin);
+    end_index = inf_text_chunk_segment_get_index(
+      self,
+      segment,
+      begin + length
+    );
+
+    segment->newlines -= inf_text_chunk_segment_count_newlines(
+      self, segment, begin, begin_index, begin + length, end_index
+    );
+
+    inf_text_chunk_segment_splice(
+      segment,
+      begin,
+      begin_index,
+      begin + length,
+      end_index,
+      NULL,
+      0,
+      0
+    );
+
+    result = TRUE;
+  }
+  else
+  {
+    result = FALSE;
+  }
+
+  if(result == TRUE)
+    inf_text_chunk_segment_update(segment);
+
+  return result;
+}
+
+/* Appends the parts of the segments in the tree rooted at segment which
+ * overlap with [begin, end) to result. offset is the position of the
+ * first character in the tree. Subtrees which are completely contained in
+ * the range are shared with result instead of being copied. */
+static void
+inf_text_chunk_segment_substring(InfTextChunk* self,
+                                 InfTextChunkSegment* segment,
+                                 guint offset,
+                                 guint begin,
+                                 guint end,
+                                 InfTextChunk* result)
+{
+  InfTextChunkSegment* new_segment;
+  guint segment_begin;
+  guint segment_end;
+  gsize begin_index;
+  gsize end_index;
+
+  if(segment == NULL)
+    return;
+
+  if(begin <= offset && end >= offset + segment->subtree_length)
+  {
+    result->root = inf_text_chunk_segment_merge(
+      result->root,
+      inf_text_chunk_segment_ref(segment)
+    );
+
+    return;
+  }
+
+  segment_begin =
+    offset + inf_text_chunk_segment_subtree_length(segment->left);
+  segment_end = segment_begin + segment->length;
+
+  if(begin < segment_begin)
+  {
+    inf_text_chunk_segment_substring(
+      self,
+      segment->left,
+      offset,
+      begin,
+      end,
+      result
+    );
+  }
+
+  if(begin < segment_end && end > segment_begin)
+  {
+    begin_index = inf_text_chunk_segment_get_index(
+      self,
+      segment,
+      MAX(begin, segment_begin) - segment_begin
+    );
+
+    end_index = inf_text_chunk_segment_get_index(
+      self,
+      segment,
+      MIN(end, segment_end) - segment_begin
+    );
+
+    new_segment = inf_text_chunk_segment_new_view(
+      result,
+      segment,
+      MAX(begin, segment_begin) - segment_begin,
+      begin_index,
+      end_index - begin_index,
+      MIN(end, segment_end) - MAX(begin, segment_begin),
+      inf_text_chunk_segment_count_newlines(
+        self,
+        segment,
+        MAX(begin, segment_begin) - segment_begin,
+        begin_index,
+        MIN(end, segment_end) - segment_begin,
+        end_index
+      )
+    );
+
+    result->root = inf_text_chunk_segment_merge(result->root, new_segment);
+  }
+
+  if(end > segment_end)
+  {
+    inf_text_chunk_segment_substring(
+      self,
+      segment->right,
+      segment_end,
+      begin,
+      end,
+      result
+    );
+  }
+}
+
+/* Copies the text of all segments in the tree rooted at segment into
+ * buffer, and returns the position behind the last byte written. */
+static gchar*
+inf_text_chunk_segment_get_text(InfTextChunkSegment* segment,
+                                gchar* buffer)
+{
+  if(segment != NULL)
+  {
+    buffer = inf_text_chunk_segment_get_text(segment->left, buffer);
+    memcpy(buffer, segment->text, segment->bytes);
+    buffer += segment->bytes;
+    buffer = inf_text_chunk_segment_get_text(segment->right, buffer);
+  }
+
+  return buffer;
+}
+
+static void
+inf_text_chunk_segment_flatten(InfTextChunkSegment* segment,
+                               GPtrArray* array)
+{
+  if(segment != NULL)
+  {
+    inf_text_chunk_segment_flatten(segment->left, array);
+    g_ptr_array_add(array, segment);
+    inf_text_chunk_segment_flatten(segment->right, array);
+  }
+}
+
+/* Returns the segment containing the character at position pos, and
+ * stores the position of the segment's first character in offset. */
+static InfTextChunkSegment*
+inf_text_chunk_get_segment(InfTextChunk* self,
+                           guint pos,
+                           guint* offset)
+{
+  InfTextChunkSegment* segment;
+  guint left_length;
+
+  g_assert(pos < inf_text_chunk_segment_subtree_length(self->root));
+
+  segment = self->root;
+  *offset = 0;
+
+  for(;;)
+  {
+    left_length = inf_text_chunk_segment_subtree_length(segment->left);
+
+    if(pos < left_length)
+    {
+      segment = segment->left;
+    }
+    else if(pos >= left_length + segment->length)
+    {
+      pos -= left_length + segment->length;
+      *offset += left_length + segment->length;
+      segment = segment->right;
+    }
+    else
+    {
+      *offset += left_length;
+      return segment;
+    }
+  }
+}
+
+#ifdef CHUNK_CHECK_INTEGRITY
+static gboolean
+inf_text_chunk_segment_check_integrity(InfTextChunkSegment* segment)
+{
+  if(segment == NULL)
+    return TRUE;
+
+  if(segment->length == 0 || segment->bytes < segment->length)
+    return FALSE;
+
+  if(segment->left != NULL && segment->left->priority > segment->priority)
+    return FALSE;
+  if(segment->right != NULL && segment->right->priority > segment->priority)
+    return FALSE;
+
+  if(segment->subtree_length != segment->length +
+     inf_text_chunk_segment_subtree_length(segment->left) +
+     inf_text_chunk_segment_subtree_length(segment->right))
+  {
+    return FALSE;
+  }
+
+  if(segment->subtree_bytes != segment->bytes +
+     inf_text_chunk_segment_subtree_bytes(segment->left) +
+     inf_text_chunk_segment_subtree_bytes(segment->right))
+  {
+    return FALSE;
+  }
+
+  if(segment->subtree_newlines != segment->newlines +
+     inf_text_chunk_segment_subtree_newlines(segment->left) +
+     inf_text_chunk_segment_subtree_newlines(segment->right))
+  {
+    return FALSE;
+  }
+
+  if(segment->left != NULL &&
+     inf_text_chunk_segment_last(segment->left)->author == segment->author)
+  {
+    return FALSE;
+  }
+
+  if(segment->right != NULL &&
+     inf_text_chunk_segment_first(segment->right)->author == segment->author)
+  {
+    return FALSE;
+  }
+
+  if(!inf_text_chunk_segment_check_integrity(segment->left))
+    return FALSE;
+  if(!inf_text_chunk_segment_check_integrity(segment->right))
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+inf_text_chunk_segment_check_content(InfTextChunk* self,
+                                     InfTextChunkSegment* segment)
+{
+  InfTextChunkCheckpoint* checkpoint;
+  guint offset;
+  guint i;
 
-    g_assert(pos >= found->offset);
+  if(segment == NULL)
+    return TRUE;
 
-    /* This is not "<=" because it should rather find position 0 on the
-     * next segment in that case. */
-    g_assert(pos <= inf_text_chunk_next_offset(self, iter));
+  if(segment->newlines != self->path->find_newlines(
+       self, segment->text, segment->bytes, NULL))
+  {
+    return FALSE;
+  }
 
-    /* Find byte index in the segment where the specified character starts.
-     * This is rather ugly, I wish iconv or glib or someone had some nice(r)
-     * API for this. */
-    if(index != NULL)
+  if(segment->checkpoints != NULL)
+  {
+    offset = 0;
+    for(i = 0; i < segment->checkpoints->len; ++i)
     {
-      if(pos == inf_text_chunk_next_offset(self, iter))
-      {
-        *index = found->length;
-      }
-      else
+      checkpoint = &segment->checkpoints->data[i];
+      if(checkpoint->offset <= offset || checkpoint->offset >= segment->length)
+        return FALSE;
+
+      if(checkpoint->index != self->path->get_byte_index(
+           self, segment->text, segment->bytes, checkpoint->offset))
       {
-        *index = self->path->get_byte_index(
-          self,
-          found->text,
-          found->length,
-          pos - found->offset
-        );
+        return FALSE;
       }
+
+      offset = checkpoint->offset;
     }
   }
-  else
-  {
-    if(index != NULL)
-      *index = 0;
-  }
-  
-  return iter;
+
+  if(!inf_text_chunk_segment_check_content(self, segment->left))
+    return FALSE;
+  if(!inf_text_chunk_segment_check_content(self, segment->right))
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+inf_text_chunk_check_integrity(InfTextChunk* self)
+{
+  if(!inf_text_chunk_segment_check_integrity(self->root))
+    return FALSE;
+  return inf_text_chunk_segment_check_content(self, self->root);
 }
+#endif
 
 /*
  * Public API
@@ -373,18 +2104,12 @@ InfTextChunk*
 inf_text_chunk_new(const gchar* encoding)
 {
   InfTextChunk* chunk = g_slice_new(InfTextChunk);
-  
-  chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
 
-  chunk->length = 0;
+  chunk->root = NULL;
   chunk->encoding = g_quark_from_string(encoding);
-
-  if(chunk->encoding == g_quark_from_static_string("UTF-8"))
-    chunk->path = &INF_TEXT_CHUNK_PATH_UTF8;
-  else
-    chunk->path = &INF_TEXT_CHUNK_PATH_ICONV;
+  chunk->seed = 2463534242u;
+  chunk->path = inf_text_chunk_find_path(encoding);
+  chunk->converter = NULL;
 
   return chunk;
 }
@@ -393,7 +2118,9 @@ inf_text_chunk_new(const gchar* encoding)
  * inf_text_chunk_copy:
  * @self: A #InfTextChunk.
  *
- * Returns a copy of @self.
+ * Returns a copy of @self. The copy shares its content with @self until
+ * one of the two is modified, so this operation does not depend on the
+ * size of @self.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -401,31 +2128,16 @@ InfTextChunk*
 inf_text_chunk_copy(InfTextChunk* self)
 {
   InfTextChunk* new_chunk;
-  GSequenceIter* iter;
 
   g_return_val_if_fail(self != NULL, NULL);
 
+  /* The segments are shared until one of the two chunks is modified */
   new_chunk = g_slice_new(InfTextChunk);
-  new_chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
-  
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    InfTextChunkSegment* segment = g_sequence_get(iter);
-    InfTextChunkSegment* new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(segment->text, segment->length);
-    new_segment->length = segment->length;
-    new_segment->offset = segment->offset;
-    g_sequence_append(new_chunk->segments, new_segment);
-  }
-
-  new_chunk->length = self->length;
+  new_chunk->root = inf_text_chunk_segment_ref(self->root);
   new_chunk->encoding = self->encoding;
+  new_chunk->seed = self->seed;
   new_chunk->path = self->path;
+  new_chunk->converter = NULL;
 
   return new_chunk;
 }
@@ -441,7 +2153,8 @@ void
 inf_text_chunk_free(InfTextChunk* self)
 {
   g_return_if_fail(self != NULL);
-  g_sequence_free(self->segments);
+  inf_text_chunk_segment_unref(self->root);
+  if(self->converter != NULL) g_iconv_close(self->converter);
   g_slice_free(InfTextChunk, self);
 }
 
@@ -472,105 +2185,170 @@ guint
 inf_text_chunk_get_length(InfTextChunk* self)
 {
   g_return_val_if_fail(self != NULL, 0);
-  return self->length;
+  return inf_text_chunk_segment_subtree_length(self->root);
 }
 
 /**
- * inf_text_chunk_substring:
+ * inf_text_chunk_get_line_count:
  * @self: A #InfTextChunk.
- * @begin: A character offset into @self.
- * @length: The length of the text to extract.
  *
- * Returns a new #InfTextChunk containing a substring of @self, beginning
- * at character offset @begin and @length characters long.
+ * Returns the number of lines in @self, which is one more than the number
+ * of newline characters it contains. An empty chunk consists of a single,
+ * empty line.
  *
- * Returns: (transfer full): A new #InfTextChunk.
+ * Returns: The number of lines in @self.
  **/
-InfTextChunk*
-inf_text_chunk_substring(InfTextChunk* self,
-                         guint begin,
-                         guint length)
+guint
+inf_text_chunk_get_line_count(InfTextChunk* self)
 {
-  GSequenceIter* begin_iter;
-  GSequenceIter* end_iter;
-  gsize begin_index;
-  gsize end_index;
+  g_return_val_if_fail(self != NULL, 0);
+  return inf_text_chunk_segment_subtree_newlines(self->root) + 1;
+}
 
-  InfTextChunk* result;
+/**
+ * inf_text_chunk_offset_to_line:
+ * @self: A #InfTextChunk.
+ * @offset: A character offset into @self.
+ *
+ * Returns the line that the character at @offset is part of, counted from
+ * zero. This is the number of newline characters in front of @offset. A
+ * newline character itself belongs to the line it ends.
+ *
+ * The lookup takes logarithmic time. The first lookup that ends up within
+ * a given segment of @self additionally scans the text of that segment, and
+ * remembers where its lines start until the segment is modified.
+ *
+ * Returns: The line containing @offset.
+ **/
+guint
+inf_text_chunk_offset_to_line(InfTextChunk* self,
+                              guint offset)
+{
   InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
-  guint current_length;
+  guint left_length;
+  guint line;
 
-  g_return_val_if_fail(self != NULL, NULL);
-  g_return_val_if_fail(begin + length <= self->length, NULL);
+  g_return_val_if_fail(self != NULL, 0);
+  g_return_val_if_fail(offset <= inf_text_chunk_get_length(self), 0);
+
+  segment = self->root;
+  line = 0;
 
-  if(self->length > 0 && length > 0)
+  while(segment != NULL)
   {
-    begin_iter = inf_text_chunk_get_segment(self, begin, &begin_index);
-    end_iter = inf_text_chunk_get_segment(self, begin + length, &end_index);
+    left_length = inf_text_chunk_segment_subtree_length(segment->left);
 
-    if(end_index == 0)
+    if(offset < left_length)
     {
-      g_assert(end_iter != g_sequence_get_end_iter(self->segments));
-      end_iter = g_sequence_iter_prev(end_iter);
-      end_index = ((InfTextChunkSegment*)g_sequence_get(end_iter))->length;
+      segment = segment->left;
+    }
+    else
+    {
+      line += inf_text_chunk_segment_subtree_newlines(segment->left);
+      offset -= left_length;
+
+      if(offset < segment->length)
+        return line + inf_text_chunk_segment_get_line(self, segment, offset);
+
+      line += segment->newlines;
+      offset -= segment->length;
+      segment = segment->right;
     }
+  }
 
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+  return line;
+}
 
-    current_length = 0;
-    segment = g_sequence_get(begin_iter);
+/**
+ * inf_text_chunk_line_to_offset:
+ * @self: A #InfTextChunk.
+ * @line: A line number, counted from zero.
+ *
+ * Returns the character offset at which @line starts, i.e. the offset
+ * behind the @line<!-- -->th newline character in @self. @line must be
+ * smaller than the number of lines in @self, see
+ * inf_text_chunk_get_line_count(). Like inf_text_chunk_offset_to_line(),
+ * this takes logarithmic time, apart from the first lookup within a segment.
+ *
+ * Returns: The offset of the first character of @line.
+ **/
+guint
+inf_text_chunk_line_to_offset(InfTextChunk* self,
+                              guint line)
+{
+  InfTextChunkSegment* segment;
+  guint left_newlines;
+  guint offset;
 
-    while(begin_iter != end_iter)
-    {
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = segment->author;
+  g_return_val_if_fail(self != NULL, 0);
+  g_return_val_if_fail(line < inf_text_chunk_get_line_count(self), 0);
 
-      new_segment->text = g_memdup(
-        segment->text + begin_index,
-        segment->length - begin_index
-      );
-      
-      new_segment->length = segment->length - begin_index;
-      new_segment->offset = current_length;
-
-      begin_iter = g_sequence_iter_next(begin_iter);
-      segment = g_sequence_get(begin_iter);
-
-      /* Add (remaining) length of this segment to current length */
-      current_length = segment->offset - begin;
-
-      /* So we get the next segment from the beginning. This may only be
-       * non-zero during the first iteration. */
-      begin_index = 0;
-    /*  begin = new_segment->offset;*/
-      
-      g_sequence_append(result->segments, new_segment);
-    }
+  if(line == 0)
+    return 0;
 
-    /* Don't forget last segment */
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(
-      segment->text + begin_index,
-      end_index - begin_index
-    );
-    
-    new_segment->length = end_index - begin_index;
-    new_segment->offset = current_length;
-    
-    g_sequence_append(result->segments, new_segment);
+  segment = self->root;
+  offset = 0;
 
-    result->length = length;
-    result->encoding = self->encoding;
-    result->path = self->path;
-  }
-  else
+  for(;;)
   {
-    g_assert(length == 0 || begin == 0);
+    left_newlines = inf_text_chunk_segment_subtree_newlines(segment->left);
+
+    if(line <= left_newlines)
+    {
+      segment = segment->left;
+    }
+    else if(line > left_newlines + segment->newlines)
+    {
+      line -= left_newlines + segment->newlines;
+      offset += inf_text_chunk_segment_subtree_length(segment->left) +
+        segment->length;
+      segment = segment->right;
+    }
+    else
+    {
+      return offset + inf_text_chunk_segment_subtree_length(segment->left) +
+        inf_text_chunk_segment_get_lines(self, segment)[
+          line - left_newlines - 1];
+    }
+  }
+}
+
+/**
+ * inf_text_chunk_substring:
+ * @self: A #InfTextChunk.
+ * @begin: A character offset into @self.
+ * @length: The length of the text to extract.
+ *
+ * Returns a new #InfTextChunk containing a substring of @self, beginning
+ * at character offset @begin and @length characters long.
+ *
+ * Returns: (transfer full): A new #InfTextChunk.
+ **/
+InfTextChunk*
+inf_text_chunk_substring(InfTextChunk* self,
+                         guint begin,
+                         guint length)
+{
+  InfTextChunk* result;
+
+  g_return_val_if_fail(self != NULL, NULL);
+  g_return_val_if_fail(
+    begin + length <= inf_text_chunk_get_length(self),
+    NULL
+  );
+
+  result = inf_text_chunk_new(g_quark_to_string(self->encoding));
 
-    /* New, empty chunk */
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+  if(length > 0)
+  {
+    inf_text_chunk_segment_substring(
+      self,
+      self->root,
+      0,
+      begin,
+      begin + length,
+      result
+    );
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -601,103 +2379,44 @@ inf_text_chunk_insert_text(InfTextChunk* self,
                            guint length,
                            guint author)
 {
-  GSequenceIter* iter;
-  gsize offset_index;
-  InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
+  InfTextChunkSegment* first;
+  InfTextChunkSegment* second;
+  guint newlines;
+  gboolean inserted;
 
   g_return_if_fail(self != NULL);
-  g_return_if_fail(offset <= self->length);
+  g_return_if_fail(offset <= inf_text_chunk_get_length(self));
+
+  if(length == 0)
+    return;
+
+  newlines = self->path->find_newlines(self, (gchar*)text, bytes, NULL);
+
+  /* If there is a segment by the same author at the insertion position,
+   * then simply insert the text into it. This is the common case when a
+   * user is typing. */
+  inserted = inf_text_chunk_segment_insert_text(
+    self,
+    &self->root,
+    offset,
+    text,
+    bytes,
+    length,
+    newlines,
+    author
+  );
 
-  if(self->length > 0)
+  if(inserted == FALSE)
   {
-    iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-
-    /* Have to split segment, unless it is between two segments in which
-     * case we can perhaps append to the previous. */
-    if(segment->author != author && offset > 0 && offset_index == 0)
-    {
-      g_assert(iter != g_sequence_get_begin_iter(self->segments));
-
-      iter = g_sequence_iter_prev(iter);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      offset_index = segment->length;
-    }
-
-    if(segment->author != author)
-    {
-      /* No luck, split if necessary */
-      if(offset_index > 0 && offset_index < segment->length)
-      {
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(
-          segment->text + offset_index,
-          segment->length - offset_index
-        );
-
-        new_segment->length = segment->length - offset_index;
-        new_segment->offset = offset;
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
-
-        /* Don't realloc to make smaller */
-        segment->length = offset_index;
-        /* Note that we did not invalidate offsets so far */
-      }
-      else if(offset_index == segment->length)
-      {
-        /* Insert behind segment */
-        iter = g_sequence_iter_next(iter);
-      }
-
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = author;
-      new_segment->text = g_memdup(text, bytes);
-      new_segment->length = bytes;
-      new_segment->offset = offset;
-      g_sequence_insert_before(iter, new_segment);
-    }
-    else
-    {
-      /* TODO: g_malloc + g_free + 2*memcpy? */
-      segment->text = g_realloc(segment->text, segment->length + bytes);
-      if(offset_index < segment->length)
-      {
-        g_memmove(
-          segment->text + offset_index + bytes,
-          segment->text + offset_index,
-          segment->length - offset_index
-        );
-      }
-      
-      memcpy(segment->text + offset_index, text, bytes);
-      segment->length += bytes;
-      iter = g_sequence_iter_next(iter);
-    }
-
-    /* Adjust offsets */
-    while(iter != g_sequence_get_end_iter(self->segments))
-    {
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      segment->offset += length;
-      iter = g_sequence_iter_next(iter);
-    }
+    /* No luck, split if necessary */
+    inf_text_chunk_segment_split(self, self->root, offset, &first, &second);
 
-    self->length += length;
-  }
-  else
-  {
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = author;
-    new_segment->text = g_memdup(text, bytes);
-    new_segment->length = bytes;
-    new_segment->offset = 0;
+    first = inf_text_chunk_segment_merge(
+      first,
+      inf_text_chunk_segment_new(self, author, text, bytes, length, newlines)
+    );
 
-    g_sequence_append(self->segments, new_segment);
-    self->length = length;
+    self->root = inf_text_chunk_segment_merge(first, second);
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -719,262 +2438,40 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
                             guint offset,
                             InfTextChunk* text)
 {
-  GSequenceIter* iter;
-  GSequenceIter* text_iter;
-  gsize offset_index;
-  InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
-
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
   InfTextChunkSegment* first;
-  InfTextChunkSegment* last;
-
-  InfTextChunkSegment* first_merge;
-  InfTextChunkSegment* last_merge;
-  GSequenceIter* beyond;
+  InfTextChunkSegment* second;
 
   g_return_if_fail(self != NULL);
-  g_return_if_fail(offset <= self->length);
+  g_return_if_fail(offset <= inf_text_chunk_get_length(self));
   g_return_if_fail(text != NULL);
   g_return_if_fail(self->encoding == text->encoding);
 
-  if(self->length > 0 && text->length > 0)
+  if(text->root != NULL)
   {
-    if(g_sequence_get_length(text->segments) == 1)
+    if(text->root->left == NULL && text->root->right == NULL)
     {
-      segment = g_sequence_get(g_sequence_get_begin_iter(text->segments));
-
       inf_text_chunk_insert_text(
         self,
         offset,
-        segment->text,
-        segment->length,
-        text->length,
-        segment->author
+        text->root->text,
+        text->root->bytes,
+        text->root->length,
+        text->root->author
       );
     }
     else
     {
-      iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-
-      /* First, we insert the first and last segment of text into self,
-       * possibly merging with adjacent segments. Then, the rest is
-       * copied. */
-      first_iter = g_sequence_get_begin_iter(text->segments);
-      last_iter = g_sequence_iter_prev(
-        g_sequence_get_end_iter(text->segments)
-      );
-
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      last = (InfTextChunkSegment*)g_sequence_get(last_iter);
-
-      /* 0 and 1 segment special cases have been handled above */
-      g_assert(first != last);
-
-      last_merge = segment;
-      first_merge = segment;
-
-      /* beyond points to the first segment that needs offset adjustment
-       * after insertion */
-      beyond = iter;
-
-      /* Try merge with end of previous segment if inserting inbetween two
-       * segments. */
-      if(offset_index == 0 && offset > 0)
-      {
-        g_assert(iter != g_sequence_get_begin_iter(self->segments));
-
-        iter = g_sequence_iter_prev(iter);
-        first_merge = (InfTextChunkSegment*)g_sequence_get(iter);
-        offset_index = first_merge->length;
-      }
-
-      if(offset == 0 || offset == self->length || first_merge != last_merge)
-      {
-        /* Insert between two segments, or at beginning/end */
-        if(first_merge->author == first->author && offset > 0)
-        {
-          /* Can merge first segment */
-          first_merge->length += first->length;
-
-          first_merge->text = g_realloc(
-            first_merge->text,
-            first_merge->length
-          );
-
-          memcpy(
-            first_merge->text + first_merge->length - first->length,
-            first->text,
-            first->length
-          );
-
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-
-        if(last_merge->author == last->author && offset < self->length)
-        {
-          /* Can merge last segment */
-          last_merge->length += last->length;
-          last_merge->text = g_realloc(last_merge->text, last_merge->length);
-
-          g_memmove(
-            last_merge->text + last->length,
-            last_merge->text,
-            last_merge->length - last->length
-          );
-
-          memcpy(last_merge->text, last->text, last->length);
-          last_merge->offset = offset + last->offset;
-
-          /* Merged with last, so don't need to adjust last_merge->offset
-           * anymore, continue behind with offset adjustment. */
-          beyond = g_sequence_iter_next(beyond);
-        }
-        else
-        {
-          /* Could not merge last segment, so we have to insert it. Therefore,
-           * make last_iter point to the end of the sequence. */
-          last_iter = g_sequence_iter_next(last_iter);
-
-          if(offset_index > 0) /* Note: This is only false for offset == 0 */
-            beyond = g_sequence_iter_next(iter);
-        }
-
-        if(offset_index > 0) /* Note: This is only false for offset == 0 */
-        {
-          /* Pointing to the position before which to insert
-           * the rest of text. */
-          iter = g_sequence_iter_next(iter);
-        }
-      }
-      else
-      {
-        /* Insert within a segment, split segment */
-
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = last_merge->author;
-
-        if(last_merge->author == last->author)
-        {
-          /* Merge last part into new segment */
-          new_segment->length = last_merge->length - offset_index +
-            last->length;
-
-          new_segment->text = g_malloc(new_segment->length);
-          memcpy(new_segment->text, last->text, last->length);
-
-          memcpy(
-            new_segment->text + last->length,
-            last_merge->text + offset_index,
-            last_merge->length - offset_index
-          );
-
-          new_segment->offset = offset + last->offset;
-        }
-        else
-        {
-          /* Split up last part */
-          new_segment->length = last_merge->length - offset_index;
-          new_segment->text = g_malloc(new_segment->length);
-
-          memcpy(
-            new_segment->text,
-            last_merge->text + offset_index,
-            new_segment->length
-          );
-
-          new_segment->offset = offset + text->length;
-
-          /* We still have to insert last segment since we could not merge */
-          last_iter = g_sequence_iter_next(last_iter);
-        }
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
-
-        /* The segment just inserted is the last one being inserted, so
-         * we need to adjust beyond that */
-        beyond = g_sequence_iter_next(iter);
-
-        /* Note first_merge == last_merge */
-        if(first_merge->author == first->author)
-        {
-          /* Merge into first */
-          if(first_merge->length < offset_index + first->length)
-          {
-            first_merge->text = g_realloc(
-              first_merge->text,
-              offset_index + first->length
-            );
-          }
-
-          first_merge->length = offset_index + first->length;
-
-          memcpy(
-            first_merge->text + offset_index,
-            first->text,
-            first->length
-          );
-
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        else
-        {
-          /* Cannot merge, just cut */
-          first_merge->length = offset_index;
-        }
-      }
-
-      /* iter now points to the segment before which the rest of text has to
-       * be inserted */
-
-      for(text_iter = first_iter;
-          text_iter != last_iter;
-          text_iter = g_sequence_iter_next(text_iter))
-      {
-        segment = g_sequence_get(text_iter);
-        new_segment = g_slice_new(InfTextChunkSegment);
-
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(segment->text, segment->length);
-        new_segment->length = segment->length;
-        new_segment->offset = offset + segment->offset;
-        g_sequence_insert_before(iter, new_segment);
-      }
-
-      for(iter = beyond;
-          iter != g_sequence_get_end_iter(self->segments);
-          iter = g_sequence_iter_next(iter))
-      {
-        segment = g_sequence_get(iter);
-        segment->offset += inf_text_chunk_get_length(text);
-      }
-
-      self->length += text->length;
-    }
-  }
-  else
-  {
-    for(text_iter = g_sequence_get_begin_iter(text->segments);
-        text_iter != g_sequence_get_end_iter(text->segments);
-        text_iter = g_sequence_iter_next(text_iter))
-    {
-      segment = (InfTextChunkSegment*)g_sequence_get(text_iter);
-      new_segment = g_slice_new(InfTextChunkSegment);
+      /* Split at the insertion position, and then join everything together
+       * again, merging segments at the borders where possible. */
+      inf_text_chunk_segment_split(self, self->root, offset, &first, &second);
 
-      new_segment->author = segment->author;
-      new_segment->text = g_memdup(segment->text, segment->length);
-      new_segment->length = segment->length;
-      new_segment->offset = segment->offset;
+      first = inf_text_chunk_segment_join(
+        first,
+        inf_text_chunk_segment_ref(text->root)
+      );
 
-      g_sequence_append(self->segments, new_segment);
+      self->root = inf_text_chunk_segment_join(first, second);
     }
-
-    self->length += text->length;
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -995,178 +2492,31 @@ inf_text_chunk_erase(InfTextChunk* self,
                      guint begin,
                      guint length)
 {
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
-  GSequenceIter* beyond;
-  gsize first_index;
-  gsize last_index;
   InfTextChunkSegment* first;
-  InfTextChunkSegment* last;
+  InfTextChunkSegment* second;
+  InfTextChunkSegment* erased;
+  gboolean done;
 
   g_return_if_fail(self != NULL);
-  g_return_if_fail(begin + length <= self->length);
-
-  if(self->length > 0 && length > 0)
-  {
-    first_iter = inf_text_chunk_get_segment(self, begin, &first_index);
-    last_iter = inf_text_chunk_get_segment(self, begin + length, &last_index);
-
-    first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-    last = (InfTextChunkSegment*)g_sequence_get(last_iter);
-
-    if(begin > 0 && begin + length < self->length)
-    {
-      if(first_index == 0)
-      {
-        g_assert(first_iter != g_sequence_get_end_iter(self->segments));
-        first_iter = g_sequence_iter_prev(first_iter);
-        first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-        first_index = first->length;
-      }
-
-      if(first->author == last->author)
-      {
-        /* Can merge */
-        if(first == last)
-        {
-          /* Remove within a segment */
-          g_memmove(
-            first->text + first_index,
-            first->text + last_index,
-            first->length - last_index
-          );
-
-          first->length -= (last_index - first_index);
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          if(first->length < first_index + last->length - last_index)
-          {
-            first->text = g_realloc(
-              first->text,
-              first_index + last->length - last_index
-            );
-          }
-
-          first->length = first_index + last->length - last_index;
-
-          memcpy(
-            first->text + first_index,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last_iter = g_sequence_iter_next(last_iter);
-          beyond = last_iter;
-        }
-      }
-      else
-      {
-        /* This could only happen if these are the first or last segment,
-         * of the whole chunk, respectively, which they are not
-         * (as checked above). */
-        g_assert(first_index > 0);
-        g_assert(last_index < last->length);
-        
-        /* Erase from border segments */
-        first->length = first_index;
-
-        if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-        }
-
-        last->length -= last_index;
-        last->offset = begin;
-
-        /* We already adjusted offset of last, so only adjust behind */
-        beyond = g_sequence_iter_next(last_iter);
-      }
-
-      /* Keep first alive, we merged stuff into it */
-      first_iter = g_sequence_iter_next(first_iter);
-    }
-    else
-    {
-      if(begin == 0 && length == self->length)
-      {
-        /* Erase everything */
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
-
-        beyond = last_iter;
-      }
-      else if(begin == 0)
-      {
-        g_assert(last_index < last->length);
-
-        /* Erase from beginning */
-        if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last->length -= last_index;
-          last->offset = 0;
-
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          /* First segments are completely removed */
-          beyond = last_iter;
-        }
-      }
-      else
-      {
-        /* Erase until end */
-
-        /* This could only be possible in the last segment, but then we
-         * would erase 0-length, which is a special case we would have
-         * catched elsewhere. */
-        g_assert(first_index < first->length);
+  g_return_if_fail(begin + length <= inf_text_chunk_get_length(self));
 
+  if(length == 0)
+    return;
 
-        if(first_index > 0)
-        {
-          /* Cannot erase whole first chunk */
-          first->length = first_index;
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
+  /* Erasing within a single segment does not change the tree structure */
+  done = inf_text_chunk_segment_erase(self, &self->root, begin, length);
 
-        beyond = last_iter;
-      }
-    }
-
-    /* first_iter and last_iter have been adjusted so that we have to
-     * remove [first_iter, last_iter). */
-
-    /* segments are freed through the sequence's destroy function */
-    g_sequence_remove_range(first_iter, last_iter);
+  if(done == FALSE)
+  {
+    inf_text_chunk_segment_split(self, self->root, begin, &first, &second);
+    inf_text_chunk_segment_split(self, second, length, &erased, &second);
+    inf_text_chunk_segment_unref(erased);
 
-    /* adjust offsets */
-    for(first_iter = beyond;
-        first_iter != g_sequence_get_end_iter(self->segments);
-        first_iter = g_sequence_iter_next(first_iter))
-    {
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      first->offset -= length;
-    }
+    /* The segments adjacent to the erased range might have the same
+     * author, in which case join merges them. */
+    self->root = inf_text_chunk_segment_join(first, second);
   }
 
-  self->length -= length;
-
 #ifdef CHUNK_CHECK_INTEGRITY
   g_assert(inf_text_chunk_check_integrity(self) == TRUE);
 #endif
@@ -1188,36 +2538,14 @@ gpointer
 inf_text_chunk_get_text(InfTextChunk* self,
                         gsize* length)
 {
-  GSequenceIter* iter;
-  InfTextChunkSegment* segment;
   gsize bytes;
-  gsize cur;
   gchar* result;
-  
-  g_return_val_if_fail(self != NULL, NULL);
-  bytes = 0;
 
-  /* First pass, determine size */
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    bytes += segment->length;
-  }
+  g_return_val_if_fail(self != NULL, NULL);
 
-  /* Second pass, copy */
+  bytes = inf_text_chunk_segment_subtree_bytes(self->root);
   result = g_malloc(bytes);
-  cur = 0;
-
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    memcpy(result + cur, segment->text, segment->length);
-    cur += segment->length;
-  }
+  inf_text_chunk_segment_get_text(self->root, result);
 
   if(length != NULL) *length = bytes;
   return result;
@@ -1237,41 +2565,46 @@ gboolean
 inf_text_chunk_equal(InfTextChunk* self,
                      InfTextChunk* other)
 {
-  GSequenceIter* iter1;
-  GSequenceIter* iter2;
+  GPtrArray* segments1;
+  GPtrArray* segments2;
   InfTextChunkSegment* segment1;
   InfTextChunkSegment* segment2;
+  gboolean result;
+  guint i;
 
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(other != NULL, FALSE);
   g_return_val_if_fail(self->encoding == other->encoding, FALSE);
 
-  iter1 = g_sequence_get_begin_iter(self->segments);
-  iter2 = g_sequence_get_begin_iter(other->segments);
+  if(self->root == other->root)
+    return TRUE;
 
-  while(iter1 != g_sequence_get_end_iter(self->segments) &&
-        iter2 != g_sequence_get_end_iter(other->segments))
+  if(inf_text_chunk_segment_subtree_bytes(self->root) !=
+     inf_text_chunk_segment_subtree_bytes(other->root))
   {
-    segment1 = (InfTextChunkSegment*)g_sequence_get(iter1);
-    segment2 = (InfTextChunkSegment*)g_sequence_get(iter2);
-
-    if(segment1->length != segment2->length)
-      return FALSE;
-
-    if(memcmp(segment1->text, segment2->text, segment1->length) != 0)
-      return FALSE;
-
-    iter1 = g_sequence_iter_next(iter1);
-    iter2 = g_sequence_iter_next(iter2);
+    return FALSE;
   }
 
-  if(iter1 != g_sequence_get_end_iter(self->segments) ||
-     iter2 != g_sequence_get_end_iter(other->segments))
+  segments1 = g_ptr_array_new();
+  segments2 = g_ptr_array_new();
+  inf_text_chunk_segment_flatten(self->root, segments1);
+  inf_text_chunk_segment_flatten(other->root, segments2);
+
+  result = (segments1->len == segments2->len);
+  for(i = 0; i < segments1->len && result == TRUE; ++i)
   {
-    return FALSE;
+    segment1 = (InfTextChunkSegment*)g_ptr_array_index(segments1, i);
+    segment2 = (InfTextChunkSegment*)g_ptr_array_index(segments2, i);
+
+    if(segment1->bytes != segment2->bytes)
+      result = FALSE;
+    else if(memcmp(segment1->text, segment2->text, segment1->bytes) != 0)
+      result = FALSE;
   }
 
-  return TRUE;
+  g_ptr_array_free(segments1, TRUE);
+  g_ptr_array_free(segments2, TRUE);
+  return result;
 }
 
 /**
@@ -1292,11 +2625,11 @@ inf_text_chunk_iter_init_begin(InfTextChunk* self,
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(self->length > 0)
+  if(self->root != NULL)
   {
     iter->chunk = self;
-    iter->first = g_sequence_get_begin_iter(self->segments);
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->segment = inf_text_chunk_segment_first(self->root);
+    iter->offset = 0;
     return TRUE;
   }
   else
@@ -1320,14 +2653,18 @@ gboolean
 inf_text_chunk_iter_init_end(InfTextChunk* self,
                              InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* segment;
+
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(self->length > 0)
+  if(self->root != NULL)
   {
+    segment = inf_text_chunk_segment_last(self->root);
+
     iter->chunk = self;
-    iter->second = g_sequence_get_end_iter(self->segments);
-    iter->first = g_sequence_iter_prev(iter->second);
+    iter->segment = segment;
+    iter->offset = self->root->subtree_length - segment->length;
     return TRUE;
   }
   else
@@ -1348,12 +2685,22 @@ inf_text_chunk_iter_init_end(InfTextChunk* self,
 gboolean
 inf_text_chunk_iter_next(InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* segment;
+  guint next;
+
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_end(iter->second) == FALSE)
+  segment = (InfTextChunkSegment*)iter->segment;
+  next = iter->offset + segment->length;
+
+  if(next < inf_text_chunk_get_length(iter->chunk))
   {
-    iter->first = iter->second;
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->segment = inf_text_chunk_get_segment(
+      iter->chunk,
+      next,
+      &iter->offset
+    );
+
     return TRUE;
   }
   else
@@ -1376,10 +2723,14 @@ inf_text_chunk_iter_prev(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_begin(iter->first) == FALSE)
+  if(iter->offset > 0)
   {
-    iter->second = iter->first;
-    iter->first = g_sequence_iter_prev(iter->first);
+    iter->segment = inf_text_chunk_get_segment(
+      iter->chunk,
+      iter->offset - 1,
+      &iter->offset
+    );
+
     return TRUE;
   }
   else
@@ -1401,7 +2752,7 @@ gconstpointer
 inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, NULL);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->text;
+  return ((InfTextChunkSegment*)iter->segment)->text;
 }
 
 /**
@@ -1416,12 +2767,8 @@ inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-  return first->offset;
+  return iter->offset;
 }
 
 /**
@@ -1435,22 +2782,8 @@ inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_length(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-  InfTextChunkSegment* second;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  if(g_sequence_iter_is_end(iter->second) == TRUE)
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    return iter->chunk->length - first->offset;
-  }
-  else
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    second = (InfTextChunkSegment*)g_sequence_get(iter->second);
-    return second->offset - first->offset;
-  }
+  return ((InfTextChunkSegment*)iter->segment)->length;
 }
 
 /**
@@ -1465,7 +2798,7 @@ gsize
 inf_text_chunk_iter_get_bytes(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->length;
+  return ((InfTextChunkSegment*)iter->segment)->bytes;
 }
 
 /**
@@ -1480,7 +2813,7 @@ guint
 inf_text_chunk_iter_get_author(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->author;
+  return ((InfTextChunkSegment*)iter->segment)->author;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -52,8 +52,8 @@ typedef struct _InfTextChunkIter InfTextChunkIter;
 struct _InfTextChunkIter {
   /*< private >*/
   InfTextChunk* chunk;
-  GSequenceIter* first;
-  GSequenceIter* second;
+  gpointer segment;
+  guint offset;
 };
 
 GType
@@ -83,6 +83,17 @@ inf_text_chunk_get_encoding(InfTextChunk* self);
 guint
 inf_text_chunk_get_length(InfTextChunk* self);
 
+guint
+inf_text_chunk_get_line_count(InfTextChunk* self);
+
+guint
+inf_text_chunk_offset_to_line(InfTextChunk* self,
+                              guint offset);
+
+guint
+inf_text_chunk_line_to_offset(InfTextChunk* self,
+                              guint line);
+
 InfTextChunk*
 inf_text_chunk_substring(InfTextChunk* self,
                          guint begin,
@@ -171,6 +171,28 @@ inf_text_default_buffer_get_length(InfTextBuffer* buffer)
   return inf_text_chunk_get_length(priv->chunk);
 }
 
+static guint
+inf_text_default_buffer_buffer_offset_to_line(InfTextBuffer* buffer,
+                                              guint pos)
+{
+  InfTextDefaultBufferPrivate* priv;
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+  return inf_text_chunk_offset_to_line(priv->chunk, pos);
+}
+
+static guint
+inf_text_default_buffer_buffer_line_to_offset(InfTextBuffer* buffer,
+                                              guint line)
+{
+  InfTextDefaultBufferPrivate* priv;
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+
+  if(line >= inf_text_chunk_get_line_count(priv->chunk))
+    return inf_text_chunk_get_length(priv->chunk);
+
+  return inf_text_chunk_line_to_offset(priv->chunk, line);
+}
+
 static InfTextChunk*
 inf_text_default_buffer_buffer_get_slice(InfTextBuffer* buffer,
                                          guint pos,
@@ -377,6 +399,8 @@ inf_text_default_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->iter_get_author = inf_text_default_buffer_buffer_iter_get_author;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
+  iface->offset_to_line = inf_text_default_buffer_buffer_offset_to_line;
+  iface->line_to_offset = inf_text_default_buffer_buffer_line_to_offset;
 }
 
 /**
@@ -40,7 +40,9 @@ enum {
   PROP_CHUNK
 };
 
-#define INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, InfTextDefaultInsertOperationPrivate))
+/* Operations are created and destroyed very often during transformation,
+ * so avoid the type lookup of G_TYPE_INSTANCE_GET_PRIVATE. */
+#define INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(obj) (inf_text_default_insert_operation_get_instance_private((InfTextDefaultInsertOperation*)(obj)))
 
 static void inf_text_default_insert_operation_operation_iface_init(InfAdoptedOperationInterface* iface);
 static void inf_text_default_insert_operation_insert_operation_iface_init(InfTextInsertOperationInterface* iface);
@@ -49,6 +51,26 @@ G_DEFINE_TYPE_WITH_CODE(InfTextDefaultInsertOperation, inf_text_default_insert_o
   G_IMPLEMENT_INTERFACE(INF_ADOPTED_TYPE_OPERATION, inf_text_default_insert_operation_operation_iface_init)
   G_IMPLEMENT_INTERFACE(INF_TEXT_TYPE_INSERT_OPERATION, inf_text_default_insert_operation_insert_operation_iface_init))
 
+/* Creates a new operation without going through the GObject property
+ * machinery. Takes ownership of chunk. */
+static InfTextDefaultInsertOperation*
+inf_text_default_insert_operation_new_internal(guint position,
+                                               InfTextChunk* chunk)
+{
+  InfTextDefaultInsertOperation* operation;
+  InfTextDefaultInsertOperationPrivate* priv;
+
+  operation = INF_TEXT_DEFAULT_INSERT_OPERATION(
+    g_object_new(INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, NULL)
+  );
+
+  priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
+  priv->position = position;
+  priv->chunk = chunk;
+
+  return operation;
+}
+
 static void
 inf_text_default_insert_operation_init(
   InfTextDefaultInsertOperation* operation)
@@ -185,11 +207,9 @@ inf_text_default_insert_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_insert_operation_new_internal(
+      priv->position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -270,18 +290,14 @@ inf_text_default_insert_operation_transform_position(
   guint position)
 {
   InfTextDefaultInsertOperationPrivate* priv;
-  GObject* result;
-
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", position,
-    "chunk", priv->chunk,
-    NULL
+  return INF_TEXT_INSERT_OPERATION(
+    inf_text_default_insert_operation_new_internal(
+      position,
+      inf_text_chunk_copy(priv->chunk)
+    )
   );
-
-  return INF_TEXT_INSERT_OPERATION(result);
 }
 
 static void
@@ -362,18 +378,12 @@ InfTextDefaultInsertOperation*
 inf_text_default_insert_operation_new(guint pos,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", pos,
-    "chunk", chunk,
-    NULL
+  return inf_text_default_insert_operation_new_internal(
+    pos,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
 }
 
 /**
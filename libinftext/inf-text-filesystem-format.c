@@ -30,18 +30,46 @@
  * implementing a #InfdNotePlugin to handle #InfTextSession<!-- -->s. These
  * functions implement reading and writing the content of an #InfTextSession
  * to an XML file in the storage.
+ *
+ * Writing the whole document on every save takes time proportional to the
+ * size of the document. #InfTextFilesystemJournal instead records the
+ * changes made to a session, and appends them to a journal next to the XML
+ * file on every write. The XML file is only rewritten, as a snapshot, once
+ * the journal has grown larger than the document. When reading the
+ * session, the journal is applied on top of the snapshot.
  */
 
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-chunk.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
 #include <string.h>
+#include <errno.h>
 
-typedef struct _InfTextFilesystemFormatWriteData {
-  xmlNodePtr root;
-  GHashTable* encountered_authors;
-} InfTextFilesystemFormatWriteData;
+/* The journal is stored next to the snapshot. The identifier does not start
+ * with "Inf", so that it does not show up in the directory. */
+#define INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER "journal"
+#define INF_TEXT_FILESYSTEM_JOURNAL_MAGIC "inf-text-journal"
+/* Journals smaller than this are never compacted */
+#define INF_TEXT_FILESYSTEM_JOURNAL_COMPACT_SIZE 65536
+
+typedef struct _InfTextFilesystemFormatUser {
+  guint id;
+  gchar* name;
+  gdouble hue;
+} InfTextFilesystemFormatUser;
+
+/* A copy of everything that is written to disk, so that the XML document
+ * can be created in a worker thread while the session goes on. */
+typedef struct _InfTextFilesystemFormatSnapshot {
+  InfTextChunk* chunk;
+  GArray* users;
+  /* The journal which continues this snapshot, if any */
+  gchar* journal_id;
+  guint64 journal_seq;
+} InfTextFilesystemFormatSnapshot;
 
 static GQuark
 inf_text_filesystem_format_error_quark()
@@ -256,256 +284,121 @@ inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
 }
 
 static void
-inf_text_filesystem_format_write_foreach_user_func(InfUser* user,
-                                                   gpointer user_data)
+inf_text_filesystem_format_snapshot_foreach_user_func(InfUser* user,
+                                                      gpointer user_data)
 {
-  InfTextFilesystemFormatWriteData* data;
-  gpointer user_id;
-  xmlNodePtr node;
-
-  data = (InfTextFilesystemFormatWriteData*)user_data;
-  user_id = GUINT_TO_POINTER(inf_user_get_id(user));
+  InfTextFilesystemFormatSnapshot* snapshot;
+  InfTextFilesystemFormatUser entry;
 
-  /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
-  if(g_hash_table_lookup(data->encountered_authors, user_id) != NULL)
-  {
-    node = xmlNewChild(data->root, NULL, (const xmlChar*)"user", NULL);
+  snapshot = (InfTextFilesystemFormatSnapshot*)user_data;
 
-    inf_xml_util_set_attribute_uint(node, "id", inf_user_get_id(user));
-    inf_xml_util_set_attribute(node, "name", inf_user_get_name(user));
-    inf_xml_util_set_attribute_double(
-      node,
-      "hue",
-      inf_text_user_get_hue(INF_TEXT_USER(user))
-    );
-  }
+  entry.id = inf_user_get_id(user);
+  entry.name = g_strdup(inf_user_get_name(user));
+  entry.hue = inf_text_user_get_hue(INF_TEXT_USER(user));
+  g_array_append_val(snapshot->users, entry);
 }
 
-/**
- * inf_text_filesystem_format_read:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path to retrieve the session from.
- * @user_table: An empty #InfUserTable to use as the new session's user table.
- * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Reads a text session from @path in @storage. The file is expected to have
- * been saved with inf_text_filesystem_format_write() before. The @user_table
- * parameter should be an empty user table that will be used for the session,
- * and the @buffer parameter should be an empty #InfTextBuffer, and the
- * document will be written into this buffer. If the function succeeds, the
- * user table and buffer can be used to create an #InfTextSession with
- * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
-                                const gchar* path,
-                                InfUserTable* user_table,
-                                InfTextBuffer* buffer,
-                                GError** error)
+static InfTextFilesystemFormatSnapshot*
+inf_text_filesystem_format_snapshot_new(InfUserTable* user_table,
+                                        InfTextBuffer* buffer)
 {
-  FILE* stream;
-  gchar* full_path;
-  gchar* uri;
-
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  xmlNodePtr root;
-  xmlNodePtr child;
-  gboolean result;
-
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
-
-  /* TODO: Use a SAX parser for better performance */
-  full_path = NULL;
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "r",
-    &full_path,
-    error
+  InfTextFilesystemFormatSnapshot* snapshot;
+  snapshot = g_slice_new(InfTextFilesystemFormatSnapshot);
+
+  /* Text chunks share their content copy-on-write, so this is cheap even
+   * for large documents, and the copy can be used in another thread. */
+  snapshot->chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
   );
 
-  if(stream == NULL)
-  {
-    g_free(full_path);
-    return FALSE;
-  }
-
-  uri = g_filename_to_uri(full_path, NULL, error);
-  g_free(full_path);
+  snapshot->users =
+    g_array_new(FALSE, FALSE, sizeof(InfTextFilesystemFormatUser));
 
-  if(uri == NULL)
-    return FALSE;
+  snapshot->journal_id = NULL;
+  snapshot->journal_seq = 0;
 
-  doc = xmlReadIO(
-    inf_text_filesystem_format_read_read_func,
-    inf_text_filesystem_format_read_close_func,
-    stream,
-    uri,
-    "UTF-8",
-    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_snapshot_foreach_user_func,
+    snapshot
   );
 
-  g_free(uri);
+  return snapshot;
+}
 
-  if(doc == NULL)
-  {
-    xmlerror = xmlGetLastError();
+static void
+inf_text_filesystem_format_snapshot_free(gpointer data)
+{
+  InfTextFilesystemFormatSnapshot* snapshot;
+  guint i;
 
-    g_set_error(
-      error,
-      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
-      xmlerror->code,
-      _("Error parsing XML in file \"%s\": [%d]: %s"),
-      path,
-      xmlerror->line,
-      xmlerror->message
-    );
+  snapshot = (InfTextFilesystemFormatSnapshot*)data;
 
-    result = FALSE;
-  }
-  else
+  for(i = 0; i < snapshot->users->len; ++i)
   {
-    root = xmlDocGetRootElement(doc);
-    if(strcmp((const char*)root->name, "inf-text-session") != 0)
-    {
-      g_set_error(
-        error,
-        inf_text_filesystem_format_error_quark(),
-        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
-        _("Error processing file \"%s\": %s"),
-        path,
-        _("The document is not a text session")
-      );
-
-      result = FALSE;
-    }
-    else
-    {
-      for(child = root->children; child != NULL; child = child->next)
-      {
-        if(child->type != XML_ELEMENT_NODE)
-          continue;
-
-        if(strcmp((const char*)child->name, "user") == 0)
-        {
-          if(!inf_text_filesystem_format_read_user(user_table, child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-        else if(strcmp((const char*)child->name, "buffer") == 0)
-        {
-          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
-                                                     child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-      }
-
-      if(child == NULL)
-        result = TRUE;
-    }
-
-    xmlFreeDoc(doc);
+    g_free(
+      g_array_index(snapshot->users, InfTextFilesystemFormatUser, i).name
+    );
   }
 
-  return result;
+  g_array_free(snapshot->users, TRUE);
+  inf_text_chunk_free(snapshot->chunk);
+  g_free(snapshot->journal_id);
+  g_slice_free(InfTextFilesystemFormatSnapshot, snapshot);
 }
 
-/**
- * inf_text_filesystem_format_write:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path where to write the session to.
- * @user_table: The #InfUserTable to write.
- * @buffer: The #InfTextBuffer to write.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Writes the given user table and buffer into the filesystem storage at
- * @path. If successful, the session can then be read back with
- * inf_text_filesystem_format_read(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
-                                 const gchar* path,
-                                 InfUserTable* user_table,
-                                 InfTextBuffer* buffer,
-                                 GError** error)
+/* Creates the XML document for a snapshot. This does not access the session
+ * anymore and can therefore run in a worker thread. */
+static xmlDocPtr
+inf_text_filesystem_format_snapshot_to_xml(gpointer data,
+                                           GError** error)
 {
-  InfTextBufferIter* iter;
+  InfTextFilesystemFormatSnapshot* snapshot;
+  InfTextFilesystemFormatUser* user;
+  GHashTable* encountered_authors;
+  InfTextChunkIter iter;
+  xmlNodePtr root;
   xmlNodePtr buffer_node;
   xmlNodePtr segment_node;
+  xmlNodePtr node;
+  xmlDocPtr doc;
 
+  const gchar* encoding;
   guint author;
-  gchar* content;
+  gconstpointer content;
   gsize bytes;
   gchar* converted;
   gsize converted_bytes;
+  gchar* seq_str;
+  guint i;
 
-  FILE* stream;
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  gboolean is_utf8;
-
-  InfTextFilesystemFormatWriteData data;
-
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
-
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "w",
-    NULL,
-    error
-  );
-
-  if(stream == NULL)
-    return FALSE;
+  snapshot = (InfTextFilesystemFormatSnapshot*)data;
+  encoding = inf_text_chunk_get_encoding(snapshot->chunk);
 
-  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
-  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
+  if(snapshot->journal_id != NULL)
+  {
+    seq_str = g_strdup_printf("%" G_GUINT64_FORMAT, snapshot->journal_seq);
+    inf_xml_util_set_attribute(root, "journal", snapshot->journal_id);
+    inf_xml_util_set_attribute(root, "journal-seq", seq_str);
+    g_free(seq_str);
+  }
+  encountered_authors = g_hash_table_new(NULL, NULL);
 
   buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  if(iter != NULL)
+  if(inf_text_chunk_iter_init_begin(snapshot->chunk, &iter))
   {
     do
     {
-      author = inf_text_buffer_iter_get_author(buffer, iter);
-      content = inf_text_buffer_iter_get_text(buffer, iter);
-      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+      author = inf_text_chunk_iter_get_author(&iter);
+      content = inf_text_chunk_iter_get_text(&iter);
+      bytes = inf_text_chunk_iter_get_bytes(&iter);
 
       /* TODO: Use g_hash_table_add with glib 2.32 */
       g_hash_table_insert(
-        data.encountered_authors,
+        encountered_authors,
         GUINT_TO_POINTER(author),
         GUINT_TO_POINTER(author)
       );
@@ -519,11 +412,10 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
 
       inf_xml_util_set_attribute_uint(segment_node, "author", author);
 
-      if(is_utf8)
+      if(strcmp(encoding, "UTF-8") == 0)
       {
         /* Buffer is UTF-8, no conversion necessary */
         inf_xml_util_add_child_text(segment_node, content, bytes);
-        g_free(content);
       }
       else
       {
@@ -532,70 +424,1873 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
           content,
           bytes,
           "UTF-8",
-          inf_text_buffer_get_encoding(buffer),
+          encoding,
           NULL,
           &converted_bytes,
           error
         );
 
-        g_free(content);
-
         if(converted == NULL)
         {
           xmlFreeNode(buffer_node);
-          xmlFreeNode(data.root);
-          g_hash_table_destroy(data.encountered_authors);
-          infd_filesystem_storage_stream_close(stream);
-          return FALSE;
+          xmlFreeNode(root);
+          g_hash_table_destroy(encountered_authors);
+          return NULL;
         }
 
         inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
         g_free(converted);
       }
-    } while(inf_text_buffer_iter_next(buffer, iter));
-
-    inf_text_buffer_destroy_iter(buffer, iter);
+    } while(inf_text_chunk_iter_next(&iter));
   }
 
   /* After we wrote the buffer, now write the user table, but only for those
    * users that have contributed to the document. The others we drop, to
    * avoid cluttering the user table too much. */
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_filesystem_format_write_foreach_user_func,
-    &data
-  );
+  for(i = 0; i < snapshot->users->len; ++i)
+  {
+    user = &g_array_index(snapshot->users, InfTextFilesystemFormatUser, i);
+
+    /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
+    if(g_hash_table_lookup(encountered_authors, GUINT_TO_POINTER(user->id)))
+    {
+      node = xmlNewChild(root, NULL, (const xmlChar*)"user", NULL);
+
+      inf_xml_util_set_attribute_uint(node, "id", user->id);
+      inf_xml_util_set_attribute(node, "name", user->name);
+      inf_xml_util_set_attribute_double(node, "hue", user->hue);
+    }
+  }
 
-  g_hash_table_destroy(data.encountered_authors);
+  g_hash_table_destroy(encountered_authors);
 
   /* Write the buffer after the users */
-  xmlAddChild(data.root, buffer_node);
+  xmlAddChild(root, buffer_node);
 
   doc = xmlNewDoc((const xmlChar*)"1.0");
-  xmlDocSetRootElement(doc, data.root);
+  xmlDocSetRootElement(doc, root);
+  return doc;
+}
+
+static gboolean
+inf_text_filesystem_journal_parse_uint64(const gchar* str,
+                                         guint64* value)
+{
+  gchar* endptr;
+
+  if(!g_ascii_isdigit(*str))
+    return FALSE;
+
+  *value = g_ascii_strtoull(str, &endptr, 10);
+  return *endptr == '\0';
+}
+
+/* FNV-1a, to detect records which have not been written completely */
+static guint32
+inf_text_filesystem_journal_checksum(guint32 checksum,
+                                     const gchar* data,
+                                     gsize len)
+{
+  gsize i;
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
+  for(i = 0; i < len; ++i)
   {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
+    checksum ^= (guchar)data[i];
+    checksum *= 16777619u;
+  }
+
+  return checksum;
+}
 
-    g_set_error_literal(
+static void
+inf_text_filesystem_journal_set_invalid_error(GError** error,
+                                              const gchar* path,
+                                              const gchar* message)
+{
+  g_set_error(
+    error,
+    inf_text_filesystem_format_error_quark(),
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+    _("Error processing journal of \"%s\": %s"),
+    path,
+    message
+  );
+}
+
+/* Applies a single record of the journal. first and second are the two
+ * fields following the sequence number in the record header. */
+static gboolean
+inf_text_filesystem_journal_apply(InfUserTable* user_table,
+                                  InfTextBuffer* buffer,
+                                  const gchar* path,
+                                  gchar type,
+                                  const gchar* first,
+                                  const gchar* second,
+                                  const gchar* payload,
+                                  gsize bytes,
+                                  GError** error)
+{
+  guint64 fields[2];
+  InfUser* user;
+  gchar* text;
+  gchar* converted;
+  gsize converted_bytes;
+  gchar* endptr;
+  gdouble hue;
+
+  hue = 0.0;
+  fields[1] = 0;
+
+  if(!inf_text_filesystem_journal_parse_uint64(first, &fields[0]))
+  {
+    inf_text_filesystem_journal_set_invalid_error(
       error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
+      path,
+      _("Record contains an invalid number")
     );
 
     return FALSE;
   }
 
-  infd_filesystem_storage_stream_close(stream);
-  xmlFreeDoc(doc);
-  return TRUE;
+  if(type == 'u')
+  {
+    hue = g_ascii_strtod(second, &endptr);
+    if(endptr == second || *endptr != '\0' || fields[0] > G_MAXUINT)
+    {
+      inf_text_filesystem_journal_set_invalid_error(
+        error,
+        path,
+        _("Record contains an invalid number")
+      );
+
+      return FALSE;
+    }
+  }
+  else if(!inf_text_filesystem_journal_parse_uint64(second, &fields[1]) ||
+          (type == 'i' && fields[1] > G_MAXUINT))
+  {
+    inf_text_filesystem_journal_set_invalid_error(
+      error,
+      path,
+      _("Record contains an invalid number")
+    );
+
+    return FALSE;
+  }
+
+  if(type != 'e' && !g_utf8_validate(payload, bytes, NULL))
+  {
+    inf_text_filesystem_journal_set_invalid_error(
+      error,
+      path,
+      _("Record is not valid UTF-8")
+    );
+
+    return FALSE;
+  }
+
+  switch(type)
+  {
+  case 'u':
+    /* The user might have been recorded before already, or be contained
+     * in the snapshot. */
+    if(inf_user_table_lookup_user_by_id(user_table, fields[0]) != NULL)
+      return TRUE;
+
+    text = g_strndup(payload, bytes);
+    if(inf_user_table_lookup_user_by_name(user_table, text) != NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+        _("User with name \"%s\" exists already"),
+        text
+      );
+
+      g_free(text);
+      return FALSE;
+    }
+
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", (guint)fields[0],
+        "name", text,
+        "hue", hue,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+    g_free(text);
+    return TRUE;
+  case 'i':
+    if(fields[0] > inf_text_buffer_get_length(buffer))
+    {
+      inf_text_filesystem_journal_set_invalid_error(
+        error,
+        path,
+        _("Insertion position is out of range")
+      );
+
+      return FALSE;
+    }
+
+    user = NULL;
+    if(fields[1] != 0)
+    {
+      user = inf_user_table_lookup_user_by_id(user_table, fields[1]);
+      if(user == NULL)
+      {
+        g_set_error(
+          error,
+          inf_text_filesystem_format_error_quark(),
+          INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+          _("User with ID \"%u\" does not exist"),
+          (guint)fields[1]
+        );
+
+        return FALSE;
+      }
+    }
+
+    if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0)
+    {
+      inf_text_buffer_insert_text(
+        buffer,
+        fields[0],
+        payload,
+        bytes,
+        g_utf8_strlen(payload, bytes),
+        user
+      );
+    }
+    else
+    {
+      converted = g_convert(
+        payload,
+        bytes,
+        inf_text_buffer_get_encoding(buffer),
+        "UTF-8",
+        NULL,
+        &converted_bytes,
+        error
+      );
+
+      if(converted == NULL)
+        return FALSE;
+
+      inf_text_buffer_insert_text(
+        buffer,
+        fields[0],
+        converted,
+        converted_bytes,
+        g_utf8_strlen(payload, bytes),
+        user
+      );
+
+      g_free(converted);
+    }
+
+    return TRUE;
+  case 'e':
+    if(fields[0] > inf_text_buffer_get_length(buffer) ||
+       fields[1] > inf_text_buffer_get_length(buffer) - fields[0])
+    {
+      inf_text_filesystem_journal_set_invalid_error(
+        error,
+        path,
+        _("Erased range is out of range")
+      );
+
+      return FALSE;
+    }
+
+    inf_text_buffer_erase_text(buffer, fields[0], fields[1], NULL);
+    return TRUE;
+  default:
+    g_assert_not_reached();
+    return FALSE;
+  }
+}
+
+/* Replays the journal continuing a snapshot which has been read into
+ * user_table and buffer already. id is the journal ID stored in the
+ * snapshot, and *seq the sequence number of the last change contained in
+ * it. Records are applied up to the first one that is incomplete or
+ * damaged, which is what remains if the server went down while appending
+ * to the journal. On return, *seq is set to the sequence number of the last
+ * change applied, and *size to the length of the intact part of the
+ * journal, or to 0 if there is no journal belonging to the snapshot. If
+ * repair is TRUE, a damaged tail is cut off the journal file, so that
+ * further records can be appended to it. */
+static gboolean
+inf_text_filesystem_journal_replay(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   InfUserTable* user_table,
+                                   InfTextBuffer* buffer,
+                                   const gchar* id,
+                                   guint64* seq,
+                                   gsize* size,
+                                   gboolean repair,
+                                   GError** error)
+{
+  gchar* full_path;
+  gchar* contents;
+  gsize length;
+  GError* local_error;
+
+  gchar* header;
+  gsize offset;
+  const gchar* line;
+  const gchar* newline;
+  const gchar* last_space;
+  gchar* line_copy;
+  gchar** tokens;
+  guint n_tokens;
+  guint64 record_seq;
+  guint64 prev_seq;
+  guint64 bytes;
+  guint64 checksum;
+  const gchar* payload;
+  gsize end;
+  gchar* endptr;
+  gboolean valid;
+  gboolean result;
+
+  *size = 0;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  local_error = NULL;
+  if(!g_file_get_contents(full_path, &contents, &length, &local_error))
+  {
+    g_free(full_path);
+
+    /* The snapshot has been written, but the journal not yet */
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  /* A journal with a different ID belongs to another snapshot, for example
+   * if the snapshot has been replaced but the journal not yet. */
+  header = g_strdup_printf("%s %s\n", INF_TEXT_FILESYSTEM_JOURNAL_MAGIC, id);
+  offset = strlen(header);
+  if(length < offset || memcmp(contents, header, offset) != 0)
+  {
+    g_free(header);
+    g_free(contents);
+    g_free(full_path);
+    return TRUE;
+  }
+
+  g_free(header);
+
+  prev_seq = 0;
+  result = TRUE;
+
+  while(offset < length)
+  {
+    line = contents + offset;
+    newline = memchr(line, '\n', length - offset);
+    if(newline == NULL)
+      break;
+
+    line_copy = g_strndup(line, newline - line);
+    tokens = g_strsplit(line_copy, " ", 0);
+    n_tokens = g_strv_length(tokens);
+
+    valid = FALSE;
+    record_seq = 0;
+    bytes = 0;
+    payload = NULL;
+    end = newline + 1 - contents;
+
+    /* "<type> <seq> <field> <field> [<bytes>] <checksum>", followed by
+     * <bytes> bytes of payload and a newline for user and insert
+     * records. */
+    if(n_tokens >= 5 && strlen(tokens[0]) == 1 &&
+       inf_text_filesystem_journal_parse_uint64(tokens[1], &record_seq) &&
+       (prev_seq == 0 || record_seq == prev_seq + 1))
+    {
+      switch(tokens[0][0])
+      {
+      case 'u':
+      case 'i':
+        valid = n_tokens == 6 &&
+          inf_text_filesystem_journal_parse_uint64(tokens[4], &bytes) &&
+          bytes < length - end &&
+          contents[end + bytes] == '\n';
+        break;
+      case 'e':
+        valid = n_tokens == 5;
+        break;
+      default:
+        break;
+      }
+    }
+
+    if(valid)
+    {
+      payload = contents + end;
+      checksum = g_ascii_strtoull(tokens[n_tokens - 1], &endptr, 16);
+      last_space = strrchr(line_copy, ' ');
+
+      valid = *endptr == '\0' &&
+        checksum == inf_text_filesystem_journal_checksum(
+          inf_text_filesystem_journal_checksum(
+            2166136261u,
+            line_copy,
+            last_space - line_copy
+          ),
+          payload,
+          bytes
+        );
+
+      if(tokens[0][0] != 'e')
+        end += bytes + 1;
+    }
+
+    /* Records up to the snapshot's sequence number are contained in the
+     * snapshot already. A gap means that records are missing. */
+    if(valid && record_seq > *seq && record_seq != *seq + 1)
+      valid = FALSE;
+
+    if(valid && record_seq > *seq)
+    {
+      result = inf_text_filesystem_journal_apply(
+        user_table,
+        buffer,
+        path,
+        tokens[0][0],
+        tokens[2],
+        tokens[3],
+        payload,
+        bytes,
+        error
+      );
+
+      *seq = record_seq;
+    }
+
+    g_strfreev(tokens);
+    g_free(line_copy);
+
+    if(!valid || !result)
+      break;
+
+    prev_seq = record_seq;
+    offset = end;
+  }
+
+  if(result == TRUE)
+  {
+    *size = offset;
+
+    if(repair && offset < length)
+    {
+      /* Cut off the incomplete record(s) */
+      result = g_file_set_contents(full_path, contents, offset, error);
+    }
+  }
+
+  g_free(contents);
+  g_free(full_path);
+  return result;
+}
+
+/* Reads the snapshot at path into user_table and buffer. If the snapshot is
+ * continued by a journal, then *journal_id is set to the ID of that journal
+ * and *journal_seq to the sequence number of the last change contained in
+ * the snapshot. Otherwise, *journal_id is set to NULL. */
+static gboolean
+inf_text_filesystem_format_read_snapshot(InfdFilesystemStorage* storage,
+                                         const gchar* path,
+                                         InfUserTable* user_table,
+                                         InfTextBuffer* buffer,
+                                         gchar** journal_id,
+                                         guint64* journal_seq,
+                                         GError** error)
+{
+  FILE* stream;
+  gchar* full_path;
+  gchar* uri;
+
+  xmlDocPtr doc;
+  xmlErrorPtr xmlerror;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  xmlChar* id;
+  xmlChar* seq;
+  gboolean result;
+
+  *journal_id = NULL;
+  *journal_seq = 0;
+
+  /* TODO: Use a SAX parser for better performance */
+  full_path = NULL;
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "InfText",
+    path,
+    "r",
+    &full_path,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_free(full_path);
+    return FALSE;
+  }
+
+  uri = g_filename_to_uri(full_path, NULL, error);
+  g_free(full_path);
+
+  if(uri == NULL)
+    return FALSE;
+
+  doc = xmlReadIO(
+    inf_text_filesystem_format_read_read_func,
+    inf_text_filesystem_format_read_close_func,
+    stream,
+    uri,
+    "UTF-8",
+    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  );
+
+  g_free(uri);
+
+  if(doc == NULL)
+  {
+    xmlerror = xmlGetLastError();
+
+    g_set_error(
+      error,
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
+      xmlerror->code,
+      _("Error parsing XML in file \"%s\": [%d]: %s"),
+      path,
+      xmlerror->line,
+      xmlerror->message
+    );
+
+    result = FALSE;
+  }
+  else
+  {
+    root = xmlDocGetRootElement(doc);
+    if(strcmp((const char*)root->name, "inf-text-session") != 0)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+        _("Error processing file \"%s\": %s"),
+        path,
+        _("The document is not a text session")
+      );
+
+      result = FALSE;
+    }
+    else
+    {
+      for(child = root->children; child != NULL; child = child->next)
+      {
+        if(child->type != XML_ELEMENT_NODE)
+          continue;
+
+        if(strcmp((const char*)child->name, "user") == 0)
+        {
+          if(!inf_text_filesystem_format_read_user(user_table, child, error))
+          {
+            g_prefix_error(error, _("Error processing file \"%s\": "), path);
+            result = FALSE;
+            break;
+          }
+        }
+        else if(strcmp((const char*)child->name, "buffer") == 0)
+        {
+          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
+                                                     child, error))
+          {
+            g_prefix_error(error, _("Error processing file \"%s\": "), path);
+            result = FALSE;
+            break;
+          }
+        }
+      }
+
+      if(child == NULL)
+      {
+        result = TRUE;
+
+        id = inf_xml_util_get_attribute(root, "journal");
+        if(id != NULL)
+        {
+          seq = inf_xml_util_get_attribute(root, "journal-seq");
+          if(seq == NULL ||
+             !inf_text_filesystem_journal_parse_uint64((const gchar*)seq,
+                                                       journal_seq))
+          {
+            g_set_error(
+              error,
+              inf_text_filesystem_format_error_quark(),
+              INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+              _("Error processing file \"%s\": %s"),
+              path,
+              _("The journal sequence number is invalid")
+            );
+
+            result = FALSE;
+          }
+          else
+          {
+            *journal_id = g_strdup((const gchar*)id);
+          }
+
+          if(seq != NULL) xmlFree(seq);
+          xmlFree(id);
+        }
+      }
+    }
+
+    xmlFreeDoc(doc);
+  }
+
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_read:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage. The file is expected to have
+ * been saved with inf_text_filesystem_format_write() or with a
+ * #InfTextFilesystemJournal before. In the latter case, the changes
+ * recorded in the journal are applied after the snapshot has been read.
+ * The @user_table parameter should be an empty user table that will be
+ * used for the session, and the @buffer parameter should be an empty
+ * #InfTextBuffer, and the document will be written into this buffer. If the
+ * function succeeds, the user table and buffer can be used to create an
+ * #InfTextSession with inf_text_session_new_with_user_table(). If the
+ * function fails, %FALSE is returned and @error is set.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                GError** error)
+{
+  gchar* journal_id;
+  guint64 journal_seq;
+  gsize journal_size;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  result = inf_text_filesystem_format_read_snapshot(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &journal_id,
+    &journal_seq,
+    error
+  );
+
+  if(result == TRUE && journal_id != NULL)
+  {
+    result = inf_text_filesystem_journal_replay(
+      storage,
+      path,
+      user_table,
+      buffer,
+      journal_id,
+      &journal_seq,
+      &journal_size,
+      FALSE,
+      error
+    );
+  }
+
+  g_free(journal_id);
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path. If successful, the session can then be read back with
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  InfTextFilesystemFormatSnapshot* snapshot;
+  xmlDocPtr doc;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  snapshot = inf_text_filesystem_format_snapshot_new(user_table, buffer);
+  doc = inf_text_filesystem_format_snapshot_to_xml(snapshot, error);
+  inf_text_filesystem_format_snapshot_free(snapshot);
+
+  if(doc == NULL)
+    return FALSE;
+
+  result = infd_filesystem_storage_write_xml_file(
+    storage,
+    "InfText",
+    path,
+    doc,
+    error
+  );
+
+  xmlFreeDoc(doc);
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the thread in which @func is to be called.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @func: (scope notified): Function to be called when the session has been
+ * written.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path, like inf_text_filesystem_format_write(), but without blocking.
+ * The function takes a snapshot of the user table and the buffer content,
+ * and then creates the XML document and writes it to disk in a worker
+ * thread. Changes made to the session afterwards are not written. See
+ * infd_filesystem_storage_write_xml_file_async() for details.
+ *
+ * Returns: (transfer none) (allow-none): The running #InfAsyncOperation,
+ * or %NULL on error.
+ */
+InfAsyncOperation*
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfdStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  return infd_filesystem_storage_write_xml_file_async(
+    storage,
+    io,
+    "InfText",
+    path,
+    inf_text_filesystem_format_snapshot_to_xml,
+    inf_text_filesystem_format_snapshot_new(user_table, buffer),
+    inf_text_filesystem_format_snapshot_free,
+    func,
+    user_data,
+    error
+  );
+}
+
+struct _InfTextFilesystemJournal {
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+
+  /* ID of the journal file on disk, or NULL if there is no journal on disk
+   * that belongs to the current snapshot. */
+  gchar* id;
+  /* Length of the journal file */
+  gsize size;
+  /* Sequence number of the last recorded change */
+  guint64 seq;
+  /* Records that have not yet been appended to the journal file */
+  GString* pending;
+  /* Authors for which a user record has been written since the last
+   * snapshot */
+  GHashTable* recorded_users;
+
+  /* The snapshot being written in the background, if any, and the InfIo
+   * to report its result to */
+  InfAsyncOperation* compaction;
+  InfIo* io;
+  gchar* compaction_id;
+  gsize compaction_offset;
+  gboolean compaction_continues;
+
+  /* InfTextFilesystemJournalReports of asynchronous writes which are
+   * waiting for the compaction to finish */
+  GSList* reports;
+};
+
+typedef struct _InfTextFilesystemJournalReport {
+  InfdFilesystemStorage* storage;
+  InfdStorageWriteFunc func;
+  gpointer user_data;
+  GError* error;
+
+  InfAsyncOperation* operation;
+  /* The journal while the report is waiting in its reports list */
+  InfTextFilesystemJournal* journal;
+} InfTextFilesystemJournalReport;
+
+/* Forget about the journal on disk, for example because appending to it
+ * failed. The next write will write a new snapshot instead. */
+static void
+inf_text_filesystem_journal_drop(InfTextFilesystemJournal* journal)
+{
+  g_free(journal->id);
+  journal->id = NULL;
+  journal->size = 0;
+}
+
+static void
+inf_text_filesystem_journal_add_record(InfTextFilesystemJournal* journal,
+                                       gchar type,
+                                       const gchar* fields,
+                                       const gchar* payload,
+                                       gsize bytes)
+{
+  gchar* header;
+  guint32 checksum;
+
+  header = g_strdup_printf(
+    "%c %" G_GUINT64_FORMAT " %s",
+    type,
+    ++journal->seq,
+    fields
+  );
+
+  checksum = inf_text_filesystem_journal_checksum(
+    inf_text_filesystem_journal_checksum(2166136261u, header, strlen(header)),
+    payload,
+    bytes
+  );
+
+  g_string_append_printf(journal->pending, "%s %08x\n", header, checksum);
+  if(payload != NULL)
+  {
+    g_string_append_len(journal->pending, payload, bytes);
+    g_string_append_c(journal->pending, '\n');
+  }
+
+  g_free(header);
+}
+
+static void
+inf_text_filesystem_journal_record_user(InfTextFilesystemJournal* journal,
+                                        guint id)
+{
+  InfUser* user;
+  const gchar* name;
+  gchar hue[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar* fields;
+
+  if(id == 0)
+    return;
+
+  /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
+  if(g_hash_table_lookup(journal->recorded_users, GUINT_TO_POINTER(id)))
+    return;
+
+  user = inf_user_table_lookup_user_by_id(journal->user_table, id);
+  g_assert(user != NULL);
+
+  name = inf_user_get_name(user);
+  g_ascii_dtostr(hue, sizeof(hue), inf_text_user_get_hue(INF_TEXT_USER(user)));
+  fields = g_strdup_printf("%u %s %lu", id, hue, (gulong)strlen(name));
+  inf_text_filesystem_journal_add_record(
+    journal,
+    'u',
+    fields,
+    name,
+    strlen(name)
+  );
+
+  g_free(fields);
+
+  /* TODO: Use g_hash_table_add with glib 2.32 */
+  g_hash_table_insert(
+    journal->recorded_users,
+    GUINT_TO_POINTER(id),
+    GUINT_TO_POINTER(id)
+  );
+}
+
+static void
+inf_text_filesystem_journal_text_inserted_cb(InfTextBuffer* buffer,
+                                             guint pos,
+                                             InfTextChunk* chunk,
+                                             InfUser* user,
+                                             gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextChunkIter iter;
+  const gchar* encoding;
+  guint author;
+  gconstpointer text;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+  gchar* fields;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+  encoding = inf_text_chunk_get_encoding(chunk);
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      author = inf_text_chunk_iter_get_author(&iter);
+      text = inf_text_chunk_iter_get_text(&iter);
+      bytes = inf_text_chunk_iter_get_bytes(&iter);
+
+      converted = NULL;
+      if(strcmp(encoding, "UTF-8") != 0)
+      {
+        converted = g_convert(
+          text,
+          bytes,
+          "UTF-8",
+          encoding,
+          NULL,
+          &converted_bytes,
+          NULL
+        );
+
+        /* The next snapshot reports the error */
+        if(converted == NULL)
+        {
+          inf_text_filesystem_journal_drop(journal);
+          return;
+        }
+
+        text = converted;
+        bytes = converted_bytes;
+      }
+
+      inf_text_filesystem_journal_record_user(journal, author);
+
+      fields = g_strdup_printf(
+        "%u %u %lu",
+        pos + inf_text_chunk_iter_get_offset(&iter),
+        author,
+        (gulong)bytes
+      );
+
+      inf_text_filesystem_journal_add_record(
+        journal,
+        'i',
+        fields,
+        text,
+        bytes
+      );
+
+      g_free(fields);
+      g_free(converted);
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+}
+
+static void
+inf_text_filesystem_journal_text_erased_cb(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user,
+                                           gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  gchar* fields;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+
+  fields = g_strdup_printf("%u %u", pos, inf_text_chunk_get_length(chunk));
+  inf_text_filesystem_journal_add_record(journal, 'e', fields, NULL, 0);
+  g_free(fields);
+}
+
+/* Appends the pending records to the journal on disk. If there is no
+ * journal on disk, the function fails without setting error. */
+static gboolean
+inf_text_filesystem_journal_flush(InfTextFilesystemJournal* journal,
+                                  GError** error)
+{
+  FILE* stream;
+  gsize written;
+  int res;
+  int save_errno;
+
+  if(journal->id == NULL)
+    return FALSE;
+
+  if(journal->pending->len == 0)
+    return TRUE;
+
+  stream = infd_filesystem_storage_open(
+    journal->storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    journal->path,
+    "a",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    inf_text_filesystem_journal_drop(journal);
+    return FALSE;
+  }
+
+  written = infd_filesystem_storage_stream_write(
+    stream,
+    journal->pending->str,
+    journal->pending->len
+  );
+
+  save_errno = errno;
+  res = infd_filesystem_storage_stream_close(stream);
+  if(res != 0)
+    save_errno = errno;
+
+  if(written < journal->pending->len || res != 0)
+  {
+    g_set_error(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      _("Failed to append to the journal of \"%s\": %s"),
+      journal->path,
+      g_strerror(save_errno)
+    );
+
+    /* The journal might end with an incomplete record now, which will be
+     * ignored when reading it. Since we do not know how far we got, we
+     * cannot append to it anymore, though. */
+    inf_text_filesystem_journal_drop(journal);
+    return FALSE;
+  }
+
+  journal->size += journal->pending->len;
+  g_string_truncate(journal->pending, 0);
+  return TRUE;
+}
+
+static gboolean
+inf_text_filesystem_journal_needs_compaction(InfTextFilesystemJournal* journal)
+{
+  if(journal->id == NULL)
+    return TRUE;
+
+  /* Compact once replaying the journal is more work than reading the
+   * snapshot, so that the cost of compacting is bounded by the
+   * number of changes written in between. The buffer length is only an
+   * estimate of the snapshot size, but that is good enough here. */
+  return journal->size > INF_TEXT_FILESYSTEM_JOURNAL_COMPACT_SIZE &&
+         journal->size > inf_text_buffer_get_length(journal->buffer);
+}
+
+/* Takes a snapshot for a compaction. If the journal on disk can be
+ * continued, the snapshot refers to it, and records appended while the
+ * snapshot is written are kept in the new journal after the snapshot has
+ * been written. Otherwise, a new journal is started, and new records are
+ * held back until the snapshot has been written. */
+static InfTextFilesystemFormatSnapshot*
+inf_text_filesystem_journal_begin_compaction(InfTextFilesystemJournal* journal)
+{
+  InfTextFilesystemFormatSnapshot* snapshot;
+
+  g_assert(journal->compaction_id == NULL);
+
+  snapshot = inf_text_filesystem_format_snapshot_new(
+    journal->user_table,
+    journal->buffer
+  );
+
+  journal->compaction_continues = journal->id != NULL;
+  if(journal->compaction_continues)
+  {
+    journal->compaction_id = g_strdup(journal->id);
+    journal->compaction_offset = journal->size;
+  }
+  else
+  {
+    journal->compaction_id =
+      g_strdup_printf("%08x%08x", g_random_int(), g_random_int());
+    journal->compaction_offset = 0;
+
+    /* Everything pending is contained in the snapshot */
+    g_string_truncate(journal->pending, 0);
+  }
+
+  snapshot->journal_id = g_strdup(journal->compaction_id);
+  snapshot->journal_seq = journal->seq;
+
+  /* Users contained in the snapshot are only those who have written
+   * something that is still in the document. */
+  g_hash_table_remove_all(journal->recorded_users);
+  return snapshot;
+}
+
+/* Replaces the journal on disk after the snapshot has been written */
+static gboolean
+inf_text_filesystem_journal_end_compaction(InfTextFilesystemJournal* journal,
+                                           GError** error)
+{
+  gchar* full_path;
+  gchar* contents;
+  gsize length;
+  GString* new_journal;
+  gboolean result;
+
+  if(journal->compaction_continues && journal->id == NULL)
+  {
+    /* Appending to the journal failed in the meanwhile, so we do not have
+     * the records written since the snapshot was taken. Write another
+     * snapshot next time. */
+    g_free(journal->compaction_id);
+    journal->compaction_id = NULL;
+    return TRUE;
+  }
+
+  full_path = infd_filesystem_storage_get_path(
+    journal->storage,
+    INF_TEXT_FILESYSTEM_JOURNAL_IDENTIFIER,
+    journal->path,
+    error
+  );
+
+  if(full_path == NULL)
+  {
+    inf_text_filesystem_journal_drop(journal);
+    g_free(journal->compaction_id);
+    journal->compaction_id = NULL;
+    return FALSE;
+  }
+
+  new_journal = g_string_new(NULL);
+  g_string_printf(
+    new_journal,
+    "%s %s\n",
+    INF_TEXT_FILESYSTEM_JOURNAL_MAGIC,
+    journal->compaction_id
+  );
+
+  result = TRUE;
+  if(journal->compaction_continues &&
+     journal->size > journal->compaction_offset)
+  {
+    /* Keep what has been appended while the snapshot was written */
+    result = g_file_get_contents(full_path, &contents, &length, error);
+    if(result == TRUE)
+    {
+      if(length == journal->size)
+      {
+        g_string_append_len(
+          new_journal,
+          contents + journal->compaction_offset,
+          length - journal->compaction_offset
+        );
+      }
+      else
+      {
+        g_set_error(
+          error,
+          inf_text_filesystem_format_error_quark(),
+          INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+          _("Error processing journal of \"%s\": %s"),
+          journal->path,
+          _("The journal has been modified by someone else")
+        );
+
+        result = FALSE;
+      }
+
+      g_free(contents);
+    }
+  }
+
+  if(result == TRUE)
+  {
+    result = g_file_set_contents(
+      full_path,
+      new_journal->str,
+      new_journal->len,
+      error
+    );
+  }
+
+  if(result == TRUE)
+  {
+    g_free(journal->id);
+    journal->id = journal->compaction_id;
+    journal->size = new_journal->len;
+  }
+  else
+  {
+    inf_text_filesystem_journal_drop(journal);
+    g_free(journal->compaction_id);
+  }
+
+  journal->compaction_id = NULL;
+  g_string_free(new_journal, TRUE);
+  g_free(full_path);
+  return result;
+}
+
+static void
+inf_text_filesystem_journal_cancel_compaction(InfTextFilesystemJournal* journal)
+{
+  /* If the snapshot is written nevertheless, then this does no harm, since
+   * the journal on disk is not touched before it has been written, and it
+   * is either overwritten by a newer one or continued by the same journal
+   * as before. */
+  if(journal->compaction != NULL)
+  {
+    inf_async_operation_free(journal->compaction);
+    journal->compaction = NULL;
+
+    g_free(journal->compaction_id);
+    journal->compaction_id = NULL;
+  }
+}
+
+static void
+inf_text_filesystem_journal_report_done(gpointer run_data,
+                                        gpointer user_data)
+{
+  InfTextFilesystemJournalReport* report;
+  report = (InfTextFilesystemJournalReport*)user_data;
+
+  report->func(
+    INFD_STORAGE(report->storage),
+    report->error,
+    report->user_data
+  );
+}
+
+static void
+inf_text_filesystem_journal_report_free(gpointer user_data)
+{
+  InfTextFilesystemJournalReport* report;
+  report = (InfTextFilesystemJournalReport*)user_data;
+
+  /* The operation has been cancelled while waiting for the compaction */
+  if(report->journal != NULL)
+  {
+    report->journal->reports =
+      g_slist_remove(report->journal->reports, report);
+  }
+
+  if(report->error != NULL)
+    g_error_free(report->error);
+
+  g_object_unref(report->storage);
+  g_slice_free(InfTextFilesystemJournalReport, report);
+}
+
+static InfTextFilesystemJournalReport*
+inf_text_filesystem_journal_report_new(InfTextFilesystemJournal* journal,
+                                       InfIo* io,
+                                       InfdStorageWriteFunc func,
+                                       gpointer user_data)
+{
+  InfTextFilesystemJournalReport* report;
+  report = g_slice_new(InfTextFilesystemJournalReport);
+
+  report->storage = journal->storage;
+  report->func = func;
+  report->user_data = user_data;
+  report->error = NULL;
+  report->journal = NULL;
+  g_object_ref(report->storage);
+
+  /* The result is passed with inf_async_operation_complete() */
+  report->operation = inf_async_operation_new_full(
+    io,
+    NULL,
+    inf_text_filesystem_journal_report_done,
+    report,
+    inf_text_filesystem_journal_report_free
+  );
+
+  return report;
+}
+
+/* Reports the result of a write to all asynchronous writes waiting for the
+ * compaction. */
+static void
+inf_text_filesystem_journal_report(InfTextFilesystemJournal* journal,
+                                   const GError* error)
+{
+  InfTextFilesystemJournalReport* report;
+  GSList* reports;
+  GSList* item;
+
+  reports = journal->reports;
+  journal->reports = NULL;
+
+  for(item = reports; item != NULL; item = item->next)
+  {
+    report = (InfTextFilesystemJournalReport*)item->data;
+    report->journal = NULL;
+    if(error != NULL)
+      report->error = g_error_copy(error);
+
+    inf_async_operation_complete(report->operation, NULL, NULL);
+  }
+
+  g_slist_free(reports);
+}
+
+/* Required by inf_text_filesystem_journal_start_compaction() */
+static void
+inf_text_filesystem_journal_compaction_done_cb(InfdStorage* storage,
+                                               const GError* error,
+                                               gpointer user_data);
+
+static gboolean
+inf_text_filesystem_journal_start_compaction(InfTextFilesystemJournal* journal,
+                                             GError** error)
+{
+  journal->compaction = infd_filesystem_storage_write_xml_file_async(
+    journal->storage,
+    journal->io,
+    "InfText",
+    journal->path,
+    inf_text_filesystem_format_snapshot_to_xml,
+    inf_text_filesystem_journal_begin_compaction(journal),
+    inf_text_filesystem_format_snapshot_free,
+    inf_text_filesystem_journal_compaction_done_cb,
+    journal,
+    error
+  );
+
+  if(journal->compaction == NULL)
+  {
+    g_free(journal->compaction_id);
+    journal->compaction_id = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_text_filesystem_journal_compaction_done_cb(InfdStorage* storage,
+                                               const GError* error,
+                                               gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  GError* local_error;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+  journal->compaction = NULL;
+  local_error = NULL;
+
+  if(error != NULL)
+  {
+    g_free(journal->compaction_id);
+    journal->compaction_id = NULL;
+    local_error = g_error_copy(error);
+  }
+  else if(inf_text_filesystem_journal_end_compaction(journal, &local_error))
+  {
+    if(journal->id == NULL)
+    {
+      /* Appending to the journal failed while the snapshot was written, so
+       * the changes made since are only in memory. Write them with another
+       * snapshot before reporting to anyone who is waiting for them. */
+      if(journal->reports == NULL ||
+         inf_text_filesystem_journal_start_compaction(journal, &local_error))
+      {
+        return;
+      }
+    }
+    else
+    {
+      /* Records held back while a new journal was started */
+      inf_text_filesystem_journal_flush(journal, &local_error);
+    }
+  }
+
+  if(local_error != NULL && journal->reports == NULL)
+  {
+    /* Nobody is waiting for the result, and the next write retries */
+    g_warning(
+      _("Failed to write snapshot of \"%s\": %s"),
+      journal->path,
+      local_error->message
+    );
+  }
+
+  inf_text_filesystem_journal_report(journal, local_error);
+  if(local_error != NULL)
+    g_error_free(local_error);
+}
+
+static InfTextFilesystemJournal*
+inf_text_filesystem_journal_new_impl(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     InfUserTable* user_table,
+                                     InfTextBuffer* buffer)
+{
+  InfTextFilesystemJournal* journal;
+  journal = g_slice_new(InfTextFilesystemJournal);
+
+  journal->storage = storage;
+  journal->path = g_strdup(path);
+  journal->user_table = user_table;
+  journal->buffer = buffer;
+  g_object_ref(storage);
+  g_object_ref(user_table);
+  g_object_ref(buffer);
+
+  journal->id = NULL;
+  journal->size = 0;
+  journal->seq = 0;
+  journal->pending = g_string_new(NULL);
+  journal->recorded_users = g_hash_table_new(NULL, NULL);
+
+  journal->compaction = NULL;
+  journal->io = NULL;
+  journal->compaction_id = NULL;
+  journal->compaction_offset = 0;
+  journal->compaction_continues = FALSE;
+  journal->reports = NULL;
+
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-inserted",
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-erased",
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_new: (constructor)
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the session.
+ * @user_table: The #InfUserTable of the session.
+ * @buffer: The #InfTextBuffer of the session.
+ *
+ * Creates a new #InfTextFilesystemJournal which records all changes made
+ * to @buffer, so that they can be appended to the journal of the session
+ * at @path in @storage with inf_text_filesystem_journal_write() or
+ * inf_text_filesystem_journal_write_async(). This does not access the
+ * storage yet. The first write will write a complete snapshot of the
+ * session and start a new journal.
+ *
+ * Use inf_text_filesystem_journal_open() instead to read a session from
+ * the storage and continue its journal.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal. Free with
+ * inf_text_filesystem_journal_free().
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_new(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+
+  return inf_text_filesystem_journal_new_impl(
+    storage,
+    path,
+    user_table,
+    buffer
+  );
+}
+
+/**
+ * inf_text_filesystem_journal_open: (constructor)
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage like
+ * inf_text_filesystem_format_read(), and creates a
+ * #InfTextFilesystemJournal which continues the journal of the session.
+ * This way, the next write only needs to append the changes made after
+ * the session has been read. If the journal ends with an incomplete
+ * record, for example because the server went down while writing it, the
+ * record is removed from the journal.
+ *
+ * Returns: (transfer full) (allow-none): A new #InfTextFilesystemJournal,
+ * or %NULL on error. Free with inf_text_filesystem_journal_free().
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  InfTextFilesystemJournal* journal;
+  gchar* journal_id;
+  guint64 journal_seq;
+  gsize journal_size;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, NULL);
+
+  result = inf_text_filesystem_format_read_snapshot(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &journal_id,
+    &journal_seq,
+    error
+  );
+
+  journal_size = 0;
+  if(result == TRUE && journal_id != NULL)
+  {
+    result = inf_text_filesystem_journal_replay(
+      storage,
+      path,
+      user_table,
+      buffer,
+      journal_id,
+      &journal_seq,
+      &journal_size,
+      TRUE,
+      error
+    );
+  }
+
+  if(result == FALSE)
+  {
+    g_free(journal_id);
+    return NULL;
+  }
+
+  journal = inf_text_filesystem_journal_new_impl(
+    storage,
+    path,
+    user_table,
+    buffer
+  );
+
+  if(journal_size > 0)
+  {
+    journal->id = journal_id;
+    journal->size = journal_size;
+  }
+  else
+  {
+    g_free(journal_id);
+  }
+
+  journal->seq = journal_seq;
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_free:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Stops recording changes and frees @journal. Changes which have not been
+ * written with inf_text_filesystem_journal_write() or
+ * inf_text_filesystem_journal_write_async() before are not written. If a
+ * snapshot is still being written in the background, it is cancelled. This
+ * leaves the files on disk in a consistent state, but the changes that
+ * would have been written with it are lost, and asynchronous writes that
+ * are still waiting for it fail with
+ * %INF_TEXT_FILESYSTEM_FORMAT_ERROR_JOURNAL_CLOSED. To make sure that all
+ * changes are written, call inf_text_filesystem_journal_write() first.
+ */
+void
+inf_text_filesystem_journal_free(InfTextFilesystemJournal* journal)
+{
+  GError* error;
+
+  g_return_if_fail(journal != NULL);
+
+  inf_text_filesystem_journal_cancel_compaction(journal);
+
+  if(journal->reports != NULL)
+  {
+    error = NULL;
+    g_set_error(
+      &error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_JOURNAL_CLOSED,
+      _("The session \"%s\" was closed before its changes were written"),
+      journal->path
+    );
+
+    inf_text_filesystem_journal_report(journal, error);
+    g_error_free(error);
+  }
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  if(journal->io != NULL)
+    g_object_unref(journal->io);
+
+  g_hash_table_destroy(journal->recorded_users);
+  g_string_free(journal->pending, TRUE);
+  g_free(journal->id);
+  g_free(journal->path);
+  g_object_unref(journal->buffer);
+  g_object_unref(journal->user_table);
+  g_object_unref(journal->storage);
+  g_slice_free(InfTextFilesystemJournal, journal);
+}
+
+static gboolean
+inf_text_filesystem_journal_write_impl(InfTextFilesystemJournal* journal,
+                                       GError** error)
+{
+  InfTextFilesystemFormatSnapshot* snapshot;
+  xmlDocPtr doc;
+  gboolean result;
+
+  inf_text_filesystem_journal_cancel_compaction(journal);
+
+  /* If this fails, the changes are written as part of a new snapshot */
+  inf_text_filesystem_journal_flush(journal, NULL);
+  if(!inf_text_filesystem_journal_needs_compaction(journal))
+    return TRUE;
+
+  snapshot = inf_text_filesystem_journal_begin_compaction(journal);
+  doc = inf_text_filesystem_format_snapshot_to_xml(snapshot, error);
+  inf_text_filesystem_format_snapshot_free(snapshot);
+
+  if(doc != NULL)
+  {
+    result = infd_filesystem_storage_write_xml_file(
+      journal->storage,
+      "InfText",
+      journal->path,
+      doc,
+      error
+    );
+
+    xmlFreeDoc(doc);
+  }
+  else
+  {
+    result = FALSE;
+  }
+
+  if(result == FALSE)
+  {
+    g_free(journal->compaction_id);
+    journal->compaction_id = NULL;
+    return FALSE;
+  }
+
+  if(!inf_text_filesystem_journal_end_compaction(journal, error))
+    return FALSE;
+
+  /* Records held back while a new journal was started */
+  if(journal->id != NULL && !inf_text_filesystem_journal_flush(journal, error))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_journal_write:
+ * @journal: A #InfTextFilesystemJournal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Appends the changes made to the session since the last write to the
+ * journal on disk. If the journal has grown larger than the document
+ * itself, or if there is no journal yet, a complete snapshot of the
+ * session is written instead, and a new journal is started. If a snapshot
+ * is being written in the background by
+ * inf_text_filesystem_journal_write_async(), it is written again
+ * synchronously, and asynchronous writes waiting for it are reported with
+ * the result of this function.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_write(InfTextFilesystemJournal* journal,
+                                  GError** error)
+{
+  GError* local_error;
+  gboolean result;
+
+  g_return_val_if_fail(journal != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  local_error = NULL;
+  result = inf_text_filesystem_journal_write_impl(journal, &local_error);
+
+  inf_text_filesystem_journal_report(journal, local_error);
+  if(local_error != NULL)
+    g_propagate_error(error, local_error);
+
+  return result;
+}
+
+/**
+ * inf_text_filesystem_journal_write_async:
+ * @journal: A #InfTextFilesystemJournal.
+ * @io: The #InfIo object of the thread in which @func is to be called.
+ * @func: (scope notified): Function to be called when the changes have
+ * been written.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Appends the changes made to the session since the last write to the
+ * journal on disk, like inf_text_filesystem_journal_write(), but writes
+ * snapshots in a worker thread. Appending to the journal takes time
+ * proportional to the number of changes, and is done before the function
+ * returns.
+ *
+ * If a snapshot needs to be written, it is written in the background, and
+ * the session can be modified in the meanwhile. If a snapshot is being
+ * written already, the changes are written with it. @func is called from
+ * @io's thread once the changes are on disk, or writing them has failed,
+ * and it is not called if the returned operation is freed before. If the
+ * snapshot could not be written, the next write writes it again.
+ *
+ * Returns: (transfer none) (allow-none): The running #InfAsyncOperation,
+ * or %NULL on error.
+ */
+InfAsyncOperation*
+inf_text_filesystem_journal_write_async(InfTextFilesystemJournal* journal,
+                                        InfIo* io,
+                                        InfdStorageWriteFunc func,
+                                        gpointer user_data,
+                                        GError** error)
+{
+  InfTextFilesystemJournalReport* report;
+
+  g_return_val_if_fail(journal != NULL, NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  /* If this fails, the changes are written as part of a new snapshot */
+  inf_text_filesystem_journal_flush(journal, NULL);
+
+  if(journal->compaction == NULL &&
+     inf_text_filesystem_journal_needs_compaction(journal))
+  {
+    g_object_ref(io);
+    if(journal->io != NULL)
+      g_object_unref(journal->io);
+    journal->io = io;
+
+    if(!inf_text_filesystem_journal_start_compaction(journal, error))
+      return NULL;
+  }
+
+  report = inf_text_filesystem_journal_report_new(
+    journal,
+    io,
+    func,
+    user_data
+  );
+
+  if(journal->compaction != NULL)
+  {
+    /* Reported by inf_text_filesystem_journal_compaction_done_cb() */
+    report->journal = journal;
+    journal->reports = g_slist_append(journal->reports, report);
+  }
+  else
+  {
+    inf_async_operation_complete(report->operation, NULL, NULL);
+  }
+
+  return report->operation;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -35,6 +35,10 @@ G_BEGIN_DECLS
  * session contains users with duplicate ID or duplicate name.
  * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER: A segment of the text
  * document is written by a user which does not exist.
+ * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL: The journal of the
+ * session contains a change which cannot be applied to the document.
+ * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_JOURNAL_CLOSED: The journal was freed
+ * before the changes could be written.
  *
  * Errors that can occur when reading a #InfTextSession from a
  * #InfdFilesystemStorage.
@@ -42,9 +46,19 @@ G_BEGIN_DECLS
 typedef enum _InfTextFilesystemFormatError {
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_JOURNAL_CLOSED
 } InfTextFilesystemFormatError;
 
+/**
+ * InfTextFilesystemJournal:
+ *
+ * #InfTextFilesystemJournal is an opaque data type. You should only access
+ * it via the public API functions.
+ */
+typedef struct _InfTextFilesystemJournal InfTextFilesystemJournal;
+
 gboolean
 inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
                                 const gchar* path,
@@ -59,6 +73,43 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
                                  InfTextBuffer* buffer,
                                  GError** error);
 
+InfAsyncOperation*
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfdStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_new(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer);
+
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error);
+
+void
+inf_text_filesystem_journal_free(InfTextFilesystemJournal* journal);
+
+gboolean
+inf_text_filesystem_journal_write(InfTextFilesystemJournal* journal,
+                                  GError** error);
+
+InfAsyncOperation*
+inf_text_filesystem_journal_write_async(InfTextFilesystemJournal* journal,
+                                        InfIo* io,
+                                        InfdStorageWriteFunc func,
+                                        gpointer user_data,
+                                        GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_FILESYSTEM_FORMAT_H__ */
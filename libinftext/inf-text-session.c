@@ -76,6 +76,16 @@ struct _InfTextSessionEraseForeachData {
   InfUser* user;
 };
 
+/* A copy of the buffer content at the time a synchronization started, and
+ * the position up to which it has been sent */
+typedef struct _InfTextSessionSyncSegments InfTextSessionSyncSegments;
+struct _InfTextSessionSyncSegments {
+  InfTextChunk* chunk;
+  InfTextChunkIter iter;
+  gsize bytes_left; /* in the segment iter points to */
+  GIConv cd;
+};
+
 #define INF_TEXT_SESSION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_SESSION, InfTextSessionPrivate))
 
 static GQuark inf_text_session_error_quark;
@@ -101,17 +111,15 @@ inf_text_session_timeval_diff(GTimeVal* first,
          (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
 }
 
-/* Converts at most *bytes bytes with cd and writes the result, which are
- * at most 1024 bytes, into xml, setting the given author. *bytes will be
- * set to the number of bytes not yet processed. */
-static void
-inf_text_session_segment_to_xml(GIConv* cd,
-                                xmlNodePtr xml,
-                                gconstpointer text,
-                                gsize* bytes, /* in/out */
-                                guint author)
+/* Converts at most *bytes bytes with cd into utf8_text, which must have
+ * room for 1024 bytes, and returns the number of bytes written. *bytes will
+ * be set to the number of bytes not yet processed. */
+static gsize
+inf_text_session_segment_to_utf8(GIConv* cd,
+                                 gconstpointer text,
+                                 gsize* bytes, /* in/out */
+                                 gchar* utf8_text)
 {
-  gchar utf8_text[1024];
   gsize result;
 
   gsize bytes_left;
@@ -135,7 +143,25 @@ inf_text_session_segment_to_xml(GIConv* cd,
   /* Conversion into UTF-8 should always succeed */
   g_assert(result == 0 || errno == E2BIG);
 
-  inf_xml_util_add_child_text(xml, utf8_text, 1024 - bytes_left);
+  return 1024 - bytes_left;
+}
+
+/* Converts at most *bytes bytes with cd and writes the result, which are
+ * at most 1024 bytes, into xml, setting the given author. *bytes will be
+ * set to the number of bytes not yet processed. */
+static void
+inf_text_session_segment_to_xml(GIConv* cd,
+                                xmlNodePtr xml,
+                                gconstpointer text,
+                                gsize* bytes, /* in/out */
+                                guint author)
+{
+  gchar utf8_text[1024];
+  gsize utf8_bytes;
+
+  utf8_bytes = inf_text_session_segment_to_utf8(cd, text, bytes, utf8_text);
+
+  inf_xml_util_add_child_text(xml, utf8_text, utf8_bytes);
   inf_xml_util_set_attribute_uint(xml, "author", author);
 }
 
@@ -975,59 +1001,124 @@ inf_text_session_handle_user_color_change(InfTextSession* session,
  * InfSession overrides
  */
 
-static void
-inf_text_session_to_xml_sync(InfSession* session,
-                             xmlNodePtr parent)
+static xmlNodePtr
+inf_text_session_to_xml_sync_stream_segment_func(InfSession* session,
+                                                 gpointer user_data)
 {
-  InfTextBuffer* buffer;
-  InfTextBufferIter* iter;
-  xmlNodePtr xml;
+  InfTextSessionSyncSegments* data;
+  const gchar* text;
+  gsize total_bytes;
   gboolean result;
+  xmlNodePtr xml;
 
-  gchar* text;
+  data = (InfTextSessionSyncSegments*)user_data;
+
+  if(data->bytes_left == 0)
+  {
+    result = inf_text_chunk_iter_next(&data->iter);
+    g_assert(result == TRUE);
+
+    data->bytes_left = inf_text_chunk_iter_get_bytes(&data->iter);
+  }
+
+  text = inf_text_chunk_iter_get_text(&data->iter);
+  total_bytes = inf_text_chunk_iter_get_bytes(&data->iter);
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"sync-segment");
+  inf_text_session_segment_to_xml(
+    &data->cd,
+    xml,
+    text + total_bytes - data->bytes_left,
+    &data->bytes_left,
+    inf_text_chunk_iter_get_author(&data->iter)
+  );
+
+  return xml;
+}
+
+static void
+inf_text_session_to_xml_sync_stream_free_func(gpointer user_data)
+{
+  InfTextSessionSyncSegments* data;
+  data = (InfTextSessionSyncSegments*)user_data;
+
+  g_iconv_close(data->cd);
+  inf_text_chunk_free(data->chunk);
+  g_slice_free(InfTextSessionSyncSegments, data);
+}
+
+static void
+inf_text_session_to_xml_sync_stream(InfSession* session,
+                                    InfSessionSyncStream* stream)
+{
+  InfTextBuffer* buffer;
+  InfTextSessionSyncSegments* data;
+  gchar utf8_text[1024];
+  const gchar* text;
   gsize total_bytes;
   gsize bytes_left;
-  GIConv cd;
+  guint n_messages;
+  gboolean result;
 
-  INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync(
+  INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync_stream(
     session,
-    parent
+    stream
   );
 
+  /* Take a copy of the buffer content, which does not need to copy the
+   * text itself for InfTextDefaultBuffer. The messages are produced from
+   * the copy, so that changes made while the synchronization is in progress
+   * do not affect it. */
   buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
-  cd = g_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
 
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  if(iter != NULL)
+  data = g_slice_new(InfTextSessionSyncSegments);
+  data->chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  data->cd = g_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
+
+  /* Segments are written in 1024 byte chunks. We need to convert the text
+   * once to find out how many chunks there are. */
+  n_messages = 0;
+  result = inf_text_chunk_iter_init_begin(data->chunk, &data->iter);
+  while(result == TRUE)
   {
-    result = TRUE;
-    while(result == TRUE)
-    {
-      /* Write segment in 1024 byte chunks */
-      text = inf_text_buffer_iter_get_text(buffer, iter);
-      total_bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
-      bytes_left = total_bytes;
+    text = inf_text_chunk_iter_get_text(&data->iter);
+    total_bytes = inf_text_chunk_iter_get_bytes(&data->iter);
+    bytes_left = total_bytes;
 
-      while(bytes_left > 0)
-      {
-        xml = xmlNewChild(parent, NULL, (const xmlChar*)"sync-segment", NULL);
-        inf_text_session_segment_to_xml(
-          &cd,
-          xml,
-          text + total_bytes - bytes_left,
-          &bytes_left,
-          inf_text_buffer_iter_get_author(buffer, iter)
-        );
-      }
+    while(bytes_left > 0)
+    {
+      inf_text_session_segment_to_utf8(
+        &data->cd,
+        text + total_bytes - bytes_left,
+        &bytes_left,
+        utf8_text
+      );
 
-      g_free(text);
-      result = inf_text_buffer_iter_next(buffer, iter);
+      ++ n_messages;
     }
 
-    inf_text_buffer_destroy_iter(buffer, iter);
+    result = inf_text_chunk_iter_next(&data->iter);
   }
 
-  g_iconv_close(cd);
+  g_iconv(data->cd, NULL, NULL, NULL, NULL);
+
+  if(inf_text_chunk_iter_init_begin(data->chunk, &data->iter) == TRUE)
+    data->bytes_left = inf_text_chunk_iter_get_bytes(&data->iter);
+  else
+    data->bytes_left = 0;
+
+  inf_session_sync_stream_add(
+    stream,
+    n_messages,
+    inf_text_session_to_xml_sync_stream_segment_func,
+    data,
+    inf_text_session_to_xml_sync_stream_free_func
+  );
 }
 
 static gboolean
@@ -1768,7 +1859,7 @@ inf_text_session_class_init(InfTextSessionClass* text_session_class)
   object_class->set_property = inf_text_session_set_property;
   object_class->get_property = inf_text_session_get_property;
 
-  session_class->to_xml_sync = inf_text_session_to_xml_sync;
+  session_class->to_xml_sync_stream = inf_text_session_to_xml_sync_stream;
   session_class->process_xml_sync = inf_text_session_process_xml_sync;
   session_class->process_xml_run = inf_text_session_process_xml_run;
   session_class->get_xml_user_props = inf_text_session_get_xml_user_props;
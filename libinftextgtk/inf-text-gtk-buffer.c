@@ -2150,6 +2150,8 @@ inf_text_gtk_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->iter_get_author = inf_text_gtk_buffer_buffer_iter_get_author;
   iface->text_inserted = NULL;
   iface->text_erased = NULL;
+  iface->offset_to_line = NULL;
+  iface->line_to_offset = NULL;
 }
 
 /**
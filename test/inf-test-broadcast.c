@@ -0,0 +1,350 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures the CPU time the server spends to broadcast a message to all
+ * members of a group, depending on the number of members. Clients and
+ * server run in the same process and are connected via unencrypted XMPP
+ * over the loopback device. Only the time spent in
+ * inf_communication_group_send_group_message() is measured, not the time
+ * it takes the clients to receive the message. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <libxml/parser.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INF_TEST_BROADCAST_PORT 6525
+
+/* A typical message as sent for a single keystroke */
+static const gchar INF_TEST_BROADCAST_MESSAGE[] =
+  "<request user=\"3\" time=\"1:1734;2:955;4:23;5:1271\">"
+  "<insert-caret pos=\"14203\">x</insert-caret>"
+  "</request>";
+
+static const guint INF_TEST_BROADCAST_GROUP_SIZES[] = {
+  1, 10, 50, 100, 200
+};
+
+typedef struct _InfTestBroadcast InfTestBroadcast;
+struct _InfTestBroadcast {
+  InfStandaloneIo* io;
+  GPtrArray* server_connections;
+  GPtrArray* client_connections;
+  guint received;
+};
+
+static void
+inf_test_broadcast_new_connection_cb(InfdXmlServer* server,
+                                     InfXmlConnection* connection,
+                                     gpointer user_data)
+{
+  InfTestBroadcast* test;
+  test = (InfTestBroadcast*)user_data;
+
+  g_object_ref(connection);
+  g_ptr_array_add(test->server_connections, connection);
+}
+
+static void
+inf_test_broadcast_received_cb(InfXmlConnection* connection,
+                               xmlNodePtr xml,
+                               gpointer user_data)
+{
+  InfTestBroadcast* test;
+  test = (InfTestBroadcast*)user_data;
+
+  ++test->received;
+}
+
+static gboolean
+inf_test_broadcast_all_open(GPtrArray* connections,
+                            guint count)
+{
+  InfXmlConnectionStatus status;
+  guint i;
+
+  if(connections->len < count)
+    return FALSE;
+
+  for(i = 0; i < connections->len; ++i)
+  {
+    g_object_get(
+      G_OBJECT(g_ptr_array_index(connections, i)),
+      "status", &status,
+      NULL
+    );
+
+    if(status != INF_XML_CONNECTION_OPEN)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_broadcast_connect(InfTestBroadcast* test,
+                           guint count,
+                           GError** error)
+{
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  guint i;
+
+  addr = inf_ip_address_new_loopback4();
+
+  for(i = 0; i < count; ++i)
+  {
+    tcp = inf_tcp_connection_new_and_open(
+      INF_IO(test->io),
+      addr,
+      INF_TEST_BROADCAST_PORT,
+      error
+    );
+
+    if(tcp == NULL)
+    {
+      inf_ip_address_free(addr);
+      return FALSE;
+    }
+
+    xmpp = inf_xmpp_connection_new(
+      tcp,
+      INF_XMPP_CONNECTION_CLIENT,
+      NULL,
+      "localhost",
+      INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      NULL,
+      NULL,
+      NULL
+    );
+
+    g_signal_connect(
+      G_OBJECT(xmpp),
+      "received",
+      G_CALLBACK(inf_test_broadcast_received_cb),
+      test
+    );
+
+    g_ptr_array_add(test->client_connections, xmpp);
+    g_object_unref(tcp);
+  }
+
+  inf_ip_address_free(addr);
+
+  /* Wait until all connections are fully established */
+  while(!inf_test_broadcast_all_open(test->client_connections, count) ||
+        !inf_test_broadcast_all_open(test->server_connections, count))
+  {
+    inf_standalone_io_iteration(test->io);
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_broadcast_run(InfTestBroadcast* test,
+                       InfCommunicationGroup* group,
+                       xmlNodePtr message,
+                       guint size,
+                       guint broadcasts)
+{
+  clock_t begin;
+  clock_t total;
+  guint expected;
+  guint i;
+
+  total = 0;
+  for(i = 0; i < broadcasts; ++i)
+  {
+    expected = test->received + size;
+
+    begin = clock();
+    inf_communication_group_send_group_message(
+      group,
+      xmlCopyNode(message, 1)
+    );
+    total += clock() - begin;
+
+    /* Let the clients receive the message before sending the next one, so
+     * that the server does not need to queue messages. */
+    while(test->received < expected)
+      inf_standalone_io_iteration(test->io);
+  }
+
+  printf(
+    "%3u clients: %8.2f us per broadcast, %6.2f us per client\n",
+    size,
+    (gdouble)total * 1e6 / CLOCKS_PER_SEC / broadcasts,
+    (gdouble)total * 1e6 / CLOCKS_PER_SEC / broadcasts / size
+  );
+}
+
+int main(int argc, char* argv[])
+{
+  static const gchar* const methods[] = { "central", NULL };
+
+  InfTestBroadcast test;
+  InfdTcpServer* server;
+  InfdXmppServer* xmpp;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  xmlDocPtr doc;
+  xmlNodePtr message;
+  GError* error;
+  guint broadcasts;
+  guint max_size;
+  guint members;
+  guint size;
+  guint i;
+
+  broadcasts = 1000;
+  max_size = 200;
+
+  if(argc > 1)
+    broadcasts = strtoul(argv[1], NULL, 10);
+  if(argc > 2)
+    max_size = strtoul(argv[2], NULL, 10);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.server_connections = g_ptr_array_new_with_free_func(g_object_unref);
+  test.client_connections = g_ptr_array_new_with_free_func(g_object_unref);
+  test.received = 0;
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-port", INF_TEST_BROADCAST_PORT,
+    NULL
+  );
+
+  if(infd_tcp_server_open(server, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(server);
+    g_object_unref(test.io);
+    return -1;
+  }
+
+  xmpp = infd_xmpp_server_new(
+    server,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "new-connection",
+    G_CALLBACK(inf_test_broadcast_new_connection_cb),
+    &test
+  );
+
+  doc = xmlReadMemory(
+    INF_TEST_BROADCAST_MESSAGE,
+    sizeof(INF_TEST_BROADCAST_MESSAGE) - 1,
+    NULL,
+    "UTF-8",
+    0
+  );
+
+  message = xmlCopyNode(xmlDocGetRootElement(doc), 1);
+  xmlFreeDoc(doc);
+
+  manager = inf_communication_manager_new();
+  group = inf_communication_manager_open_group(
+    manager,
+    "InfTestBroadcast",
+    methods
+  );
+
+  members = 0;
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_BROADCAST_GROUP_SIZES); ++i)
+  {
+    size = INF_TEST_BROADCAST_GROUP_SIZES[i];
+    if(size > max_size)
+      break;
+
+    if(!inf_test_broadcast_connect(&test, size - members, &error))
+    {
+      fprintf(stderr, "Could not connect: %s\n", error->message);
+      g_error_free(error);
+      break;
+    }
+
+    for(; members < size; ++members)
+    {
+      inf_communication_hosted_group_add_member(
+        group,
+        INF_XML_CONNECTION(
+          g_ptr_array_index(test.server_connections, members)
+        )
+      );
+    }
+
+    inf_test_broadcast_run(
+      &test,
+      INF_COMMUNICATION_GROUP(group),
+      message,
+      size,
+      broadcasts
+    );
+  }
+
+  g_object_unref(group);
+  g_object_unref(manager);
+  xmlFreeNode(message);
+
+  for(i = 0; i < test.client_connections->len; ++i)
+    inf_xml_connection_close(g_ptr_array_index(test.client_connections, i));
+
+  g_ptr_array_free(test.client_connections, TRUE);
+  g_ptr_array_free(test.server_connections, TRUE);
+
+  g_object_unref(xmpp);
+  infd_tcp_server_close(server);
+  g_object_unref(server);
+  g_object_unref(test.io);
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
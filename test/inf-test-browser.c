@@ -27,6 +27,7 @@
 #include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-init.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 typedef struct _InfTestBrowser InfTestBrowser;
@@ -55,7 +56,6 @@ inf_test_browser_find_node(InfTestBrowser* test,
                            InfBrowserIter* result_iter)
 {
   InfBrowserIter iter;
-  gboolean result;
 
   if(inf_browser_get_explored(test->browser, &test->cwd) == FALSE)
   {
@@ -68,15 +68,11 @@ inf_test_browser_find_node(InfTestBrowser* test,
   else
   {
     iter = test->cwd;
-    for(result = inf_browser_get_child(test->browser, &iter);
-        result == TRUE;
-        result = inf_browser_get_next(test->browser, &iter))
+    if(infc_browser_iter_get_child_by_name(INFC_BROWSER(test->browser),
+                                           &iter, name))
     {
-      if(strcmp(inf_browser_get_node_name(test->browser, &iter), name) == 0)
-      {
-        *result_iter = iter;
-        return TRUE;
-      }
+      *result_iter = iter;
+      return TRUE;
     }
   }
 
@@ -178,6 +174,42 @@ inf_test_browser_cmd_explore(InfTestBrowser* test,
   }
 }
 
+static void
+inf_test_browser_cmd_more(InfTestBrowser* test,
+                          const gchar* param)
+{
+  InfBrowserIter iter;
+
+  if(param == NULL || *param == '\0')
+  {
+    iter = test->cwd;
+  }
+  else if(inf_test_browser_find_node(test, param, &iter) == FALSE)
+  {
+    fprintf(
+      stderr,
+      "Directory '%s' does not exist\n",
+      param
+    );
+
+    return;
+  }
+
+  if(!infc_browser_iter_get_partially_explored(INFC_BROWSER(test->browser),
+                                               &iter))
+  {
+    fprintf(
+      stderr,
+      "Directory '%s' is not partially explored\n",
+      inf_browser_get_node_name(test->browser, &iter)
+    );
+  }
+  else
+  {
+    infc_browser_iter_explore_continue(INFC_BROWSER(test->browser), &iter);
+  }
+}
+
 static void
 inf_test_browser_cmd_create(InfTestBrowser* test,
                             const gchar* param)
@@ -215,6 +247,7 @@ static const InfTestBrowserCmd inf_test_browser_commands[] = {
   { "ls", inf_test_browser_cmd_ls },
   { "cd", inf_test_browser_cmd_cd },
   { "explore", inf_test_browser_cmd_explore },
+  { "more", inf_test_browser_cmd_more },
   { "create", inf_test_browser_cmd_create },
   { "remove", inf_test_browser_cmd_remove }
 };
@@ -373,6 +406,16 @@ main(int argc, char* argv[])
       )
     );
 
+    /* Explore page by page if a page size is given */
+    if(argc > 1)
+    {
+      g_object_set(
+        G_OBJECT(test.browser),
+        "explore-page-size", (guint)strtoul(argv[1], NULL, 10),
+        NULL
+      );
+    }
+
     g_signal_connect_after(
       G_OBJECT(test.browser),
       "notify::status",
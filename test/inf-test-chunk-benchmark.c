@@ -0,0 +1,366 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures InfTextChunk performance for random edits on large buffers
+ * written by many authors. This only uses the public InfTextChunk API, so
+ * that the same program can be built against different versions of
+ * libinftext to compare their performance. */
+
+#include <libinftext/inf-text-chunk.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_CHUNK_BENCHMARK_AUTHORS 50
+#define INF_TEST_CHUNK_BENCHMARK_SEGMENT_LENGTH 48
+#define INF_TEST_CHUNK_BENCHMARK_COPIES 100
+#define INF_TEST_CHUNK_BENCHMARK_LOOKUPS 1000000
+#define INF_TEST_CHUNK_BENCHMARK_LOG_LINES 1000000
+#define INF_TEST_CHUNK_BENCHMARK_LOG_SUBSTRINGS 100000
+#define INF_TEST_CHUNK_BENCHMARK_LOG_EDITS 1000
+
+static const gchar INF_TEST_CHUNK_BENCHMARK_TEXT[] =
+  "Lorem ipsum dolor sit amet, consectetur adipisici elit, sed eiusmod "
+  "tempor incidunt ut labore et dolore magna aliqua.\n";
+
+static InfTextChunk*
+inf_test_chunk_benchmark_create(gsize size)
+{
+  InfTextChunk* chunk;
+  gsize bytes;
+  guint length;
+  guint offset;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  bytes = 0;
+
+  /* The text is ASCII, so the number of characters equals the number
+   * of bytes. */
+  while(bytes < size)
+  {
+    length = g_random_int_range(
+      1,
+      2 * INF_TEST_CHUNK_BENCHMARK_SEGMENT_LENGTH
+    );
+
+    length = MIN(length, size - bytes);
+    offset = g_random_int_range(
+      0,
+      sizeof(INF_TEST_CHUNK_BENCHMARK_TEXT) - length
+    );
+
+    inf_text_chunk_insert_text(
+      chunk,
+      bytes,
+      INF_TEST_CHUNK_BENCHMARK_TEXT + offset,
+      length,
+      length,
+      g_random_int_range(1, INF_TEST_CHUNK_BENCHMARK_AUTHORS + 1)
+    );
+
+    bytes += length;
+  }
+
+  return chunk;
+}
+
+static guint
+inf_test_chunk_benchmark_count_segments(InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  gboolean result;
+  guint count;
+
+  count = 0;
+  for(result = inf_text_chunk_iter_init_begin(chunk, &iter);
+      result == TRUE;
+      result = inf_text_chunk_iter_next(&iter))
+  {
+    ++count;
+  }
+
+  return count;
+}
+
+static void
+inf_test_chunk_benchmark_lines(InfTextChunk* chunk)
+{
+  GTimer* timer;
+  gdouble elapsed;
+  guint length;
+  guint lines;
+  guint line;
+  guint i;
+
+  length = inf_text_chunk_get_length(chunk);
+  lines = inf_text_chunk_get_line_count(chunk);
+
+  /* Map random offsets to lines and back, like an editor does when
+   * converting between line/column positions and offsets. */
+  timer = g_timer_new();
+  for(i = 0; i < INF_TEST_CHUNK_BENCHMARK_LOOKUPS; ++i)
+  {
+    line = inf_text_chunk_offset_to_line(
+      chunk,
+      g_random_int_range(0, length + 1)
+    );
+
+    g_assert(line < lines);
+    inf_text_chunk_line_to_offset(chunk, line);
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u line lookups in %u lines in %.3f s (%.2f us per lookup)\n",
+    INF_TEST_CHUNK_BENCHMARK_LOOKUPS,
+    lines,
+    elapsed,
+    elapsed * 1e6 / INF_TEST_CHUNK_BENCHMARK_LOOKUPS
+  );
+
+  g_timer_destroy(timer);
+}
+
+static void
+inf_test_chunk_benchmark_log(guint lines)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* sub;
+  GTimer* timer;
+  gdouble elapsed;
+  guint length;
+  guint offset;
+  guint count;
+  guint i;
+
+  /* A log file written by a single author consists of a single segment,
+   * so lookups cannot make use of the segment tree. */
+  timer = g_timer_new();
+  chunk = inf_text_chunk_new("UTF-8");
+  for(i = 0; i < lines; ++i)
+  {
+    length = g_random_int_range(
+      1,
+      sizeof(INF_TEST_CHUNK_BENCHMARK_TEXT) - 1
+    );
+
+    inf_text_chunk_insert_text(
+      chunk,
+      inf_text_chunk_get_length(chunk),
+      INF_TEST_CHUNK_BENCHMARK_TEXT + sizeof(INF_TEST_CHUNK_BENCHMARK_TEXT) -
+        1 - length,
+      length,
+      length,
+      1
+    );
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u lines log, %u segments, created in %.3f s\n",
+    lines,
+    inf_test_chunk_benchmark_count_segments(chunk),
+    elapsed
+  );
+
+  inf_test_chunk_benchmark_lines(chunk);
+
+  /* Short substrings at random offsets within the single segment. Both
+   * of their ends need to be converted to byte indices. */
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_CHUNK_BENCHMARK_LOG_SUBSTRINGS; ++i)
+  {
+    length = inf_text_chunk_get_length(chunk);
+    offset = g_random_int_range(0, length);
+    count = MIN(g_random_int_range(1, 100), length - offset);
+
+    sub = inf_text_chunk_substring(chunk, offset, count);
+    inf_text_chunk_free(sub);
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u substrings of the log in %.3f s (%.2f us per substring)\n",
+    INF_TEST_CHUNK_BENCHMARK_LOG_SUBSTRINGS,
+    elapsed,
+    elapsed * 1e6 / INF_TEST_CHUNK_BENCHMARK_LOG_SUBSTRINGS
+  );
+
+  /* Edits by the author of the log modify the segment in place, which
+   * means moving the text behind the edit in memory. */
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_CHUNK_BENCHMARK_LOG_EDITS; ++i)
+  {
+    length = inf_text_chunk_get_length(chunk);
+    offset = g_random_int_range(0, length);
+    count = MIN(g_random_int_range(1, 6), length - offset);
+
+    if(g_random_int_range(0, 2) == 0)
+    {
+      inf_text_chunk_erase(chunk, offset, count);
+    }
+    else
+    {
+      inf_text_chunk_insert_text(
+        chunk,
+        offset,
+        INF_TEST_CHUNK_BENCHMARK_TEXT,
+        count,
+        count,
+        1
+      );
+    }
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u random edits of the log in %.3f s (%.2f us per edit)\n",
+    INF_TEST_CHUNK_BENCHMARK_LOG_EDITS,
+    elapsed,
+    elapsed * 1e6 / INF_TEST_CHUNK_BENCHMARK_LOG_EDITS
+  );
+
+  inf_text_chunk_free(chunk);
+  g_timer_destroy(timer);
+}
+
+static void
+inf_test_chunk_benchmark_run(gsize size,
+                             guint edits)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* sub;
+  GTimer* timer;
+  gdouble elapsed;
+  guint length;
+  guint offset;
+  guint count;
+  guint i;
+
+  timer = g_timer_new();
+  chunk = inf_test_chunk_benchmark_create(size);
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%" G_GSIZE_FORMAT " bytes, %u segments, created in %.3f s\n",
+    size,
+    inf_test_chunk_benchmark_count_segments(chunk),
+    elapsed
+  );
+
+  /* Random inserts, erasures and substrings, in about the proportion
+   * in which they occur during a typical editing session. */
+  g_timer_start(timer);
+  for(i = 0; i < edits; ++i)
+  {
+    length = inf_text_chunk_get_length(chunk);
+
+    switch(g_random_int_range(0, 10))
+    {
+    case 0:
+    case 1:
+    case 2:
+      offset = g_random_int_range(0, length);
+      count = g_random_int_range(1, 6);
+      count = MIN(count, length - offset);
+      inf_text_chunk_erase(chunk, offset, count);
+      break;
+    case 3:
+      offset = g_random_int_range(0, length);
+      count = g_random_int_range(1, 100);
+      count = MIN(count, length - offset);
+      sub = inf_text_chunk_substring(chunk, offset, count);
+      inf_text_chunk_free(sub);
+      break;
+    default:
+      offset = g_random_int_range(0, length + 1);
+      count = g_random_int_range(1, 6);
+
+      inf_text_chunk_insert_text(
+        chunk,
+        offset,
+        INF_TEST_CHUNK_BENCHMARK_TEXT,
+        count,
+        count,
+        g_random_int_range(1, INF_TEST_CHUNK_BENCHMARK_AUTHORS + 1)
+      );
+
+      break;
+    }
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u random edits in %.3f s (%.2f us per edit)\n",
+    edits,
+    elapsed,
+    elapsed * 1e6 / edits
+  );
+
+  inf_test_chunk_benchmark_lines(chunk);
+
+  /* Operations copy their chunks quite often */
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_CHUNK_BENCHMARK_COPIES; ++i)
+  {
+    sub = inf_text_chunk_copy(chunk);
+    inf_text_chunk_free(sub);
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u copies in %.3f s (%.2f us per copy)\n",
+    INF_TEST_CHUNK_BENCHMARK_COPIES,
+    elapsed,
+    elapsed * 1e6 / INF_TEST_CHUNK_BENCHMARK_COPIES
+  );
+
+  inf_text_chunk_free(chunk);
+  g_timer_destroy(timer);
+}
+
+int main(int argc, char* argv[])
+{
+  guint edits;
+
+  edits = 100000;
+  if(argc > 1)
+    edits = strtoul(argv[1], NULL, 10);
+
+  if(argc > 2)
+  {
+    inf_test_chunk_benchmark_run(strtoul(argv[2], NULL, 10) << 20, edits);
+  }
+  else
+  {
+    inf_test_chunk_benchmark_run(1 << 20, edits);
+    inf_test_chunk_benchmark_run(50 << 20, edits);
+    inf_test_chunk_benchmark_log(INF_TEST_CHUNK_BENCHMARK_LOG_LINES);
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
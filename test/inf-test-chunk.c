@@ -19,10 +19,467 @@
 
 #include <libinftext/inf-text-chunk.h>
 
+#include <string.h>
+
+/* A trivial reference implementation of a chunk: The text as an UTF-8
+ * string, and the author of every character. */
+typedef struct _InfTestChunkModel InfTestChunkModel;
+struct _InfTestChunkModel {
+  GString* text;
+  GArray* authors;
+};
+
+/* Characters outside of the basic multilingual plane come last, since not
+ * all encodings can represent them */
+static const gchar* const INF_TEST_CHUNK_CHARACTERS[] = {
+  "a", "b", "c", "\n", "\xc3\xbc", "\xe2\x82\xac", "\xf0\x9d\x84\x9e"
+};
+
+static void
+inf_test_chunk_model_insert(InfTestChunkModel* model,
+                            guint offset,
+                            const gchar* text,
+                            guint length,
+                            guint author)
+{
+  const gchar* pos;
+  guint i;
+
+  pos = g_utf8_offset_to_pointer(model->text->str, offset);
+  g_string_insert(model->text, pos - model->text->str, text);
+
+  for(i = 0; i < length; ++i)
+    g_array_insert_val(model->authors, offset, author);
+}
+
+static void
+inf_test_chunk_model_erase(InfTestChunkModel* model,
+                           guint begin,
+                           guint length)
+{
+  const gchar* begin_pos;
+  const gchar* end_pos;
+
+  begin_pos = g_utf8_offset_to_pointer(model->text->str, begin);
+  end_pos = g_utf8_offset_to_pointer(begin_pos, length);
+
+  g_string_erase(
+    model->text,
+    begin_pos - model->text->str,
+    end_pos - begin_pos
+  );
+
+  g_array_remove_range(model->authors, begin, length);
+}
+
+/* Inserts UTF-8 text into chunk, converting it to the chunk's encoding */
+static void
+inf_test_chunk_insert_text(InfTextChunk* chunk,
+                           guint offset,
+                           const gchar* text,
+                           gsize bytes,
+                           guint length,
+                           guint author)
+{
+  gchar* converted;
+  gsize converted_bytes;
+
+  converted = g_convert(
+    text,
+    bytes,
+    inf_text_chunk_get_encoding(chunk),
+    "UTF-8",
+    NULL,
+    &converted_bytes,
+    NULL
+  );
+
+  g_assert(converted != NULL);
+
+  inf_text_chunk_insert_text(
+    chunk,
+    offset,
+    converted,
+    converted_bytes,
+    length,
+    author
+  );
+
+  g_free(converted);
+}
+
+/* Returns the text of chunk, converted to UTF-8 */
+static gchar*
+inf_test_chunk_get_text(InfTextChunk* chunk,
+                        gsize* bytes)
+{
+  gchar* text;
+  gchar* converted;
+  gsize text_bytes;
+
+  text = inf_text_chunk_get_text(chunk, &text_bytes);
+  if(text == NULL)
+  {
+    *bytes = 0;
+    return g_strdup("");
+  }
+
+  converted = g_convert(
+    text,
+    text_bytes,
+    "UTF-8",
+    inf_text_chunk_get_encoding(chunk),
+    NULL,
+    bytes,
+    NULL
+  );
+
+  g_assert(converted != NULL);
+
+  g_free(text);
+  return converted;
+}
+
+static gboolean
+inf_test_chunk_verify(InfTextChunk* chunk,
+                      InfTestChunkModel* model)
+{
+  InfTextChunkIter iter;
+  gboolean result;
+  gchar* text;
+  const gchar* pos;
+  gsize bytes;
+  guint offset;
+  guint author;
+  guint line;
+  guint i;
+
+  if(inf_text_chunk_get_length(chunk) != model->authors->len)
+    return FALSE;
+
+  text = inf_test_chunk_get_text(chunk, &bytes);
+  result = bytes == model->text->len &&
+    memcmp(text, model->text->str, bytes) == 0;
+  g_free(text);
+
+  if(result == FALSE)
+    return FALSE;
+
+  /* Every segment must be a maximal run of characters by the same author */
+  offset = 0;
+  result = inf_text_chunk_iter_init_begin(chunk, &iter);
+  while(result == TRUE)
+  {
+    if(inf_text_chunk_iter_get_offset(&iter) != offset)
+      return FALSE;
+    if(inf_text_chunk_iter_get_length(&iter) == 0)
+      return FALSE;
+
+    author = inf_text_chunk_iter_get_author(&iter);
+    if(offset > 0)
+      if(g_array_index(model->authors, guint, offset - 1) == author)
+        return FALSE;
+
+    for(i = 0; i < inf_text_chunk_iter_get_length(&iter); ++i)
+      if(g_array_index(model->authors, guint, offset + i) != author)
+        return FALSE;
+
+    offset += inf_text_chunk_iter_get_length(&iter);
+    result = inf_text_chunk_iter_next(&iter);
+  }
+
+  if(offset != model->authors->len)
+    return FALSE;
+
+  /* Line lookups must agree with the newlines in the text */
+  line = 0;
+  pos = model->text->str;
+  for(offset = 0; offset <= model->authors->len; ++offset)
+  {
+    if(inf_text_chunk_offset_to_line(chunk, offset) != line)
+      return FALSE;
+
+    if(offset < model->authors->len)
+    {
+      if(*pos == '\n')
+      {
+        ++line;
+        if(inf_text_chunk_line_to_offset(chunk, line) != offset + 1)
+          return FALSE;
+      }
+
+      pos = g_utf8_next_char(pos);
+    }
+  }
+
+  return inf_text_chunk_get_line_count(chunk) == line + 1;
+}
+
+static gboolean
+inf_test_chunk_lines_iconv(void)
+{
+  /* Checks the line index of a chunk which is not in UTF-8 */
+  InfTextChunk* chunk;
+  gboolean result;
+
+  chunk = inf_text_chunk_new("UTF-16LE");
+  inf_text_chunk_insert_text(chunk, 0, "a\0\n\0b\0\n\0\n\0", 10, 5, 1);
+
+  result = inf_text_chunk_get_line_count(chunk) == 4 &&
+    inf_text_chunk_offset_to_line(chunk, 1) == 0 &&
+    inf_text_chunk_offset_to_line(chunk, 2) == 1 &&
+    inf_text_chunk_offset_to_line(chunk, 5) == 3 &&
+    inf_text_chunk_line_to_offset(chunk, 1) == 2 &&
+    inf_text_chunk_line_to_offset(chunk, 3) == 5;
+
+  /* Remove the "b" */
+  inf_text_chunk_erase(chunk, 2, 1);
+
+  result = result &&
+    inf_text_chunk_get_line_count(chunk) == 4 &&
+    inf_text_chunk_offset_to_line(chunk, 3) == 2 &&
+    inf_text_chunk_line_to_offset(chunk, 2) == 3;
+
+  inf_text_chunk_free(chunk);
+  return result;
+}
+
+/* Returns the number of leading INF_TEST_CHUNK_CHARACTERS which can be
+ * represented in encoding */
+static guint
+inf_test_chunk_count_characters(const gchar* encoding)
+{
+  gchar* converted;
+  guint i;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_CHUNK_CHARACTERS); ++i)
+  {
+    converted = g_convert(
+      INF_TEST_CHUNK_CHARACTERS[i],
+      -1,
+      encoding,
+      "UTF-8",
+      NULL,
+      NULL,
+      NULL
+    );
+
+    if(converted == NULL)
+      break;
+
+    g_free(converted);
+  }
+
+  return i;
+}
+
+static void
+inf_test_chunk_random_text(GString* text,
+                           guint length,
+                           guint n_characters)
+{
+  guint i;
+
+  g_string_truncate(text, 0);
+  for(i = 0; i < length; ++i)
+  {
+    g_string_append(
+      text,
+      INF_TEST_CHUNK_CHARACTERS[
+        g_random_int_range(0, n_characters)
+      ]
+    );
+  }
+}
+
+static gboolean
+inf_test_chunk_random(const gchar* encoding,
+                      guint initial,
+                      guint operations)
+{
+  InfTestChunkModel model;
+  InfTestChunkModel copy;
+  InfTestChunkModel snapshot_model;
+  InfTextChunk* chunk;
+  InfTextChunk* sub;
+  InfTextChunk* snapshot;
+  const gchar* begin_pos;
+  const gchar* end_pos;
+  gchar* text;
+  gsize bytes;
+  guint length;
+  guint begin;
+  guint offset;
+  guint count;
+  guint author;
+  guint n_characters;
+  guint i;
+  gboolean result;
+
+  model.text = g_string_new(NULL);
+  model.authors = g_array_new(FALSE, FALSE, sizeof(guint));
+  copy.text = g_string_new(NULL);
+  copy.authors = g_array_new(FALSE, FALSE, sizeof(guint));
+  snapshot_model.text = g_string_new(NULL);
+  snapshot_model.authors = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  chunk = inf_text_chunk_new(encoding);
+  n_characters = inf_test_chunk_count_characters(encoding);
+  snapshot = NULL;
+  result = TRUE;
+
+  /* Start with a long segment by a single author, if requested */
+  if(initial > 0)
+  {
+    inf_test_chunk_random_text(copy.text, initial, n_characters);
+    inf_test_chunk_insert_text(
+      chunk,
+      0,
+      copy.text->str,
+      copy.text->len,
+      initial,
+      1
+    );
+
+    inf_test_chunk_model_insert(&model, 0, copy.text->str, initial, 1);
+  }
+
+  for(i = 0; i < operations && result == TRUE; ++i)
+  {
+    /* Copies share their content with the original chunk, so make sure
+     * that modifying the original does not change an earlier copy. */
+    if(i % 100 == 0)
+    {
+      if(snapshot != NULL)
+      {
+        result = inf_test_chunk_verify(snapshot, &snapshot_model);
+        inf_text_chunk_free(snapshot);
+      }
+
+      snapshot = inf_text_chunk_copy(chunk);
+      g_string_assign(snapshot_model.text, model.text->str);
+      g_array_set_size(snapshot_model.authors, 0);
+      g_array_append_vals(
+        snapshot_model.authors,
+        model.authors->data,
+        model.authors->len
+      );
+    }
+
+    length = model.authors->len;
+    author = g_random_int_range(1, 5);
+
+    switch(g_random_int_range(0, 4))
+    {
+    case 0:
+    case 1:
+      offset = g_random_int_range(0, length + 1);
+      count = g_random_int_range(1, 8);
+      inf_test_chunk_random_text(copy.text, count, n_characters);
+
+      inf_test_chunk_insert_text(
+        chunk,
+        offset,
+        copy.text->str,
+        copy.text->len,
+        count,
+        author
+      );
+
+      inf_test_chunk_model_insert(
+        &model,
+        offset,
+        copy.text->str,
+        count,
+        author
+      );
+      break;
+    case 2:
+      if(length > 0)
+      {
+        offset = g_random_int_range(0, length);
+        count = g_random_int_range(1, MIN(length - offset, 20) + 1);
+        inf_text_chunk_erase(chunk, offset, count);
+        inf_test_chunk_model_erase(&model, offset, count);
+      }
+
+      break;
+    case 3:
+      /* Copy a part of the chunk to another position */
+      begin = g_random_int_range(0, length + 1);
+      count = g_random_int_range(0, MIN(length - begin, 50) + 1);
+      sub = inf_text_chunk_substring(chunk, begin, count);
+
+      begin_pos = g_utf8_offset_to_pointer(model.text->str, begin);
+      end_pos = g_utf8_offset_to_pointer(begin_pos, count);
+      g_string_truncate(copy.text, 0);
+      g_string_append_len(copy.text, begin_pos, end_pos - begin_pos);
+      g_array_set_size(copy.authors, 0);
+      g_array_append_vals(
+        copy.authors,
+        &g_array_index(model.authors, guint, begin),
+        count
+      );
+
+      text = inf_test_chunk_get_text(sub, &bytes);
+      if(bytes != copy.text->len || memcmp(text, copy.text->str, bytes) != 0)
+        result = FALSE;
+      g_free(text);
+
+      offset = g_random_int_range(0, length + 1);
+      inf_text_chunk_insert_chunk(chunk, offset, sub);
+      inf_text_chunk_free(sub);
+
+      begin_pos = g_utf8_offset_to_pointer(model.text->str, offset);
+      g_string_insert_len(
+        model.text,
+        begin_pos - model.text->str,
+        copy.text->str,
+        copy.text->len
+      );
+
+      g_array_insert_vals(
+        model.authors,
+        offset,
+        copy.authors->data,
+        copy.authors->len
+      );
+
+      break;
+    }
+
+    if(result == TRUE)
+      result = inf_test_chunk_verify(chunk, &model);
+  }
+
+  if(snapshot != NULL)
+  {
+    if(result == TRUE)
+      result = inf_test_chunk_verify(snapshot, &snapshot_model);
+    inf_text_chunk_free(snapshot);
+  }
+
+  inf_text_chunk_free(chunk);
+  g_array_free(snapshot_model.authors, TRUE);
+  g_string_free(snapshot_model.text, TRUE);
+  g_array_free(copy.authors, TRUE);
+  g_string_free(copy.text, TRUE);
+  g_array_free(model.authors, TRUE);
+  g_string_free(model.text, TRUE);
+  return result;
+}
+
 int main()
 {
+  /* Encodings with a dedicated code path, and one that goes through
+   * iconv */
+  static const gchar* const encodings[] = {
+    "UTF-16LE", "UTF-16BE", "UTF-32LE", "UTF-32BE", "ISO-8859-15", "GB18030"
+  };
+
   InfTextChunk* chunk;
   InfTextChunk* chunk2;
+  guint i;
 
   chunk2 = inf_text_chunk_new("UTF-8");
 
@@ -35,5 +492,40 @@ int main()
   inf_text_chunk_free(chunk);
   inf_text_chunk_free(chunk2);
 
+  if(inf_test_chunk_random("UTF-8", 0, 2000) == FALSE)
+  {
+    fprintf(stderr, "Random operations produced an inconsistent chunk\n");
+    return -1;
+  }
+
+  /* Long segments make use of checkpoints to find byte indices */
+  if(inf_test_chunk_random("UTF-8", 20000, 500) == FALSE)
+  {
+    fprintf(stderr, "Random operations on a long segment produced an "
+                    "inconsistent chunk\n");
+    return -1;
+  }
+
+  /* The other encodings take different code paths to find byte indices and
+   * newlines. Fewer operations are enough to exercise them. */
+  for(i = 0; i < G_N_ELEMENTS(encodings); ++i)
+  {
+    if(inf_test_chunk_random(encodings[i], 0, 1000) == FALSE ||
+       inf_test_chunk_random(encodings[i], 20000, 100) == FALSE)
+    {
+      fprintf(stderr, "Random operations produced an inconsistent %s "
+                      "chunk\n", encodings[i]);
+      return -1;
+    }
+  }
+
+  if(inf_test_chunk_lines_iconv() == FALSE)
+  {
+    fprintf(stderr, "Line lookups in a UTF-16 chunk are incorrect\n");
+    return -1;
+  }
+
   return 0;
 }
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,514 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Creates a directory tree with many folders and documents in a temporary
+ * filesystem storage, and measures how long an InfdDirectory on top of it
+ * takes until it can serve the first request for a deeply nested folder,
+ * and until the whole tree is available, once when exploring on demand and
+ * once when prefetching the tree with infd_directory_prefetch(). */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/server/infd-filesystem-account-storage.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-browser.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of subfolders of each folder */
+#define INF_TEST_COLD_START_FANOUT 8
+
+typedef struct _InfTestColdStartCount InfTestColdStartCount;
+struct _InfTestColdStartCount {
+  guint folders;
+  guint notes;
+};
+
+typedef struct _InfTestColdStartPrefetch InfTestColdStartPrefetch;
+struct _InfTestColdStartPrefetch {
+  gboolean done;
+  guint explored;
+  guint errors;
+};
+
+static gchar*
+inf_test_cold_start_child_path(const gchar* path,
+                               const gchar* name)
+{
+  if(strcmp(path, "/") == 0)
+    return g_strconcat("/", name, NULL);
+  else
+    return g_strconcat(path, "/", name, NULL);
+}
+
+/* Creates folders numbered 1 to n_folders, where the parent of folder i is
+ * folder i / FANOUT, or the root folder if that is 0. Each folder contains
+ * n_notes documents, and every fourth folder has an ACL. Returns the paths
+ * of all folders, with the root folder at index 0. */
+static GPtrArray*
+inf_test_cold_start_create_tree(InfdFilesystemStorage* storage,
+                                guint n_folders,
+                                guint n_notes,
+                                GError** error)
+{
+  GPtrArray* paths;
+  InfAclSheet sheet;
+  InfAclSheetSet* sheet_set;
+  const gchar* parent;
+  gchar* name;
+  gchar* path;
+  gchar* note_path;
+  FILE* stream;
+  guint i;
+  guint j;
+
+  sheet.account = inf_acl_account_id_from_string("default");
+  inf_acl_mask_clear(&sheet.mask);
+  inf_acl_mask_set1(&sheet.mask, INF_ACL_CAN_ADD_DOCUMENT);
+  inf_acl_mask_clear(&sheet.perms);
+  sheet_set = inf_acl_sheet_set_new_external(&sheet, 1);
+
+  paths = g_ptr_array_new_with_free_func(g_free);
+  g_ptr_array_add(paths, g_strdup("/"));
+
+  for(i = 1; i <= n_folders; ++i)
+  {
+    parent = g_ptr_array_index(paths, i / INF_TEST_COLD_START_FANOUT);
+    name = g_strdup_printf("Folder %u", i);
+    path = inf_test_cold_start_child_path(parent, name);
+    g_ptr_array_add(paths, path);
+    g_free(name);
+
+    if(!infd_storage_create_subdirectory(INFD_STORAGE(storage), path, error))
+      break;
+
+    if(i % 4 == 0 &&
+       !infd_storage_write_acl(INFD_STORAGE(storage), path, sheet_set, error))
+    {
+      break;
+    }
+
+    for(j = 0; j < n_notes; ++j)
+    {
+      name = g_strdup_printf("Document %u", j);
+      note_path = inf_test_cold_start_child_path(path, name);
+      g_free(name);
+
+      stream = infd_filesystem_storage_open(
+        storage,
+        "InfText",
+        note_path,
+        "w",
+        NULL,
+        error
+      );
+
+      g_free(note_path);
+
+      if(stream == NULL) break;
+      infd_filesystem_storage_stream_close(stream);
+    }
+
+    if(j < n_notes) break;
+  }
+
+  inf_acl_sheet_set_free(sheet_set);
+
+  if(i <= n_folders)
+  {
+    g_ptr_array_free(paths, TRUE);
+    return NULL;
+  }
+
+  return paths;
+}
+
+static InfdDirectory*
+inf_test_cold_start_make_directory(InfStandaloneIo* io,
+                                   InfdFilesystemStorage* storage,
+                                   GError** error)
+{
+  InfCommunicationManager* manager;
+  InfdFilesystemAccountStorage* account_storage;
+  InfdDirectory* directory;
+
+  account_storage = infd_filesystem_account_storage_new();
+  if(!infd_filesystem_account_storage_set_filesystem(account_storage,
+                                                     storage,
+                                                     error))
+  {
+    g_object_unref(account_storage);
+    return NULL;
+  }
+
+  manager = inf_communication_manager_new();
+  directory = infd_directory_new(INF_IO(io), INFD_STORAGE(storage), manager);
+
+  g_object_set(
+    G_OBJECT(directory),
+    "account-storage", account_storage,
+    NULL
+  );
+
+  g_object_unref(account_storage);
+  g_object_unref(manager);
+  return directory;
+}
+
+static void
+inf_test_cold_start_explore(InfBrowser* browser,
+                            const InfBrowserIter* iter)
+{
+  if(!inf_browser_get_explored(browser, iter))
+    inf_browser_explore(browser, iter, NULL, NULL);
+}
+
+/* Does what serving a request for the folder at path requires: exploring
+ * all folders on the way from the root folder to it, and the folder
+ * itself. */
+static gboolean
+inf_test_cold_start_open(InfdDirectory* directory,
+                         const gchar* path)
+{
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  gchar** components;
+  gchar** component;
+  gboolean result;
+
+  browser = INF_BROWSER(directory);
+  components = g_strsplit(path + 1, "/", 0);
+  result = TRUE;
+
+  inf_browser_get_root(browser, &iter);
+  for(component = components; *component != NULL; ++component)
+  {
+    inf_test_cold_start_explore(browser, &iter);
+    if(!infd_directory_iter_get_child_by_name(directory, &iter, *component))
+    {
+      result = FALSE;
+      break;
+    }
+  }
+
+  if(result == TRUE)
+    inf_test_cold_start_explore(browser, &iter);
+
+  g_strfreev(components);
+  return result;
+}
+
+/* Explores everything below iter, and counts the nodes */
+static void
+inf_test_cold_start_count(InfBrowser* browser,
+                          const InfBrowserIter* iter,
+                          InfTestColdStartCount* count)
+{
+  InfBrowserIter child;
+  gboolean result;
+
+  inf_test_cold_start_explore(browser, iter);
+
+  child = *iter;
+  for(result = inf_browser_get_child(browser, &child);
+      result == TRUE;
+      result = inf_browser_get_next(browser, &child))
+  {
+    if(inf_browser_is_subdirectory(browser, &child))
+    {
+      ++count->folders;
+      inf_test_cold_start_count(browser, &child, count);
+    }
+    else
+    {
+      ++count->notes;
+    }
+  }
+}
+
+static gboolean
+inf_test_cold_start_check_count(InfdDirectory* directory,
+                                guint n_folders,
+                                guint n_notes)
+{
+  InfBrowserIter root;
+  InfTestColdStartCount count;
+
+  count.folders = 0;
+  count.notes = 0;
+
+  inf_browser_get_root(INF_BROWSER(directory), &root);
+  inf_test_cold_start_count(INF_BROWSER(directory), &root, &count);
+
+  if(count.folders != n_folders || count.notes != n_folders * n_notes)
+  {
+    fprintf(
+      stderr,
+      "Found %u folders and %u documents, expected %u and %u\n",
+      count.folders,
+      count.notes,
+      n_folders,
+      n_folders * n_notes
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_cold_start_prefetch_func(InfdDirectory* directory,
+                                  guint explored,
+                                  guint remaining,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfTestColdStartPrefetch* prefetch;
+  prefetch = (InfTestColdStartPrefetch*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to prefetch folder: %s\n", error->message);
+    ++prefetch->errors;
+  }
+
+  prefetch->explored = explored;
+  if(remaining == 0)
+    prefetch->done = TRUE;
+}
+
+static gboolean
+inf_test_cold_start_run_lazy(InfStandaloneIo* io,
+                             InfdFilesystemStorage* storage,
+                             const gchar* leaf,
+                             guint n_folders,
+                             guint n_notes)
+{
+  InfdDirectory* directory;
+  GTimer* timer;
+  GError* error;
+  gdouble first_time;
+  gdouble full_time;
+  gboolean result;
+
+  error = NULL;
+  timer = g_timer_new();
+
+  directory = inf_test_cold_start_make_directory(io, storage, &error);
+  if(directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_timer_destroy(timer);
+    return FALSE;
+  }
+
+  result = inf_test_cold_start_open(directory, leaf);
+  first_time = g_timer_elapsed(timer, NULL);
+
+  if(result == TRUE)
+    result = inf_test_cold_start_check_count(directory, n_folders, n_notes);
+  full_time = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "On demand: %.2f ms until first request, %.2f ms for the full tree\n",
+    first_time * 1e3,
+    full_time * 1e3
+  );
+
+  g_object_unref(directory);
+  g_timer_destroy(timer);
+  return result;
+}
+
+static gboolean
+inf_test_cold_start_run_prefetch(InfStandaloneIo* io,
+                                 InfdFilesystemStorage* storage,
+                                 const gchar* leaf,
+                                 guint n_folders,
+                                 guint n_notes)
+{
+  InfTestColdStartPrefetch prefetch;
+  InfdDirectory* directory;
+  GTimer* timer;
+  GError* error;
+  gdouble prefetch_time;
+  gdouble first_time;
+  gboolean result;
+
+  error = NULL;
+  timer = g_timer_new();
+
+  directory = inf_test_cold_start_make_directory(io, storage, &error);
+  if(directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_timer_destroy(timer);
+    return FALSE;
+  }
+
+  prefetch.done = FALSE;
+  prefetch.explored = 0;
+  prefetch.errors = 0;
+
+  infd_directory_prefetch(
+    directory,
+    inf_test_cold_start_prefetch_func,
+    &prefetch
+  );
+
+  while(!prefetch.done)
+    inf_standalone_io_iteration(io);
+
+  prefetch_time = g_timer_elapsed(timer, NULL);
+
+  result = TRUE;
+  if(prefetch.errors > 0)
+    result = FALSE;
+
+  /* The root folder is explored as well */
+  if(prefetch.explored != n_folders + 1)
+  {
+    fprintf(
+      stderr,
+      "Prefetched %u folders, expected %u\n",
+      prefetch.explored,
+      n_folders + 1
+    );
+
+    result = FALSE;
+  }
+
+  g_timer_start(timer);
+  if(!inf_test_cold_start_open(directory, leaf))
+    result = FALSE;
+  first_time = g_timer_elapsed(timer, NULL);
+
+  if(result == TRUE)
+    result = inf_test_cold_start_check_count(directory, n_folders, n_notes);
+
+  printf(
+    "Prefetch: %.2f ms for the full tree, %.2f ms for the first request "
+    "afterwards\n",
+    prefetch_time * 1e3,
+    first_time * 1e3
+  );
+
+  g_object_unref(directory);
+  g_timer_destroy(timer);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  GPtrArray* paths;
+  GError* error;
+  gchar* root_directory;
+  const gchar* leaf;
+  guint n_folders;
+  guint n_notes;
+  gboolean result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  n_folders = 1000;
+  if(argc > 1)
+    n_folders = strtoul(argv[1], NULL, 10);
+
+  n_notes = 10;
+  if(argc > 2)
+    n_notes = strtoul(argv[2], NULL, 10);
+
+  root_directory = g_dir_make_tmp("inf-test-cold-start-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(root_directory);
+
+  paths = inf_test_cold_start_create_tree(storage, n_folders, n_notes, &error);
+  if(paths == NULL)
+  {
+    fprintf(stderr, "Failed to create tree: %s\n", error->message);
+    g_error_free(error);
+    error = NULL;
+    result = FALSE;
+  }
+  else
+  {
+    leaf = g_ptr_array_index(paths, paths->len - 1);
+    result = inf_test_cold_start_run_lazy(
+      io,
+      storage,
+      leaf,
+      n_folders,
+      n_notes
+    );
+
+    if(result == TRUE)
+    {
+      result = inf_test_cold_start_run_prefetch(
+        io,
+        storage,
+        leaf,
+        n_folders,
+        n_notes
+      );
+    }
+
+    g_ptr_array_free(paths, TRUE);
+  }
+
+  g_object_unref(storage);
+  g_object_unref(io);
+
+  if(!inf_file_util_delete_directory(root_directory, &error))
+  {
+    fprintf(stderr, "Failed to remove tree: %s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root_directory);
+
+  if(result == FALSE)
+    return -1;
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
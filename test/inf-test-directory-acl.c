@@ -0,0 +1,451 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Builds a random directory tree with random ACLs for a couple of accounts
+ * in an InfdDirectory without storage, changes the ACLs of random nodes,
+ * and verifies after each change that the cached permissions reported by
+ * infd_directory_iter_check_acl() and
+ * infd_directory_iter_get_child_permissions() match the ones computed by
+ * inf_browser_check_acl(). Prints the time needed to check the permissions
+ * of all accounts on all nodes either way. */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-browser.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_DIRECTORY_ACL_N_ACCOUNTS 8
+
+typedef struct _InfTestDirectoryAcl InfTestDirectoryAcl;
+struct _InfTestDirectoryAcl {
+  InfdDirectory* directory;
+  /* The default account, followed by transient accounts */
+  InfAclAccountId accounts[INF_TEST_DIRECTORY_ACL_N_ACCOUNTS];
+  /* All nodes in the tree, the root node first */
+  GArray* nodes;
+};
+
+static void
+inf_test_directory_acl_random_mask(InfAclMask* mask)
+{
+  guint i;
+
+  inf_acl_mask_clear(mask);
+  for(i = 0; i < INF_ACL_LAST; ++i)
+    if(g_random_int_range(0, 3) == 0)
+      inf_acl_mask_or1(mask, i);
+}
+
+/* Makes a sheet set with sheets for some random accounts. A sheet with an
+ * empty mask removes the sheet of that account from the node. */
+static InfAclSheetSet*
+inf_test_directory_acl_random_sheets(InfTestDirectoryAcl* test)
+{
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+  guint i;
+
+  sheet_set = inf_acl_sheet_set_new();
+  for(i = 0; i < INF_TEST_DIRECTORY_ACL_N_ACCOUNTS; ++i)
+  {
+    if(g_random_int_range(0, 4) == 0)
+    {
+      sheet = inf_acl_sheet_set_add_sheet(sheet_set, test->accounts[i]);
+      inf_test_directory_acl_random_mask(&sheet->mask);
+      inf_test_directory_acl_random_mask(&sheet->perms);
+    }
+  }
+
+  return sheet_set;
+}
+
+static void
+inf_test_directory_acl_add_func(InfRequest* request,
+                                const InfRequestResult* result,
+                                const GError* error,
+                                gpointer user_data)
+{
+  InfTestDirectoryAcl* test;
+  const InfBrowserIter* iter;
+
+  test = (InfTestDirectoryAcl*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to add node: %s\n", error->message);
+    return;
+  }
+
+  inf_request_result_get_add_node(result, NULL, NULL, &iter);
+  g_array_append_val(test->nodes, *iter);
+}
+
+static void
+inf_test_directory_acl_set_func(InfRequest* request,
+                                const InfRequestResult* result,
+                                const GError* error,
+                                gpointer user_data)
+{
+  if(error != NULL)
+    fprintf(stderr, "Failed to set ACL: %s\n", error->message);
+}
+
+static gboolean
+inf_test_directory_acl_check_node(InfTestDirectoryAcl* test,
+                                  const InfBrowserIter* iter)
+{
+  InfBrowser* browser;
+  InfBrowserIter child;
+  InfAclMask expected;
+  InfAclMask cached;
+  InfAclMask* children;
+  guint n_children;
+  guint i;
+  guint n;
+
+  browser = INF_BROWSER(test->directory);
+
+  for(i = 0; i < INF_TEST_DIRECTORY_ACL_N_ACCOUNTS; ++i)
+  {
+    inf_browser_check_acl(
+      browser,
+      iter,
+      test->accounts[i],
+      &INF_ACL_MASK_ALL,
+      &expected
+    );
+
+    infd_directory_iter_check_acl(
+      test->directory,
+      iter,
+      test->accounts[i],
+      &INF_ACL_MASK_ALL,
+      &cached
+    );
+
+    if(!inf_acl_mask_equal(&expected, &cached))
+    {
+      fprintf(
+        stderr,
+        "Cached permissions of account \"%s\" on node %u are wrong\n",
+        inf_acl_account_id_to_string(test->accounts[i]),
+        iter->node_id
+      );
+
+      return FALSE;
+    }
+
+    if(inf_browser_is_subdirectory(browser, iter))
+    {
+      children = infd_directory_iter_get_child_permissions(
+        test->directory,
+        iter,
+        test->accounts[i],
+        &n_children
+      );
+
+      n = 0;
+      child = *iter;
+      if(inf_browser_get_child(browser, &child))
+      {
+        do
+        {
+          inf_browser_check_acl(
+            browser,
+            &child,
+            test->accounts[i],
+            &INF_ACL_MASK_ALL,
+            &expected
+          );
+
+          if(n >= n_children || !inf_acl_mask_equal(&expected, &children[n]))
+          {
+            fprintf(
+              stderr,
+              "Child permissions of account \"%s\" in node %u are wrong\n",
+              inf_acl_account_id_to_string(test->accounts[i]),
+              iter->node_id
+            );
+
+            g_free(children);
+            return FALSE;
+          }
+
+          ++n;
+        } while(inf_browser_get_next(browser, &child));
+      }
+
+      g_free(children);
+      if(n != n_children)
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_directory_acl_check_all(InfTestDirectoryAcl* test)
+{
+  guint i;
+
+  /* Check in random order, so that the cache is filled in different ways */
+  for(i = 0; i < test->nodes->len; ++i)
+  {
+    if(!inf_test_directory_acl_check_node(
+         test,
+         &g_array_index(
+           test->nodes,
+           InfBrowserIter,
+           g_random_int_range(0, test->nodes->len)
+         )))
+    {
+      return FALSE;
+    }
+  }
+
+  for(i = 0; i < test->nodes->len; ++i)
+  {
+    if(!inf_test_directory_acl_check_node(
+         test,
+         &g_array_index(test->nodes, InfBrowserIter, i)))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_directory_acl_benchmark(InfTestDirectoryAcl* test)
+{
+  InfAclMask mask;
+  const InfBrowserIter* iter;
+  GTimer* timer;
+  gdouble walk_time;
+  gdouble cached_time;
+  guint i;
+  guint j;
+
+  inf_acl_mask_set1(&mask, INF_ACL_CAN_EXPLORE_NODE);
+  timer = g_timer_new();
+
+  for(i = 0; i < test->nodes->len; ++i)
+  {
+    iter = &g_array_index(test->nodes, InfBrowserIter, i);
+    for(j = 0; j < INF_TEST_DIRECTORY_ACL_N_ACCOUNTS; ++j)
+    {
+      inf_browser_check_acl(
+        INF_BROWSER(test->directory),
+        iter,
+        test->accounts[j],
+        &mask,
+        NULL
+      );
+    }
+  }
+
+  walk_time = g_timer_elapsed(timer, NULL);
+  g_timer_start(timer);
+
+  for(i = 0; i < test->nodes->len; ++i)
+  {
+    iter = &g_array_index(test->nodes, InfBrowserIter, i);
+    for(j = 0; j < INF_TEST_DIRECTORY_ACL_N_ACCOUNTS; ++j)
+    {
+      infd_directory_iter_check_acl(
+        test->directory,
+        iter,
+        test->accounts[j],
+        &mask,
+        NULL
+      );
+    }
+  }
+
+  cached_time = g_timer_elapsed(timer, NULL);
+
+  printf(
+    "%u nodes: %.3f us per check walking up the tree, %.3f us cached\n",
+    test->nodes->len,
+    walk_time * 1e6 / (test->nodes->len * INF_TEST_DIRECTORY_ACL_N_ACCOUNTS),
+    cached_time * 1e6 / (test->nodes->len * INF_TEST_DIRECTORY_ACL_N_ACCOUNTS)
+  );
+
+  g_timer_destroy(timer);
+}
+
+static gboolean
+inf_test_directory_acl_run(guint n_nodes,
+                           guint n_changes)
+{
+  InfTestDirectoryAcl test;
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfBrowser* browser;
+  InfBrowserIter root;
+  InfBrowserIter parent;
+  InfAclSheetSet* sheet_set;
+  GError* error;
+  gchar* name;
+  gboolean result;
+  guint i;
+
+  io = inf_standalone_io_new();
+  manager = inf_communication_manager_new();
+  test.directory = infd_directory_new(INF_IO(io), NULL, manager);
+  test.nodes = g_array_new(FALSE, FALSE, sizeof(InfBrowserIter));
+  browser = INF_BROWSER(test.directory);
+  result = TRUE;
+
+  test.accounts[0] = inf_acl_account_id_from_string("default");
+  for(i = 1; i < INF_TEST_DIRECTORY_ACL_N_ACCOUNTS; ++i)
+  {
+    name = g_strdup_printf("Account %u", i);
+    error = NULL;
+
+    test.accounts[i] = infd_directory_create_acl_account(
+      test.directory,
+      name,
+      TRUE,
+      NULL,
+      0,
+      &error
+    );
+
+    g_free(name);
+
+    if(test.accounts[i] == 0)
+    {
+      fprintf(stderr, "Failed to create account: %s\n", error->message);
+      g_error_free(error);
+      result = FALSE;
+    }
+  }
+
+  inf_browser_get_root(browser, &root);
+  g_array_append_val(test.nodes, root);
+
+  /* Fill the cache for the root node, so that later nodes inherit from
+   * a cached entry. */
+  if(result == TRUE)
+    result = inf_test_directory_acl_check_all(&test);
+
+  for(i = 0; i < n_nodes && result == TRUE; ++i)
+  {
+    /* Copy the parent, since adding the node appends to the array */
+    parent = g_array_index(
+      test.nodes,
+      InfBrowserIter,
+      g_random_int_range(0, test.nodes->len)
+    );
+
+    name = g_strdup_printf("Node %u", i);
+    sheet_set = inf_test_directory_acl_random_sheets(&test);
+
+    inf_browser_add_subdirectory(
+      browser,
+      &parent,
+      name,
+      sheet_set->n_sheets > 0 ? sheet_set : NULL,
+      inf_test_directory_acl_add_func,
+      &test
+    );
+
+    inf_acl_sheet_set_free(sheet_set);
+    g_free(name);
+
+    if(test.nodes->len != i + 2)
+      result = FALSE;
+  }
+
+  if(result == TRUE)
+    result = inf_test_directory_acl_check_all(&test);
+
+  /* Only change the ACLs of non-root nodes, so that the default
+   * permissions stay intact. */
+  for(i = 0; i < n_changes && test.nodes->len > 1 && result == TRUE; ++i)
+  {
+    sheet_set = inf_test_directory_acl_random_sheets(&test);
+
+    inf_browser_set_acl(
+      browser,
+      &g_array_index(
+        test.nodes,
+        InfBrowserIter,
+        g_random_int_range(1, test.nodes->len)
+      ),
+      sheet_set,
+      inf_test_directory_acl_set_func,
+      NULL
+    );
+
+    inf_acl_sheet_set_free(sheet_set);
+    result = inf_test_directory_acl_check_all(&test);
+  }
+
+  if(result == TRUE)
+    inf_test_directory_acl_benchmark(&test);
+
+  g_array_free(test.nodes, TRUE);
+  g_object_unref(test.directory);
+  g_object_unref(manager);
+  g_object_unref(io);
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint n_nodes;
+  guint n_changes;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  n_nodes = 500;
+  if(argc > 1)
+    n_nodes = strtoul(argv[1], NULL, 10);
+
+  n_changes = 50;
+  if(argc > 2)
+    n_changes = strtoul(argv[2], NULL, 10);
+
+  if(!inf_test_directory_acl_run(n_nodes, n_changes))
+  {
+    fprintf(stderr, "Cached permissions do not match\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
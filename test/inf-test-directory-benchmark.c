@@ -0,0 +1,290 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Adds many subdirectories to a single folder of an InfdDirectory without
+ * storage, in random order, looks them up by name and removes them again.
+ * Prints the time per operation, and verifies that the children are kept
+ * in sorted order and that names which only differ in case are rejected. */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-browser.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _InfTestDirectoryBenchmark InfTestDirectoryBenchmark;
+struct _InfTestDirectoryBenchmark {
+  InfdDirectory* directory;
+  guint failed;
+};
+
+static void
+inf_test_directory_benchmark_add_func(InfRequest* request,
+                                      const InfRequestResult* result,
+                                      const GError* error,
+                                      gpointer user_data)
+{
+  InfTestDirectoryBenchmark* test;
+  test = (InfTestDirectoryBenchmark*)user_data;
+
+  if(error != NULL)
+    ++test->failed;
+}
+
+static gchar*
+inf_test_directory_benchmark_name(guint index)
+{
+  return g_strdup_printf("Folder %u", index);
+}
+
+/* Shuffles the numbers 0 to count - 1 */
+static guint*
+inf_test_directory_benchmark_permutation(guint count)
+{
+  guint* permutation;
+  guint tmp;
+  guint i;
+  guint j;
+
+  permutation = g_malloc(sizeof(guint) * count);
+  for(i = 0; i < count; ++i)
+    permutation[i] = i;
+
+  for(i = count; i > 1; --i)
+  {
+    j = g_random_int_range(0, i);
+    tmp = permutation[i - 1];
+    permutation[i - 1] = permutation[j];
+    permutation[j] = tmp;
+  }
+
+  return permutation;
+}
+
+static gboolean
+inf_test_directory_benchmark_check_order(InfBrowser* browser,
+                                         const InfBrowserIter* parent,
+                                         guint count)
+{
+  InfBrowserIter iter;
+  gboolean result;
+  gchar* prev;
+  gchar* folded;
+  guint n;
+
+  prev = NULL;
+  n = 0;
+
+  iter = *parent;
+  for(result = inf_browser_get_child(browser, &iter);
+      result == TRUE;
+      result = inf_browser_get_next(browser, &iter))
+  {
+    folded = g_utf8_casefold(inf_browser_get_node_name(browser, &iter), -1);
+    if(prev != NULL && g_utf8_collate(prev, folded) >= 0)
+    {
+      g_free(folded);
+      g_free(prev);
+      return FALSE;
+    }
+
+    g_free(prev);
+    prev = folded;
+    ++n;
+  }
+
+  g_free(prev);
+  return n == count;
+}
+
+static gboolean
+inf_test_directory_benchmark_run(guint count)
+{
+  InfTestDirectoryBenchmark test;
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfBrowser* browser;
+  InfBrowserIter root;
+  InfBrowserIter iter;
+  GTimer* timer;
+  gdouble add_time;
+  gdouble lookup_time;
+  gdouble remove_time;
+  guint* permutation;
+  gchar* name;
+  gchar* upper;
+  gboolean result;
+  guint i;
+
+  io = inf_standalone_io_new();
+  manager = inf_communication_manager_new();
+  test.directory = infd_directory_new(INF_IO(io), NULL, manager);
+  test.failed = 0;
+  browser = INF_BROWSER(test.directory);
+  result = TRUE;
+
+  inf_browser_get_root(browser, &root);
+  permutation = inf_test_directory_benchmark_permutation(count);
+
+  timer = g_timer_new();
+  for(i = 0; i < count; ++i)
+  {
+    name = inf_test_directory_benchmark_name(permutation[i]);
+
+    inf_browser_add_subdirectory(
+      browser,
+      &root,
+      name,
+      NULL,
+      inf_test_directory_benchmark_add_func,
+      &test
+    );
+
+    g_free(name);
+  }
+
+  add_time = g_timer_elapsed(timer, NULL);
+  if(test.failed > 0)
+    result = FALSE;
+
+  if(!inf_test_directory_benchmark_check_order(browser, &root, count))
+  {
+    fprintf(stderr, "Children are not in sorted order\n");
+    result = FALSE;
+  }
+
+  /* Look up every node by its name, in a different random order */
+  g_free(permutation);
+  permutation = inf_test_directory_benchmark_permutation(count);
+
+  g_timer_start(timer);
+  for(i = 0; i < count; ++i)
+  {
+    name = inf_test_directory_benchmark_name(permutation[i]);
+    iter = root;
+
+    if(!infd_directory_iter_get_child_by_name(test.directory, &iter, name))
+      result = FALSE;
+    else if(strcmp(inf_browser_get_node_name(browser, &iter), name) != 0)
+      result = FALSE;
+
+    g_free(name);
+  }
+
+  lookup_time = g_timer_elapsed(timer, NULL);
+
+  /* Names differing only in case refer to the same node */
+  if(count > 0)
+  {
+    name = inf_test_directory_benchmark_name(count / 2);
+    upper = g_utf8_strup(name, -1);
+    iter = root;
+
+    if(!infd_directory_iter_get_child_by_name(test.directory, &iter, upper))
+      result = FALSE;
+
+    test.failed = 0;
+    inf_browser_add_subdirectory(
+      browser,
+      &root,
+      upper,
+      NULL,
+      inf_test_directory_benchmark_add_func,
+      &test
+    );
+
+    if(test.failed != 1)
+    {
+      fprintf(stderr, "Node \"%s\" was added twice\n", upper);
+      result = FALSE;
+    }
+
+    g_free(upper);
+    g_free(name);
+  }
+
+  g_timer_start(timer);
+  for(i = 0; i < count; ++i)
+  {
+    name = inf_test_directory_benchmark_name(permutation[i]);
+    iter = root;
+
+    if(infd_directory_iter_get_child_by_name(test.directory, &iter, name))
+      inf_browser_remove_node(browser, &iter, NULL, NULL);
+
+    g_free(name);
+  }
+
+  remove_time = g_timer_elapsed(timer, NULL);
+
+  iter = root;
+  if(inf_browser_get_child(browser, &iter))
+  {
+    fprintf(stderr, "Not all nodes were removed\n");
+    result = FALSE;
+  }
+
+  printf(
+    "%u nodes: %.2f us per add, %.2f us per lookup, %.2f us per remove\n",
+    count,
+    count > 0 ? add_time * 1e6 / count : 0.0,
+    count > 0 ? lookup_time * 1e6 / count : 0.0,
+    count > 0 ? remove_time * 1e6 / count : 0.0
+  );
+
+  g_timer_destroy(timer);
+  g_free(permutation);
+  g_object_unref(test.directory);
+  g_object_unref(manager);
+  g_object_unref(io);
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  guint count;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  count = 100000;
+  if(argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+
+  if(!inf_test_directory_benchmark_run(count))
+  {
+    fprintf(stderr, "Directory operations did not work correctly\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,254 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures how InfStandaloneIo scales with the number of idle sockets it
+ * watches, for each of its backends. A number of idle socket pairs is
+ * watched which never become readable, plus a smaller number of active
+ * ones to which data is written. The program reports the latency between
+ * writing a byte and the watch callback being run, and the CPU time per
+ * event when all active sockets become readable at once. */
+
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INF_TEST_IO_BENCHMARK_ROUNDS 1000
+
+static const gchar* const INF_TEST_IO_BENCHMARK_BACKENDS[] = {
+  "epoll",
+  "poll"
+};
+
+typedef struct _InfTestIoBenchmark InfTestIoBenchmark;
+struct _InfTestIoBenchmark {
+  InfStandaloneIo* io;
+  InfNativeSocket (*sockets)[2];
+  guint n_sockets;
+  guint received;
+};
+
+static void
+inf_test_io_benchmark_watch_func(InfNativeSocket* socket,
+                                 InfIoEvent event,
+                                 gpointer user_data)
+{
+  InfTestIoBenchmark* benchmark;
+  char c;
+
+  benchmark = (InfTestIoBenchmark*)user_data;
+
+  if(event & INF_IO_INCOMING)
+  {
+    if(read(*socket, &c, 1) == 1)
+      ++benchmark->received;
+  }
+}
+
+static gboolean
+inf_test_io_benchmark_open(InfTestIoBenchmark* benchmark,
+                           guint count)
+{
+  guint i;
+
+  benchmark->sockets = g_malloc(sizeof(InfNativeSocket[2]) * count);
+  benchmark->n_sockets = 0;
+
+  for(i = 0; i < count; ++i)
+  {
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, benchmark->sockets[i]) == -1)
+    {
+      fprintf(stderr, "socketpair() failed: %s\n", strerror(errno));
+      return FALSE;
+    }
+
+    ++benchmark->n_sockets;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_io_benchmark_close(InfTestIoBenchmark* benchmark)
+{
+  guint i;
+
+  for(i = 0; i < benchmark->n_sockets; ++i)
+  {
+    close(benchmark->sockets[i][0]);
+    close(benchmark->sockets[i][1]);
+  }
+
+  g_free(benchmark->sockets);
+}
+
+static void
+inf_test_io_benchmark_run(InfTestIoBenchmark* benchmark,
+                          const gchar* backend,
+                          guint idle,
+                          guint active)
+{
+  InfIoWatch** watches;
+  gint64 latency;
+  gint64 begin;
+  clock_t cpu;
+  guint expected;
+  guint index;
+  guint i;
+
+  g_setenv("LIBINFINITY_STANDALONE_IO_BACKEND", backend, TRUE);
+  benchmark->io = inf_standalone_io_new();
+  benchmark->received = 0;
+
+  /* The active sockets come first */
+  watches = g_malloc(sizeof(InfIoWatch*) * (idle + active));
+  for(i = 0; i < idle + active; ++i)
+  {
+    watches[i] = inf_io_add_watch(
+      INF_IO(benchmark->io),
+      &benchmark->sockets[i][0],
+      INF_IO_INCOMING | INF_IO_ERROR,
+      inf_test_io_benchmark_watch_func,
+      benchmark,
+      NULL
+    );
+  }
+
+  /* Wakeup latency for a single active socket */
+  latency = 0;
+  for(i = 0; i < INF_TEST_IO_BENCHMARK_ROUNDS; ++i)
+  {
+    index = g_random_int_range(0, active);
+    expected = benchmark->received + 1;
+
+    begin = g_get_monotonic_time();
+    if(write(benchmark->sockets[index][1], "x", 1) != 1)
+      fprintf(stderr, "write() failed: %s\n", strerror(errno));
+
+    while(benchmark->received < expected)
+      inf_standalone_io_iteration(benchmark->io);
+    latency += g_get_monotonic_time() - begin;
+  }
+
+  /* CPU time when all active sockets are readable */
+  cpu = clock();
+  for(i = 0; i < INF_TEST_IO_BENCHMARK_ROUNDS; ++i)
+  {
+    expected = benchmark->received + active;
+
+    for(index = 0; index < active; ++index)
+      if(write(benchmark->sockets[index][1], "x", 1) != 1)
+        fprintf(stderr, "write() failed: %s\n", strerror(errno));
+
+    while(benchmark->received < expected)
+      inf_standalone_io_iteration(benchmark->io);
+  }
+  cpu = clock() - cpu;
+
+  printf(
+    "%5s: %u idle, %u active: %8.2f us latency, %8.2f us CPU per event\n",
+    backend,
+    idle,
+    active,
+    (gdouble)latency / INF_TEST_IO_BENCHMARK_ROUNDS,
+    (gdouble)cpu * 1e6 / CLOCKS_PER_SEC / INF_TEST_IO_BENCHMARK_ROUNDS /
+      active
+  );
+
+  for(i = 0; i < idle + active; ++i)
+    inf_io_remove_watch(INF_IO(benchmark->io), watches[i]);
+
+  g_free(watches);
+  g_object_unref(benchmark->io);
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestIoBenchmark benchmark;
+  struct rlimit limit;
+  guint idle;
+  guint active;
+  guint i;
+
+  idle = 10000;
+  active = 100;
+
+  if(argc > 1)
+    idle = strtoul(argv[1], NULL, 10);
+  if(argc > 2)
+    active = strtoul(argv[2], NULL, 10);
+
+  if(active == 0)
+  {
+    fprintf(stderr, "Need at least one active socket\n");
+    return -1;
+  }
+
+  /* Every socket pair takes two file descriptors. If we are not allowed to
+   * open that many, reduce the number of idle sockets. */
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    if(limit.rlim_cur < 2 * (idle + active) + 32)
+    {
+      limit.rlim_cur = MIN(limit.rlim_max, 2 * (idle + active) + 32);
+      setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    if(limit.rlim_cur < 2 * (idle + active) + 32)
+    {
+      if(limit.rlim_cur < 2 * active + 32)
+      {
+        fprintf(stderr, "Too few file descriptors available\n");
+        return -1;
+      }
+
+      idle = (limit.rlim_cur - 32) / 2 - active;
+      fprintf(stderr, "File descriptor limit reached, using %u idle\n", idle);
+    }
+  }
+
+  if(!inf_test_io_benchmark_open(&benchmark, idle + active))
+  {
+    inf_test_io_benchmark_close(&benchmark);
+    return -1;
+  }
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_IO_BENCHMARK_BACKENDS); ++i)
+  {
+    inf_test_io_benchmark_run(
+      &benchmark,
+      INF_TEST_IO_BENCHMARK_BACKENDS[i],
+      idle,
+      active
+    );
+  }
+
+  inf_test_io_benchmark_close(&benchmark);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,198 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Makes a number of sockets report a hangup in the same poll, and in the
+ * first callback closes all other sockets and watches a fresh socket under
+ * each of their numbers. The fresh sockets have no events, so their
+ * watches must not run, even though events for the old sockets with the
+ * same numbers were pending. This is done for each backend of
+ * InfStandaloneIo. */
+
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define INF_TEST_IO_FD_REUSE_SOCKETS 8
+
+static const gchar* const INF_TEST_IO_FD_REUSE_BACKENDS[] = {
+  "epoll",
+  "poll"
+};
+
+typedef struct _InfTestIoFdReuse InfTestIoFdReuse;
+typedef struct _InfTestIoFdReuseSocket InfTestIoFdReuseSocket;
+
+struct _InfTestIoFdReuseSocket {
+  InfTestIoFdReuse* test;
+  InfNativeSocket socket;
+  /* The other end of a fresh socket, or -1 */
+  InfNativeSocket peer;
+  InfIoWatch* watch;
+  gboolean fresh;
+};
+
+struct _InfTestIoFdReuse {
+  InfStandaloneIo* io;
+  InfTestIoFdReuseSocket sockets[INF_TEST_IO_FD_REUSE_SOCKETS];
+  gboolean replaced;
+  gboolean result;
+};
+
+static void
+inf_test_io_fd_reuse_func(InfNativeSocket* socket,
+                          InfIoEvent events,
+                          gpointer user_data)
+{
+  InfTestIoFdReuseSocket* entry;
+  InfTestIoFdReuseSocket* other;
+  InfTestIoFdReuse* test;
+  int pair[2];
+  guint i;
+
+  entry = (InfTestIoFdReuseSocket*)user_data;
+  test = entry->test;
+
+  /* Nothing has been written to a fresh socket, and its peer is open */
+  if(entry->fresh)
+  {
+    fprintf(stderr, "Stale events 0x%x for fresh socket %d\n",
+            (unsigned int)events, entry->socket);
+    test->result = FALSE;
+  }
+
+  inf_io_remove_watch(INF_IO(test->io), entry->watch);
+  entry->watch = NULL;
+
+  if(test->replaced)
+    return;
+
+  test->replaced = TRUE;
+  for(i = 0; i < INF_TEST_IO_FD_REUSE_SOCKETS; ++i)
+  {
+    other = &test->sockets[i];
+    if(other == entry || other->watch == NULL)
+      continue;
+
+    inf_io_remove_watch(INF_IO(test->io), other->watch);
+    close(other->socket);
+
+    /* Give the fresh socket the number of the old one */
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1 ||
+       dup2(pair[0], other->socket) == -1)
+    {
+      perror("Failed to replace socket");
+      test->result = FALSE;
+      other->watch = NULL;
+      continue;
+    }
+
+    close(pair[0]);
+    other->peer = pair[1];
+    other->fresh = TRUE;
+
+    other->watch = inf_io_add_watch(
+      INF_IO(test->io),
+      &other->socket,
+      INF_IO_INCOMING,
+      inf_test_io_fd_reuse_func,
+      other,
+      NULL
+    );
+  }
+}
+
+static gboolean
+inf_test_io_fd_reuse_run(const gchar* backend)
+{
+  InfTestIoFdReuse test;
+  InfTestIoFdReuseSocket* entry;
+  int pair[2];
+  guint i;
+
+  g_setenv("LIBINFINITY_STANDALONE_IO_BACKEND", backend, TRUE);
+
+  test.io = inf_standalone_io_new();
+  test.replaced = FALSE;
+  test.result = TRUE;
+
+  for(i = 0; i < INF_TEST_IO_FD_REUSE_SOCKETS; ++i)
+  {
+    entry = &test.sockets[i];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+    {
+      perror("socketpair() failed");
+      return FALSE;
+    }
+
+    /* Closing the peer makes the socket report a hangup */
+    close(pair[1]);
+
+    entry->test = &test;
+    entry->socket = pair[0];
+    entry->peer = -1;
+    entry->fresh = FALSE;
+    entry->watch = inf_io_add_watch(
+      INF_IO(test.io),
+      &entry->socket,
+      INF_IO_INCOMING,
+      inf_test_io_fd_reuse_func,
+      entry,
+      NULL
+    );
+  }
+
+  /* The first iteration runs the first callback, which replaces the other
+   * sockets. Give stale events a few more iterations to show up. */
+  for(i = 0; i < INF_TEST_IO_FD_REUSE_SOCKETS + 2; ++i)
+    inf_standalone_io_iteration_timeout(test.io, 10);
+
+  for(i = 0; i < INF_TEST_IO_FD_REUSE_SOCKETS; ++i)
+  {
+    entry = &test.sockets[i];
+    if(entry->watch != NULL)
+      inf_io_remove_watch(INF_IO(test.io), entry->watch);
+
+    close(entry->socket);
+    if(entry->peer != -1)
+      close(entry->peer);
+  }
+
+  g_object_unref(test.io);
+
+  printf("%s: %s\n", backend, test.result ? "OK" : "FAILED");
+  return test.result;
+}
+
+int main(int argc, char* argv[])
+{
+  gboolean result;
+  guint i;
+
+  result = TRUE;
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_IO_FD_REUSE_BACKENDS); ++i)
+    if(!inf_test_io_fd_reuse_run(INF_TEST_IO_FD_REUSE_BACKENDS[i]))
+      result = FALSE;
+
+  return result ? 0 : -1;
+}
+
+/* vim:set et sw=2 ts=2: */
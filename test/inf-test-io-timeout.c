@@ -0,0 +1,204 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Schedules many timeouts on an InfStandaloneIo, removes a part of them
+ * again, partly from within other timeout callbacks, and verifies that
+ * every remaining timeout fires exactly once, not before it is due and in
+ * the order in which they are due. */
+
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INF_TEST_IO_TIMEOUT_MAX_MSECS 200
+
+typedef struct _InfTestIoTimeout InfTestIoTimeout;
+typedef struct _InfTestIoTimeoutEntry InfTestIoTimeoutEntry;
+
+struct _InfTestIoTimeoutEntry {
+  InfTestIoTimeout* test;
+  InfIoTimeout* timeout;
+  /* The deadline lies between these two times */
+  gint64 earliest;
+  gint64 latest;
+  guint fired;
+  gboolean removed;
+  /* Another entry to remove when this one fires, or -1 */
+  gint remove;
+};
+
+struct _InfTestIoTimeout {
+  InfStandaloneIo* io;
+  InfTestIoTimeoutEntry* entries;
+  guint n_entries;
+  guint pending;
+  gint64 last_earliest;
+  gboolean result;
+};
+
+static void
+inf_test_io_timeout_func(gpointer user_data)
+{
+  InfTestIoTimeoutEntry* entry;
+  InfTestIoTimeoutEntry* other;
+  InfTestIoTimeout* test;
+
+  entry = (InfTestIoTimeoutEntry*)user_data;
+  test = entry->test;
+
+  /* A timeout must not fire before it is due, and not before a timeout
+   * which is due earlier. */
+  if(entry->removed || entry->fired > 0 ||
+     g_get_monotonic_time() < entry->earliest ||
+     entry->latest < test->last_earliest)
+  {
+    test->result = FALSE;
+  }
+
+  ++entry->fired;
+  --test->pending;
+  entry->timeout = NULL;
+
+  if(entry->earliest > test->last_earliest)
+    test->last_earliest = entry->earliest;
+
+  if(entry->remove >= 0)
+  {
+    other = &test->entries[entry->remove];
+    if(other->timeout != NULL)
+    {
+      inf_io_remove_timeout(INF_IO(test->io), other->timeout);
+      other->timeout = NULL;
+      other->removed = TRUE;
+      --test->pending;
+    }
+  }
+}
+
+static gboolean
+inf_test_io_timeout_run(guint count)
+{
+  InfTestIoTimeout test;
+  InfTestIoTimeoutEntry* entry;
+  GTimer* timer;
+  gdouble add_time;
+  gdouble remove_time;
+  guint msecs;
+  guint removed;
+  guint i;
+
+  test.io = inf_standalone_io_new();
+  test.entries = g_malloc(sizeof(InfTestIoTimeoutEntry) * count);
+  test.n_entries = count;
+  test.pending = count;
+  test.last_earliest = 0;
+  test.result = TRUE;
+
+  timer = g_timer_new();
+  for(i = 0; i < count; ++i)
+  {
+    entry = &test.entries[i];
+    msecs = g_random_int_range(0, INF_TEST_IO_TIMEOUT_MAX_MSECS);
+
+    entry->test = &test;
+    entry->earliest = g_get_monotonic_time() + msecs * 1000;
+    entry->fired = 0;
+    entry->removed = FALSE;
+    entry->remove = -1;
+    if(g_random_int_range(0, 10) == 0)
+      entry->remove = g_random_int_range(0, count);
+
+    entry->timeout = inf_io_add_timeout(
+      INF_IO(test.io),
+      msecs,
+      inf_test_io_timeout_func,
+      entry,
+      NULL
+    );
+
+    entry->latest = g_get_monotonic_time() + msecs * 1000;
+  }
+
+  add_time = g_timer_elapsed(timer, NULL);
+
+  /* Remove about a third of the timeouts right away */
+  g_timer_start(timer);
+  removed = 0;
+  for(i = 0; i < count; ++i)
+  {
+    entry = &test.entries[i];
+    if(g_random_int_range(0, 3) == 0)
+    {
+      inf_io_remove_timeout(INF_IO(test.io), entry->timeout);
+      entry->timeout = NULL;
+      entry->removed = TRUE;
+      --test.pending;
+      ++removed;
+    }
+  }
+
+  remove_time = g_timer_elapsed(timer, NULL);
+
+  g_timer_start(timer);
+  while(test.pending > 0 && test.result == TRUE)
+    inf_standalone_io_iteration(test.io);
+
+  printf(
+    "%u timeouts: %.2f us per add, %.2f us per remove, %u fired in %.3f s\n",
+    count,
+    add_time * 1e6 / count,
+    removed > 0 ? remove_time * 1e6 / removed : 0.0,
+    count - removed,
+    g_timer_elapsed(timer, NULL)
+  );
+
+  for(i = 0; i < count; ++i)
+  {
+    entry = &test.entries[i];
+    if(entry->fired != (entry->removed ? 0 : 1))
+      test.result = FALSE;
+  }
+
+  g_timer_destroy(timer);
+  g_free(test.entries);
+  g_object_unref(test.io);
+
+  return test.result;
+}
+
+int main(int argc, char* argv[])
+{
+  guint count;
+
+  count = 100000;
+  if(argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+
+  if(!inf_test_io_timeout_run(count))
+  {
+    fprintf(stderr, "Timeouts did not fire correctly\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -34,21 +34,34 @@
 #include <libinfinity/common/inf-init.h>
 
 #include <string.h>
+#include <stdlib.h>
+
+/* Number of joiners connecting at the same time in each round */
+static const guint INF_TEST_MASS_JOIN_COUNTS[] = { 50, 200, 500 };
+
+typedef struct _InfTestMassJoin InfTestMassJoin;
 
 typedef struct _InfTestMassJoiner InfTestMassJoiner;
 struct _InfTestMassJoiner {
+  InfTestMassJoin* massjoin;
   InfCommunicationManager* communication_manager;
   InfcBrowser* browser;
   InfcSessionProxy* session;
 
   gchar* document;
   gchar* username;
+
+  /* Time at which the joiner started to connect */
+  gint64 start_time;
 };
 
-typedef struct _InfTestMassJoin InfTestMassJoin;
 struct _InfTestMassJoin {
   InfIo* io;
   GSList* joiners;
+  GSList* finished;
+
+  /* Time from connecting until the user is joined, in microseconds */
+  GArray* latencies;
 };
 
 static InfSession*
@@ -88,11 +101,19 @@ inf_test_mass_join_user_join_finished_cb(InfRequest* request,
                                          gpointer user_data)
 {
   InfTestMassJoiner* joiner;
+  gint64 latency;
+
   joiner = (InfTestMassJoiner*)user_data;
 
   if(error == NULL)
   {
+    latency = g_get_monotonic_time() - joiner->start_time;
+    g_array_append_val(joiner->massjoin->latencies, latency);
+
     fprintf(stdout, "Joiner %s: User joined!\n", joiner->username);
+
+    /* The joiner is done, make room for the next round */
+    inf_xml_connection_close(infc_browser_get_connection(joiner->browser));
   }
   else
   {
@@ -342,6 +363,7 @@ inf_test_mass_join_browser_notify_status_cb(GObject* object,
   case INF_BROWSER_CLOSED:
     fprintf(stdout, "Joiner %s: Disconnected\n", joiner->username);
     massjoin->joiners = g_slist_remove(massjoin->joiners, joiner);
+    massjoin->finished = g_slist_prepend(massjoin->finished, joiner);
     if(massjoin->joiners == NULL)
       inf_standalone_io_loop_quit(INF_STANDALONE_IO(massjoin->io));
     break;
@@ -379,6 +401,7 @@ inf_test_mass_join_connect(InfTestMassJoin* massjoin,
   );
 
   joiner = g_slice_new(InfTestMassJoiner);
+  joiner->massjoin = massjoin;
   joiner->communication_manager = inf_communication_manager_new();
   joiner->browser = infc_browser_new(
     massjoin->io,
@@ -388,6 +411,7 @@ inf_test_mass_join_connect(InfTestMassJoin* massjoin,
   joiner->session = NULL;
   joiner->document = g_strdup(document);
   joiner->username = g_strdup(username);
+  joiner->start_time = g_get_monotonic_time();
 
   g_object_unref(xmpp);
   g_object_unref(tcp);
@@ -416,11 +440,100 @@ inf_test_mass_join_connect(InfTestMassJoin* massjoin,
     );
 
     g_error_free(error);
-    massjoin->joiners = g_slist_remove(massjoin->joiners, joiner);
 
-    if(massjoin->joiners == NULL)
-      inf_standalone_io_loop_quit(INF_STANDALONE_IO(massjoin->io));
+    /* The loop is not running yet, so there is no need to quit it */
+    if(g_slist_find(massjoin->joiners, joiner) != NULL)
+    {
+      massjoin->joiners = g_slist_remove(massjoin->joiners, joiner);
+      massjoin->finished = g_slist_prepend(massjoin->finished, joiner);
+    }
+  }
+}
+
+static void
+inf_test_mass_join_joiner_free(gpointer data)
+{
+  InfTestMassJoiner* joiner;
+  joiner = (InfTestMassJoiner*)data;
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(joiner->browser),
+    G_CALLBACK(inf_test_mass_join_browser_notify_status_cb),
+    joiner->massjoin
+  );
+
+  g_object_unref(joiner->browser);
+  g_object_unref(joiner->communication_manager);
+  g_free(joiner->document);
+  g_free(joiner->username);
+  g_slice_free(InfTestMassJoiner, joiner);
+}
+
+static gint
+inf_test_mass_join_latency_cmp(gconstpointer first,
+                               gconstpointer second)
+{
+  gint64 a = *(const gint64*)first;
+  gint64 b = *(const gint64*)second;
+  return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+static void
+inf_test_mass_join_round(InfTestMassJoin* massjoin,
+                         guint count)
+{
+  GArray* latencies;
+  gint64 sum;
+  guint i;
+  gchar* name;
+
+  for(i = 0; i < count; ++i)
+  {
+    name = g_strdup_printf("MassJoin%03u", i);
+
+    inf_test_mass_join_connect(
+      massjoin,
+      "127.0.0.1",
+      inf_protocol_get_default_port(),
+      "Test",
+      name
+    );
+
+    g_free(name);
   }
+
+  if(massjoin->joiners != NULL)
+    inf_standalone_io_loop(INF_STANDALONE_IO(massjoin->io));
+
+  g_slist_free_full(massjoin->finished, inf_test_mass_join_joiner_free);
+  massjoin->finished = NULL;
+
+  latencies = massjoin->latencies;
+  g_array_sort(latencies, inf_test_mass_join_latency_cmp);
+
+  if(latencies->len == 0)
+  {
+    printf("%u joiners: none joined\n", count);
+  }
+  else
+  {
+    sum = 0;
+    for(i = 0; i < latencies->len; ++i)
+      sum += g_array_index(latencies, gint64, i);
+
+    printf(
+      "%u joiners: %u joined, latency min %.1f ms, mean %.1f ms, "
+      "median %.1f ms, max %.1f ms\n",
+      count,
+      latencies->len,
+      g_array_index(latencies, gint64, 0) / 1000.0,
+      (double)sum / latencies->len / 1000.0,
+      g_array_index(latencies, gint64, latencies->len / 2) / 1000.0,
+      g_array_index(latencies, gint64, latencies->len - 1) / 1000.0
+    );
+  }
+
+  g_array_set_size(latencies, 0);
 }
 
 int
@@ -429,8 +542,7 @@ main(int argc,
 {
   InfTestMassJoin massjoin;
   GError* error;
-  int i;
-  gchar* name;
+  guint i;
 
   error = NULL;
   if(!inf_init(&error))
@@ -441,24 +553,25 @@ main(int argc,
 
   massjoin.io = INF_IO(inf_standalone_io_new());
   massjoin.joiners = NULL;
+  massjoin.finished = NULL;
+  massjoin.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
 
-  for(i = 0; i < 128; ++i)
+  /* Each round connects all joiners at once and waits until each of them
+   * has joined a user into the session, or failed to. The joiners of a
+   * round reuse the user names of the previous round. */
+  if(argc > 1)
   {
-    name = g_strdup_printf("MassJoin%03d", i);
-
-    inf_test_mass_join_connect(
-      &massjoin,
-      "127.0.0.1",
-      inf_protocol_get_default_port(),
-      "Test",
-      name
-    );
-
-    g_free(name);
-    //g_usleep(100000);
+    for(i = 1; i < (guint)argc; ++i)
+      inf_test_mass_join_round(&massjoin, strtoul(argv[i], NULL, 10));
+  }
+  else
+  {
+    for(i = 0; i < G_N_ELEMENTS(INF_TEST_MASS_JOIN_COUNTS); ++i)
+      inf_test_mass_join_round(&massjoin, INF_TEST_MASS_JOIN_COUNTS[i]);
   }
 
-  inf_standalone_io_loop(INF_STANDALONE_IO(massjoin.io));
+  g_array_free(massjoin.latencies, TRUE);
+  g_object_unref(massjoin.io);
   return 0;
 }
 
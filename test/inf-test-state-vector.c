@@ -20,6 +20,7 @@
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-user.h>
 #include <string.h>
+#include <stdlib.h>
 
 static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
   char* is;
@@ -127,6 +128,108 @@ static void l_test() {
   apply(free, (vec_));
 }
 
+static void max_min_test() {
+  InfAdoptedStateVector* vec, * vec_;
+
+  vec  = apply(from_string, ("1:10;2:5;5:3", NULL));
+  vec_ = apply(from_string, ("1:7;3:4;5:8;6:0", NULL));
+
+  apply(max, (vec, vec_));
+  cmp("1:10;2:5;3:4;5:8", vec);
+  g_assert(apply(causally_before, (vec_, vec)));
+
+  apply(min, (vec, vec_));
+  cmp("1:7;3:4;5:8", vec);
+
+  apply(free, (vec));
+  vec = apply(from_string, ("2:5", NULL));
+  apply(min, (vec, vec_));
+  cmp("", vec);
+
+  apply(free, (vec));
+  apply(free, (vec_));
+}
+
+/* The least common successor as it used to be computed by
+ * InfAdoptedAlgorithm, for comparison. */
+static InfAdoptedStateVector*
+reference_lcs(InfAdoptedStateVector* first,
+              InfAdoptedStateVector* second,
+              guint n_users)
+{
+  InfAdoptedStateVector* result;
+  guint id;
+
+  result = inf_adopted_state_vector_new();
+  for (id = 1; id <= n_users; ++id) {
+    inf_adopted_state_vector_set(
+      result,
+      id,
+      MAX(
+        inf_adopted_state_vector_get(first, id),
+        inf_adopted_state_vector_get(second, id)
+      )
+    );
+  }
+
+  return result;
+}
+
+static void benchmark(guint n_users, guint iterations) {
+  InfAdoptedStateVector* first, * second, * result;
+  gint64 start;
+  gint64 reference_time;
+  gint64 max_time;
+  gint64 before_time;
+  guint id;
+  guint i;
+
+  first = inf_adopted_state_vector_new();
+  second = inf_adopted_state_vector_new();
+  for (id = 1; id <= n_users; ++id) {
+    inf_adopted_state_vector_set(first, id, rand() % 1000);
+    inf_adopted_state_vector_set(second, id, rand() % 1000);
+  }
+
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; ++i) {
+    result = reference_lcs(first, second, n_users);
+    inf_adopted_state_vector_free(result);
+  }
+  reference_time = g_get_monotonic_time() - start;
+
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; ++i) {
+    result = inf_adopted_state_vector_copy(first);
+    inf_adopted_state_vector_max(result, second);
+    inf_adopted_state_vector_free(result);
+  }
+  max_time = g_get_monotonic_time() - start;
+
+  result = inf_adopted_state_vector_copy(first);
+  inf_adopted_state_vector_max(result, second);
+
+  /* Compare against a vector that first is causally before, so that all
+   * components need to be looked at. */
+  start = g_get_monotonic_time();
+  for (i = 0; i < iterations; ++i)
+    g_assert(inf_adopted_state_vector_causally_before(first, result));
+  before_time = g_get_monotonic_time() - start;
+
+  g_assert(inf_adopted_state_vector_causally_before(second, result));
+  inf_adopted_state_vector_free(result);
+
+  printf("%u users: get/set lcs %.3f us, max %.3f us, "
+         "causally_before %.3f us\n",
+         n_users,
+         (double)reference_time / iterations,
+         (double)max_time / iterations,
+         (double)before_time / iterations);
+
+  inf_adopted_state_vector_free(first);
+  inf_adopted_state_vector_free(second);
+}
+
 int main(int argc, char* argv[])
 {
   guint users[2];
@@ -158,6 +261,10 @@ int main(int argc, char* argv[])
 
   inf_adopted_state_vector_free(vec);
   l_test();
+  max_min_test();
+
+  benchmark(10, argc > 1 ? atoi(argv[1]) : 10000);
+  benchmark(500, argc > 1 ? atoi(argv[1]) : 10000);
   return 0;
 }
 
@@ -0,0 +1,281 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Modifies a text buffer while asynchronous writes of it to a filesystem
+ * storage are running, and verifies that the document on disk matches the
+ * snapshot taken for the last write once all writes have finished, even
+ * though the writes may finish in a different order. */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-user-table.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_TEXT_ASYNC_WRITE_PATH "/test"
+
+typedef struct _InfTestTextAsyncWrite InfTestTextAsyncWrite;
+struct _InfTestTextAsyncWrite {
+  guint pending;
+  gboolean result;
+};
+
+static void
+inf_test_text_async_write_done_cb(InfdStorage* storage,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfTestTextAsyncWrite* test;
+  test = (InfTestTextAsyncWrite*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Write failed: %s\n", error->message);
+    test->result = FALSE;
+  }
+
+  --test->pending;
+}
+
+static void
+inf_test_text_async_write_insert(InfTextBuffer* buffer,
+                                 InfUser* user)
+{
+  gchar text[1024];
+  guint len;
+  guint i;
+
+  len = g_random_int_range(1, sizeof(text));
+  for(i = 0; i < len; ++i)
+    text[i] = (i % 64 == 63) ? '\n' : 'a' + g_random_int_range(0, 26);
+
+  inf_text_buffer_insert_text(
+    buffer,
+    g_random_int_range(0, inf_text_buffer_get_length(buffer) + 1),
+    text,
+    len,
+    len,
+    user
+  );
+}
+
+static gboolean
+inf_test_text_async_write_check(InfdFilesystemStorage* storage,
+                                InfTextChunk* expected)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+  gchar* expected_text;
+  gsize expected_bytes;
+  GError* error;
+  gboolean result;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  error = NULL;
+
+  result = inf_text_filesystem_format_read(
+    storage,
+    INF_TEST_TEXT_ASYNC_WRITE_PATH,
+    user_table,
+    buffer,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    fprintf(stderr, "Failed to read document: %s\n", error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    text = inf_text_chunk_get_text(chunk, &bytes);
+    expected_text = inf_text_chunk_get_text(expected, &expected_bytes);
+
+    if(bytes != expected_bytes || memcmp(text, expected_text, bytes) != 0)
+    {
+      fprintf(stderr, "Document on disk is not the last snapshot\n");
+      result = FALSE;
+    }
+
+    g_free(text);
+    g_free(expected_text);
+    inf_text_chunk_free(chunk);
+  }
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestTextAsyncWrite test;
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfUser* user;
+  InfTextChunk* expected;
+  InfAsyncOperation* operation;
+  GError* error;
+  gchar* root_directory;
+  gchar* full_path;
+  GDir* dir;
+  guint n_files;
+  guint count;
+  guint i;
+
+  count = 100;
+  if(argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+
+  error = NULL;
+  root_directory = g_dir_make_tmp("inf-test-text-async-write-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(root_directory);
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  user = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", 1,
+      "name", "Test",
+      "hue", 0.5,
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, user);
+
+  test.pending = 0;
+  test.result = TRUE;
+  expected = NULL;
+
+  for(i = 0; i < count && test.result == TRUE; ++i)
+  {
+    inf_test_text_async_write_insert(buffer, i % 2 == 0 ? user : NULL);
+
+    operation = inf_text_filesystem_format_write_async(
+      storage,
+      INF_IO(io),
+      INF_TEST_TEXT_ASYNC_WRITE_PATH,
+      user_table,
+      buffer,
+      inf_test_text_async_write_done_cb,
+      &test,
+      &error
+    );
+
+    if(operation == NULL)
+    {
+      fprintf(stderr, "Failed to start write: %s\n", error->message);
+      g_error_free(error);
+      error = NULL;
+      test.result = FALSE;
+      break;
+    }
+
+    ++test.pending;
+
+    if(expected != NULL) inf_text_chunk_free(expected);
+    expected = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    /* Change the buffer while the write is running */
+    inf_test_text_async_write_insert(buffer, user);
+    if(g_random_int_range(0, 4) == 0)
+      inf_standalone_io_iteration_timeout(io, 0);
+  }
+
+  while(test.pending > 0)
+    inf_standalone_io_iteration(io);
+
+  if(test.result == TRUE && expected != NULL)
+    test.result = inf_test_text_async_write_check(storage, expected);
+
+  /* No temporary files must be left behind */
+  n_files = 0;
+  dir = g_dir_open(root_directory, 0, NULL);
+  if(dir != NULL)
+  {
+    while(g_dir_read_name(dir) != NULL)
+      ++n_files;
+    g_dir_close(dir);
+  }
+
+  if(n_files != 1)
+  {
+    fprintf(stderr, "%u files in storage, expected 1\n", n_files);
+    test.result = FALSE;
+  }
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText",
+    INF_TEST_TEXT_ASYNC_WRITE_PATH,
+    NULL
+  );
+
+  g_unlink(full_path);
+  g_rmdir(root_directory);
+
+  g_free(full_path);
+  if(expected != NULL) inf_text_chunk_free(expected);
+  g_object_unref(user);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  g_object_unref(storage);
+  g_object_unref(io);
+  g_free(root_directory);
+
+  if(test.result == FALSE)
+    return -1;
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,626 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Writes a text session with InfTextFilesystemJournal after every change,
+ * then simulates a crash in the middle of appending to the journal by
+ * cutting off or damaging the journal at many positions, and verifies that
+ * reading the session yields the document as of the last complete write.
+ * Afterwards, writes large changes asynchronously so that the journal gets
+ * compacted in the background while the buffer is modified, and verifies
+ * that the document on disk is complete, and that removing the note
+ * removes its journal. */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-user-table.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_TEXT_JOURNAL_PATH "/test"
+
+typedef struct _InfTestTextJournal InfTestTextJournal;
+struct _InfTestTextJournal {
+  InfdFilesystemStorage* storage;
+  gchar* journal_path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfUser* users[3];
+  guint pending;
+  gboolean result;
+};
+
+static gchar*
+inf_test_text_journal_get_text(InfTextBuffer* buffer,
+                               gsize* bytes)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, bytes);
+  inf_text_chunk_free(chunk);
+  return text;
+}
+
+static void
+inf_test_text_journal_change(InfTestTextJournal* test,
+                             guint max_len)
+{
+  gchar* text;
+  guint length;
+  guint len;
+  guint pos;
+  guint i;
+
+  length = inf_text_buffer_get_length(test->buffer);
+  if(length > 0 && g_random_int_range(0, 3) == 0)
+  {
+    pos = g_random_int_range(0, length);
+    len = g_random_int_range(1, MIN(length - pos, max_len) + 1);
+    inf_text_buffer_erase_text(test->buffer, pos, len, NULL);
+  }
+  else
+  {
+    len = g_random_int_range(1, max_len + 1);
+    text = g_malloc(len);
+    for(i = 0; i < len; ++i)
+      text[i] = (i % 64 == 63) ? '\n' : 'a' + g_random_int_range(0, 26);
+
+    inf_text_buffer_insert_text(
+      test->buffer,
+      g_random_int_range(0, length + 1),
+      text,
+      len,
+      len,
+      test->users[g_random_int_range(0, G_N_ELEMENTS(test->users))]
+    );
+
+    g_free(text);
+  }
+}
+
+/* Reads the session from disk and compares it to the given text */
+static gboolean
+inf_test_text_journal_check(InfTestTextJournal* test,
+                            const gchar* expected,
+                            gsize expected_bytes,
+                            gboolean open)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextFilesystemJournal* journal;
+  gchar* text;
+  gsize bytes;
+  GError* error;
+  gboolean result;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  error = NULL;
+  journal = NULL;
+
+  if(open)
+  {
+    journal = inf_text_filesystem_journal_open(
+      test->storage,
+      INF_TEST_TEXT_JOURNAL_PATH,
+      user_table,
+      buffer,
+      &error
+    );
+
+    result = journal != NULL;
+  }
+  else
+  {
+    result = inf_text_filesystem_format_read(
+      test->storage,
+      INF_TEST_TEXT_JOURNAL_PATH,
+      user_table,
+      buffer,
+      &error
+    );
+  }
+
+  if(result == FALSE)
+  {
+    fprintf(stderr, "Failed to read document: %s\n", error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    text = inf_test_text_journal_get_text(buffer, &bytes);
+    if(bytes != expected_bytes || memcmp(text, expected, bytes) != 0)
+    {
+      fprintf(stderr, "Document on disk is not the last written one\n");
+      result = FALSE;
+    }
+
+    g_free(text);
+  }
+
+  if(journal != NULL)
+    inf_text_filesystem_journal_free(journal);
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+static gboolean
+inf_test_text_journal_torn(InfTestTextJournal* test,
+                           guint count)
+{
+  InfTextFilesystemJournal* journal;
+  GError* error;
+  GPtrArray* texts;
+  GArray* sizes;
+  gsize bytes;
+  gchar* text;
+  gchar* contents;
+  gchar* damaged;
+  gsize length;
+  gsize cut;
+  guint index;
+  guint i;
+
+  journal = inf_text_filesystem_journal_new(
+    test->storage,
+    INF_TEST_TEXT_JOURNAL_PATH,
+    test->user_table,
+    test->buffer
+  );
+
+  /* Remember the document and the size of the journal after every write,
+   * as pairs of entries in sizes. The changes are small, so that the
+   * journal is not compacted. */
+  texts = g_ptr_array_new();
+  sizes = g_array_new(FALSE, FALSE, sizeof(gsize));
+  contents = NULL;
+  error = NULL;
+
+  for(i = 0; i < count; ++i)
+  {
+    inf_test_text_journal_change(test, 32);
+    if(!inf_text_filesystem_journal_write(journal, &error))
+    {
+      fprintf(stderr, "Failed to write journal: %s\n", error->message);
+      g_error_free(error);
+      test->result = FALSE;
+      break;
+    }
+
+    text = inf_test_text_journal_get_text(test->buffer, &bytes);
+    g_ptr_array_add(texts, text);
+    g_array_append_val(sizes, bytes);
+
+    if(!g_file_get_contents(test->journal_path, &contents, &length, NULL))
+      length = 0;
+    else
+      g_free(contents);
+
+    g_array_append_val(sizes, length);
+  }
+
+  if(test->result == TRUE &&
+     !g_file_get_contents(test->journal_path, &contents, &length, &error))
+  {
+    fprintf(stderr, "Failed to read journal: %s\n", error->message);
+    g_error_free(error);
+    test->result = FALSE;
+  }
+
+  /* Cut off the journal, or damage a byte, at random positions. The
+   * document read must be the one of the last write that the remaining
+   * journal contains completely. */
+  for(i = 0; i < count && test->result == TRUE; ++i)
+  {
+    cut = g_random_int_range(0, length + 1);
+    damaged = g_memdup(contents, length);
+    if(i % 2 == 1 && cut < length)
+      damaged[cut] ^= 0x01;
+
+    if(!g_file_set_contents(test->journal_path, damaged,
+                            i % 2 == 1 ? length : cut, &error))
+    {
+      fprintf(stderr, "Failed to damage journal: %s\n", error->message);
+      g_error_free(error);
+      test->result = FALSE;
+    }
+
+    g_free(damaged);
+
+    /* The first write is a snapshot without journal entries */
+    for(index = texts->len - 1; index > 0; --index)
+      if(g_array_index(sizes, gsize, 2 * index + 1) <= cut)
+        break;
+
+    text = g_ptr_array_index(texts, index);
+    bytes = g_array_index(sizes, gsize, 2 * index);
+
+    if(test->result == TRUE)
+    {
+      test->result =
+        inf_test_text_journal_check(test, text, bytes, i % 3 == 0);
+    }
+  }
+
+  /* Restore the journal, then continue it after a damaged tail */
+  if(test->result == TRUE)
+  {
+    inf_text_filesystem_journal_free(journal);
+    journal = NULL;
+
+    cut = length - g_random_int_range(1, 16);
+    if(!g_file_set_contents(test->journal_path, contents, cut, &error))
+    {
+      fprintf(stderr, "Failed to damage journal: %s\n", error->message);
+      g_error_free(error);
+      test->result = FALSE;
+    }
+  }
+
+  if(test->result == TRUE)
+  {
+    g_object_unref(test->buffer);
+    g_object_unref(test->user_table);
+    test->user_table = inf_user_table_new();
+    test->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+    journal = inf_text_filesystem_journal_open(
+      test->storage,
+      INF_TEST_TEXT_JOURNAL_PATH,
+      test->user_table,
+      test->buffer,
+      &error
+    );
+
+    if(journal == NULL)
+    {
+      fprintf(stderr, "Failed to open journal: %s\n", error->message);
+      g_error_free(error);
+      test->result = FALSE;
+    }
+    else
+    {
+      for(i = 0; i < G_N_ELEMENTS(test->users); ++i)
+      {
+        g_object_unref(test->users[i]);
+        test->users[i] = inf_user_table_lookup_user_by_id(
+          test->user_table,
+          i + 1
+        );
+
+        /* The user might not have written anything */
+        if(test->users[i] == NULL)
+        {
+          test->users[i] = INF_USER(
+            g_object_new(
+              INF_TEXT_TYPE_USER,
+              "id", i + 1,
+              "name", i == 0 ? "A" : (i == 1 ? "B" : "C"),
+              "hue", 0.1 * i,
+              NULL
+            )
+          );
+
+          inf_user_table_add_user(test->user_table, test->users[i]);
+        }
+        else
+        {
+          g_object_ref(test->users[i]);
+        }
+      }
+
+      inf_test_text_journal_change(test, 32);
+      if(!inf_text_filesystem_journal_write(journal, &error))
+      {
+        fprintf(stderr, "Failed to write journal: %s\n", error->message);
+        g_error_free(error);
+        test->result = FALSE;
+      }
+    }
+  }
+
+  if(test->result == TRUE)
+  {
+    text = inf_test_text_journal_get_text(test->buffer, &bytes);
+    test->result = inf_test_text_journal_check(test, text, bytes, FALSE);
+    g_free(text);
+  }
+
+  if(journal != NULL)
+    inf_text_filesystem_journal_free(journal);
+
+  for(i = 0; i < texts->len; ++i)
+    g_free(g_ptr_array_index(texts, i));
+  g_ptr_array_free(texts, TRUE);
+  g_array_free(sizes, TRUE);
+  g_free(contents);
+
+  return test->result;
+}
+
+static void
+inf_test_text_journal_done_cb(InfdStorage* storage,
+                              const GError* error,
+                              gpointer user_data)
+{
+  InfTestTextJournal* test;
+  test = (InfTestTextJournal*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Write failed: %s\n", error->message);
+    test->result = FALSE;
+  }
+
+  --test->pending;
+}
+
+static gboolean
+inf_test_text_journal_compact(InfTestTextJournal* test,
+                              InfStandaloneIo* io,
+                              guint count)
+{
+  InfTextFilesystemJournal* journal;
+  InfAsyncOperation* operation;
+  GError* error;
+  gchar* text;
+  gsize bytes;
+  gchar* contents;
+  gsize length;
+  guint i;
+
+  error = NULL;
+  journal = inf_text_filesystem_journal_new(
+    test->storage,
+    INF_TEST_TEXT_JOURNAL_PATH,
+    test->user_table,
+    test->buffer
+  );
+
+  for(i = 0; i < count && test->result == TRUE; ++i)
+  {
+    inf_test_text_journal_change(test, 4096);
+
+    operation = inf_text_filesystem_journal_write_async(
+      journal,
+      INF_IO(io),
+      inf_test_text_journal_done_cb,
+      test,
+      &error
+    );
+
+    if(operation == NULL)
+    {
+      fprintf(stderr, "Failed to start write: %s\n", error->message);
+      g_error_free(error);
+      test->result = FALSE;
+      break;
+    }
+
+    ++test->pending;
+
+    /* Change the buffer while a snapshot might be written */
+    inf_test_text_journal_change(test, 4096);
+    if(g_random_int_range(0, 4) == 0)
+      inf_standalone_io_iteration_timeout(io, 0);
+  }
+
+  while(test->pending > 0)
+    inf_standalone_io_iteration(io);
+
+  /* Once a write is reported, the document must be on disk without any
+   * further synchronous write */
+  if(test->result == TRUE)
+  {
+    operation = inf_text_filesystem_journal_write_async(
+      journal,
+      INF_IO(io),
+      inf_test_text_journal_done_cb,
+      test,
+      &error
+    );
+
+    if(operation == NULL)
+    {
+      fprintf(stderr, "Failed to start write: %s\n", error->message);
+      g_error_free(error);
+      test->result = FALSE;
+    }
+    else
+    {
+      ++test->pending;
+      while(test->pending > 0)
+        inf_standalone_io_iteration(io);
+
+      if(test->result == TRUE)
+      {
+        text = inf_test_text_journal_get_text(test->buffer, &bytes);
+        test->result = inf_test_text_journal_check(test, text, bytes, FALSE);
+        g_free(text);
+      }
+    }
+  }
+
+  if(test->result == TRUE &&
+     !inf_text_filesystem_journal_write(journal, &error))
+  {
+    fprintf(stderr, "Failed to write journal: %s\n", error->message);
+    g_error_free(error);
+    test->result = FALSE;
+  }
+
+  if(test->result == TRUE)
+  {
+    text = inf_test_text_journal_get_text(test->buffer, &bytes);
+    test->result = inf_test_text_journal_check(test, text, bytes, FALSE);
+
+    /* The journal must not grow without bounds */
+    if(g_file_get_contents(test->journal_path, &contents, &length, NULL))
+    {
+      if(length > MAX(2 * bytes, 2 * 65536))
+      {
+        fprintf(stderr, "Journal has not been compacted\n");
+        test->result = FALSE;
+      }
+
+      g_free(contents);
+    }
+
+    g_free(text);
+  }
+
+  inf_text_filesystem_journal_free(journal);
+  return test->result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestTextJournal test;
+  InfStandaloneIo* io;
+  GError* error;
+  gchar* root_directory;
+  gchar* full_path;
+  GDir* dir;
+  guint n_files;
+  guint count;
+  guint i;
+
+  count = 200;
+  if(argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+
+  error = NULL;
+  root_directory = g_dir_make_tmp("inf-test-text-journal-XXXXXX", &error);
+  if(root_directory == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  test.storage = infd_filesystem_storage_new(root_directory);
+  test.journal_path = infd_filesystem_storage_get_path(
+    test.storage,
+    "journal",
+    INF_TEST_TEXT_JOURNAL_PATH,
+    NULL
+  );
+
+  test.user_table = inf_user_table_new();
+  test.buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  test.pending = 0;
+  test.result = TRUE;
+
+  for(i = 0; i < G_N_ELEMENTS(test.users); ++i)
+  {
+    test.users[i] = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i + 1,
+        "name", i == 0 ? "A" : (i == 1 ? "B" : "C"),
+        "hue", 0.1 * i,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(test.user_table, test.users[i]);
+  }
+
+  if(inf_test_text_journal_torn(&test, count))
+    inf_test_text_journal_compact(&test, io, count);
+
+  /* Only the snapshot and the journal must be left, no temporary files */
+  n_files = 0;
+  dir = g_dir_open(root_directory, 0, NULL);
+  if(dir != NULL)
+  {
+    while(g_dir_read_name(dir) != NULL)
+      ++n_files;
+    g_dir_close(dir);
+  }
+
+  if(test.result == TRUE && n_files != 2)
+  {
+    fprintf(stderr, "%u files in storage, expected 2\n", n_files);
+    test.result = FALSE;
+  }
+
+  /* Removing the note must remove its journal, too, so that a new note
+   * with the same name does not pick it up */
+  if(test.result == TRUE)
+  {
+    if(!infd_storage_remove_node(INFD_STORAGE(test.storage), "InfText",
+                                 INF_TEST_TEXT_JOURNAL_PATH, &error))
+    {
+      fprintf(stderr, "Failed to remove note: %s\n", error->message);
+      g_error_free(error);
+      error = NULL;
+      test.result = FALSE;
+    }
+    else if(g_file_test(test.journal_path, G_FILE_TEST_EXISTS))
+    {
+      fprintf(stderr, "Journal is left over after removing the note\n");
+      test.result = FALSE;
+    }
+  }
+
+  full_path = infd_filesystem_storage_get_path(
+    test.storage,
+    "InfText",
+    INF_TEST_TEXT_JOURNAL_PATH,
+    NULL
+  );
+
+  g_unlink(full_path);
+  g_unlink(test.journal_path);
+  g_rmdir(root_directory);
+
+  g_free(full_path);
+  for(i = 0; i < G_N_ELEMENTS(test.users); ++i)
+    g_object_unref(test.users[i]);
+  g_object_unref(test.buffer);
+  g_object_unref(test.user_table);
+  g_free(test.journal_path);
+  g_object_unref(test.storage);
+  g_object_unref(io);
+  g_free(root_directory);
+
+  if(test.result == FALSE)
+    return -1;
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
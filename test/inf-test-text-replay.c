@@ -33,6 +33,44 @@
 
 #include <string.h>
 
+#ifdef __GLIBC__
+/* Count the calls to the memory allocator while replaying, so that the
+ * effect of changes that avoid allocations in the transformation code can
+ * be measured. Newer versions of glib ignore g_mem_set_vtable(), so we
+ * wrap the libc allocator directly. Run with G_SLICE=always-malloc to also
+ * count slice allocations with older versions of glib. */
+#define INF_TEST_TEXT_REPLAY_COUNT_ALLOCATIONS
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static guint64 inf_test_text_replay_allocations;
+
+void*
+malloc(size_t size)
+{
+  ++inf_test_text_replay_allocations;
+  return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb,
+       size_t size)
+{
+  ++inf_test_text_replay_allocations;
+  return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr,
+        size_t size)
+{
+  ++inf_test_text_replay_allocations;
+  return __libc_realloc(ptr, size);
+}
+#endif
+
 typedef struct _InfTestTextReplayUndoGroupingInfo
   InfTestTextReplayUndoGroupingInfo;
 struct _InfTestTextReplayUndoGroupingInfo {
@@ -189,6 +227,7 @@ inf_test_text_replay_request_typestring(InfAdoptedRequest* request)
 }
 
 static gint64 test;
+static guint requests;
 
 static void
 inf_test_text_replay_begin_execute_request_cb(InfAdoptedAlgorithm* algorithm,
@@ -247,6 +286,7 @@ inf_test_text_replay_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   gint64 time;
 
   time = g_get_monotonic_time();
+  ++requests;
 
   if(error == NULL)
   {
@@ -335,6 +375,29 @@ inf_test_text_replay_play_user_table_foreach_func(InfUser* user,
   inf_test_text_replay_add_undo_grouping(user_data, INF_ADOPTED_USER(user));
 }
 
+static void
+inf_test_text_replay_cache_statistics_foreach_func(InfUser* user,
+                                                   gpointer user_data)
+{
+  guint64* totals;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+
+  totals = (guint64*)user_data;
+
+  inf_adopted_request_log_get_cache_statistics(
+    inf_adopted_user_get_request_log(INF_ADOPTED_USER(user)),
+    &hits,
+    &misses,
+    &evictions
+  );
+
+  totals[0] += hits;
+  totals[1] += misses;
+  totals[2] += evictions;
+}
+
 /*
  * Entry point
  */
@@ -352,6 +415,9 @@ int main(int argc, char* argv[])
   InfUserTable* user_table;
   InfTestTextReplayUndoGroupingInfo data;
   GSList* item;
+  gint64 start;
+  gint64 elapsed;
+  guint64 cache_statistics[3];
 
   if(argc < 2)
   {
@@ -441,6 +507,12 @@ int main(int argc, char* argv[])
         &data
       );
 
+      requests = 0;
+#ifdef INF_TEST_TEXT_REPLAY_COUNT_ALLOCATIONS
+      inf_test_text_replay_allocations = 0;
+#endif
+
+      start = g_get_monotonic_time();
       if(!inf_adopted_session_replay_play_to_end(replay, &error))
       {
         fprintf(stderr, "%s\n", error->message);
@@ -451,6 +523,42 @@ int main(int argc, char* argv[])
       }
       else
       {
+        /* Note that this includes the time to verify the buffer contents
+         * after every request, so it is a lower bound. */
+        elapsed = g_get_monotonic_time() - start;
+        fprintf(
+          stderr,
+          "%u requests, %.0f requests/s",
+          requests,
+          elapsed > 0 ? requests * 1e6 / elapsed : 0.
+        );
+
+        cache_statistics[0] = cache_statistics[1] = cache_statistics[2] = 0;
+        inf_user_table_foreach_user(
+          user_table,
+          inf_test_text_replay_cache_statistics_foreach_func,
+          cache_statistics
+        );
+
+        fprintf(
+          stderr,
+          ", cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+          " misses, %" G_GUINT64_FORMAT " evictions",
+          cache_statistics[0],
+          cache_statistics[1],
+          cache_statistics[2]
+        );
+
+#ifdef INF_TEST_TEXT_REPLAY_COUNT_ALLOCATIONS
+        fprintf(
+          stderr,
+          ", %" G_GUINT64_FORMAT " allocations (%.1f per request)",
+          inf_test_text_replay_allocations,
+          requests > 0 ?
+            (gdouble)inf_test_text_replay_allocations / requests : 0.
+        );
+#endif
+
         fprintf(stderr, "\n");
         inf_test_util_print_buffer(INF_TEXT_BUFFER(buffer));
       }
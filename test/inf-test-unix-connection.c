@@ -0,0 +1,665 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Compares a local InfUnixConnection with XMPP over loopback TCP, once
+ * unsecured and once with TLS. For each transport it measures the time to
+ * set up a connection, the round trip time of a message that the server
+ * echoes back, and the time to send a batch of messages from the client to
+ * the server. Client and server run in the same process. The XMPP
+ * connections use binary encoding without compression, so that the
+ * difference is the transport and not the encoding. The content of every
+ * message is verified on arrival. Finally, a raw client sends a message
+ * whose element name is not a valid XML name, which the server must reject
+ * without passing it on. */
+
+#include <libinfinity/server/infd-unix-server.h>
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-unix-connection.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-certificate-credentials.h>
+#include <libinfinity/common/inf-cert-util.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-init.h>
+#include <libinfinity/common/inf-xml-binary-private.h>
+
+#include <gnutls/x509.h>
+#include <gnutls/gnutls.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define INF_TEST_UNIX_CONNECTION_TCP_PORT 6527
+#define INF_TEST_UNIX_CONNECTION_TLS_PORT 6528
+
+/* Roughly the size of a typical text request */
+#define INF_TEST_UNIX_CONNECTION_PAYLOAD \
+  "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do " \
+  "eiusmod tempor incididunt ut labore et dolore magna aliqua."
+
+typedef enum _InfTestUnixConnectionTransport {
+  INF_TEST_UNIX_CONNECTION_UNIX,
+  INF_TEST_UNIX_CONNECTION_TCP,
+  INF_TEST_UNIX_CONNECTION_TLS
+} InfTestUnixConnectionTransport;
+
+typedef struct _InfTestUnixConnectionMode InfTestUnixConnectionMode;
+struct _InfTestUnixConnectionMode {
+  const gchar* name;
+  InfTestUnixConnectionTransport transport;
+};
+
+static const InfTestUnixConnectionMode INF_TEST_UNIX_CONNECTION_MODES[] = {
+  { "unix", INF_TEST_UNIX_CONNECTION_UNIX },
+  { "tcp", INF_TEST_UNIX_CONNECTION_TCP },
+  { "tls", INF_TEST_UNIX_CONNECTION_TLS }
+};
+
+typedef struct _InfTestUnixConnectionResult InfTestUnixConnectionResult;
+struct _InfTestUnixConnectionResult {
+  gint64 setup;
+  gint64 round_trip;
+  gint64 throughput;
+};
+
+typedef struct _InfTestUnixConnection InfTestUnixConnection;
+struct _InfTestUnixConnection {
+  InfStandaloneIo* io;
+  InfXmlConnection* server_connection;
+  gboolean echo;
+
+  guint server_received;
+  guint client_received;
+  gboolean corrupted;
+};
+
+static xmlNodePtr
+inf_test_unix_connection_message(guint seq)
+{
+  xmlNodePtr xml;
+  gchar buf[16];
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"message");
+  g_snprintf(buf, sizeof(buf), "%u", seq);
+  xmlNewProp(xml, (const xmlChar*)"seq", (const xmlChar*)buf);
+  xmlNewProp(xml, (const xmlChar*)"pos", (const xmlChar*)"4711");
+  xmlNodeAddContent(xml, (const xmlChar*)INF_TEST_UNIX_CONNECTION_PAYLOAD);
+  return xml;
+}
+
+static gboolean
+inf_test_unix_connection_check(xmlNodePtr xml,
+                               guint seq)
+{
+  xmlChar* seq_attr;
+  xmlChar* pos_attr;
+  xmlChar* content;
+  gboolean result;
+
+  seq_attr = xmlGetProp(xml, (const xmlChar*)"seq");
+  pos_attr = xmlGetProp(xml, (const xmlChar*)"pos");
+  content = xmlNodeGetContent(xml);
+
+  result = strcmp((const char*)xml->name, "message") == 0 &&
+    seq_attr != NULL && strtoul((const char*)seq_attr, NULL, 10) == seq &&
+    pos_attr != NULL && strcmp((const char*)pos_attr, "4711") == 0 &&
+    content != NULL &&
+    strcmp((const char*)content, INF_TEST_UNIX_CONNECTION_PAYLOAD) == 0;
+
+  if(seq_attr != NULL) xmlFree(seq_attr);
+  if(pos_attr != NULL) xmlFree(pos_attr);
+  if(content != NULL) xmlFree(content);
+  return result;
+}
+
+static void
+inf_test_unix_connection_server_received_cb(InfXmlConnection* connection,
+                                            xmlNodePtr xml,
+                                            gpointer user_data)
+{
+  InfTestUnixConnection* test;
+  test = (InfTestUnixConnection*)user_data;
+
+  if(!inf_test_unix_connection_check(xml, test->server_received))
+    test->corrupted = TRUE;
+  ++test->server_received;
+
+  if(test->echo)
+    inf_xml_connection_send(connection, xmlCopyNode(xml, 1));
+}
+
+static void
+inf_test_unix_connection_client_received_cb(InfXmlConnection* connection,
+                                            xmlNodePtr xml,
+                                            gpointer user_data)
+{
+  InfTestUnixConnection* test;
+  test = (InfTestUnixConnection*)user_data;
+
+  if(!inf_test_unix_connection_check(xml, test->client_received))
+    test->corrupted = TRUE;
+  ++test->client_received;
+}
+
+static void
+inf_test_unix_connection_new_connection_cb(InfdXmlServer* server,
+                                           InfXmlConnection* connection,
+                                           gpointer user_data)
+{
+  InfTestUnixConnection* test;
+  test = (InfTestUnixConnection*)user_data;
+
+  g_assert(test->server_connection == NULL);
+  g_object_ref(connection);
+  test->server_connection = connection;
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_unix_connection_server_received_cb),
+    test
+  );
+}
+
+static gboolean
+inf_test_unix_connection_is_open(InfXmlConnection* connection)
+{
+  InfXmlConnectionStatus status;
+
+  if(connection == NULL)
+    return FALSE;
+
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+  return status == INF_XML_CONNECTION_OPEN;
+}
+
+static InfXmlConnection*
+inf_test_unix_connection_connect(InfTestUnixConnection* test,
+                                 const InfTestUnixConnectionMode* mode,
+                                 const gchar* path,
+                                 InfTcpConnection** tcp,
+                                 GError** error)
+{
+  InfIpAddress* addr;
+  InfXmlConnection* client;
+  InfXmppConnectionSecurityPolicy policy;
+  guint port;
+
+  *tcp = NULL;
+
+  if(mode->transport == INF_TEST_UNIX_CONNECTION_UNIX)
+  {
+    client = INF_XML_CONNECTION(
+      inf_unix_connection_new(INF_IO(test->io), path)
+    );
+
+    if(!inf_xml_connection_open(client, error))
+    {
+      g_object_unref(client);
+      return NULL;
+    }
+
+    return client;
+  }
+
+  if(mode->transport == INF_TEST_UNIX_CONNECTION_TLS)
+  {
+    port = INF_TEST_UNIX_CONNECTION_TLS_PORT;
+    policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
+  }
+  else
+  {
+    port = INF_TEST_UNIX_CONNECTION_TCP_PORT;
+    policy = INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED;
+  }
+
+  addr = inf_ip_address_new_loopback4();
+  *tcp = inf_tcp_connection_new_and_open(INF_IO(test->io), addr, port, error);
+  inf_ip_address_free(addr);
+
+  if(*tcp == NULL)
+    return NULL;
+
+  /* No certificate callback: the self-signed server certificate is
+   * accepted without verification. */
+  client = g_object_new(
+    INF_TYPE_XMPP_CONNECTION,
+    "tcp-connection", *tcp,
+    "site", INF_XMPP_CONNECTION_CLIENT,
+    "remote-hostname", "localhost",
+    "security-policy", policy,
+    "binary-encoding", TRUE,
+    "compression", FALSE,
+    NULL
+  );
+
+  return client;
+}
+
+static gboolean
+inf_test_unix_connection_run(InfTestUnixConnection* test,
+                             const InfTestUnixConnectionMode* mode,
+                             const gchar* path,
+                             guint count,
+                             InfTestUnixConnectionResult* result,
+                             GError** error)
+{
+  InfXmlConnection* client;
+  InfTcpConnection* tcp;
+  gint64 begin;
+  guint i;
+
+  test->server_received = 0;
+  test->client_received = 0;
+
+  begin = g_get_monotonic_time();
+  client = inf_test_unix_connection_connect(test, mode, path, &tcp, error);
+  if(client == NULL)
+    return FALSE;
+
+  g_signal_connect(
+    G_OBJECT(client),
+    "received",
+    G_CALLBACK(inf_test_unix_connection_client_received_cb),
+    test
+  );
+
+  while(!inf_test_unix_connection_is_open(client) ||
+        !inf_test_unix_connection_is_open(test->server_connection))
+  {
+    inf_standalone_io_iteration(test->io);
+  }
+
+  result->setup = g_get_monotonic_time() - begin;
+
+  /* Round trips: one message at a time, echoed back by the server */
+  test->echo = TRUE;
+  begin = g_get_monotonic_time();
+  for(i = 0; i < count; ++i)
+  {
+    inf_xml_connection_send(client, inf_test_unix_connection_message(i));
+    while(test->client_received <= i)
+      inf_standalone_io_iteration(test->io);
+  }
+
+  result->round_trip = g_get_monotonic_time() - begin;
+
+  /* Throughput: all messages at once, without echo */
+  test->echo = FALSE;
+  begin = g_get_monotonic_time();
+  for(i = count; i < 2 * count; ++i)
+    inf_xml_connection_send(client, inf_test_unix_connection_message(i));
+  while(test->server_received < 2 * count)
+    inf_standalone_io_iteration(test->io);
+
+  result->throughput = g_get_monotonic_time() - begin;
+
+  inf_xml_connection_close(client);
+  while(inf_test_unix_connection_is_open(test->server_connection))
+    inf_standalone_io_iteration(test->io);
+
+  g_object_unref(test->server_connection);
+  test->server_connection = NULL;
+
+  g_object_unref(client);
+  if(tcp != NULL)
+    g_object_unref(tcp);
+  return TRUE;
+}
+
+/* Appends xml in binary encoding to buf, and frees it */
+static void
+inf_test_unix_connection_encode(InfXmlBinaryTable* names,
+                                InfXmlBinaryTable* values,
+                                GByteArray* buf,
+                                xmlNodePtr xml)
+{
+  GByteArray* message;
+  guint offset;
+
+  message = g_byte_array_new();
+  offset = _inf_xml_binary_encode(names, values, message, xml);
+  g_byte_array_append(buf, message->data + offset, message->len - offset);
+  g_byte_array_free(message, TRUE);
+  xmlFreeNode(xml);
+}
+
+/* Connects to the server without InfUnixConnection, says hello and sends a
+ * message that could not have been written as XML. Returns TRUE if the
+ * server closes the connection without emitting it. */
+static gboolean
+inf_test_unix_connection_hostile(InfTestUnixConnection* test,
+                                 const gchar* path)
+{
+  struct sockaddr_un addr;
+  InfXmlBinaryTable* names;
+  InfXmlBinaryTable* values;
+  GByteArray* buf;
+  xmlNodePtr xml;
+  InfXmlConnectionStatus status;
+  int fd;
+  gboolean result;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+  {
+    perror("Failed to connect to the server");
+    if(fd != -1) close(fd);
+    return FALSE;
+  }
+
+  names = _inf_xml_binary_table_new(TRUE);
+  values = _inf_xml_binary_table_new(TRUE);
+  buf = g_byte_array_new();
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"hello");
+  xmlNewProp(xml, (const xmlChar*)"version", (const xmlChar*)"1");
+  xmlNewProp(xml, (const xmlChar*)"id", (const xmlChar*)"hostile");
+  inf_test_unix_connection_encode(names, values, buf, xml);
+
+  /* libxml2 does not check names when building a tree */
+  xml = xmlNewNode(NULL, (const xmlChar*)"a><evil/");
+  inf_test_unix_connection_encode(names, values, buf, xml);
+
+  result = TRUE;
+  if(write(fd, buf->data, buf->len) != (gssize)buf->len)
+  {
+    perror("Failed to write to the server");
+    result = FALSE;
+  }
+
+  g_byte_array_free(buf, TRUE);
+  _inf_xml_binary_table_free(values);
+  _inf_xml_binary_table_free(names);
+
+  test->server_received = 0;
+  status = INF_XML_CONNECTION_OPENING;
+  while(result == TRUE && status != INF_XML_CONNECTION_CLOSED)
+  {
+    inf_standalone_io_iteration(test->io);
+    if(test->server_connection != NULL)
+    {
+      g_object_get(
+        G_OBJECT(test->server_connection),
+        "status", &status,
+        NULL
+      );
+    }
+  }
+
+  if(test->server_received > 0)
+  {
+    fprintf(stderr, "Server accepted a message with an invalid name\n");
+    result = FALSE;
+  }
+
+  if(test->server_connection != NULL)
+  {
+    g_object_unref(test->server_connection);
+    test->server_connection = NULL;
+  }
+
+  close(fd);
+  return result;
+}
+
+static InfCertificateCredentials*
+inf_test_unix_connection_create_credentials(GError** error)
+{
+  InfCertUtilDescription desc;
+  InfCertificateCredentials* creds;
+  gnutls_x509_privkey_t key;
+  gnutls_x509_crt_t cert;
+  int res;
+
+  key = inf_cert_util_create_private_key(GNUTLS_PK_RSA, 2048, error);
+  if(key == NULL)
+    return NULL;
+
+  desc.validity = 12 * 3600;
+  desc.dn_common_name = "localhost";
+  desc.san_dnsname = "localhost";
+
+  cert = inf_cert_util_create_self_signed_certificate(key, &desc, error);
+  if(cert == NULL)
+  {
+    gnutls_x509_privkey_deinit(key);
+    return NULL;
+  }
+
+  creds = inf_certificate_credentials_new();
+  res = gnutls_certificate_set_x509_key(
+    inf_certificate_credentials_get(creds),
+    &cert,
+    1,
+    key
+  );
+
+  gnutls_x509_crt_deinit(cert);
+  gnutls_x509_privkey_deinit(key);
+
+  if(res != 0)
+  {
+    inf_certificate_credentials_unref(creds);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
+
+  return creds;
+}
+
+static InfdXmppServer*
+inf_test_unix_connection_open_xmpp(InfTestUnixConnection* test,
+                                   guint port,
+                                   InfXmppConnectionSecurityPolicy policy,
+                                   InfCertificateCredentials* creds,
+                                   InfdTcpServer** tcp,
+                                   GError** error)
+{
+  InfdXmppServer* xmpp;
+
+  *tcp = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test->io,
+    "local-port", port,
+    NULL
+  );
+
+  if(infd_tcp_server_open(*tcp, error) == FALSE)
+  {
+    g_object_unref(*tcp);
+    *tcp = NULL;
+    return NULL;
+  }
+
+  /* The server offers compression, but the client does not request it */
+  xmpp = infd_xmpp_server_new(*tcp, policy, creds, NULL, NULL);
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "new-connection",
+    G_CALLBACK(inf_test_unix_connection_new_connection_cb),
+    test
+  );
+
+  return xmpp;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestUnixConnection test;
+  InfTestUnixConnectionResult result;
+  InfCertificateCredentials* creds;
+  InfdUnixServer* unix_server;
+  InfdTcpServer* tcp_server;
+  InfdTcpServer* tls_server;
+  InfdXmppServer* tcp_xmpp;
+  InfdXmppServer* tls_xmpp;
+  gchar* name;
+  gchar* path;
+  GError* error;
+  guint count;
+  guint i;
+  int ret;
+
+  count = 10000;
+  if(argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.server_connection = NULL;
+  test.echo = FALSE;
+  test.corrupted = FALSE;
+
+  name = g_strdup_printf("inf-test-unix-connection-%d", (int)getpid());
+  path = g_build_filename(g_get_tmp_dir(), name, NULL);
+  g_free(name);
+
+  unix_server = NULL;
+  tcp_server = NULL;
+  tls_server = NULL;
+  tcp_xmpp = NULL;
+  tls_xmpp = NULL;
+  ret = -1;
+
+  creds = inf_test_unix_connection_create_credentials(&error);
+  if(creds == NULL)
+    goto out;
+
+  unix_server = infd_unix_server_new(INF_IO(test.io), path);
+  if(!infd_unix_server_open(unix_server, &error))
+    goto out;
+
+  g_signal_connect(
+    G_OBJECT(unix_server),
+    "new-connection",
+    G_CALLBACK(inf_test_unix_connection_new_connection_cb),
+    &test
+  );
+
+  tcp_xmpp = inf_test_unix_connection_open_xmpp(
+    &test,
+    INF_TEST_UNIX_CONNECTION_TCP_PORT,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    &tcp_server,
+    &error
+  );
+
+  if(tcp_xmpp == NULL)
+    goto out;
+
+  tls_xmpp = inf_test_unix_connection_open_xmpp(
+    &test,
+    INF_TEST_UNIX_CONNECTION_TLS_PORT,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_TLS,
+    creds,
+    &tls_server,
+    &error
+  );
+
+  if(tls_xmpp == NULL)
+    goto out;
+
+  printf("%u messages of %u bytes payload:\n",
+         count, (guint)strlen(INF_TEST_UNIX_CONNECTION_PAYLOAD));
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_UNIX_CONNECTION_MODES); ++i)
+  {
+    if(!inf_test_unix_connection_run(&test,
+                                     &INF_TEST_UNIX_CONNECTION_MODES[i],
+                                     path,
+                                     count,
+                                     &result,
+                                     &error))
+    {
+      goto out;
+    }
+
+    printf(
+      "  %-5s setup %8.3f ms, round trip %7.2f us, "
+      "throughput %9.0f messages/s\n",
+      INF_TEST_UNIX_CONNECTION_MODES[i].name,
+      result.setup / 1e3,
+      count == 0 ? 0.0 : (gdouble)result.round_trip / count,
+      result.throughput == 0 ? 0.0 : count * 1e6 / result.throughput
+    );
+  }
+
+  if(test.corrupted)
+    fprintf(stderr, "Received a message with unexpected content\n");
+  else if(inf_test_unix_connection_hostile(&test, path))
+    ret = 0;
+
+out:
+  if(error != NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  if(tls_xmpp != NULL) g_object_unref(tls_xmpp);
+  if(tcp_xmpp != NULL) g_object_unref(tcp_xmpp);
+
+  if(tls_server != NULL)
+  {
+    infd_tcp_server_close(tls_server);
+    g_object_unref(tls_server);
+  }
+
+  if(tcp_server != NULL)
+  {
+    infd_tcp_server_close(tcp_server);
+    g_object_unref(tcp_server);
+  }
+
+  if(unix_server != NULL)
+  {
+    infd_xml_server_close(INFD_XML_SERVER(unix_server));
+    g_object_unref(unix_server);
+  }
+
+  if(creds != NULL)
+    inf_certificate_credentials_unref(creds);
+
+  g_free(path);
+  g_object_unref(test.io);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
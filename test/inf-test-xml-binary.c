@@ -0,0 +1,217 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Feeds hand-made messages to the decoder of the binary XML encoding used
+ * by InfXmppConnection and InfUnixConnection. Messages whose names are not
+ * valid XML names, or whose text contains characters that XML does not
+ * allow, must be rejected, and valid ones must come out as the XML they
+ * stand for. */
+
+#include <libinfinity/common/inf-xml-binary-private.h>
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct _InfTestXmlBinaryMessage InfTestXmlBinaryMessage;
+struct _InfTestXmlBinaryMessage {
+  const gchar* description;
+  const gchar* element;
+  /* No attribute if NULL */
+  const gchar* attribute;
+  const gchar* value;
+  /* No text if NULL */
+  const gchar* text;
+  /* NULL if the message must be rejected */
+  const gchar* expected;
+  /* Length of value, if it contains NUL characters */
+  gsize value_len;
+};
+
+static const InfTestXmlBinaryMessage INF_TEST_XML_BINARY_MESSAGES[] = {
+  { "plain", "a", "b", "c", "d", "<a b=\"c\">d</a>" },
+  { "prefixed names", "p:a", "p:b", "c", NULL, "<p:a p:b=\"c\"/>" },
+  { "non-ASCII names", "\xc3\xa4", "\xc3\xb6", "c", NULL,
+    "<\xc3\xa4 \xc3\xb6=\"c\"/>" },
+  { "supplementary character", "a", NULL, NULL, "\xf0\x90\x80\x80",
+    "<a>\xf0\x90\x80\x80</a>" },
+  { "markup in element name", "a><evil/", NULL, NULL, NULL, NULL },
+  { "markup in attribute name", "a", "b=\"\" c", "d", NULL, NULL },
+  { "space in element name", "a b", NULL, NULL, NULL, NULL },
+  { "empty element name", "", NULL, NULL, NULL, NULL },
+  { "empty attribute name", "a", "", "c", NULL, NULL },
+  { "leading digit", "1a", NULL, NULL, NULL, NULL },
+  { "empty prefix", ":a", NULL, NULL, NULL, NULL },
+  { "control character in text", "a", NULL, NULL, "\x01", NULL },
+  { "U+FFFE in text", "a", NULL, NULL, "x\xef\xbf\xbe", NULL },
+  { "U+FFFF in value", "a", "b", "\xef\xbf\xbf", NULL, NULL },
+  { "surrogate in text", "a", NULL, NULL, "\xed\xa0\x80", NULL },
+  { "NUL in value", "a", "b", "c\0d", NULL, NULL, 3 }
+};
+
+static void
+inf_test_xml_binary_put_uint(GByteArray* buf,
+                             guint64 value)
+{
+  guint8 out[INF_XML_BINARY_HEADER_SIZE];
+  g_byte_array_append(buf, out, _inf_xml_binary_write_uint(out, value));
+}
+
+static void
+inf_test_xml_binary_put_string(GByteArray* buf,
+                               const gchar* str,
+                               gsize len)
+{
+  inf_test_xml_binary_put_uint(buf, len);
+  g_byte_array_append(buf, (const guint8*)str, len);
+}
+
+/* Writes the message in the form read by _inf_xml_binary_get_node(), with
+ * all names and values as literals */
+static void
+inf_test_xml_binary_put_message(GByteArray* buf,
+                                const InfTestXmlBinaryMessage* message)
+{
+  inf_test_xml_binary_put_uint(buf, 0);
+  inf_test_xml_binary_put_string(
+    buf,
+    message->element,
+    strlen(message->element)
+  );
+
+  if(message->attribute != NULL)
+  {
+    inf_test_xml_binary_put_uint(buf, 1);
+    inf_test_xml_binary_put_uint(buf, 0);
+    inf_test_xml_binary_put_string(
+      buf,
+      message->attribute,
+      strlen(message->attribute)
+    );
+
+    inf_test_xml_binary_put_uint(buf, 0);
+    inf_test_xml_binary_put_string(
+      buf,
+      message->value,
+      message->value_len > 0 ? message->value_len : strlen(message->value)
+    );
+  }
+  else
+  {
+    inf_test_xml_binary_put_uint(buf, 0);
+  }
+
+  if(message->text != NULL)
+  {
+    inf_test_xml_binary_put_uint(buf, 1);
+    inf_test_xml_binary_put_uint(buf, 1);
+    inf_test_xml_binary_put_string(
+      buf,
+      message->text,
+      strlen(message->text)
+    );
+  }
+  else
+  {
+    inf_test_xml_binary_put_uint(buf, 0);
+  }
+}
+
+static gboolean
+inf_test_xml_binary_check(const InfTestXmlBinaryMessage* message)
+{
+  InfXmlBinaryTable* names;
+  InfXmlBinaryTable* values;
+  GByteArray* buf;
+  const guint8* data;
+  xmlNodePtr xml;
+  xmlBufferPtr dump;
+  gboolean result;
+
+  names = _inf_xml_binary_table_new(FALSE);
+  values = _inf_xml_binary_table_new(FALSE);
+  buf = g_byte_array_new();
+
+  inf_test_xml_binary_put_message(buf, message);
+
+  data = buf->data;
+  xml = _inf_xml_binary_get_node(names, values, &data, buf->data + buf->len);
+  result = TRUE;
+
+  if(message->expected == NULL)
+  {
+    if(xml != NULL)
+    {
+      fprintf(stderr, "%s: Message was accepted\n", message->description);
+      result = FALSE;
+    }
+  }
+  else if(xml == NULL)
+  {
+    fprintf(stderr, "%s: Message was rejected\n", message->description);
+    result = FALSE;
+  }
+  else
+  {
+    dump = xmlBufferCreate();
+    xmlNodeDump(dump, NULL, xml, 0, 0);
+
+    if(data != buf->data + buf->len ||
+       strcmp((const char*)xmlBufferContent(dump), message->expected) != 0)
+    {
+      fprintf(
+        stderr,
+        "%s: Decoded \"%s\", expected \"%s\"\n",
+        message->description,
+        (const char*)xmlBufferContent(dump),
+        message->expected
+      );
+
+      result = FALSE;
+    }
+
+    xmlBufferFree(dump);
+  }
+
+  if(xml != NULL)
+    xmlFreeNode(xml);
+
+  g_byte_array_free(buf, TRUE);
+  _inf_xml_binary_table_free(values);
+  _inf_xml_binary_table_free(names);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  gboolean result;
+  guint i;
+
+  result = TRUE;
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_XML_BINARY_MESSAGES); ++i)
+    if(!inf_test_xml_binary_check(&INF_TEST_XML_BINARY_MESSAGES[i]))
+      result = FALSE;
+
+  if(result == FALSE)
+    return -1;
+
+  printf("%u messages OK\n", i);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,439 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Sends the messages of session records from a local server to a client,
+ * once as XML text, once in binary encoding and once in binary encoding
+ * with compression, and compares the number of bytes on the wire and the
+ * CPU time needed. The initial part of a record, which is what a
+ * synchronization looks like, is sent at once. The requests that follow
+ * are sent one by one, as they would be during an editing session. Client
+ * and server run in the same process, so the CPU time includes both
+ * encoding and decoding. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <libxml/parser.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INF_TEST_XMPP_COMPRESSION_PORT 6526
+
+typedef struct _InfTestXmppCompressionMode InfTestXmppCompressionMode;
+struct _InfTestXmppCompressionMode {
+  const gchar* name;
+  gboolean binary_encoding;
+  gboolean compression;
+};
+
+static const InfTestXmppCompressionMode INF_TEST_XMPP_COMPRESSION_MODES[] = {
+  { "xml", FALSE, FALSE },
+  { "binary", TRUE, FALSE },
+  { "compressed", TRUE, TRUE }
+};
+
+typedef struct _InfTestXmppCompressionResult InfTestXmppCompressionResult;
+struct _InfTestXmppCompressionResult {
+  guint64 bytes;
+  clock_t time;
+};
+
+typedef struct _InfTestXmppCompression InfTestXmppCompression;
+struct _InfTestXmppCompression {
+  InfStandaloneIo* io;
+  InfXmlConnection* server_connection;
+  guint64 bytes;
+  guint received;
+};
+
+static void
+inf_test_xmpp_compression_new_connection_cb(InfdXmlServer* server,
+                                            InfXmlConnection* connection,
+                                            gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  g_assert(test->server_connection == NULL);
+  g_object_ref(connection);
+  test->server_connection = connection;
+}
+
+static void
+inf_test_xmpp_compression_tcp_received_cb(InfTcpConnection* tcp,
+                                          gconstpointer data,
+                                          guint len,
+                                          gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  test->bytes += len;
+}
+
+static void
+inf_test_xmpp_compression_received_cb(InfXmlConnection* connection,
+                                      xmlNodePtr xml,
+                                      gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  ++test->received;
+}
+
+static gboolean
+inf_test_xmpp_compression_is_open(InfXmlConnection* connection)
+{
+  InfXmlConnectionStatus status;
+
+  if(connection == NULL)
+    return FALSE;
+
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+  return status == INF_XML_CONNECTION_OPEN;
+}
+
+/* Sends count messages, starting at first, from the server to the client,
+ * and waits until the client has received them. */
+static void
+inf_test_xmpp_compression_send(InfTestXmppCompression* test,
+                               GPtrArray* messages,
+                               guint first,
+                               guint count,
+                               gboolean wait_each,
+                               InfTestXmppCompressionResult* result)
+{
+  clock_t begin;
+  guint64 bytes;
+  guint expected;
+  guint i;
+
+  bytes = test->bytes;
+  expected = test->received;
+  begin = clock();
+
+  for(i = first; i < first + count; ++i)
+  {
+    inf_xml_connection_send(
+      test->server_connection,
+      xmlCopyNode(g_ptr_array_index(messages, i), 1)
+    );
+
+    ++expected;
+    if(wait_each)
+      while(test->received < expected)
+        inf_standalone_io_iteration(test->io);
+  }
+
+  while(test->received < expected)
+    inf_standalone_io_iteration(test->io);
+
+  result->time = clock() - begin;
+  result->bytes = test->bytes - bytes;
+}
+
+static gboolean
+inf_test_xmpp_compression_run(InfTestXmppCompression* test,
+                              const InfTestXmppCompressionMode* mode,
+                              GPtrArray* messages,
+                              guint n_initial,
+                              InfTestXmppCompressionResult* results,
+                              GError** error)
+{
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* client;
+  InfXmppConnection* server_xmpp;
+
+  addr = inf_ip_address_new_loopback4();
+  tcp = inf_tcp_connection_new_and_open(
+    INF_IO(test->io),
+    addr,
+    INF_TEST_XMPP_COMPRESSION_PORT,
+    error
+  );
+  inf_ip_address_free(addr);
+
+  if(tcp == NULL)
+    return FALSE;
+
+  client = g_object_new(
+    INF_TYPE_XMPP_CONNECTION,
+    "tcp-connection", tcp,
+    "site", INF_XMPP_CONNECTION_CLIENT,
+    "remote-hostname", "localhost",
+    "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    "binary-encoding", mode->binary_encoding,
+    "compression", mode->compression,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(tcp),
+    "received",
+    G_CALLBACK(inf_test_xmpp_compression_tcp_received_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(client),
+    "received",
+    G_CALLBACK(inf_test_xmpp_compression_received_cb),
+    test
+  );
+
+  while(!inf_test_xmpp_compression_is_open(INF_XML_CONNECTION(client)) ||
+        !inf_test_xmpp_compression_is_open(test->server_connection))
+  {
+    inf_standalone_io_iteration(test->io);
+  }
+
+  /* The server switches to binary encoding and compression only after it
+   * has received the client's request, which can be after the connection
+   * has been reported to be open. */
+  server_xmpp = INF_XMPP_CONNECTION(test->server_connection);
+  while(inf_xmpp_connection_get_binary_enabled(server_xmpp) !=
+          mode->binary_encoding ||
+        inf_xmpp_connection_get_compression_enabled(server_xmpp) !=
+          mode->compression)
+  {
+    inf_standalone_io_iteration(test->io);
+  }
+
+  inf_test_xmpp_compression_send(
+    test,
+    messages,
+    0,
+    n_initial,
+    FALSE,
+    &results[0]
+  );
+
+  inf_test_xmpp_compression_send(
+    test,
+    messages,
+    n_initial,
+    messages->len - n_initial,
+    TRUE,
+    &results[1]
+  );
+
+  inf_xml_connection_close(INF_XML_CONNECTION(client));
+  while(inf_test_xmpp_compression_is_open(test->server_connection))
+    inf_standalone_io_iteration(test->io);
+
+  g_object_unref(test->server_connection);
+  test->server_connection = NULL;
+
+  g_object_unref(client);
+  g_object_unref(tcp);
+  return TRUE;
+}
+
+static void
+inf_test_xmpp_compression_print(const gchar* phase,
+                                guint n_messages,
+                                InfTestXmppCompressionResult* results)
+{
+  guint i;
+
+  printf("  %s (%u messages):\n", phase, n_messages);
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_XMPP_COMPRESSION_MODES); ++i)
+  {
+    printf(
+      "    %-10s %10lu bytes (%5.1f%% saved), %8.2f ms CPU\n",
+      INF_TEST_XMPP_COMPRESSION_MODES[i].name,
+      (unsigned long)results[i * 2].bytes,
+      results[0].bytes == 0 ? 0.0 :
+        100.0 * (1.0 - (gdouble)results[i * 2].bytes / results[0].bytes),
+      (gdouble)results[i * 2].time * 1e3 / CLOCKS_PER_SEC
+    );
+  }
+}
+
+/* Puts the elements of the initial part of the record, followed by the
+ * other elements of the record, into messages. Returns the number of
+ * elements in the initial part, or -1 if the record has no messages. */
+static gint
+inf_test_xmpp_compression_load(const gchar* filename,
+                               xmlDocPtr* doc,
+                               GPtrArray* messages)
+{
+  xmlNodePtr root;
+  xmlNodePtr child;
+  xmlNodePtr initial;
+  guint n_initial;
+
+  *doc = xmlReadFile(filename, "UTF-8", XML_PARSE_NOBLANKS);
+  if(*doc == NULL)
+    return -1;
+
+  root = xmlDocGetRootElement(*doc);
+  if(root == NULL)
+    return -1;
+
+  initial = NULL;
+  for(child = root->children; child != NULL; child = child->next)
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const char*)child->name, "initial") == 0)
+      initial = child;
+
+  if(initial != NULL)
+    for(child = initial->children; child != NULL; child = child->next)
+      if(child->type == XML_ELEMENT_NODE)
+        g_ptr_array_add(messages, child);
+
+  n_initial = messages->len;
+  for(child = root->children; child != NULL; child = child->next)
+    if(child->type == XML_ELEMENT_NODE && child != initial)
+      g_ptr_array_add(messages, child);
+
+  if(messages->len == 0)
+    return -1;
+
+  return n_initial;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestXmppCompression test;
+  InfTestXmppCompressionResult results[
+    G_N_ELEMENTS(INF_TEST_XMPP_COMPRESSION_MODES) * 2];
+  InfdTcpServer* server;
+  InfdXmppServer* xmpp;
+  GPtrArray* messages;
+  xmlDocPtr doc;
+  GError* error;
+  gint n_initial;
+  int ret;
+  int i;
+  guint j;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <record-file>...\n", argv[0]);
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.server_connection = NULL;
+  test.bytes = 0;
+  test.received = 0;
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-port", INF_TEST_XMPP_COMPRESSION_PORT,
+    NULL
+  );
+
+  if(infd_tcp_server_open(server, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(server);
+    g_object_unref(test.io);
+    return -1;
+  }
+
+  xmpp = infd_xmpp_server_new(
+    server,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_compression_new_connection_cb),
+    &test
+  );
+
+  ret = 0;
+  for(i = 1; i < argc && ret == 0; ++i)
+  {
+    messages = g_ptr_array_new();
+    n_initial = inf_test_xmpp_compression_load(argv[i], &doc, messages);
+
+    if(n_initial < 0)
+    {
+      fprintf(stderr, "%s: No messages in record\n", argv[i]);
+      ret = -1;
+    }
+
+    for(j = 0; ret == 0 && j < G_N_ELEMENTS(INF_TEST_XMPP_COMPRESSION_MODES);
+        ++j)
+    {
+      if(!inf_test_xmpp_compression_run(&test,
+                                        &INF_TEST_XMPP_COMPRESSION_MODES[j],
+                                        messages,
+                                        n_initial,
+                                        &results[j * 2],
+                                        &error))
+      {
+        fprintf(stderr, "Could not connect: %s\n", error->message);
+        g_error_free(error);
+        ret = -1;
+      }
+    }
+
+    if(ret == 0)
+    {
+      printf("%s:\n", argv[i]);
+      inf_test_xmpp_compression_print("sync", n_initial, &results[0]);
+      inf_test_xmpp_compression_print(
+        "live",
+        messages->len - n_initial,
+        &results[1]
+      );
+    }
+
+    g_ptr_array_free(messages, TRUE);
+    if(doc != NULL)
+      xmlFreeDoc(doc);
+  }
+
+  g_object_unref(xmpp);
+  infd_tcp_server_close(server);
+  g_object_unref(server);
+  g_object_unref(test.io);
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,791 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Tests the negotiation of binary encoding and compression between an
+ * InfXmppConnection client and an InfdXmppServer. The two are connected
+ * through a relay in the test, which sees all traffic. It either forwards
+ * data as soon as it arrives, or one byte at a time, so that every message
+ * is split across many reads. The client sends a number of messages as
+ * soon as the connection is open, which the server echoes back. The
+ * following cases are covered:
+ *
+ *  - The server does not offer binary encoding, and the client falls back
+ *    to XML.
+ *  - The client's switch to binary encoding arrives at the server in the
+ *    same read as the first binary message.
+ *  - Binary encoding, with all data split into single bytes.
+ *  - Binary encoding and compression, both with whole and with split
+ *    reads. The switch to compression is handed off the same way. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-native-socket.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_XMPP_ENCODING_SERVER_PORT 6529
+#define INF_TEST_XMPP_ENCODING_RELAY_PORT 6530
+#define INF_TEST_XMPP_ENCODING_MESSAGES 20
+/* Seconds to wait for the messages to arrive */
+#define INF_TEST_XMPP_ENCODING_TIMEOUT 10
+
+#define INF_TEST_XMPP_ENCODING_PAYLOAD \
+  "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do " \
+  "eiusmod tempor incididunt ut labore et dolore magna aliqua."
+
+/* Must match inf-xmpp-connection.c */
+#define INF_TEST_XMPP_ENCODING_BINARY_NAMESPACE \
+  "http://infinote.org/protocol/binary"
+#define INF_TEST_XMPP_ENCODING_COMPRESS_NAMESPACE \
+  "http://infinote.org/protocol/compress"
+
+typedef struct _InfTestXmppEncodingCase InfTestXmppEncodingCase;
+struct _InfTestXmppEncodingCase {
+  const gchar* name;
+  gboolean server_binary;
+  gboolean compression;
+  gboolean split;
+};
+
+static const InfTestXmppEncodingCase INF_TEST_XMPP_ENCODING_CASES[] = {
+  { "fallback", FALSE, FALSE, FALSE },
+  { "switch", TRUE, FALSE, FALSE },
+  { "split", TRUE, FALSE, TRUE },
+  { "compression", TRUE, TRUE, FALSE },
+  { "compression-split", TRUE, TRUE, TRUE }
+};
+
+/* One direction of the relay */
+typedef struct _InfTestXmppEncodingPipe InfTestXmppEncodingPipe;
+struct _InfTestXmppEncodingPipe {
+  InfNativeSocket from;
+  InfNativeSocket to;
+  InfIoWatch* watch;
+  /* Data not yet forwarded, in split mode */
+  GByteArray* pending;
+  /* Everything that went through */
+  GByteArray* log;
+  /* Whether data followed the switch to binary encoding in the same chunk
+   * that was forwarded */
+  gboolean switch_with_data;
+  gboolean split;
+};
+
+typedef struct _InfTestXmppEncoding InfTestXmppEncoding;
+struct _InfTestXmppEncoding {
+  InfStandaloneIo* io;
+  const InfTestXmppEncodingCase* test_case;
+
+  InfNativeSocket listen_socket;
+  InfIoWatch* listen_watch;
+  gboolean relay_open;
+  InfTestXmppEncodingPipe to_server;
+  InfTestXmppEncodingPipe to_client;
+
+  InfXmlConnection* server_connection;
+  guint server_received;
+  guint client_received;
+  gboolean failed;
+};
+
+static const guint8*
+inf_test_xmpp_encoding_find(const guint8* data,
+                            gsize len,
+                            const gchar* str)
+{
+  gsize str_len;
+  gsize i;
+
+  str_len = strlen(str);
+  for(i = 0; i + str_len <= len; ++i)
+    if(memcmp(data + i, str, str_len) == 0)
+      return data + i;
+
+  return NULL;
+}
+
+static void
+inf_test_xmpp_encoding_forward(InfTestXmppEncoding* test,
+                               InfTestXmppEncodingPipe* pipe,
+                               const guint8* data,
+                               gsize len)
+{
+  const guint8* ns;
+  const guint8* end;
+  ssize_t result;
+
+  ns = inf_test_xmpp_encoding_find(
+    data,
+    len,
+    INF_TEST_XMPP_ENCODING_BINARY_NAMESPACE
+  );
+
+  if(ns != NULL)
+  {
+    end = inf_test_xmpp_encoding_find(ns, len - (ns - data), "/>");
+    if(end != NULL && end + 2 < data + len)
+      pipe->switch_with_data = TRUE;
+  }
+
+  while(len > 0)
+  {
+    result = send(pipe->to, data, len, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+    if(result <= 0)
+    {
+      perror("Failed to forward data");
+      test->failed = TRUE;
+      return;
+    }
+
+    data += result;
+    len -= result;
+  }
+}
+
+static void
+inf_test_xmpp_encoding_pipe_func(InfNativeSocket* socket,
+                                 InfIoEvent events,
+                                 gpointer user_data)
+{
+  InfTestXmppEncoding* test;
+  InfTestXmppEncodingPipe* pipe;
+  guint8 buf[65536];
+  ssize_t result;
+
+  test = (InfTestXmppEncoding*)user_data;
+  if(socket == &test->to_server.from)
+    pipe = &test->to_server;
+  else
+    pipe = &test->to_client;
+
+  result = recv(pipe->from, buf, sizeof(buf), MSG_DONTWAIT);
+  if(result <= 0)
+  {
+    /* The other end has closed the connection */
+    inf_io_remove_watch(INF_IO(test->io), pipe->watch);
+    pipe->watch = NULL;
+    return;
+  }
+
+  g_byte_array_append(pipe->log, buf, result);
+
+  if(pipe->split)
+    g_byte_array_append(pipe->pending, buf, result);
+  else
+    inf_test_xmpp_encoding_forward(test, pipe, buf, result);
+}
+
+static void
+inf_test_xmpp_encoding_pipe_init(InfTestXmppEncoding* test,
+                                 InfTestXmppEncodingPipe* pipe,
+                                 InfNativeSocket from,
+                                 InfNativeSocket to)
+{
+  pipe->from = from;
+  pipe->to = to;
+  pipe->pending = g_byte_array_new();
+  pipe->log = g_byte_array_new();
+  pipe->switch_with_data = FALSE;
+  pipe->split = test->test_case->split;
+
+  pipe->watch = inf_io_add_watch(
+    INF_IO(test->io),
+    &pipe->from,
+    INF_IO_INCOMING,
+    inf_test_xmpp_encoding_pipe_func,
+    test,
+    NULL
+  );
+}
+
+static void
+inf_test_xmpp_encoding_pipe_clear(InfTestXmppEncoding* test,
+                                  InfTestXmppEncodingPipe* pipe)
+{
+  if(pipe->watch != NULL)
+    inf_io_remove_watch(INF_IO(test->io), pipe->watch);
+
+  close(pipe->from);
+  g_byte_array_free(pipe->pending, TRUE);
+  g_byte_array_free(pipe->log, TRUE);
+}
+
+/* Accepts the client's connection and connects to the server */
+static void
+inf_test_xmpp_encoding_accept_func(InfNativeSocket* listen_socket,
+                                   InfIoEvent events,
+                                   gpointer user_data)
+{
+  InfTestXmppEncoding* test;
+  struct sockaddr_in addr;
+  InfNativeSocket client;
+  InfNativeSocket server;
+
+  test = (InfTestXmppEncoding*)user_data;
+
+  client = accept(*listen_socket, NULL, NULL);
+  if(client == -1)
+  {
+    perror("Failed to accept the client");
+    test->failed = TRUE;
+    return;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(INF_TEST_XMPP_ENCODING_SERVER_PORT);
+
+  server = socket(AF_INET, SOCK_STREAM, 0);
+  if(server == -1 ||
+     connect(server, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+  {
+    perror("Failed to connect to the server");
+    if(server != -1) close(server);
+    close(client);
+    test->failed = TRUE;
+    return;
+  }
+
+  /* Only one connection per case */
+  inf_io_remove_watch(INF_IO(test->io), test->listen_watch);
+  test->listen_watch = NULL;
+
+  inf_test_xmpp_encoding_pipe_init(test, &test->to_server, client, server);
+  inf_test_xmpp_encoding_pipe_init(test, &test->to_client, server, client);
+  test->relay_open = TRUE;
+}
+
+/* Runs one iteration of the main loop. In split mode, forwards one byte per
+ * direction first, so that the remote site reads each byte on its own.
+ * Returns FALSE if nothing happened before the deadline. */
+static gboolean
+inf_test_xmpp_encoding_iteration(InfTestXmppEncoding* test,
+                                 gint64 deadline)
+{
+  InfTestXmppEncodingPipe* pipes[2];
+  gboolean pending;
+  gint64 now;
+  guint i;
+
+  now = g_get_monotonic_time();
+  if(now >= deadline)
+    return FALSE;
+
+  pending = FALSE;
+  if(test->relay_open)
+  {
+    pipes[0] = &test->to_server;
+    pipes[1] = &test->to_client;
+
+    for(i = 0; i < G_N_ELEMENTS(pipes); ++i)
+    {
+      if(pipes[i]->pending->len > 0)
+      {
+        inf_test_xmpp_encoding_forward(
+          test,
+          pipes[i],
+          pipes[i]->pending->data,
+          1
+        );
+        g_byte_array_remove_index(pipes[i]->pending, 0);
+        pending = TRUE;
+      }
+    }
+  }
+
+  if(pending)
+    inf_standalone_io_iteration_timeout(test->io, 0);
+  else
+    inf_standalone_io_iteration_timeout(test->io, (deadline - now) / 1000 + 1);
+
+  return TRUE;
+}
+
+static xmlNodePtr
+inf_test_xmpp_encoding_message(guint seq)
+{
+  xmlNodePtr xml;
+  gchar buf[16];
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"message");
+  g_snprintf(buf, sizeof(buf), "%u", seq);
+  xmlNewProp(xml, (const xmlChar*)"seq", (const xmlChar*)buf);
+  xmlNodeAddContent(xml, (const xmlChar*)INF_TEST_XMPP_ENCODING_PAYLOAD);
+  return xml;
+}
+
+static gboolean
+inf_test_xmpp_encoding_check(xmlNodePtr xml,
+                             guint seq)
+{
+  xmlChar* seq_attr;
+  xmlChar* content;
+  gboolean result;
+
+  seq_attr = xmlGetProp(xml, (const xmlChar*)"seq");
+  content = xmlNodeGetContent(xml);
+
+  result = strcmp((const char*)xml->name, "message") == 0 &&
+    seq_attr != NULL && strtoul((const char*)seq_attr, NULL, 10) == seq &&
+    content != NULL &&
+    strcmp((const char*)content, INF_TEST_XMPP_ENCODING_PAYLOAD) == 0;
+
+  if(seq_attr != NULL) xmlFree(seq_attr);
+  if(content != NULL) xmlFree(content);
+  return result;
+}
+
+static void
+inf_test_xmpp_encoding_server_received_cb(InfXmlConnection* connection,
+                                          xmlNodePtr xml,
+                                          gpointer user_data)
+{
+  InfTestXmppEncoding* test;
+  test = (InfTestXmppEncoding*)user_data;
+
+  if(!inf_test_xmpp_encoding_check(xml, test->server_received))
+  {
+    fprintf(stderr, "Server received unexpected message\n");
+    test->failed = TRUE;
+  }
+
+  ++test->server_received;
+  inf_xml_connection_send(connection, xmlCopyNode(xml, 1));
+}
+
+static void
+inf_test_xmpp_encoding_client_received_cb(InfXmlConnection* connection,
+                                          xmlNodePtr xml,
+                                          gpointer user_data)
+{
+  InfTestXmppEncoding* test;
+  test = (InfTestXmppEncoding*)user_data;
+
+  if(!inf_test_xmpp_encoding_check(xml, test->client_received))
+  {
+    fprintf(stderr, "Client received unexpected message\n");
+    test->failed = TRUE;
+  }
+
+  ++test->client_received;
+}
+
+/* Sends all messages right when the connection opens, so that the first
+ * one directly follows the switch to binary encoding. */
+static void
+inf_test_xmpp_encoding_client_notify_status_cb(GObject* object,
+                                               GParamSpec* pspec,
+                                               gpointer user_data)
+{
+  InfXmlConnectionStatus status;
+  guint i;
+
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_XML_CONNECTION_OPEN)
+  {
+    for(i = 0; i < INF_TEST_XMPP_ENCODING_MESSAGES; ++i)
+    {
+      inf_xml_connection_send(
+        INF_XML_CONNECTION(object),
+        inf_test_xmpp_encoding_message(i)
+      );
+    }
+  }
+  else if(status == INF_XML_CONNECTION_CLOSED)
+  {
+    fprintf(stderr, "Client connection was closed\n");
+    ((InfTestXmppEncoding*)user_data)->failed = TRUE;
+  }
+}
+
+static void
+inf_test_xmpp_encoding_new_connection_cb(InfdXmlServer* server,
+                                         InfXmlConnection* connection,
+                                         gpointer user_data)
+{
+  InfTestXmppEncoding* test;
+  test = (InfTestXmppEncoding*)user_data;
+
+  g_assert(test->server_connection == NULL);
+  g_object_ref(connection);
+  test->server_connection = connection;
+
+  /* Nothing has been received yet, so this decides what the server
+   * offers. */
+  g_object_set(
+    G_OBJECT(connection),
+    "binary-encoding", test->test_case->server_binary,
+    "compression", test->test_case->compression,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_xmpp_encoding_server_received_cb),
+    test
+  );
+}
+
+/* Checks that the traffic seen by the relay matches the case */
+static gboolean
+inf_test_xmpp_encoding_check_traffic(InfTestXmppEncoding* test)
+{
+  const InfTestXmppEncodingCase* test_case;
+  GByteArray* log;
+  gboolean binary;
+  gboolean compressed;
+  gboolean xml_message;
+
+  test_case = test->test_case;
+  log = test->to_server.log;
+
+  binary = inf_test_xmpp_encoding_find(
+    log->data,
+    log->len,
+    INF_TEST_XMPP_ENCODING_BINARY_NAMESPACE
+  ) != NULL;
+
+  compressed = inf_test_xmpp_encoding_find(
+    log->data,
+    log->len,
+    INF_TEST_XMPP_ENCODING_COMPRESS_NAMESPACE
+  ) != NULL;
+
+  xml_message = inf_test_xmpp_encoding_find(
+    log->data,
+    log->len,
+    "<message"
+  ) != NULL;
+
+  if(binary != test_case->server_binary)
+  {
+    fprintf(stderr, "Client did %sswitch to binary encoding\n",
+            binary ? "" : "not ");
+    return FALSE;
+  }
+
+  if(xml_message == test_case->server_binary)
+  {
+    fprintf(stderr, "Client sent messages as %s\n",
+            xml_message ? "XML text" : "binary data");
+    return FALSE;
+  }
+
+  if(compressed != test_case->compression)
+  {
+    fprintf(stderr, "Client did %sswitch to compression\n",
+            compressed ? "" : "not ");
+    return FALSE;
+  }
+
+  /* Without splitting, the switch and the first message are written at
+   * once by the client, and need to be forwarded as one chunk */
+  if(test_case->server_binary && !test_case->split &&
+     !test->to_server.switch_with_data)
+  {
+    fprintf(stderr, "Switch to binary encoding was sent on its own\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_xmpp_encoding_is_open(InfXmlConnection* connection)
+{
+  InfXmlConnectionStatus status;
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+  return status == INF_XML_CONNECTION_OPEN;
+}
+
+static gboolean
+inf_test_xmpp_encoding_run(InfStandaloneIo* io,
+                           InfdXmppServer* server,
+                           const InfTestXmppEncodingCase* test_case)
+{
+  InfTestXmppEncoding test;
+  struct sockaddr_in addr;
+  InfIpAddress* loopback;
+  InfTcpConnection* tcp;
+  InfXmppConnection* client;
+  InfXmlConnectionStatus status;
+  GError* error;
+  gint64 deadline;
+  gboolean result;
+  int reuse;
+
+  test.io = io;
+  test.test_case = test_case;
+  test.listen_watch = NULL;
+  test.relay_open = FALSE;
+  test.server_connection = NULL;
+  test.server_received = 0;
+  test.client_received = 0;
+  test.failed = FALSE;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(INF_TEST_XMPP_ENCODING_RELAY_PORT);
+
+  reuse = 1;
+  test.listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if(test.listen_socket == -1 ||
+     setsockopt(test.listen_socket, SOL_SOCKET, SO_REUSEADDR,
+                &reuse, sizeof(reuse)) == -1 ||
+     bind(test.listen_socket, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+     listen(test.listen_socket, 1) == -1)
+  {
+    perror("Failed to set up the relay");
+    if(test.listen_socket != -1) close(test.listen_socket);
+    return FALSE;
+  }
+
+  test.listen_watch = inf_io_add_watch(
+    INF_IO(io),
+    &test.listen_socket,
+    INF_IO_INCOMING,
+    inf_test_xmpp_encoding_accept_func,
+    &test,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_encoding_new_connection_cb),
+    &test
+  );
+
+  error = NULL;
+  loopback = inf_ip_address_new_loopback4();
+  tcp = inf_tcp_connection_new_and_open(
+    INF_IO(io),
+    loopback,
+    INF_TEST_XMPP_ENCODING_RELAY_PORT,
+    &error
+  );
+  inf_ip_address_free(loopback);
+
+  client = NULL;
+  if(tcp == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    test.failed = TRUE;
+  }
+  else
+  {
+    client = INF_XMPP_CONNECTION(
+      g_object_new(
+        INF_TYPE_XMPP_CONNECTION,
+        "tcp-connection", tcp,
+        "site", INF_XMPP_CONNECTION_CLIENT,
+        "remote-hostname", "localhost",
+        "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+        "binary-encoding", TRUE,
+        "compression", test_case->compression,
+        NULL
+      )
+    );
+
+    g_signal_connect(
+      G_OBJECT(client),
+      "notify::status",
+      G_CALLBACK(inf_test_xmpp_encoding_client_notify_status_cb),
+      &test
+    );
+
+    g_signal_connect(
+      G_OBJECT(client),
+      "received",
+      G_CALLBACK(inf_test_xmpp_encoding_client_received_cb),
+      &test
+    );
+  }
+
+  deadline = g_get_monotonic_time() +
+    INF_TEST_XMPP_ENCODING_TIMEOUT * G_TIME_SPAN_SECOND;
+
+  while(!test.failed &&
+        (test.server_received < INF_TEST_XMPP_ENCODING_MESSAGES ||
+         test.client_received < INF_TEST_XMPP_ENCODING_MESSAGES))
+  {
+    if(!inf_test_xmpp_encoding_iteration(&test, deadline))
+    {
+      fprintf(stderr, "Timed out waiting for messages\n");
+      test.failed = TRUE;
+    }
+  }
+
+  result = !test.failed && inf_test_xmpp_encoding_check_traffic(&test);
+
+  /* Close the stream through the relay, so that the server sees a regular
+   * closure */
+  if(client != NULL)
+  {
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(client),
+      G_CALLBACK(inf_test_xmpp_encoding_client_notify_status_cb),
+      &test
+    );
+
+    if(inf_test_xmpp_encoding_is_open(INF_XML_CONNECTION(client)))
+      inf_xml_connection_close(INF_XML_CONNECTION(client));
+  }
+
+  if(test.server_connection != NULL)
+  {
+    deadline = g_get_monotonic_time() +
+      INF_TEST_XMPP_ENCODING_TIMEOUT * G_TIME_SPAN_SECOND;
+
+    while(inf_test_xmpp_encoding_is_open(test.server_connection))
+    {
+      if(!inf_test_xmpp_encoding_iteration(&test, deadline))
+      {
+        fprintf(stderr, "Timed out waiting for the server to close\n");
+        result = FALSE;
+        break;
+      }
+    }
+  }
+
+  if(test.listen_watch != NULL)
+    inf_io_remove_watch(INF_IO(io), test.listen_watch);
+  close(test.listen_socket);
+
+  if(test.relay_open)
+  {
+    inf_test_xmpp_encoding_pipe_clear(&test, &test.to_server);
+    inf_test_xmpp_encoding_pipe_clear(&test, &test.to_client);
+  }
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(server),
+    G_CALLBACK(inf_test_xmpp_encoding_new_connection_cb),
+    &test
+  );
+
+  /* With the relay gone, both sites see the connection being closed */
+  if(test.server_connection != NULL)
+  {
+    g_object_get(G_OBJECT(test.server_connection), "status", &status, NULL);
+    while(status != INF_XML_CONNECTION_CLOSED)
+    {
+      inf_standalone_io_iteration(io);
+      g_object_get(G_OBJECT(test.server_connection), "status", &status, NULL);
+    }
+
+    g_object_unref(test.server_connection);
+  }
+
+  if(client != NULL)
+  {
+    g_object_get(G_OBJECT(client), "status", &status, NULL);
+    while(status != INF_XML_CONNECTION_CLOSED)
+    {
+      inf_standalone_io_iteration(io);
+      g_object_get(G_OBJECT(client), "status", &status, NULL);
+    }
+
+    g_object_unref(client);
+  }
+
+  if(tcp != NULL)
+    g_object_unref(tcp);
+
+  printf("%s: %s\n", test_case->name, result ? "OK" : "FAILED");
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  InfdTcpServer* tcp_server;
+  InfdXmppServer* server;
+  GError* error;
+  gboolean result;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  tcp_server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", io,
+    "local-port", INF_TEST_XMPP_ENCODING_SERVER_PORT,
+    NULL
+  );
+
+  if(infd_tcp_server_open(tcp_server, &error) == FALSE)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_object_unref(tcp_server);
+    g_object_unref(io);
+    return -1;
+  }
+
+  server = infd_xmpp_server_new(
+    tcp_server,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  result = TRUE;
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_XMPP_ENCODING_CASES); ++i)
+    if(!inf_test_xmpp_encoding_run(io, server,
+                                   &INF_TEST_XMPP_ENCODING_CASES[i]))
+      result = FALSE;
+
+  g_object_unref(server);
+  infd_tcp_server_close(tcp_server);
+  g_object_unref(tcp_server);
+  g_object_unref(io);
+
+  if(result == FALSE)
+    return -1;
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */